@@ -13,6 +13,17 @@
 
 #include <core/FileLogWriter.hpp>
 
+#include <cstdlib>
+#include <iostream>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include <core/FileInfo.hpp>
 #include <core/FileSerializer.hpp>
@@ -20,22 +31,98 @@
 
 namespace core {
 
+namespace {
+
+// rotate the log once it exceeds 4 megabytes
+const uintmax_t kMaxLogSize = 4096 * 1024;
+
+// number of rotated logs to keep
+const int kMaxLogArchives = 5;
+
+// entries queued beyond this are dropped
+const std::size_t kMaxQueuedEntries = 4096;
+
+int currentPid()
+{
+#ifdef _WIN32
+   return ::_getpid();
+#else
+   return ::getpid();
+#endif
+}
+
+FilePath archivePath(const FilePath& logFile, int index)
+{
+   return FilePath(logFile.absolutePath() + "." +
+                   boost::lexical_cast<std::string>(index));
+}
+
+// writer to flush when the process exits (so entries logged just before
+// exiting aren't lost)
+FileLogWriter* s_pExitFlushWriter = NULL;
+
+void flushOnExit()
+{
+   if (s_pExitFlushWriter)
+      s_pExitFlushWriter->flush();
+}
+
+} // anonymous namespace
+
 FileLogWriter::FileLogWriter(const std::string& programIdentity,
                              int logLevel,
                              const FilePath& logDir)
                                 : programIdentity_(programIdentity),
-                                  logLevel_(logLevel)
+                                  logLevel_(logLevel),
+                                  pid_(currentPid()),
+                                  droppedEntries_(0),
+                                  queuedCount_(0),
+                                  writtenCount_(0),
+                                  stopping_(false),
+                                  logSize_(0)
 {
    logDir.ensureDirectory();
 
    logFile_ = logDir.childPath(programIdentity + ".log");
+
+   // start the writer thread (if this fails we write entries directly)
+   try
+   {
+      boost::thread writerThread(
+                  boost::bind(&FileLogWriter::writerThreadMain, this));
+      writerThread_.swap(writerThread);
+   }
+   catch(const boost::thread_resource_error&)
+   {
+   }
+
+   static bool s_registeredExitFlush = false;
+   if (!s_registeredExitFlush)
+   {
+      std::atexit(flushOnExit);
+      s_registeredExitFlush = true;
+   }
+   s_pExitFlushWriter = this;
 }
 
 FileLogWriter::~FileLogWriter()
 {
    try
    {
-      // we don't keep a file handle open so do nothing here
+      if (s_pExitFlushWriter == this)
+         s_pExitFlushWriter = NULL;
+
+      // stop the writer thread (it writes any remaining entries first)
+      if (writerThread_.joinable())
+      {
+         {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            stopping_ = true;
+         }
+         queuedCondition_.notify_all();
+
+         writerThread_.join();
+      }
    }
    catch(...)
    {
@@ -48,23 +135,186 @@ void FileLogWriter::log(core::system::LogLevel logLevel,
    if (logLevel > logLevel_)
       return;
 
-   rotateLogFile();
+   std::string entry = formatLogEntry(programIdentity_, message);
 
-   // Swallow errors--we can't do anything anyway
-   core::appendToFile(logFile_, formatLogEntry(programIdentity_, message));
+   // forked children don't have the writer thread (and the queue mutex may
+   // have been held at the time of the fork) so write directly
+   if (!writerThread_.joinable() || currentPid() != pid_)
+   {
+      writeEntryDirect(entry);
+      return;
+   }
+
+   // (we don't use LOCK_MUTEX because it logs errors)
+   try
+   {
+      boost::lock_guard<boost::mutex> lock(mutex_);
+      if (queue_.size() >= kMaxQueuedEntries)
+      {
+         droppedEntries_++;
+         return;
+      }
+      queue_.push_back(entry);
+      queuedCount_++;
+   }
+   catch(const boost::thread_resource_error&)
+   {
+      return;
+   }
+
+   queuedCondition_.notify_one();
+}
+
+void FileLogWriter::flush()
+{
+   if (!writerThread_.joinable() || currentPid() != pid_)
+      return;
+
+   try
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      unsigned long long target = queuedCount_;
+      while (writtenCount_ < target && !stopping_)
+         writtenCondition_.wait(lock);
+   }
+   catch(const boost::thread_resource_error&)
+   {
+   }
 }
 
+void FileLogWriter::writerThreadMain()
+{
+   try
+   {
+      std::deque<std::string> entries;
+      while (true)
+      {
+         std::size_t droppedEntries = 0;
+         bool stopping = false;
+
+         // wait for entries then take all of them
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (queue_.empty() && droppedEntries_ == 0 && !stopping_)
+               queuedCondition_.wait(lock);
+
+            entries.swap(queue_);
+            droppedEntries = droppedEntries_;
+            droppedEntries_ = 0;
+            stopping = stopping_;
+         }
+
+         // write them
+         writeEntries(entries, droppedEntries);
+
+         // let anyone waiting in flush know
+         {
+            boost::lock_guard<boost::mutex> lock(mutex_);
+            writtenCount_ += entries.size();
+         }
+         writtenCondition_.notify_all();
+         entries.clear();
+
+         if (stopping)
+            break;
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   catch(const boost::thread_resource_error&)
+   {
+   }
 
+   closeLogFile();
+}
 
-#define LOGMAX (4096*1024)  // remove every 4 megabytes
-bool FileLogWriter::rotateLogFile()
+void FileLogWriter::writeEntries(const std::deque<std::string>& entries,
+                                 std::size_t droppedEntries)
 {
-   if (logFile_.exists() && logFile_.size() > LOGMAX)
+   if (entries.empty() && droppedEntries == 0)
+      return;
+
+   if (!pLogStream_ && !openLogFile())
+      return;
+
+   for (std::deque<std::string>::const_iterator it = entries.begin();
+        it != entries.end();
+        ++it)
+   {
+      *pLogStream_ << *it;
+      logSize_ += it->size();
+
+      if (logSize_ > kMaxLogSize)
+      {
+         rotateLogFile();
+         if (!pLogStream_)
+            return;
+      }
+   }
+
+   if (droppedEntries > 0)
    {
+      std::string entry = formatLogEntry(
+               programIdentity_,
+               boost::lexical_cast<std::string>(droppedEntries) +
+               " log entries dropped (log queue full)");
+      *pLogStream_ << entry;
+      logSize_ += entry.size();
+   }
+
+   // one flush per batch (swallow errors--we can't do anything anyway)
+   pLogStream_->flush();
+}
+
+void FileLogWriter::writeEntryDirect(const std::string& entry)
+{
+   if (logFile_.exists() && logFile_.size() > kMaxLogSize)
       logFile_.remove();
-      return true;
+
+   // Swallow errors--we can't do anything anyway
+   core::appendToFile(logFile_, entry);
+}
+
+bool FileLogWriter::openLogFile()
+{
+   Error error = logFile_.open_w(&pLogStream_, false);
+   if (error)
+   {
+      pLogStream_.reset();
+      return false;
+   }
+
+   // make sure we are positioned at the end of an existing log
+   pLogStream_->seekp(0, std::ios_base::end);
+   logSize_ = logFile_.size();
+   return true;
+}
+
+void FileLogWriter::closeLogFile()
+{
+   if (pLogStream_)
+   {
+      pLogStream_->flush();
+      pLogStream_.reset();
+   }
+}
+
+void FileLogWriter::rotateLogFile()
+{
+   closeLogFile();
+
+   // shift the archives (dropping the oldest) then archive the log
+   archivePath(logFile_, kMaxLogArchives).removeIfExists();
+   for (int i = kMaxLogArchives - 1; i > 0; i--)
+   {
+      FilePath archive = archivePath(logFile_, i);
+      if (archive.exists())
+         archive.move(archivePath(logFile_, i + 1));
    }
-   return false;
+   logFile_.move(archivePath(logFile_, 1));
+
+   openLogFile();
 }
 
 
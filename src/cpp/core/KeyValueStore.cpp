@@ -0,0 +1,789 @@
+/*
+ * KeyValueStore.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/KeyValueStore.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/file.h>
+#endif
+
+#include <sstream>
+
+#include <boost/crc.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+
+namespace core {
+
+namespace {
+
+// record operations
+const char kSetRecord = 'S';
+const char kRemoveRecord = 'D';
+
+// headers are short; anything longer than this is corrupt
+const std::size_t kMaxHeaderSize = 64;
+
+// don't bother compacting files smaller than this
+const boost::uintmax_t kMinCompactSize = 64 * 1024;
+
+unsigned int recordChecksum(char op,
+                            const std::string& key,
+                            const std::string& value)
+{
+   boost::crc_32_type crc;
+   crc.process_byte(op);
+   crc.process_bytes(key.data(), key.length());
+   crc.process_bytes(value.data(), value.length());
+   return crc.checksum();
+}
+
+// records are a header line ("<op> <key-size> <value-size> <crc>") followed
+// by the key, the value and a newline
+std::string recordHeader(char op,
+                         const std::string& key,
+                         const std::string& value)
+{
+   return boost::str(boost::format("%1% %2% %3% %4$x\n")
+                        % op
+                        % key.length()
+                        % value.length()
+                        % recordChecksum(op, key, value));
+}
+
+void appendRecordTo(char op,
+                    const std::string& key,
+                    const std::string& value,
+                    std::string* pBuffer)
+{
+   pBuffer->append(recordHeader(op, key, value));
+   pBuffer->append(key);
+   pBuffer->append(value);
+   pBuffer->push_back('\n');
+}
+
+boost::uintmax_t recordSize(const std::string& key, const std::string& value)
+{
+   return recordHeader(kSetRecord, key, value).length() +
+          key.length() + value.length() + 1;
+}
+
+// parse the record at *pOffset, advancing the offset past it. returns
+// false (leaving the offset unchanged) if the record is torn or corrupt
+bool readRecord(const std::string& contents,
+                std::size_t* pOffset,
+                char* pOp,
+                std::string* pKey,
+                std::string* pValue)
+{
+   std::size_t offset = *pOffset;
+   std::size_t headerEnd = contents.find('\n', offset);
+   if (headerEnd == std::string::npos || headerEnd - offset > kMaxHeaderSize)
+      return false;
+
+   char op = 0;
+   std::size_t keySize = 0, valueSize = 0;
+   unsigned int checksum = 0;
+   std::istringstream header(contents.substr(offset, headerEnd - offset));
+   header >> op >> keySize >> valueSize >> std::hex >> checksum;
+   if (header.fail() || (op != kSetRecord && op != kRemoveRecord))
+      return false;
+
+   // key, value and trailing newline must all be present
+   std::size_t dataOffset = headerEnd + 1;
+   std::size_t remaining = contents.length() - dataOffset;
+   if (keySize > remaining ||
+       valueSize > remaining - keySize ||
+       remaining - keySize - valueSize < 1 ||
+       contents[dataOffset + keySize + valueSize] != '\n')
+   {
+      return false;
+   }
+
+   std::string key = contents.substr(dataOffset, keySize);
+   std::string value = contents.substr(dataOffset + keySize, valueSize);
+   if (recordChecksum(op, key, value) != checksum)
+      return false;
+
+   *pOp = op;
+   pKey->swap(key);
+   pValue->swap(value);
+   *pOffset = dataOffset + keySize + valueSize + 1;
+   return true;
+}
+
+Error fileError(int errorNumber,
+                const FilePath& filePath,
+                const ErrorLocation& location)
+{
+   Error error = systemError(errorNumber, location);
+   error.addProperty("path", filePath.absolutePath());
+   return error;
+}
+
+Error openFile(const FilePath& filePath, int flags, int* pFd)
+{
+#ifdef _WIN32
+   int fd = ::_wopen(filePath.absolutePathW().c_str(),
+                     flags | O_BINARY,
+                     _S_IREAD | _S_IWRITE);
+#else
+   int fd = ::open(filePath.absolutePath().c_str(), flags, 0600);
+#endif
+   if (fd == -1)
+      return fileError(errno, filePath, ERROR_LOCATION);
+
+#ifndef _WIN32
+   // don't leak the descriptor into child processes
+   ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+
+   *pFd = fd;
+   return Success();
+}
+
+// read from the current position until end of file
+Error readFile(int fd, const FilePath& filePath, std::string* pContents)
+{
+   char buffer[16384];
+   while (true)
+   {
+#ifdef _WIN32
+      int result = ::_read(fd, buffer, sizeof(buffer));
+#else
+      ssize_t result = ::read(fd, buffer, sizeof(buffer));
+#endif
+      if (result == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         return fileError(errno, filePath, ERROR_LOCATION);
+      }
+      else if (result == 0)
+      {
+         return Success();
+      }
+      pContents->append(buffer, result);
+   }
+}
+
+Error seekFile(int fd, boost::uintmax_t offset, const FilePath& filePath)
+{
+#ifdef _WIN32
+   __int64 result = ::_lseeki64(fd, offset, SEEK_SET);
+#else
+   off_t result = ::lseek(fd, offset, SEEK_SET);
+#endif
+   if (result == -1)
+      return fileError(errno, filePath, ERROR_LOCATION);
+   else
+      return Success();
+}
+
+Error writeFile(int fd, const std::string& data, const FilePath& filePath)
+{
+   std::size_t written = 0;
+   while (written < data.length())
+   {
+#ifdef _WIN32
+      int result = ::_write(fd,
+                            data.data() + written,
+                            static_cast<unsigned int>(data.length() - written));
+#else
+      ssize_t result = ::write(fd,
+                               data.data() + written,
+                               data.length() - written);
+#endif
+      if (result == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         return fileError(errno, filePath, ERROR_LOCATION);
+      }
+      written += result;
+   }
+
+   return Success();
+}
+
+Error syncFile(int fd, const FilePath& filePath)
+{
+#ifdef _WIN32
+   int result = ::_commit(fd);
+#else
+   int result = ::fsync(fd);
+#endif
+   if (result == -1)
+      return fileError(errno, filePath, ERROR_LOCATION);
+   else
+      return Success();
+}
+
+void closeFile(int fd)
+{
+#ifdef _WIN32
+   ::_close(fd);
+#else
+   ::close(fd);
+#endif
+}
+
+// read the contents of the file from offset onwards along with the total
+// size of the file (a file which doesn't exist is empty)
+Error readFileFrom(const FilePath& filePath,
+                   boost::uintmax_t offset,
+                   std::string* pContents,
+                   boost::uintmax_t* pFileSize)
+{
+   pContents->clear();
+   *pFileSize = 0;
+
+   int fd = -1;
+   Error error = openFile(filePath, O_RDONLY, &fd);
+   if (error)
+   {
+      if (error.code() == boost::system::errc::no_such_file_or_directory)
+         return Success();
+      return error;
+   }
+
+#ifdef _WIN32
+   struct _stati64 st;
+   int result = ::_fstati64(fd, &st);
+#else
+   struct stat st;
+   int result = ::fstat(fd, &st);
+#endif
+   if (result == -1)
+      error = fileError(errno, filePath, ERROR_LOCATION);
+   else
+      *pFileSize = st.st_size;
+
+   if (!error && offset < *pFileSize)
+   {
+      error = seekFile(fd, offset, filePath);
+      if (!error)
+         error = readFile(fd, filePath, pContents);
+   }
+
+   closeFile(fd);
+   return error;
+}
+
+FilePath lockFilePath(const FilePath& filePath)
+{
+   return filePath.parent().complete(filePath.filename() + ".lock");
+}
+
+Error lockFile(int fd, bool exclusive, const FilePath& filePath)
+{
+#ifdef _WIN32
+   HANDLE hFile = reinterpret_cast<HANDLE>(::_get_osfhandle(fd));
+   OVERLAPPED overlapped;
+   ::ZeroMemory(&overlapped, sizeof(overlapped));
+   if (!::LockFileEx(hFile,
+                     exclusive ? LOCKFILE_EXCLUSIVE_LOCK : 0,
+                     0,
+                     MAXDWORD,
+                     MAXDWORD,
+                     &overlapped))
+   {
+      Error error = systemError(::GetLastError(), ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+#else
+   while (::flock(fd, exclusive ? LOCK_EX : LOCK_SH) == -1)
+   {
+      if (errno != EINTR)
+         return fileError(errno, filePath, ERROR_LOCATION);
+   }
+#endif
+
+   return Success();
+}
+
+void unlockFile(int fd)
+{
+#ifdef _WIN32
+   HANDLE hFile = reinterpret_cast<HANDLE>(::_get_osfhandle(fd));
+   OVERLAPPED overlapped;
+   ::ZeroMemory(&overlapped, sizeof(overlapped));
+   ::UnlockFileEx(hFile, 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+   ::flock(fd, LOCK_UN);
+#endif
+}
+
+// advisory lock on the store's lock file, released on destruction
+class StoreLock : boost::noncopyable
+{
+public:
+   StoreLock(int fd, const FilePath& filePath)
+      : fd_(fd), filePath_(filePath), locked_(false)
+   {
+   }
+
+   ~StoreLock()
+   {
+      if (locked_)
+         unlockFile(fd_);
+   }
+
+   Error lock(bool exclusive)
+   {
+      Error error = lockFile(fd_, exclusive, filePath_);
+      if (!error)
+         locked_ = true;
+      return error;
+   }
+
+private:
+   int fd_;
+   FilePath filePath_;
+   bool locked_;
+};
+
+// the lock file contains the number of times the store has been rewritten
+Error readGeneration(int fd,
+                     const FilePath& filePath,
+                     boost::uint64_t* pGeneration)
+{
+   std::string contents;
+   Error error = seekFile(fd, 0, filePath);
+   if (!error)
+      error = readFile(fd, filePath, &contents);
+   if (error)
+      return error;
+
+   *pGeneration = 0;
+   std::istringstream istr(contents);
+   istr >> *pGeneration;
+   return Success();
+}
+
+Error writeGeneration(int fd,
+                      const FilePath& filePath,
+                      boost::uint64_t generation)
+{
+   Error error = seekFile(fd, 0, filePath);
+   if (!error)
+      error = writeFile(fd,
+                        boost::lexical_cast<std::string>(generation) + "\n",
+                        filePath);
+   return error;
+}
+
+// sync the directory so that a rename within it is durable
+void syncDirectory(const FilePath& dirPath)
+{
+#ifndef _WIN32
+   int fd = ::open(dirPath.absolutePath().c_str(), O_RDONLY);
+   if (fd != -1)
+   {
+      ::fsync(fd);
+      ::close(fd);
+   }
+#endif
+}
+
+} // anonymous namespace
+
+KeyValueStore::KeyValueStore()
+   : lockFd_(-1), fileSize_(0), liveSize_(0), tornTail_(false), generation_(0)
+{
+}
+
+KeyValueStore::~KeyValueStore()
+{
+   try
+   {
+      close();
+   }
+   catch(...)
+   {
+   }
+}
+
+Error KeyValueStore::initialize(const FilePath& filePath)
+{
+   close();
+   values_.clear();
+   fileSize_ = 0;
+   liveSize_ = 0;
+   tornTail_ = false;
+   generation_ = 0;
+   filePath_ = filePath;
+
+   Error error = filePath_.parent().ensureDirectory();
+   if (error)
+      return error;
+
+   error = openFile(lockFilePath(filePath_), O_RDWR | O_CREAT, &lockFd_);
+   if (error)
+      return error;
+
+   StoreLock lock(lockFd_, filePath_);
+   error = lock.lock(true);
+   if (!error)
+      error = refresh();
+   if (error)
+      return error;
+
+   // anything after the last good record can't be trusted, so rewrite the
+   // file without it now rather than waiting for the next change
+   if (tornTail_)
+      return rewrite();
+
+   return Success();
+}
+
+bool KeyValueStore::contains(const std::string& key)
+{
+   refreshForRead();
+   return values_.find(key) != values_.end();
+}
+
+std::string KeyValueStore::get(const std::string& key,
+                               const std::string& defaultValue)
+{
+   refreshForRead();
+
+   boost::unordered_map<std::string,std::string>::const_iterator it =
+                                                         values_.find(key);
+   if (it != values_.end())
+      return it->second;
+   else
+      return defaultValue;
+}
+
+std::vector<std::string> KeyValueStore::keys()
+{
+   refreshForRead();
+
+   std::vector<std::string> keys;
+   keys.reserve(values_.size());
+   for (boost::unordered_map<std::string,std::string>::const_iterator
+         it = values_.begin(); it != values_.end(); ++it)
+   {
+      keys.push_back(it->first);
+   }
+   return keys;
+}
+
+std::size_t KeyValueStore::size()
+{
+   refreshForRead();
+   return values_.size();
+}
+
+Error KeyValueStore::set(const std::string& key, const std::string& value)
+{
+   StoreLock lock(lockFd_, filePath_);
+   Error error = lock.lock(true);
+   if (!error)
+      error = refresh();
+   if (error)
+      return error;
+
+   // no need to write anything if the value hasn't changed
+   boost::unordered_map<std::string,std::string>::iterator it =
+                                                         values_.find(key);
+   if (it != values_.end() && it->second == value)
+      return Success();
+
+   error = appendRecord(kSetRecord, key, value);
+   if (error)
+      return error;
+
+   if (it != values_.end())
+   {
+      liveSize_ -= recordSize(key, it->second);
+      it->second = value;
+   }
+   else
+   {
+      values_[key] = value;
+   }
+   liveSize_ += recordSize(key, value);
+
+   return compactIfNecessary();
+}
+
+Error KeyValueStore::remove(const std::string& key)
+{
+   StoreLock lock(lockFd_, filePath_);
+   Error error = lock.lock(true);
+   if (!error)
+      error = refresh();
+   if (error)
+      return error;
+
+   boost::unordered_map<std::string,std::string>::iterator it =
+                                                         values_.find(key);
+   if (it == values_.end())
+      return Success();
+
+   error = appendRecord(kRemoveRecord, key, std::string());
+   if (error)
+      return error;
+
+   liveSize_ -= recordSize(key, it->second);
+   values_.erase(it);
+
+   return compactIfNecessary();
+}
+
+Error KeyValueStore::compact()
+{
+   StoreLock lock(lockFd_, filePath_);
+   Error error = lock.lock(true);
+   if (!error)
+      error = refresh();
+   if (error)
+      return error;
+
+   return rewrite();
+}
+
+Error KeyValueStore::sync()
+{
+   if (filePath_.empty() || !filePath_.exists())
+      return Success();
+
+   int fd = -1;
+   Error error = openFile(filePath_, O_WRONLY | O_APPEND, &fd);
+   if (error)
+      return error;
+
+   error = syncFile(fd, filePath_);
+   closeFile(fd);
+   return error;
+}
+
+void KeyValueStore::refreshForRead()
+{
+   StoreLock lock(lockFd_, filePath_);
+   Error error = lock.lock(false);
+   if (!error)
+      error = refresh();
+   if (error)
+      LOG_ERROR(error);
+}
+
+// bring the values up to date with the file (the lock must be held)
+Error KeyValueStore::refresh()
+{
+   boost::uint64_t generation;
+   Error error = readGeneration(lockFd_, lockFilePath(filePath_), &generation);
+   if (error)
+      return error;
+
+   // read only the records appended since we last looked unless the file
+   // has been rewritten (or has shrunk) in the meantime
+   boost::uintmax_t offset = (generation == generation_) ? fileSize_ : 0;
+   std::string contents;
+   boost::uintmax_t size;
+   error = readFileFrom(filePath_, offset, &contents, &size);
+   if (!error && size < offset)
+   {
+      offset = 0;
+      error = readFileFrom(filePath_, offset, &contents, &size);
+   }
+   if (error)
+      return error;
+
+   if (offset == 0)
+   {
+      values_.clear();
+      fileSize_ = 0;
+      liveSize_ = 0;
+   }
+
+   replay(contents, offset);
+   generation_ = generation;
+   return Success();
+}
+
+// apply the records in contents (read from offset within the file)
+void KeyValueStore::replay(const std::string& contents,
+                           boost::uintmax_t offset)
+{
+   std::size_t pos = 0;
+   char op;
+   std::string key, value;
+   while (pos < contents.length() &&
+          readRecord(contents, &pos, &op, &key, &value))
+   {
+      boost::unordered_map<std::string,std::string>::iterator it =
+                                                         values_.find(key);
+      if (it != values_.end())
+         liveSize_ -= recordSize(key, it->second);
+
+      if (op == kSetRecord)
+      {
+         liveSize_ += recordSize(key, value);
+         if (it != values_.end())
+            it->second.swap(value);
+         else
+            values_[key].swap(value);
+      }
+      else if (it != values_.end())
+      {
+         values_.erase(it);
+      }
+   }
+   fileSize_ = offset + pos;
+
+   bool tornTail = pos < contents.length();
+   if (tornTail && !tornTail_)
+   {
+      LOG_WARNING_MESSAGE("Discarding " +
+                          boost::lexical_cast<std::string>(
+                                    contents.length() - pos) +
+                          " bytes of corrupt data from the end of " +
+                          filePath_.absolutePath());
+   }
+   tornTail_ = tornTail;
+}
+
+// append a record to the file (the exclusive lock must be held)
+Error KeyValueStore::appendRecord(char op,
+                                  const std::string& key,
+                                  const std::string& value)
+{
+   // records appended after a torn one would never be read, so rewrite
+   // the file without it first
+   if (tornTail_)
+   {
+      Error error = rewrite();
+      if (error)
+         return error;
+   }
+
+   // write the whole record at once
+   std::string record;
+   record.reserve(kMaxHeaderSize + key.length() + value.length() + 1);
+   appendRecordTo(op, key, value, &record);
+
+   int fd = -1;
+   Error error = openFile(filePath_, O_WRONLY | O_CREAT | O_APPEND, &fd);
+   if (error)
+      return error;
+
+   error = writeFile(fd, record, filePath_);
+   closeFile(fd);
+   if (error)
+   {
+      // some of the record may have made it into the file
+      tornTail_ = true;
+      return error;
+   }
+
+   fileSize_ += record.length();
+   return Success();
+}
+
+// rewrite the file with only the current values (the exclusive lock must
+// be held)
+Error KeyValueStore::rewrite()
+{
+   // write the current values to a temporary file
+   std::string contents;
+   contents.reserve(static_cast<std::size_t>(liveSize_));
+   for (boost::unordered_map<std::string,std::string>::const_iterator
+         it = values_.begin(); it != values_.end(); ++it)
+   {
+      appendRecordTo(kSetRecord, it->first, it->second, &contents);
+   }
+
+   FilePath tempPath = filePath_.parent().complete(filePath_.filename() +
+                                                   ".tmp");
+   int fd = -1;
+   Error error = openFile(tempPath, O_WRONLY | O_CREAT | O_TRUNC, &fd);
+   if (error)
+      return error;
+
+   error = writeFile(fd, contents, tempPath);
+   if (!error)
+      error = syncFile(fd, tempPath);
+   closeFile(fd);
+   if (error)
+   {
+      Error removeError = tempPath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+      return error;
+   }
+
+   // tell other processes to reload before we replace the file (if the
+   // replace then fails they merely reload the existing file)
+   error = writeGeneration(lockFd_, lockFilePath(filePath_), generation_ + 1);
+   if (error)
+      return error;
+   generation_++;
+
+#ifdef _WIN32
+   // rename won't replace an existing file on win32
+   error = filePath_.removeIfExists();
+   if (error)
+      return error;
+#endif
+   error = tempPath.move(filePath_);
+   if (error)
+      return error;
+   syncDirectory(filePath_.parent());
+
+   fileSize_ = contents.length();
+   liveSize_ = contents.length();
+   tornTail_ = false;
+
+   return Success();
+}
+
+Error KeyValueStore::compactIfNecessary()
+{
+   // compact once superseded records make up most of the file
+   if (fileSize_ >= kMinCompactSize && (fileSize_ - liveSize_) > liveSize_)
+   {
+      // the change itself has already been written, so report but
+      // don't fail on errors
+      Error error = rewrite();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   return Success();
+}
+
+void KeyValueStore::close()
+{
+   if (lockFd_ != -1)
+   {
+      closeFile(lockFd_);
+      lockFd_ = -1;
+   }
+}
+
+} // namespace core
@@ -0,0 +1,166 @@
+/*
+ * KeyValueStoreTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/KeyValueStore.hpp>
+
+#include <fstream>
+#include <iostream>
+
+#include <boost/assert.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+namespace core {
+
+namespace {
+
+void verifySuccess(const Error& error)
+{
+   if (error)
+      std::cerr << error.summary() << std::endl;
+   BOOST_ASSERT(!error);
+}
+
+void appendToFile(const FilePath& filePath, const std::string& data)
+{
+   std::ofstream ostr(filePath.absolutePath().c_str(),
+                      std::ios::out | std::ios::app | std::ios::binary);
+   ostr << data;
+}
+
+// values survive a reload (i.e. the appended records replay correctly)
+void testAppend(const FilePath& storePath)
+{
+   {
+      KeyValueStore store;
+      verifySuccess(store.initialize(storePath));
+      verifySuccess(store.set("a", "1"));
+      verifySuccess(store.set("b", "2"));
+      verifySuccess(store.set("a", "3"));
+      verifySuccess(store.set("empty", ""));
+      verifySuccess(store.remove("b"));
+   }
+
+   KeyValueStore store;
+   verifySuccess(store.initialize(storePath));
+   BOOST_ASSERT(store.size() == 2);
+   BOOST_ASSERT(store.get("a") == "3");
+   BOOST_ASSERT(!store.contains("b"));
+   BOOST_ASSERT(store.contains("empty"));
+}
+
+// two stores on the same file (as with two processes) see each other's
+// changes, including after one of them compacts the file
+void testShared(const FilePath& storePath)
+{
+   KeyValueStore store1, store2;
+   verifySuccess(store1.initialize(storePath));
+   verifySuccess(store2.initialize(storePath));
+
+   verifySuccess(store1.set("x", "1"));
+   BOOST_ASSERT(store2.get("x") == "1");
+   verifySuccess(store2.set("y", "2"));
+   BOOST_ASSERT(store1.get("y") == "2");
+
+   // writes made after another store compacts go to the new file
+   verifySuccess(store2.compact());
+   verifySuccess(store1.set("z", "3"));
+   verifySuccess(store1.remove("x"));
+   BOOST_ASSERT(store2.get("z") == "3");
+   BOOST_ASSERT(!store2.contains("x"));
+
+   KeyValueStore store3;
+   verifySuccess(store3.initialize(storePath));
+   BOOST_ASSERT(store3.size() == 2);
+   BOOST_ASSERT(store3.get("y") == "2");
+   BOOST_ASSERT(store3.get("z") == "3");
+}
+
+// repeatedly replacing a value compacts the file once superseded records
+// make up most of it
+void testCompaction(const FilePath& storePath)
+{
+   KeyValueStore store;
+   verifySuccess(store.initialize(storePath));
+
+   std::string value(1024, 'v');
+   for (int i = 0; i < 256; i++)
+   {
+      value[0] = 'a' + (i % 26);
+      verifySuccess(store.set("key", value));
+   }
+   verifySuccess(store.set("other", "value"));
+
+   BOOST_ASSERT(storePath.size() < 64 * 1024);
+
+   KeyValueStore reloaded;
+   verifySuccess(reloaded.initialize(storePath));
+   BOOST_ASSERT(reloaded.get("key") == value);
+   BOOST_ASSERT(reloaded.get("other") == "value");
+}
+
+// a partial record at the end of the file is discarded (and doesn't
+// swallow records appended after it)
+void testTornTail(const FilePath& storePath)
+{
+   boost::uintmax_t goodSize = 0;
+   {
+      KeyValueStore store;
+      verifySuccess(store.initialize(storePath));
+      verifySuccess(store.set("a", "1"));
+      verifySuccess(store.set("b", "2"));
+      goodSize = storePath.size();
+   }
+
+   // torn while no store is open: removed on load
+   appendToFile(storePath, "S 1 10 0\na12");
+   {
+      KeyValueStore store;
+      verifySuccess(store.initialize(storePath));
+      BOOST_ASSERT(store.size() == 2);
+      BOOST_ASSERT(store.get("b") == "2");
+      BOOST_ASSERT(storePath.size() == goodSize);
+   }
+
+   // torn by another process while we have the store open: removed
+   // before our next append
+   KeyValueStore store;
+   verifySuccess(store.initialize(storePath));
+   appendToFile(storePath, "S 1 10 ");
+   BOOST_ASSERT(store.get("a") == "1");
+   verifySuccess(store.set("c", "3"));
+
+   KeyValueStore reloaded;
+   verifySuccess(reloaded.initialize(storePath));
+   BOOST_ASSERT(reloaded.size() == 3);
+   BOOST_ASSERT(reloaded.get("c") == "3");
+}
+
+} // anonymous namespace
+
+// testDir is removed and recreated
+void runKeyValueStoreTests(const FilePath& testDir)
+{
+   verifySuccess(testDir.removeIfExists());
+   verifySuccess(testDir.ensureDirectory());
+
+   testAppend(testDir.complete("append.db"));
+   testShared(testDir.complete("shared.db"));
+   testCompaction(testDir.complete("compaction.db"));
+   testTornTail(testDir.complete("torn.db"));
+
+   verifySuccess(testDir.removeIfExists());
+}
+
+} // namespace core
@@ -14,6 +14,8 @@
 #include <core/StringUtils.hpp>
 
 #include <cstdlib>
+#include <errno.h>
+#include <iconv.h>
 
 #include <vector>
 
@@ -70,6 +72,75 @@ std::wstring utf8ToWide(const std::string& value, const std::string& context)
    }
 }
 
+Error iconvstr(const std::string& value,
+               const std::string& from,
+               const std::string& to,
+               bool allowSubstitution,
+               std::string* pResult)
+{
+   std::string effectiveFrom = from;
+   if (effectiveFrom.empty())
+      effectiveFrom = "UTF-8";
+   std::string effectiveTo = to;
+   if (effectiveTo.empty())
+      effectiveTo = "UTF-8";
+
+   if (effectiveFrom == effectiveTo)
+   {
+      *pResult = value;
+      return Success();
+   }
+
+   iconv_t handle = ::iconv_open(effectiveTo.c_str(), effectiveFrom.c_str());
+   if (handle == (iconv_t)(-1))
+      return systemError(errno, ERROR_LOCATION);
+
+   std::vector<char> output;
+   output.reserve(value.length());
+
+   char* pIn = const_cast<char*>(value.data());
+   size_t inBytes = value.size();
+
+   Error error;
+   char buffer[256];
+   while (inBytes > 0)
+   {
+      const char* pInOrig = pIn;
+      char* pOut = buffer;
+      size_t outBytes = sizeof(buffer);
+
+      size_t result = ::iconv(handle, &pIn, &inBytes, &pOut, &outBytes);
+      if (buffer != pOut)
+         output.insert(output.end(), buffer, pOut);
+
+      if (result == (size_t)(-1))
+      {
+         if ((errno == EILSEQ || errno == EINVAL) && allowSubstitution)
+         {
+            output.push_back('?');
+            pIn++;
+            inBytes--;
+         }
+         else if (errno == E2BIG && pInOrig != pIn)
+         {
+            continue;
+         }
+         else
+         {
+            error = systemError(errno, ERROR_LOCATION);
+            break;
+         }
+      }
+   }
+   ::iconv_close(handle);
+
+   if (error)
+      return error;
+
+   *pResult = std::string(output.begin(), output.end());
+   return Success();
+}
+
 } // namespace string_utils
 } // namespace core
 
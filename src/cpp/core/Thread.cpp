@@ -13,6 +13,11 @@
 
 #include <core/Thread.hpp>
 
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+
 #include <core/system/System.hpp>
 
 namespace core {
@@ -42,6 +47,133 @@ void safeLaunchThread(boost::function<void()> threadMain,
    }
 }
 
+ThreadPool::ThreadPool(std::size_t threadCount, std::size_t maxPendingTasks)
+   : threadCount_(threadCount),
+     maxPendingTasks_(maxPendingTasks),
+     executing_(0),
+     stopping_(false)
+{
+   if (threadCount_ == 0)
+      threadCount_ = std::max(1U, boost::thread::hardware_concurrency());
+}
+
+ThreadPool::~ThreadPool()
+{
+   try
+   {
+      stop();
+   }
+   catch(...)
+   {
+   }
+}
+
+bool ThreadPool::enque(const Task& task)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      if ((tasks_.size() + executing_) >= maxPendingTasks_)
+         return false;
+
+      // launch the workers if necessary
+      if (threads_.empty())
+      {
+         stopping_ = false;
+         for (std::size_t i = 0; i<threadCount_; i++)
+         {
+            boost::shared_ptr<boost::thread> pThread(new boost::thread());
+            safeLaunchThread(boost::bind(&ThreadPool::workerMain, this),
+                             pThread.get());
+            threads_.push_back(pThread);
+         }
+      }
+
+      tasks_.push(task);
+   }
+   END_LOCK_MUTEX
+
+   taskAvailable_.notify_one();
+   return true;
+}
+
+std::size_t ThreadPool::pending()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return tasks_.size() + executing_;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return 0;
+}
+
+void ThreadPool::stop()
+{
+   std::vector<boost::shared_ptr<boost::thread> > threads;
+   LOCK_MUTEX(mutex_)
+   {
+      stopping_ = true;
+      tasks_ = std::queue<Task>();
+      threads.swap(threads_);
+   }
+   END_LOCK_MUTEX
+
+   taskAvailable_.notify_all();
+
+   BOOST_FOREACH(const boost::shared_ptr<boost::thread>& pThread, threads)
+   {
+      if (pThread->joinable())
+         pThread->join();
+   }
+}
+
+void ThreadPool::workerMain()
+{
+   try
+   {
+      while (true)
+      {
+         // wait for a task
+         Task task;
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (!stopping_ && tasks_.empty())
+               taskAvailable_.wait(lock);
+
+            if (stopping_)
+               return;
+
+            task = tasks_.front();
+            tasks_.pop();
+            executing_++;
+         }
+
+         // execute it
+         try
+         {
+            task();
+         }
+         CATCH_UNEXPECTED_EXCEPTION
+
+         LOCK_MUTEX(mutex_)
+         {
+            executing_--;
+         }
+         END_LOCK_MUTEX
+      }
+   }
+   catch(const boost::thread_interrupted&)
+   {
+   }
+   catch(const boost::thread_resource_error& e)
+   {
+      LOG_ERROR(Error(boost::thread_error::ec_from_exception(e),
+                      ERROR_LOCATION));
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
 } // namespace core
 } // namespace thread
 
@@ -15,6 +15,9 @@
 
 #include <windows.h>
 
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+
 #include <core/Log.hpp>
 #include <core/Error.hpp>
 
@@ -72,6 +75,113 @@ std::wstring utf8ToWide(const std::string& value,
    return std::wstring(&(result[0]));
 }
 
+namespace {
+
+// map an iconv encoding name to a windows code page (covers utf-8, the
+// iso-8859 family and numbered code pages, e.g. CP1252 or WINDOWS-1252)
+bool codePageForEncoding(const std::string& encoding, UINT* pCodePage)
+{
+   std::string name = boost::algorithm::to_upper_copy(encoding);
+   boost::algorithm::erase_all(name, "-");
+   boost::algorithm::erase_all(name, "_");
+
+   if (name.empty() || name == "UTF8")
+   {
+      *pCodePage = CP_UTF8;
+      return true;
+   }
+   if (name == "LATIN1")
+      name = "ISO88591";
+
+   UINT base = 0;
+   std::string number;
+   if (boost::algorithm::starts_with(name, "ISO8859"))
+   {
+      base = 28590;
+      number = name.substr(7);
+   }
+   else if (boost::algorithm::starts_with(name, "WINDOWS"))
+      number = name.substr(7);
+   else if (boost::algorithm::starts_with(name, "CP"))
+      number = name.substr(2);
+   else
+      return false;
+
+   try
+   {
+      *pCodePage = base + boost::lexical_cast<UINT>(number);
+      return true;
+   }
+   catch(const boost::bad_lexical_cast&)
+   {
+      return false;
+   }
+}
+
+} // anonymous namespace
+
+Error iconvstr(const std::string& value,
+               const std::string& from,
+               const std::string& to,
+               bool allowSubstitution,
+               std::string* pResult)
+{
+   UINT fromCodePage, toCodePage;
+   if (!codePageForEncoding(from, &fromCodePage) ||
+       !codePageForEncoding(to, &toCodePage))
+   {
+      Error error = systemError(boost::system::errc::invalid_argument,
+                                ERROR_LOCATION);
+      error.addProperty("from", from);
+      error.addProperty("to", to);
+      return error;
+   }
+
+   if (fromCodePage == toCodePage || value.empty())
+   {
+      *pResult = value;
+      return Success();
+   }
+
+   // convert to UTF-16 (unconvertible input becomes U+FFFD)
+   DWORD flags = allowSubstitution ? 0 : MB_ERR_INVALID_CHARS;
+   int chars = ::MultiByteToWideChar(fromCodePage, flags,
+                                     value.data(), value.size(),
+                                     NULL, 0);
+   if (chars == 0)
+      return systemError(::GetLastError(), ERROR_LOCATION);
+
+   std::vector<wchar_t> wide(chars, 0);
+   chars = ::MultiByteToWideChar(fromCodePage, flags,
+                                 value.data(), value.size(),
+                                 &(wide[0]), wide.size());
+   if (chars == 0)
+      return systemError(::GetLastError(), ERROR_LOCATION);
+
+   // then to the target (the default char may not be specified for utf-8,
+   // which can represent everything anyway)
+   BOOL usedDefault = FALSE;
+   LPBOOL pUsedDefault = (toCodePage == CP_UTF8) ? NULL : &usedDefault;
+   int bytes = ::WideCharToMultiByte(toCodePage, 0,
+                                     &(wide[0]), wide.size(),
+                                     NULL, 0, NULL, pUsedDefault);
+   if (bytes == 0)
+      return systemError(::GetLastError(), ERROR_LOCATION);
+   if (usedDefault && !allowSubstitution)
+      return systemError(boost::system::errc::illegal_byte_sequence,
+                         ERROR_LOCATION);
+
+   std::vector<char> result(bytes, 0);
+   bytes = ::WideCharToMultiByte(toCodePage, 0,
+                                 &(wide[0]), wide.size(),
+                                 &(result[0]), result.size(),
+                                 NULL, NULL);
+   if (bytes == 0)
+      return systemError(::GetLastError(), ERROR_LOCATION);
+
+   *pResult = std::string(result.begin(), result.begin() + bytes);
+   return Success();
+}
 
 } // namespace string_utils
 } // namespace core
@@ -13,12 +13,23 @@
 
 #include <core/gwt/GwtFileHandler.hpp>
 
-#include <boost/regex.hpp>
+#include <map>
+
+#include <boost/bind.hpp>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Hash.hpp>
+#include <core/Thread.hpp>
 #include <core/system/System.hpp>
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
+#include <core/http/Util.hpp>
 
 
 namespace core {
@@ -85,7 +96,285 @@ FilePath requestedFile(const std::string& wwwLocalPath,
 
 }
 
-void handleFileRequest(const std::string& wwwLocalPath,
+// files larger than this are always served from disk
+const uintmax_t kMaxAssetSize = 4 * 1024 * 1024;
+
+// total (raw plus gzipped) bytes we are willing to hold in memory
+const uintmax_t kMaxCacheSize = 64 * 1024 * 1024;
+
+// how long a cached file is served before we check whether it has changed
+const boost::posix_time::time_duration kRevalidateInterval =
+                                          boost::posix_time::seconds(1);
+
+boost::posix_time::ptime now()
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+// in memory copy of a www file
+struct Asset
+{
+   Asset() : lastWriteTime(0) {}
+
+   FilePath filePath;
+   std::time_t lastWriteTime;
+   std::string contentType;
+   std::string eTag;
+   std::string content;
+   std::string gzipContent; // empty if the file isn't compressible
+
+   uintmax_t cacheSize() const { return content.size() + gzipContent.size(); }
+};
+
+// Cache of www files (along with their gzipped content and etag) so that
+// repeated requests for application components don't re-read, re-hash, and
+// re-compress the file. Files are revalidated against their last write time
+// at most once every kRevalidateInterval. Thread safe.
+class AssetCache : boost::noncopyable
+{
+public:
+   explicit AssetCache(const std::string& wwwLocalPath)
+      : wwwLocalPath_(wwwLocalPath), cacheSize_(0)
+   {
+   }
+
+   // load all of the files within the www path
+   void preload();
+
+   // get the asset for a path relative to the www path. returns an empty
+   // pointer if the file isn't cached, in which case pFilePath is set to
+   // the validated path of the file (or empty if the request is invalid)
+   boost::shared_ptr<const Asset> asset(const std::string& relativePath,
+                                        FilePath* pFilePath);
+
+private:
+   boost::shared_ptr<const Asset> load(const std::string& relativePath,
+                                       const FilePath& filePath);
+
+   struct Entry
+   {
+      boost::shared_ptr<const Asset> pAsset;
+      boost::posix_time::ptime lastValidated;
+   };
+
+private:
+   const std::string wwwLocalPath_;
+   boost::mutex mutex_;
+   std::map<std::string,Entry> entries_;
+   uintmax_t cacheSize_;
+};
+
+void AssetCache::preload()
+{
+   FilePath wwwRealPath;
+   Error error = core::system::realPath(wwwLocalPath_, &wwwRealPath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   RecursiveDirectoryIterator iterator(wwwRealPath);
+   while (!iterator.finished())
+   {
+      FilePath filePath;
+      error = iterator.next(&filePath);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      if (filePath.isDirectory())
+         continue;
+
+      FilePath validatedPath;
+      asset(filePath.relativePath(wwwRealPath), &validatedPath);
+   }
+}
+
+boost::shared_ptr<const Asset> AssetCache::asset(
+                                          const std::string& relativePath,
+                                          FilePath* pFilePath)
+{
+   boost::shared_ptr<const Asset> pAsset;
+   boost::posix_time::ptime time = now();
+
+   LOCK_MUTEX(mutex_)
+   {
+      std::map<std::string,Entry>::iterator it = entries_.find(relativePath);
+      if (it != entries_.end())
+      {
+         if (time - it->second.lastValidated < kRevalidateInterval)
+            return it->second.pAsset;
+         pAsset = it->second.pAsset;
+      }
+   }
+   END_LOCK_MUTEX
+
+   // revalidate a cached file
+   if (pAsset)
+   {
+      if (pAsset->filePath.lastWriteTime() == pAsset->lastWriteTime)
+      {
+         LOCK_MUTEX(mutex_)
+         {
+            std::map<std::string,Entry>::iterator it =
+                                             entries_.find(relativePath);
+            if (it != entries_.end() && it->second.pAsset == pAsset)
+               it->second.lastValidated = time;
+         }
+         END_LOCK_MUTEX
+
+         return pAsset;
+      }
+
+      // the file changed or was removed so drop it
+      LOCK_MUTEX(mutex_)
+      {
+         std::map<std::string,Entry>::iterator it = entries_.find(relativePath);
+         if (it != entries_.end() && it->second.pAsset == pAsset)
+         {
+            cacheSize_ -= pAsset->cacheSize();
+            entries_.erase(it);
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+   // resolve and validate the path then attempt to cache it
+   *pFilePath = requestedFile(wwwLocalPath_, relativePath);
+   if (pFilePath->empty())
+      return boost::shared_ptr<const Asset>();
+
+   return load(relativePath, *pFilePath);
+}
+
+boost::shared_ptr<const Asset> AssetCache::load(
+                                          const std::string& relativePath,
+                                          const FilePath& filePath)
+{
+   // check the size against our limits (note that we read the last write
+   // time before the content so we'll reload if it changes while reading)
+   boost::shared_ptr<Asset> pAsset(new Asset());
+   pAsset->filePath = filePath;
+   pAsset->lastWriteTime = filePath.lastWriteTime();
+   uintmax_t size = filePath.size();
+   if (size > kMaxAssetSize)
+      return boost::shared_ptr<const Asset>();
+
+   LOCK_MUTEX(mutex_)
+   {
+      if (cacheSize_ + size > kMaxCacheSize)
+         return boost::shared_ptr<const Asset>();
+   }
+   END_LOCK_MUTEX
+
+   // read the file
+   Error error = readStringFromFile(filePath, &(pAsset->content));
+   if (error)
+   {
+      LOG_ERROR(error);
+      return boost::shared_ptr<const Asset>();
+   }
+   pAsset->contentType = filePath.mimeContentType();
+   pAsset->eTag = hash::crc32Hash(pAsset->content);
+
+   // compress it
+   if (http::Response::isCompressibleContentType(pAsset->contentType))
+   {
+      http::Response gzipResponse;
+      gzipResponse.setContentEncoding(http::kGzipEncoding);
+      error = gzipResponse.setBody(pAsset->content);
+      if (error)
+         LOG_ERROR(error);
+      else if (gzipResponse.contentEncoding() == http::kGzipEncoding)
+         pAsset->gzipContent = gzipResponse.body();
+   }
+
+   // add it to the cache (unless someone beat us to it)
+   LOCK_MUTEX(mutex_)
+   {
+      std::map<std::string,Entry>::iterator it = entries_.find(relativePath);
+      if (it != entries_.end())
+         return it->second.pAsset;
+
+      if (cacheSize_ + pAsset->cacheSize() > kMaxCacheSize)
+         return boost::shared_ptr<const Asset>();
+
+      Entry& entry = entries_[relativePath];
+      entry.pAsset = pAsset;
+      entry.lastValidated = now();
+      cacheSize_ += pAsset->cacheSize();
+   }
+   END_LOCK_MUTEX
+
+   return pAsset;
+}
+
+bool isCacheForeverFile(const std::string& uri)
+{
+   return boost::algorithm::contains(uri, ".cache.");
+}
+
+bool isNoCacheFile(const std::string& uri)
+{
+   return boost::algorithm::contains(uri, ".nocache.");
+}
+
+void setAssetResponse(const Asset& asset,
+                      const std::string& uri,
+                      const http::Request& request,
+                      http::Response* pResponse)
+{
+   // case: files designated to be cached "forever"
+   if (isCacheForeverFile(uri))
+   {
+      pResponse->setCacheForeverHeaders();
+   }
+
+   // case: files designated to never be cached
+   else if (isNoCacheFile(uri))
+   {
+      pResponse->setNoCacheHeaders();
+   }
+
+   // case: normal cacheable file
+   else
+   {
+      // since these are application components we force revalidation
+      pResponse->setCacheWithRevalidationHeaders();
+
+      using namespace boost::posix_time;
+      ptime lastModifiedDate = from_time_t(asset.lastWriteTime);
+      pResponse->setHeader("Last-Modified",
+                           http::util::httpDate(lastModifiedDate));
+      pResponse->setHeader("ETag", asset.eTag);
+
+      if (asset.eTag == request.headerValue("If-None-Match") ||
+          lastModifiedDate == request.ifModifiedSince())
+      {
+         pResponse->removeHeader("Content-Type");
+         pResponse->setStatusCode(http::status::NotModified);
+         return;
+      }
+   }
+
+   pResponse->setContentType(asset.contentType);
+   if (!asset.gzipContent.empty() &&
+       request.acceptsEncoding(http::kGzipEncoding))
+   {
+      pResponse->setBodyUnencoded(asset.gzipContent);
+      pResponse->setContentEncoding(http::kGzipEncoding);
+   }
+   else
+   {
+      pResponse->setBodyUnencoded(asset.content);
+   }
+}
+
+void handleFileRequest(boost::shared_ptr<AssetCache> pAssetCache,
+                       const std::string& wwwLocalPath,
                        const std::string& baseUri,
                        core::http::UriFilterFunction mainPageFilter,
                        const http::Request& request, 
@@ -134,10 +423,17 @@ void handleFileRequest(const std::string& wwwLocalPath,
       pResponse->setChromeFrameCompatible(request);
    }
    
-   // get the requested file 
+   // get the requested file (serving it from the cache if we can)
    std::string relativePath = uri.substr(baseUri.length());
-   FilePath filePath = requestedFile(wwwLocalPath, relativePath);
-   if (filePath.empty())
+   FilePath filePath;
+   boost::shared_ptr<const Asset> pAsset = pAssetCache->asset(relativePath,
+                                                              &filePath);
+   if (pAsset)
+   {
+      setAssetResponse(*pAsset, uri, request, pResponse);
+      return;
+   }
+   else if (filePath.empty())
    {
       pResponse->setError(http::status::NotFound, 
                           request.uri() + " not found");
@@ -145,14 +441,14 @@ void handleFileRequest(const std::string& wwwLocalPath,
    }
    
    // case: files designated to be cached "forever"
-   if (regex_match(uri, boost::regex(".*\\.cache\\..*")))
+   if (isCacheForeverFile(uri))
    {
       pResponse->setCacheForeverHeaders();
       pResponse->setFile(filePath, request);
    }
    
    // case: files designated to never be cached 
-   else if (regex_match(uri, boost::regex(".*\\.nocache\\..*")))
+   else if (isNoCacheFile(uri))
    {
       pResponse->setNoCacheHeaders();
       pResponse->setFile(filePath, request);
@@ -173,9 +469,15 @@ void handleFileRequest(const std::string& wwwLocalPath,
 http::UriHandlerFunction fileHandlerFunction(
                                        const std::string& wwwLocalPath,
                                        const std::string& baseUri,
-                                       http::UriFilterFunction mainPageFilter)
+                                       http::UriFilterFunction mainPageFilter,
+                                       bool preloadAssets)
 {
+   boost::shared_ptr<AssetCache> pAssetCache(new AssetCache(wwwLocalPath));
+   if (preloadAssets)
+      pAssetCache->preload();
+
    return boost::bind(handleFileRequest,
+                      pAssetCache,
                       wwwLocalPath,
                       baseUri,
                       mainPageFilter,
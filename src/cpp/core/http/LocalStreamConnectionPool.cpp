@@ -0,0 +1,256 @@
+/*
+ * LocalStreamConnectionPool.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/LocalStreamConnectionPool.hpp>
+
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include <boost/foreach.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+#include <core/http/SocketUtils.hpp>
+
+namespace core {
+namespace http {
+
+namespace {
+
+boost::posix_time::ptime now()
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+// an idle connection is healthy if the server hasn't closed it and
+// hasn't sent anything unexpected on it
+bool isHealthy(LocalStreamConnectionPool::Socket& socket)
+{
+   if (!socket.is_open())
+      return false;
+
+   char ch;
+   int result = ::recv(socket.native(), &ch, 1, MSG_PEEK | MSG_DONTWAIT);
+   return result == -1 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+} // anonymous namespace
+
+LocalStreamConnectionPool::LocalStreamConnectionPool(
+                  std::size_t maxIdlePerStream,
+                  const boost::posix_time::time_duration& idleTimeout)
+   : maxIdlePerStream_(maxIdlePerStream),
+     idleTimeout_(idleTimeout),
+     lastSweep_(now())
+{
+}
+
+LocalStreamConnectionPool::~LocalStreamConnectionPool()
+{
+   try
+   {
+      std::vector<boost::shared_ptr<Socket> > sockets;
+      typedef std::map<std::string,IdleConnections>::value_type StreamEntry;
+      BOOST_FOREACH(const StreamEntry& entry, idleConnections_)
+      {
+         BOOST_FOREACH(const IdleConnection& connection, entry.second)
+         {
+            sockets.push_back(connection.ptrSocket);
+         }
+      }
+      close(sockets);
+   }
+   catch(...)
+   {
+   }
+}
+
+boost::shared_ptr<LocalStreamConnectionPool::Socket>
+            LocalStreamConnectionPool::acquire(const FilePath& streamPath)
+{
+   boost::shared_ptr<Socket> ptrSocket;
+   std::vector<boost::shared_ptr<Socket> > evicted;
+
+   LOCK_MUTEX(mutex_)
+   {
+      std::map<std::string,IdleConnections>::iterator it =
+                        idleConnections_.find(streamPath.absolutePath());
+      if (it != idleConnections_.end())
+      {
+         // take the most recently used connection (the one least likely
+         // to have been closed by the server)
+         IdleConnections& connections = it->second;
+         removeExpired(now(), &connections, &evicted);
+         while (!connections.empty())
+         {
+            boost::shared_ptr<Socket> ptrCandidate =
+                                       connections.back().ptrSocket;
+            connections.pop_back();
+
+            if (isHealthy(*ptrCandidate))
+            {
+               ptrSocket = ptrCandidate;
+               stats_.reused++;
+               break;
+            }
+            else
+            {
+               evicted.push_back(ptrCandidate);
+            }
+         }
+
+         if (connections.empty())
+            idleConnections_.erase(it);
+      }
+
+      stats_.evicted += evicted.size();
+   }
+   END_LOCK_MUTEX
+
+   close(evicted);
+   return ptrSocket;
+}
+
+void LocalStreamConnectionPool::release(
+                              const FilePath& streamPath,
+                              const boost::shared_ptr<Socket>& ptrSocket)
+{
+   std::vector<boost::shared_ptr<Socket> > evicted;
+
+   LOCK_MUTEX(mutex_)
+   {
+      stats_.released++;
+
+      IdleConnections& connections =
+                           idleConnections_[streamPath.absolutePath()];
+      if (connections.size() < maxIdlePerStream_)
+         connections.push_back(IdleConnection(ptrSocket, now()));
+      else
+         evicted.push_back(ptrSocket);
+
+      // periodically sweep expired connections to other streams (so that
+      // connections to streams which are no longer used get closed)
+      boost::posix_time::ptime time = now();
+      if (time - lastSweep_ >= idleTimeout_)
+      {
+         lastSweep_ = time;
+         sweepExpired(time, &evicted);
+      }
+
+      stats_.evicted += evicted.size();
+   }
+   END_LOCK_MUTEX
+
+   close(evicted);
+}
+
+void LocalStreamConnectionPool::evict(const FilePath& streamPath)
+{
+   std::vector<boost::shared_ptr<Socket> > evicted;
+
+   LOCK_MUTEX(mutex_)
+   {
+      std::map<std::string,IdleConnections>::iterator it =
+                        idleConnections_.find(streamPath.absolutePath());
+      if (it != idleConnections_.end())
+      {
+         BOOST_FOREACH(const IdleConnection& connection, it->second)
+         {
+            evicted.push_back(connection.ptrSocket);
+         }
+         idleConnections_.erase(it);
+      }
+
+      stats_.evicted += evicted.size();
+   }
+   END_LOCK_MUTEX
+
+   close(evicted);
+}
+
+void LocalStreamConnectionPool::evictExpired()
+{
+   std::vector<boost::shared_ptr<Socket> > evicted;
+
+   LOCK_MUTEX(mutex_)
+   {
+      boost::posix_time::ptime time = now();
+      lastSweep_ = time;
+      sweepExpired(time, &evicted);
+
+      stats_.evicted += evicted.size();
+   }
+   END_LOCK_MUTEX
+
+   close(evicted);
+}
+
+LocalStreamConnectionPoolStats LocalStreamConnectionPool::stats()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return stats_;
+   }
+   END_LOCK_MUTEX
+
+   // keep compiler happy
+   return LocalStreamConnectionPoolStats();
+}
+
+void LocalStreamConnectionPool::removeExpired(
+                  const boost::posix_time::ptime& now,
+                  IdleConnections* pConnections,
+                  std::vector<boost::shared_ptr<Socket> >* pEvicted)
+{
+   // connections are ordered oldest first
+   IdleConnections::iterator it = pConnections->begin();
+   while (it != pConnections->end() && (now - it->idleSince) >= idleTimeout_)
+   {
+      pEvicted->push_back(it->ptrSocket);
+      ++it;
+   }
+   pConnections->erase(pConnections->begin(), it);
+}
+
+void LocalStreamConnectionPool::sweepExpired(
+                  const boost::posix_time::ptime& now,
+                  std::vector<boost::shared_ptr<Socket> >* pEvicted)
+{
+   std::map<std::string,IdleConnections>::iterator it =
+                                             idleConnections_.begin();
+   while (it != idleConnections_.end())
+   {
+      removeExpired(now, &(it->second), pEvicted);
+      if (it->second.empty())
+         idleConnections_.erase(it++);
+      else
+         ++it;
+   }
+}
+
+void LocalStreamConnectionPool::close(
+                     const std::vector<boost::shared_ptr<Socket> >& sockets)
+{
+   BOOST_FOREACH(const boost::shared_ptr<Socket>& ptrSocket, sockets)
+   {
+      Error error = closeSocket(*ptrSocket);
+      if (error && !isConnectionTerminatedError(error))
+         LOG_ERROR(error);
+   }
+}
+
+} // namespace http
+} // namespace core
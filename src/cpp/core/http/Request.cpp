@@ -46,10 +46,12 @@ bool Request::acceptsContentType(const std::string& contentType) const
 
 bool Request::acceptsEncoding(const std::string& encoding) const
 {
-   // read , separated fields
+   // read , separated fields (the tokenizer refers to the string so it
+   // must outlive it)
    using namespace boost ;
-   char_separator<char> comma(",");
-   tokenizer<char_separator<char> > tokens(acceptEncoding(), comma);
+   std::string acceptEncodingValue = acceptEncoding();
+   char_separator<char> comma(", ");
+   tokenizer<char_separator<char> > tokens(acceptEncodingValue, comma);
    return std::find(tokens.begin(), tokens.end(), encoding) != tokens.end();
 }
    
@@ -175,6 +177,7 @@ void Request::resetMembers()
    cookies_.clear() ;
    parsedFormFields_ = false ;
    formFields_.clear() ;
+   files_.clear() ;
    parsedQueryParams_ = false;
    queryParams_.clear();
 }
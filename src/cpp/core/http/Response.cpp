@@ -137,8 +137,29 @@ void Response::setBodyUnencoded(const std::string& body)
 {
    removeHeader("Content-Encoding");
    body_ = body;
+   ptrStreamFile_.reset();
    setContentLength(body_.length());
 }
+
+Error Response::setStreamFile(const FilePath& filePath)
+{
+#ifdef _WIN32
+   removeHeader("Content-Encoding");
+   return setBody(filePath);
+#else
+   boost::shared_ptr<StreamFile> ptrStreamFile;
+   Error error = StreamFile::open(filePath, &ptrStreamFile);
+   if (error)
+      return error;
+
+   removeHeader("Content-Encoding");
+   body_.clear();
+   ptrStreamFile_ = ptrStreamFile;
+   setHeader("Content-Length",
+             boost::lexical_cast<std::string>(ptrStreamFile_->size()));
+   return Success();
+#endif
+}
    
    
 void Response::setError(int statusCode, const std::string& message)
@@ -173,6 +194,16 @@ void Response::resetMembers()
 	statusCode_ = status::Ok ;
 	statusCodeStr_.clear() ;
 	statusMessage_.clear() ;
+	ptrStreamFile_.reset();
+}
+
+bool Response::isCompressibleContentType(const std::string& contentType)
+{
+   using namespace boost::algorithm;
+   return starts_with(contentType, "text/") ||
+          contains(contentType, "javascript") ||
+          contains(contentType, "json") ||
+          contains(contentType, "xml");
 }
    
 void Response::removeCachingHeaders()
@@ -0,0 +1,157 @@
+/*
+ * StreamFile.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/StreamFile.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#include <algorithm>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+namespace core {
+namespace http {
+
+namespace {
+
+// max bytes to write in a single call (keeps any one connection from
+// monopolizing a thread)
+const std::size_t kMaxWriteSize = 1024 * 1024;
+
+#ifndef __linux__
+const std::size_t kCopyBufferSize = 64 * 1024;
+#endif
+
+// write some of the file to the socket, returning the number of bytes
+// written (or -1 with errno set)
+ssize_t writeFileToSocket(int fd, int socket, off_t offset, std::size_t count)
+{
+#ifdef __linux__
+   return ::sendfile(socket, fd, &offset, count);
+#else
+   char buffer[kCopyBufferSize];
+   ssize_t bytesRead = ::pread(fd,
+                               buffer,
+                               std::min(count, kCopyBufferSize),
+                               offset);
+   if (bytesRead <= 0)
+      return bytesRead;
+   return ::write(socket, buffer, bytesRead);
+#endif
+}
+
+} // anonymous namespace
+
+Error StreamFile::open(const FilePath& filePath,
+                       boost::shared_ptr<StreamFile>* pStreamFile)
+{
+   int fd = ::open(filePath.absolutePath().c_str(), O_RDONLY);
+   if (fd == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   // don't leak the descriptor into child processes
+   ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+   struct stat st;
+   if (::fstat(fd, &st) == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      ::close(fd);
+      return error;
+   }
+
+   pStreamFile->reset(new StreamFile(fd, st.st_size));
+   return Success();
+}
+
+StreamFile::~StreamFile()
+{
+   ::close(fd_);
+}
+
+Error StreamFile::writeSome(int socket, boost::uintmax_t* pOffset) const
+{
+   while (*pOffset < size_)
+   {
+      std::size_t count = static_cast<std::size_t>(
+                  std::min<boost::uintmax_t>(size_ - *pOffset, kMaxWriteSize));
+
+      ssize_t written = writeFileToSocket(fd_, socket, *pOffset, count);
+      if (written > 0)
+      {
+         *pOffset += written;
+         return Success();
+      }
+      else if (written == 0)
+      {
+         // the file was truncated after we opened it
+         return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      }
+      else if (errno == EINTR)
+      {
+         continue;
+      }
+      else if (errno == EAGAIN || errno == EWOULDBLOCK)
+      {
+         return systemError(boost::system::errc::operation_would_block,
+                            ERROR_LOCATION);
+      }
+      else
+      {
+         return systemError(errno, ERROR_LOCATION);
+      }
+   }
+
+   return Success();
+}
+
+Error StreamFile::writeAll(int socket, boost::uintmax_t offset) const
+{
+   while (offset < size_)
+   {
+      Error error = writeSome(socket, &offset);
+      if (error.code() == boost::system::errc::operation_would_block)
+      {
+         // wait for the socket to become writable
+         struct pollfd pfd;
+         pfd.fd = socket;
+         pfd.events = POLLOUT;
+         pfd.revents = 0;
+         if (::poll(&pfd, 1, -1) == -1 && errno != EINTR)
+            return systemError(errno, ERROR_LOCATION);
+      }
+      else if (error)
+      {
+         return error;
+      }
+   }
+
+   return Success();
+}
+
+} // namespace http
+} // namespace core
@@ -14,11 +14,23 @@
 #ifndef FILE_LOG_WRITER_HPP
 #define FILE_LOG_WRITER_HPP
 
+#include <deque>
+#include <string>
+#include <iosfwd>
+
+#include <boost/shared_ptr.hpp>
+
+#include <core/BoostThread.hpp>
 #include <core/FilePath.hpp>
 #include <core/LogWriter.hpp>
 
 namespace core {
 
+// Writes log entries to <logDir>/<programIdentity>.log. Entries are queued
+// and written in batches by a background thread (so logging never does disk
+// io on the calling thread). If the queue is full entries are dropped (and
+// the number dropped is noted in the log). When the log exceeds its maximum
+// size it is rotated to <programIdentity>.log.1, .2, etc.
 class FileLogWriter : public LogWriter
 {
 public:
@@ -30,12 +42,41 @@ public:
     virtual void log(core::system::LogLevel level,
                      const std::string& message);
 
+    // wait until all queued entries have been written
+    void flush();
+
 private:
-    bool rotateLogFile();
+    void writerThreadMain();
+    void writeEntries(const std::deque<std::string>& entries,
+                      std::size_t droppedEntries);
+    void writeEntryDirect(const std::string& entry);
+    bool openLogFile();
+    void closeLogFile();
+    void rotateLogFile();
 
     std::string programIdentity_;
     int logLevel_;
     FilePath logFile_;
+
+    // the process which owns the writer thread (forked children write
+    // their entries directly)
+    int pid_;
+
+    // queue (protected by mutex_)
+    boost::mutex mutex_;
+    boost::condition queuedCondition_;
+    boost::condition writtenCondition_;
+    std::deque<std::string> queue_;
+    std::size_t droppedEntries_;
+    unsigned long long queuedCount_;
+    unsigned long long writtenCount_;
+    bool stopping_;
+
+    // log file (accessed only from the writer thread)
+    boost::shared_ptr<std::ostream> pLogStream_;
+    uintmax_t logSize_;
+
+    boost::thread writerThread_;
 };
 
 } // namespace core
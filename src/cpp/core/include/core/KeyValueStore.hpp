@@ -0,0 +1,102 @@
+/*
+ * KeyValueStore.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_KEY_VALUE_STORE_HPP
+#define CORE_KEY_VALUE_STORE_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <core/FilePath.hpp>
+
+namespace core {
+
+class Error ;
+
+// Persistent string key/value store kept in a single file. All values are
+// held in memory; each set or remove appends a checksummed record to the
+// end of the file, and the file is rewritten with only the current values
+// once superseded records make up most of it. A torn or corrupt record at
+// the end of the file (e.g. from a crash mid-write) is discarded.
+//
+// The file may be shared by several processes. Each operation holds an
+// advisory lock on a companion lock file and first brings the values up
+// to date with the records other processes have appended (or reloads them
+// entirely if another process has rewritten the file). Appends are not
+// synced to disk individually; call sync() at points where durability
+// matters (compaction always syncs). Not thread safe.
+class KeyValueStore : boost::noncopyable
+{
+public:
+   KeyValueStore();
+   virtual ~KeyValueStore();
+   // COPYING: boost::noncopyable
+
+   // load the store from the file (creating it if necessary)
+   Error initialize(const FilePath& filePath);
+
+   const FilePath& filePath() const { return filePath_; }
+
+public:
+   // errors bringing the values up to date are logged (the values we
+   // already have are returned)
+   bool contains(const std::string& key);
+   std::string get(const std::string& key,
+                   const std::string& defaultValue = std::string());
+   std::vector<std::string> keys();
+   std::size_t size();
+
+   Error set(const std::string& key, const std::string& value);
+   Error remove(const std::string& key);
+
+   // rewrite the file with only the current values
+   Error compact();
+
+   // flush appended records to disk
+   Error sync();
+
+private:
+   void refreshForRead();
+   Error refresh();
+   void replay(const std::string& contents, boost::uintmax_t offset);
+   Error appendRecord(char op,
+                      const std::string& key,
+                      const std::string& value);
+   Error rewrite();
+   Error compactIfNecessary();
+   void close();
+
+private:
+   FilePath filePath_;
+   int lockFd_;
+   boost::unordered_map<std::string,std::string> values_;
+
+   // offset of the end of the last good record in the file and the size
+   // of the records within it which are still current
+   boost::uintmax_t fileSize_;
+   boost::uintmax_t liveSize_;
+
+   // is there data after the last good record
+   bool tornTail_;
+
+   // incremented (within the lock file) each time the file is rewritten
+   boost::uint64_t generation_;
+};
+
+} // namespace core
+
+#endif // CORE_KEY_VALUE_STORE_HPP
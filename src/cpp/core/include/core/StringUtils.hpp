@@ -62,6 +62,15 @@ std::string wideToUtf8(const std::wstring& value);
 std::wstring utf8ToWide(const std::string& value,
                         const std::string& context = std::string());
 
+// convert between encodings without calling into R (so it can be used off
+// the main thread). empty encodings are treated as UTF-8. if
+// allowSubstitution is true, unconvertible input is replaced with '?'
+Error iconvstr(const std::string& value,
+               const std::string& from,
+               const std::string& to,
+               bool allowSubstitution,
+               std::string* pResult);
+
 template <typename Iterator, typename InputIterator>
 Error utf8Clean(Iterator begin,
                 InputIterator end,
@@ -15,9 +15,11 @@
 #define CORE_THREAD_HPP
 
 #include <queue>
+#include <vector>
 
 #include <boost/utility.hpp>
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/BoostErrors.hpp>
 #include <core/BoostThread.hpp>
@@ -206,6 +208,47 @@ private:
 
 void safeLaunchThread(boost::function<void()> threadMain,
                       boost::thread* pThread = NULL);
+
+// fixed size pool of worker threads which execute tasks from a bounded
+// queue. threads are launched (with all signals blocked) on the first
+// call to enque. note that tasks must never call into R.
+class ThreadPool : boost::noncopyable
+{
+public:
+   typedef boost::function<void()> Task;
+
+   // a threadCount of 0 indicates one thread per available core
+   ThreadPool(std::size_t threadCount, std::size_t maxPendingTasks);
+   virtual ~ThreadPool();
+
+   // COPYING: boost::noncopyable
+
+public:
+   // enque a task for execution. returns false (without enqueing the
+   // task) if maxPendingTasks are already queued or executing
+   bool enque(const Task& task);
+
+   // number of tasks queued or executing
+   std::size_t pending();
+
+   // discard queued tasks and join the worker threads (the pool will
+   // relaunch its threads if additional tasks are enqued)
+   void stop();
+
+private:
+   void workerMain();
+
+private:
+   std::size_t threadCount_;
+   const std::size_t maxPendingTasks_;
+
+   boost::mutex mutex_;
+   boost::condition taskAvailable_;
+   std::queue<Task> tasks_;
+   std::size_t executing_;
+   bool stopping_;
+   std::vector<boost::shared_ptr<boost::thread> > threads_;
+};
       
 } // namespace thread
 } // namespace core
@@ -0,0 +1,118 @@
+/*
+ * LruCache.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_COLLECTION_LRU_CACHE_HPP
+#define CORE_COLLECTION_LRU_CACHE_HPP
+
+#include <list>
+#include <cstddef>
+#include <utility>
+
+#include <boost/utility.hpp>
+#include <boost/unordered_map.hpp>
+
+namespace core {
+namespace collection {
+
+// Map with a fixed capacity which evicts the least recently used entry
+// when full. Not thread safe.
+template <typename K, typename V>
+class LruCache : boost::noncopyable
+{
+private:
+   typedef std::list<std::pair<K,V> > Entries;
+   typedef boost::unordered_map<K, typename Entries::iterator> Index;
+
+public:
+   explicit LruCache(std::size_t capacity)
+      : capacity_(capacity), size_(0)
+   {
+   }
+
+   // look up an entry (marking it as most recently used)
+   bool get(const K& key, V* pValue)
+   {
+      typename Index::iterator it = index_.find(key);
+      if (it == index_.end())
+         return false;
+
+      entries_.splice(entries_.begin(), entries_, it->second);
+      *pValue = it->second->second;
+      return true;
+   }
+
+   // add or replace an entry. returns true if this evicted the least
+   // recently used entry (whose value is returned in pEvicted, if provided)
+   bool put(const K& key, const V& value, V* pEvicted = NULL)
+   {
+      typename Index::iterator it = index_.find(key);
+      if (it != index_.end())
+      {
+         it->second->second = value;
+         entries_.splice(entries_.begin(), entries_, it->second);
+         return false;
+      }
+
+      if (capacity_ == 0)
+         return false;
+
+      bool evicted = false;
+      if (size_ >= capacity_)
+      {
+         if (pEvicted != NULL)
+            *pEvicted = entries_.back().second;
+         index_.erase(entries_.back().first);
+         entries_.pop_back();
+         size_--;
+         evicted = true;
+      }
+
+      entries_.push_front(std::make_pair(key, value));
+      index_[key] = entries_.begin();
+      size_++;
+
+      return evicted;
+   }
+
+   void remove(const K& key)
+   {
+      typename Index::iterator it = index_.find(key);
+      if (it != index_.end())
+      {
+         entries_.erase(it->second);
+         index_.erase(it);
+         size_--;
+      }
+   }
+
+   void clear()
+   {
+      index_.clear();
+      entries_.clear();
+      size_ = 0;
+   }
+
+   std::size_t size() const { return size_; }
+   std::size_t capacity() const { return capacity_; }
+
+private:
+   const std::size_t capacity_;
+   std::size_t size_;
+   Entries entries_;
+   Index index_;
+};
+
+} // namespace collection
+} // namespace core
+
+#endif // CORE_COLLECTION_LRU_CACHE_HPP
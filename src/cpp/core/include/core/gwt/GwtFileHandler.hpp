@@ -19,10 +19,13 @@
 namespace core {
 namespace gwt {
       
+// files are cached in memory as they are served (pass preloadAssets to
+// load all of the files within wwwLocalPath up front)
 http::UriHandlerFunction fileHandlerFunction(
       const std::string& wwwLocalPath,
       const std::string& baseUri = std::string(),
-      http::UriFilterFunction mainPageFilter = http::UriFilterFunction());
+      http::UriFilterFunction mainPageFilter = http::UriFilterFunction(),
+      bool preloadAssets = false);
    
 } // namespace gwt
 } // namespace core
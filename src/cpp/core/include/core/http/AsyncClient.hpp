@@ -16,6 +16,8 @@
 
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
 #include <boost/asio/write.hpp>
@@ -28,6 +30,7 @@
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/SafeConvert.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
@@ -63,7 +66,9 @@ class AsyncClient :
 public:
    AsyncClient(boost::asio::io_service& ioService)
       : ioService_(ioService),
-        connectionRetryContext_(ioService)
+        connectionRetryContext_(ioService),
+        keepAlive_(false),
+        contentLength_(-1)
    {
    }
 
@@ -121,10 +126,18 @@ protected:
    // they finish connecting)
    void writeRequest()
    {
+      // reset response state (the request may be a retry)
+      response_.reset();
+      responseBuffer_.consume(responseBuffer_.size());
+      keepAlive_ = false;
+      contentLength_ = -1;
+
       // write
       boost::asio::async_write(
           socket(),
-          request_.toBuffers(Header::connectionClose()),
+          request_.toBuffers(keepConnectionAlive() ?
+                                 Header("Connection", "keep-alive") :
+                                 Header::connectionClose()),
           boost::bind(
                &AsyncClient<SocketService>::handleWrite,
                AsyncClient<SocketService>::shared_from_this(),
@@ -155,11 +168,61 @@ protected:
                                 location);
       handleError(error);
    }
+
+   // requests which can safely be repeated if we can't tell whether the
+   // server received them
+   bool requestIsIdempotent() const
+   {
+      const std::string& method = request_.method();
+      return method == "GET" || method == "HEAD" || method == "OPTIONS";
+   }
    
 private:
 
    virtual void connectAndWriteRequest() = 0;
 
+   // subclasses which can reuse connections ask the server to keep them
+   // open. if the server agrees then releaseConnection is called (rather
+   // than close) once the response has been read
+   virtual bool keepConnectionAlive() { return false; }
+
+   virtual void releaseConnection() { close(); }
+
+   // called when an error occurs before any of the response has been
+   // read. subclasses can return true to indicate the request is being
+   // retried (e.g. on a new connection if a reused one was stale). note
+   // that once the request has been written the server may have acted on
+   // it, so only idempotent requests should then be retried
+   virtual bool retryRequestIfRequired(const Error& error,
+                                       bool requestWritten)
+   {
+      return false;
+   }
+
+   void handleRequestError(const Error& error, bool requestWritten)
+   {
+      if (!retryRequestIfRequired(error, requestWritten))
+         handleError(error);
+   }
+
+   bool responseComplete() const
+   {
+      return contentLength_ >= 0 &&
+             response_.body().length() >=
+                              static_cast<std::size_t>(contentLength_);
+   }
+
+   void completeResponse(bool connectionReusable)
+   {
+      if (connectionReusable)
+         releaseConnection();
+      else
+         close();
+
+      if (responseHandler_)
+         responseHandler_(response_);
+   }
+
 
    bool retryConnectionIfRequired(const Error& connectionError)
    {
@@ -261,7 +324,7 @@ private:
          }
          else
          {
-            handleErrorCode(ec, ERROR_LOCATION);
+            handleRequestError(Error(ec, ERROR_LOCATION), false);
          }
       }
       CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
@@ -294,7 +357,7 @@ private:
          }
          else
          {
-            handleErrorCode(ec, ERROR_LOCATION);
+            handleRequestError(Error(ec, ERROR_LOCATION), true);
          }
       }
       CATCH_UNEXPECTED_ASYNC_CLIENT_EXCEPTION
@@ -324,8 +387,25 @@ private:
             if (responseBuffer_.size() > 0)
                ResponseParser::appendToBody(&responseBuffer_, &response_);
 
+            // if we asked for the connection to be kept alive and the
+            // server agreed then the response ends after Content-Length
+            // bytes rather than when the connection is closed
+            if (keepConnectionAlive() &&
+                !boost::algorithm::iequals(response_.headerValue("Connection"),
+                                           "close"))
+            {
+               contentLength_ = safe_convert::stringTo<int>(
+                        boost::algorithm::trim_copy(
+                              response_.headerValue("Content-Length")),
+                        -1);
+               keepAlive_ = contentLength_ >= 0;
+            }
+
             // start reading content
-            readSomeContent();
+            if (responseComplete())
+               completeResponse(keepAlive_);
+            else
+               readSomeContent();
          }
          else
          {
@@ -345,14 +425,14 @@ private:
             ResponseParser::appendToBody(&responseBuffer_, &response_);
 
             // continue reading content
-            readSomeContent();
+            if (responseComplete())
+               completeResponse(keepAlive_);
+            else
+               readSomeContent();
          }
          else if (ec == boost::asio::error::eof)
          {
-            close();
-
-            if (responseHandler_)
-               responseHandler_(response_);
+            completeResponse(false);
          }
          else
          {
@@ -385,6 +465,10 @@ private:
    http::Request request_;
    boost::asio::streambuf responseBuffer_;
    http::Response response_;
+
+   // persistent connection state for the current response
+   bool keepAlive_;
+   int contentLength_;
 };
    
 
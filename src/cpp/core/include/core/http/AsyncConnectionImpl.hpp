@@ -14,6 +14,8 @@
 #ifndef CORE_HTTP_ASYNC_CONNECTION_IMPL_HPP
 #define CORE_HTTP_ASYNC_CONNECTION_IMPL_HPP
 
+#include <string>
+
 #include <boost/array.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/function.hpp>
@@ -22,6 +24,10 @@
 #include <boost/asio/write.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/placeholders.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/deadline_timer.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -34,6 +40,14 @@
 
 namespace core {
 namespace http {
+
+// default limits for persistent (keep-alive) connections
+inline boost::posix_time::time_duration defaultKeepAliveTimeout()
+{
+   return boost::posix_time::seconds(60);
+}
+
+const std::size_t kDefaultMaxKeepAliveRequests = 1000;
    
 template <typename ProtocolType>
 class AsyncConnectionImpl :
@@ -51,11 +65,23 @@ public:
 public:
    AsyncConnectionImpl(boost::asio::io_service& ioService,
                        const Handler& handler,
-                       const ResponseFilter& responseFilter =ResponseFilter())
+                       const ResponseFilter& responseFilter =ResponseFilter(),
+                       const boost::posix_time::time_duration& keepAliveTimeout
+                                                   = defaultKeepAliveTimeout(),
+                       std::size_t maxKeepAliveRequests
+                                                   = kDefaultMaxKeepAliveRequests)
       : ioService_(ioService),
+        strand_(ioService),
         socket_(ioService),
         handler_(handler),
-        responseFilter_(responseFilter)
+        responseFilter_(responseFilter),
+        keepAliveTimeout_(keepAliveTimeout),
+        maxKeepAliveRequests_(maxKeepAliveRequests),
+        idleTimer_(ioService),
+        waitingForRequest_(false),
+        requestsHandled_(0),
+        keepAlive_(false),
+        streamOffset_(0)
         
    {
    }
@@ -87,9 +113,18 @@ public:
 
    virtual void writeResponse()
    {
-      // add extra response headers
+      // add extra response headers (note that Connection is a hop-by-hop
+      // header so we always replace any value set by the handler -- e.g.
+      // the one included in a response proxied from another server)
+      keepAlive_ = shouldKeepAlive();
+      streamOffset_ = 0;
       response_.setHeader("Date", util::httpDate());
-      response_.setHeader("Connection", "close");
+      response_.setHeader("Connection", keepAlive_ ? "keep-alive" : "close");
+
+      // the client can only find the end of a response on a persistent
+      // connection using its Content-Length (we always write the whole body)
+      if (keepAlive_ && !response_.containsHeader("Content-Length"))
+         response_.setContentLength(response_.body().length());
 
       // call the response filter if we have one
       if (responseFilter_)
@@ -99,10 +134,10 @@ public:
       boost::asio::async_write(
           socket_,
           response_.toBuffers(),
-          boost::bind(
+          strand_.wrap(boost::bind(
                &AsyncConnectionImpl<ProtocolType>::handleWrite,
                AsyncConnectionImpl<ProtocolType>::shared_from_this(),
-               boost::asio::placeholders::error)
+               boost::asio::placeholders::error))
       );
    }
 
@@ -119,7 +154,69 @@ public:
    }
    
 private:
-   
+
+   bool shouldKeepAlive() const
+   {
+      if (maxKeepAliveRequests_ == 0 ||
+          requestsHandled_ >= maxKeepAliveRequests_)
+      {
+         return false;
+      }
+
+      // bad requests leave the stream in an unknown state
+      if (response_.statusCode() == http::status::BadRequest)
+         return false;
+
+      // we can't find the end of chunked request bodies
+      if (request_.containsHeader("Transfer-Encoding"))
+         return false;
+
+      // HTTP/1.1 is persistent by default, HTTP/1.0 only if requested
+      std::string connection = request_.headerValue("Connection");
+      if (request_.isHttp10())
+         return boost::algorithm::iequals(connection, "keep-alive");
+      else if (request_.httpVersionMajor() == 1)
+         return !boost::algorithm::iequals(connection, "close");
+      else
+         return false;
+   }
+
+   // parse input for the current request. returns true if more input
+   // is required (input after the end of a complete request is saved
+   // as the start of the next pipelined request)
+   bool processInput(const char* begin, const char* end)
+   {
+      const char* consumed = begin;
+      RequestParser::status status = requestParser_.parse(request_,
+                                                          begin,
+                                                          end,
+                                                          &consumed);
+
+      // error - return bad request
+      if (status == RequestParser::error)
+      {
+         response_.setStatusCode(http::status::BadRequest);
+         writeResponse();
+         return false;
+      }
+
+      // incomplete -- keep reading
+      else if (status == RequestParser::incomplete)
+      {
+         return true;
+      }
+
+      // got valid request -- handle it
+      else
+      {
+         pipelined_.assign(consumed, end);
+         requestsHandled_++;
+         handler_(AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+                  &request_);
+         return false;
+      }
+   }
+
    void handleRead(const boost::system::error_code& e,
                    std::size_t bytesTransferred)
    {
@@ -127,43 +224,31 @@ private:
       {
          if (!e)
          {
-            // parse next chunk
-            RequestParser::status status = requestParser_.parse(
-                                             request_,
-                                             buffer_.data(), 
-                                             buffer_.data() + bytesTransferred);
-            
-            // error - return bad request
-            if (status == RequestParser::error)
+            // the next request has started so it's no longer idle
+            if (waitingForRequest_)
             {
-               response_.setStatusCode(http::status::BadRequest);
-               writeResponse();
+               waitingForRequest_ = false;
+               boost::system::error_code ec;
+               idleTimer_.cancel(ec);
             }
-            
-            // incomplete -- keep reading
-            else if (status == RequestParser::incomplete)
-            {
+
+            // parse next chunk
+            if (processInput(buffer_.data(), buffer_.data() + bytesTransferred))
                readSome();
-            }
-            
-            // got valid request -- handle it 
-            else
-            {
-               handler_(AsyncConnectionImpl<ProtocolType>::shared_from_this(),
-                        &request_);
-            }
          }
          else // error reading
          {
-            // log the error if it wasn't connection terminated
+            // log the error if it wasn't connection terminated (or the
+            // socket being closed by the idle timer)
             Error error(e, ERROR_LOCATION);
-            if (!isConnectionTerminatedError(error))
+            if (!isConnectionTerminatedError(error) &&
+                e != boost::asio::error::operation_aborted)
+            {
                LOG_ERROR(error);
+            }
             
             // close the socket
-            error = closeSocket(socket_);
-            if (error)
-               LOG_ERROR(error);
+            close();
             
             //
             // no more async operations are initiated here so the shared_ptr to 
@@ -186,11 +271,21 @@ private:
             if (!http::isConnectionTerminatedError(error))
                LOG_ERROR(error);
          }
+         else if (response_.streamFile() &&
+                  streamOffset_ < response_.streamFile()->size())
+         {
+            // headers (or the previous part of the body) have been written
+            writeStreamFile();
+            return;
+         }
+         else if (keepAlive_)
+         {
+            readNextRequest();
+            return;
+         }
          
          // close the socket
-         Error error = closeSocket(socket_);
-         if (error)
-            LOG_ERROR(error);
+         close();
          
          //
          // no more async operations are initiated here so the shared_ptr to 
@@ -199,21 +294,105 @@ private:
       }
       CATCH_UNEXPECTED_EXCEPTION
    }
+
+   void writeStreamFile()
+   {
+      // write directly from the file to the socket (which asio has already
+      // put into non-blocking mode for the async write of the headers)
+      Error error = response_.streamFile()->writeSome(socket_.native(),
+                                                      &streamOffset_);
+      if (error &&
+          error.code() != boost::system::errc::operation_would_block)
+      {
+         handleWrite(error.code());
+         return;
+      }
+
+      // wait until the socket can accept more (this also keeps a large file
+      // from monopolizing the thread)
+      socket_.async_write_some(
+          boost::asio::null_buffers(),
+          strand_.wrap(boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleWrite,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error))
+      );
+   }
+
+   void readNextRequest()
+   {
+      // reset state for the next request on this connection
+      requestParser_.reset();
+      request_.reset();
+      response_.reset();
+      keepAlive_ = false;
+
+      // process pipelined input (which may complete the next request)
+      bool haveInput = !pipelined_.empty();
+      if (haveInput)
+      {
+         std::string input;
+         input.swap(pipelined_);
+         if (!processInput(input.data(), input.data() + input.size()))
+            return;
+      }
+
+      // wait for the next request (closing the connection if it is idle
+      // for too long before it starts)
+      if (!haveInput)
+      {
+         waitingForRequest_ = true;
+         idleTimer_.expires_from_now(keepAliveTimeout_);
+         idleTimer_.async_wait(strand_.wrap(boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleIdleTimeout,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error)));
+      }
+      readSome();
+   }
+
+   void handleIdleTimeout(const boost::system::error_code& e)
+   {
+      try
+      {
+         // ignore cancellations and stale expirations
+         if (e == boost::asio::error::operation_aborted ||
+             !waitingForRequest_ ||
+             idleTimer_.expires_at() >
+                  boost::asio::deadline_timer::traits_type::now())
+         {
+            return;
+         }
+
+         // closing the socket aborts the pending read
+         waitingForRequest_ = false;
+         close();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   void close()
+   {
+      Error error = closeSocket(socket_);
+      if (error)
+         LOG_ERROR(error);
+   }
    
    void readSome()
    {
       socket_.async_read_some(
          boost::asio::buffer(buffer_),
-         boost::bind(
+         strand_.wrap(boost::bind(
                &AsyncConnectionImpl<ProtocolType>::handleRead,
                AsyncConnectionImpl<ProtocolType>::shared_from_this(),
                boost::asio::placeholders::error,
-               boost::asio::placeholders::bytes_transferred)
+               boost::asio::placeholders::bytes_transferred))
       );
    }
 
 private:
    boost::asio::io_service& ioService_;
+   boost::asio::io_service::strand strand_;
    typename ProtocolType::socket socket_;
    Handler handler_;
    ResponseFilter responseFilter_;
@@ -221,6 +400,18 @@ private:
    RequestParser requestParser_ ;
    http::Request request_;
    http::Response response_;
+
+   // persistent connection state
+   const boost::posix_time::time_duration keepAliveTimeout_;
+   const std::size_t maxKeepAliveRequests_;
+   boost::asio::deadline_timer idleTimer_;
+   bool waitingForRequest_;
+   std::size_t requestsHandled_;
+   bool keepAlive_;
+   std::string pipelined_;
+
+   // position within the response's stream file (if it has one)
+   boost::uintmax_t streamOffset_;
 };
    
 
@@ -50,7 +50,9 @@ public:
                const std::string& baseUri = std::string())
       : abortOnResourceError_(false),
         serverName_(serverName),
-        baseUri_(baseUri)
+        baseUri_(baseUri),
+        keepAliveTimeout_(defaultKeepAliveTimeout()),
+        maxKeepAliveRequests_(kDefaultMaxKeepAliveRequests)
    {
    }
    
@@ -62,6 +64,19 @@ public:
    {
       abortOnResourceError_ = abortOnResourceError;
    }
+
+   // how long a persistent connection can be idle between requests
+   void setKeepAliveTimeout(
+                  const boost::posix_time::time_duration& keepAliveTimeout)
+   {
+      keepAliveTimeout_ = keepAliveTimeout;
+   }
+
+   // max requests served over a single connection (0 disables keep-alive)
+   void setMaxKeepAliveRequests(std::size_t maxKeepAliveRequests)
+   {
+      maxKeepAliveRequests_ = maxKeepAliveRequests;
+   }
    
    void addHandler(const std::string& prefix,
                    const AsyncUriHandlerFunction& handler)
@@ -172,7 +187,11 @@ private:
 
          // response filter
          boost::bind(&AsyncServer<ProtocolType>::connectionResponseFilter,
-                     this, _1)
+                     this, _1),
+
+         // persistent connection limits
+         keepAliveTimeout_,
+         maxKeepAliveRequests_
       ));
       
       // wait for next connection
@@ -336,6 +355,8 @@ private:
    bool abortOnResourceError_;
    std::string serverName_;
    std::string baseUri_;
+   boost::posix_time::time_duration keepAliveTimeout_;
+   std::size_t maxKeepAliveRequests_;
    boost::shared_ptr<AsyncConnectionImpl<ProtocolType> > ptrNextConnection_;
    AsyncUriHandlers uriHandlers_ ;
    AsyncUriHandlerFunction defaultHandler_;
@@ -23,6 +23,7 @@
 
 #include <core/http/AsyncClient.hpp>
 #include <core/http/LocalStreamSocketUtils.hpp>
+#include <core/http/LocalStreamConnectionPool.hpp>
 
 namespace core {
 namespace http {  
@@ -31,11 +32,18 @@ class LocalStreamAsyncClient
    : public AsyncClient<boost::asio::local::stream_protocol::socket>
 {
 public:
+   // if a connection pool is provided then idle connections to the stream
+   // are reused and connections are returned to the pool after use
    LocalStreamAsyncClient(boost::asio::io_service& ioService,
-                          const FilePath localStreamPath)
+                          const FilePath localStreamPath,
+                          boost::shared_ptr<LocalStreamConnectionPool>
+                             ptrConnectionPool =
+                                boost::shared_ptr<LocalStreamConnectionPool>())
      : AsyncClient<boost::asio::local::stream_protocol::socket>(ioService),
-       socket_(ioService),
-       localStreamPath_(localStreamPath)
+       ptrSocket_(new boost::asio::local::stream_protocol::socket(ioService)),
+       localStreamPath_(localStreamPath),
+       ptrConnectionPool_(ptrConnectionPool),
+       reusedConnection_(false)
    {
    }
 
@@ -43,13 +51,28 @@ protected:
 
    virtual boost::asio::local::stream_protocol::socket& socket()
    {
-      return socket_;
+      return *ptrSocket_;
    }
 
 private:
 
    virtual void connectAndWriteRequest()
    {
+      // use an idle connection if we have one
+      if (ptrConnectionPool_)
+      {
+         boost::shared_ptr<boost::asio::local::stream_protocol::socket>
+                  ptrSocket = ptrConnectionPool_->acquire(localStreamPath_);
+         if (ptrSocket)
+         {
+            ptrSocket_ = ptrSocket;
+            reusedConnection_ = true;
+            writeRequest();
+            return;
+         }
+      }
+      reusedConnection_ = false;
+
       // establish endpoint
       using boost::asio::local::stream_protocol;
       stream_protocol::endpoint endpoint(localStreamPath_.absolutePath());
@@ -80,6 +103,41 @@ private:
    }
 
 
+   virtual bool keepConnectionAlive()
+   {
+      return ptrConnectionPool_.get() != NULL;
+   }
+
+   virtual void releaseConnection()
+   {
+      ptrConnectionPool_->release(localStreamPath_, ptrSocket_);
+      ptrSocket_.reset(
+            new boost::asio::local::stream_protocol::socket(ioService()));
+   }
+
+   virtual bool retryRequestIfRequired(const Error& error,
+                                       bool requestWritten)
+   {
+      // the server may have closed a reused connection after we took it
+      // from the pool, in which case we retry on a new connection. if the
+      // request was fully written we can't tell whether the server saw it
+      // so only retry requests which are safe to repeat
+      if (reusedConnection_ &&
+          isConnectionTerminatedError(error) &&
+          (!requestWritten || requestIsIdempotent()))
+      {
+         close();
+         ptrSocket_.reset(
+               new boost::asio::local::stream_protocol::socket(ioService()));
+         connectAndWriteRequest();
+         return true;
+      }
+      else
+      {
+         return false;
+      }
+   }
+
    const boost::shared_ptr<LocalStreamAsyncClient> sharedFromThis()
    {
       boost::shared_ptr<AsyncClient<boost::asio::local::stream_protocol::socket> >
@@ -89,8 +147,10 @@ private:
    }
 
 private:
-   boost::asio::local::stream_protocol::socket socket_;
+   boost::shared_ptr<boost::asio::local::stream_protocol::socket> ptrSocket_;
    core::FilePath localStreamPath_;
+   boost::shared_ptr<LocalStreamConnectionPool> ptrConnectionPool_;
+   bool reusedConnection_;
 };
    
    
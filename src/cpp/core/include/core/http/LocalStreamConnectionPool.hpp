@@ -0,0 +1,119 @@
+/*
+ * LocalStreamConnectionPool.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
+#define CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <boost/asio/local/stream_protocol.hpp>
+
+#include <core/FilePath.hpp>
+
+namespace core {
+namespace http {
+
+struct LocalStreamConnectionPoolStats
+{
+   LocalStreamConnectionPoolStats()
+      : reused(0), released(0), evicted(0)
+   {
+   }
+
+   // connections handed out by acquire
+   std::size_t reused;
+
+   // connections returned by release
+   std::size_t released;
+
+   // idle connections closed because they were stale, expired,
+   // over the limit or explicitly evicted
+   std::size_t evicted;
+};
+
+// Pool of idle keep-alive connections to local stream servers, keyed by
+// stream path. Connections are health checked before being handed out
+// and are closed once they have been idle for longer than the timeout.
+// All methods are thread safe.
+class LocalStreamConnectionPool : boost::noncopyable
+{
+public:
+   typedef boost::asio::local::stream_protocol::socket Socket;
+
+   LocalStreamConnectionPool(std::size_t maxIdlePerStream,
+                             const boost::posix_time::time_duration& idleTimeout);
+
+   virtual ~LocalStreamConnectionPool();
+
+   // take an idle connection to the stream (returns an empty pointer
+   // if there are no healthy idle connections)
+   boost::shared_ptr<Socket> acquire(const FilePath& streamPath);
+
+   // return a connection for reuse (the response to its last request
+   // must have been completely read)
+   void release(const FilePath& streamPath,
+                const boost::shared_ptr<Socket>& ptrSocket);
+
+   // close all idle connections to the stream (e.g. when the process
+   // serving it exits)
+   void evict(const FilePath& streamPath);
+
+   // close connections which have been idle for longer than the timeout
+   void evictExpired();
+
+   LocalStreamConnectionPoolStats stats();
+
+private:
+   struct IdleConnection
+   {
+      IdleConnection(const boost::shared_ptr<Socket>& ptrSocket,
+                     const boost::posix_time::ptime& idleSince)
+         : ptrSocket(ptrSocket), idleSince(idleSince)
+      {
+      }
+
+      boost::shared_ptr<Socket> ptrSocket;
+      boost::posix_time::ptime idleSince;
+   };
+   typedef std::vector<IdleConnection> IdleConnections;
+
+   void removeExpired(const boost::posix_time::ptime& now,
+                      IdleConnections* pConnections,
+                      std::vector<boost::shared_ptr<Socket> >* pEvicted);
+
+   void sweepExpired(const boost::posix_time::ptime& now,
+                     std::vector<boost::shared_ptr<Socket> >* pEvicted);
+
+   void close(const std::vector<boost::shared_ptr<Socket> >& sockets);
+
+private:
+   const std::size_t maxIdlePerStream_;
+   const boost::posix_time::time_duration idleTimeout_;
+
+   boost::mutex mutex_;
+   std::map<std::string,IdleConnections> idleConnections_;
+   boost::posix_time::ptime lastSweep_;
+   LocalStreamConnectionPoolStats stats_;
+};
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_LOCAL_STREAM_CONNECTION_POOL_HPP
@@ -41,6 +41,27 @@ public:
   template <typename InputIterator>
   status parse(Request& req, InputIterator begin, InputIterator end)
   {
+    return parse(req, begin, end, &begin);
+  }
+
+  // parse and also return the position after the last character consumed
+  // (for a complete request this is the start of any pipelined request)
+  template <typename InputIterator>
+  status parse(Request& req,
+               InputIterator begin,
+               InputIterator end,
+               InputIterator* pConsumed)
+  {
+    status result = parseInput(req, &begin, end);
+    *pConsumed = begin;
+    return result;
+  }
+
+private:
+  template <typename InputIterator>
+  status parseInput(Request& req, InputIterator* pBegin, InputIterator end)
+  {
+    InputIterator& begin = *pBegin;
     while (begin != end)
     {
        // header parsing
@@ -76,7 +97,6 @@ public:
     return incomplete ;
   }
 
-private:
   /// Handle the next character of input.
   status consume(Request& req, char input);
 
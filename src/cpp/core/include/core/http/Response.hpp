@@ -30,6 +30,7 @@
 
 #include "Message.hpp"
 #include "Request.hpp"
+#include "StreamFile.hpp"
 #include "Util.hpp"
 
 namespace core {
@@ -88,6 +89,7 @@ public:
       statusCode_ = response.statusCode_;
       statusCodeStr_ = response.statusCodeStr_;
       statusMessage_ = response.statusMessage_;
+      ptrStreamFile_ = response.ptrStreamFile_;
    }
 
 public:   
@@ -190,6 +192,7 @@ public:
          
          // set body 
          body_ = bodyStream.str();
+         ptrStreamFile_.reset();
          setContentLength(body_.length());
          
          // return success
@@ -236,6 +239,17 @@ public:
       }
    }
 
+   // set the body to be written directly from the file when the response
+   // is sent (rather than reading it into memory). no filtering or content
+   // encoding is applied (on Win32 the file is read into the body)
+   Error setStreamFile(const FilePath& filePath);
+
+   // file to write after the headers (empty unless setStreamFile was called)
+   const boost::shared_ptr<StreamFile>& streamFile() const
+   {
+      return ptrStreamFile_;
+   }
+
    void setDynamicHtml(const std::string& html, const Request& request);
    
    void setFile(const FilePath& filePath, const Request& request)
@@ -259,12 +273,24 @@ public:
       // set content type
       setContentType(filePath.mimeContentType());
       
-      // gzip if possible
-      if (request.acceptsEncoding(kGzipEncoding))
-         setContentEncoding(kGzipEncoding);
-      
-      // set body from file
-      Error error = setBody(filePath, filter);
+      // files which don't need to be filtered or compressed are streamed
+      // from disk when the response is written
+      bool gzip = request.acceptsEncoding(kGzipEncoding) &&
+                  isCompressibleContentType(contentType());
+      Error error;
+      if (boost::is_same<Filter, NullOutputFilter>::value && !gzip)
+      {
+         error = setStreamFile(filePath);
+      }
+      else
+      {
+         // gzip if possible
+         if (gzip)
+            setContentEncoding(kGzipEncoding);
+
+         // set body from file
+         error = setBody(filePath, filter);
+      }
       if (error)
          setError(status::InternalServerError, error.code().message());
    }
@@ -311,7 +337,9 @@ public:
    
    void setMovedPermanently(const http::Request& request, const std::string& location);
    void setMovedTemporarily(const http::Request& request, const std::string& location);
-   
+
+   // whether content of this type benefits from gzip encoding
+   static bool isCompressibleContentType(const std::string& contentType);
    
 private:
    virtual void appendFirstLineBuffers(
@@ -336,6 +364,9 @@ private:
 
    // string storage for integer members (need for toBuffers)
    mutable std::string statusCodeStr_ ;
+
+   // file written after the headers (see setStreamFile)
+   boost::shared_ptr<StreamFile> ptrStreamFile_;
 };
 
 std::ostream& operator << (std::ostream& stream, const Response& r) ;
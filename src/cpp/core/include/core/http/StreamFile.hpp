@@ -0,0 +1,62 @@
+/*
+ * StreamFile.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_STREAM_FILE_HPP
+#define CORE_HTTP_STREAM_FILE_HPP
+
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace http {
+
+// A file which is written directly from its descriptor to a socket when
+// a response is sent (rather than being read into the response body).
+// The file is opened up front so it can be removed once the response has
+// been set. Not available on Win32.
+class StreamFile : boost::noncopyable
+{
+public:
+   static Error open(const FilePath& filePath,
+                     boost::shared_ptr<StreamFile>* pStreamFile);
+
+   virtual ~StreamFile();
+
+   boost::uintmax_t size() const { return size_; }
+
+   // write as much of the file from *pOffset onwards as the (non-blocking)
+   // socket will accept, advancing the offset. returns would_block if the
+   // socket can't currently accept any more data
+   Error writeSome(int socket, boost::uintmax_t* pOffset) const;
+
+   // write the file from offset onwards, waiting for the socket to become
+   // writable whenever it is full
+   Error writeAll(int socket, boost::uintmax_t offset) const;
+
+private:
+   StreamFile(int fd, boost::uintmax_t size) : fd_(fd), size_(size) {}
+
+private:
+   int fd_;
+   boost::uintmax_t size_;
+};
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_STREAM_FILE_HPP
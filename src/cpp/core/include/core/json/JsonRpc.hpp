@@ -775,8 +775,13 @@ public:
 
    json::Value& result()
    {
+      parseRawResult();
       return response_[kRpcResult];
    }
+
+   // set the result from already serialized json (lets large results be
+   // written without building an equivalent json::Value)
+   void setRawResult(const std::string& result);
    
    void setError(const core::Error& error);
 
@@ -788,6 +793,8 @@ public:
 
    void setField(const std::string& name, const json::Value& value) 
    { 
+      if (name == kRpcResult)
+         rawResult_.clear();
       response_[name] = value;
    }             
                 
@@ -801,6 +808,7 @@ public:
    void setResponse(const json::Object& response)
    {
       response_ = response;
+      rawResult_.clear();
    }
    
    // specify a function to run after the response
@@ -818,8 +826,12 @@ public:
    
    void write(std::ostream& os) const;
    
+private:
+   void parseRawResult();
+
 private:
    json::Object response_;
+   std::string rawResult_;
    boost::function<void()> afterResponse_ ;
    bool suppressDetectChanges_;
 };
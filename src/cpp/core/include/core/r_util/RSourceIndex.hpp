@@ -181,8 +181,18 @@ public:
    RSourceIndex(const std::string& context,
                 const std::string& code);
 
+   // Construct from previously computed items (used when restoring an
+   // index which was persisted to disk)
+   RSourceIndex(const std::string& context,
+                const std::vector<RSourceItem>& items)
+      : context_(context), items_(items)
+   {
+   }
+
    const std::string& context() const { return context_; }
 
+   const std::vector<RSourceItem>& items() const { return items_; }
+
    template <typename OutputIterator>
    OutputIterator search(
                   const std::string& newContext,
@@ -0,0 +1,141 @@
+/*
+ * RSourceNameIndex.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_SOURCE_NAME_INDEX_HPP
+#define CORE_R_UTIL_R_SOURCE_NAME_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <core/r_util/RSourceIndex.hpp>
+
+namespace core {
+namespace r_util {
+
+// Global index of item names across a set of RSourceIndex objects. Names
+// are kept in a sorted, case-folded array (for prefix queries) along with
+// a trigram postings list (for substring queries) so that searches over
+// large numbers of items don't need to visit every item of every index.
+//
+// Additions are buffered and merged into the sorted array on the next
+// search; removals are recorded as tombstones and compacted away once
+// they outnumber the live items.
+class RSourceNameIndex : boost::noncopyable
+{
+public:
+   RSourceNameIndex()
+      : liveItems_(0), deadItems_(0)
+   {
+   }
+
+   // add an index (replaces any existing index with the same context)
+   void add(const boost::shared_ptr<RSourceIndex>& pIndex);
+
+   // remove the index with the specified context
+   void remove(const std::string& context);
+
+   void clear();
+
+   // case-insensitive search for items whose name starts with (or if
+   // prefixOnly is false, contains) term. wildcard ('*') terms are
+   // supported. results are appended to pItems in name order and the
+   // search stops as soon as pItems contains maxResults items.
+   void search(const std::string& term,
+               bool prefixOnly,
+               const std::set<std::string>& excludeContexts,
+               std::size_t maxResults,
+               std::vector<RSourceItem>* pItems);
+
+private:
+   struct ItemRef
+   {
+      ItemRef(boost::uint32_t fileId, boost::uint32_t itemIndex)
+         : fileId(fileId), itemIndex(itemIndex)
+      {
+      }
+
+      boost::uint32_t fileId;
+      boost::uint32_t itemIndex;
+   };
+
+   struct NameEntry
+   {
+      NameEntry(const std::string& name, const ItemRef& ref)
+         : name(name), ref(ref)
+      {
+      }
+
+      std::string name;
+      ItemRef ref;
+
+      bool operator < (const NameEntry& other) const
+      {
+         return name < other.name;
+      }
+   };
+
+   typedef std::map<boost::uint32_t, std::vector<ItemRef> > Postings;
+
+private:
+   void addEntries(boost::uint32_t fileId, const RSourceIndex& index);
+   void mergePending();
+   void compact();
+
+   bool isLive(const ItemRef& ref,
+               const std::set<boost::uint32_t>& excludeIds) const;
+   const RSourceItem& item(const ItemRef& ref) const;
+   RSourceItem resultItem(const ItemRef& ref) const;
+
+   void searchPrefix(const std::string& term,
+                     const std::set<boost::uint32_t>& excludeIds,
+                     std::size_t maxResults,
+                     std::vector<RSourceItem>* pItems);
+
+   void searchContains(const std::string& term,
+                       const std::set<boost::uint32_t>& excludeIds,
+                       std::size_t maxResults,
+                       std::vector<RSourceItem>* pItems);
+
+   void searchWildcard(const std::string& term,
+                       bool prefixOnly,
+                       const std::set<boost::uint32_t>& excludeIds,
+                       std::size_t maxResults,
+                       std::vector<RSourceItem>* pItems);
+
+private:
+   // indexes by file id (null entries are tombstones)
+   std::vector<boost::shared_ptr<RSourceIndex> > files_;
+   std::map<std::string, boost::uint32_t> fileIds_;
+
+   // sorted case-folded names and additions not yet merged
+   std::vector<NameEntry> names_;
+   std::vector<NameEntry> pendingNames_;
+
+   // trigram (of case-folded name) to items containing it
+   Postings trigrams_;
+
+   std::size_t liveItems_;
+   std::size_t deadItems_;
+};
+
+} // namespace r_util
+} // namespace core
+
+
+#endif // CORE_R_UTIL_R_SOURCE_NAME_INDEX_HPP
@@ -16,6 +16,7 @@
 
 #include <string>
 #include <deque>
+#include <vector>
 #include <algorithm>
 
 #include <boost/utility.hpp>
@@ -211,6 +212,148 @@ private:
 };
 
 
+// RUtf8Token. Token within a UTF-8 encoded buffer identified by its byte
+// offset and length. Like RToken, instances are only valid as long as the
+// buffer which was tokenized is alive (no copy of the content is made).
+class RUtf8Token
+{
+public:
+   RUtf8Token()
+      : type_(0), pData_(NULL), offset_(-1), length_(0)
+   {
+   }
+
+   RUtf8Token(wchar_t type,
+              const char* pData,
+              std::size_t offset,
+              std::size_t length)
+      : type_(type), pData_(pData), offset_(offset), length_(length)
+   {
+   }
+
+   // COPYING: via compiler (copyable members)
+
+   // accessors (offset and length are in bytes)
+   wchar_t type() const { return type_; }
+   std::string content() const { return std::string(begin(), end()); }
+   std::size_t offset() const { return offset_; }
+   std::size_t length() const { return length_; }
+   const char* begin() const { return pData_ + offset_; }
+   const char* end() const { return pData_ + offset_ + length_; }
+
+   // efficient comparison operations
+   bool contentEquals(const std::string& text) const
+   {
+      return length_ == text.size() && std::equal(begin(), end(), text.begin());
+   }
+
+   bool contentStartsWith(const std::string& text) const
+   {
+      return length_ >= text.size() &&
+             std::equal(text.begin(), text.end(), begin());
+   }
+
+   bool isOperator(const std::string& op) const
+   {
+      return (type_ == RToken::OPER) && contentEquals(op);
+   }
+
+   bool isType(wchar_t type) const
+   {
+      return type_ == type;
+   }
+
+   // allow direct use in conditional statements (nullability)
+   typedef void (*unspecified_bool_type)();
+   static void unspecified_bool_true() {}
+   operator unspecified_bool_type() const
+   {
+      return offset_ == static_cast<std::size_t>(-1) ?
+                                             0 :
+                                             unspecified_bool_true;
+   }
+   bool operator!() const
+   {
+      return offset_ == static_cast<std::size_t>(-1);
+   }
+
+private:
+   wchar_t type_;
+   const char* pData_;
+   std::size_t offset_;
+   std::size_t length_;
+};
+
+// Tokenize UTF-8 encoded R code in place. Yields the same token types as
+// RTokenizer without widening the input or allocating per token. Note that
+// the data passed to the tokenizer is NOT copied so must outlive both the
+// tokenizer and the RUtf8Token instances it yields.
+class RUtf8Tokenizer : boost::noncopyable
+{
+public:
+   explicit RUtf8Tokenizer(const std::string& data)
+      : begin_(data.data()),
+        end_(data.data() + data.size()),
+        pos_(begin_)
+   {
+   }
+
+   RUtf8Tokenizer(const char* begin, const char* end)
+      : begin_(begin), end_(end), pos_(begin)
+   {
+   }
+
+   virtual ~RUtf8Tokenizer() {}
+
+   // COPYING: boost::noncopyable
+
+   RUtf8Token nextToken();
+
+private:
+   RUtf8Token matchWhitespace();
+   RUtf8Token matchStringLiteral();
+   RUtf8Token matchNumber();
+   RUtf8Token matchIdentifier();
+   RUtf8Token matchQuotedIdentifier();
+   RUtf8Token matchComment();
+   RUtf8Token matchUserOperator();
+   RUtf8Token matchOperator();
+   bool eol() const;
+   char peek(std::size_t lookahead = 0) const;
+   wchar_t peekChar(std::size_t* pLength) const;
+   std::size_t whitespaceLength(const char* pos) const;
+   RUtf8Token consumeToken(wchar_t tokenType, std::size_t length);
+
+private:
+   const char* begin_;
+   const char* end_;
+   const char* pos_;
+};
+
+// Set of RUtf8Tokens (see RTokens for a description of flags)
+class RUtf8Tokens : public std::vector<RUtf8Token>, boost::noncopyable
+{
+public:
+   explicit RUtf8Tokens(const std::string& code, int flags = RTokens::None)
+   {
+      RUtf8Tokenizer tokenizer(code);
+      RUtf8Token token;
+      while (token = tokenizer.nextToken())
+      {
+         if ((flags & RTokens::StripWhitespace) &&
+             token.type() == RToken::WHITESPACE)
+            continue;
+
+         if ((flags & RTokens::StripComments) &&
+             token.type() == RToken::COMMENT)
+            continue;
+
+         push_back(token);
+      }
+   }
+};
+
+
 } // namespace r_util
 } // namespace core 
 
@@ -34,6 +34,10 @@ class SpellChecker : boost::noncopyable
 public:
    virtual ~SpellChecker() {}
    virtual Error checkSpelling(const std::string& word, bool *pCorrect) = 0;
+   // check a batch of words at once (words which can't be checked are
+   // reported as correct)
+   virtual Error checkSpelling(const std::vector<std::string>& words,
+                               std::vector<bool>* pCorrect) = 0;
    virtual Error suggestionList(const std::string& word,
                                 std::vector<std::string>* pSugs) = 0;
    virtual Error analyzeWord(const std::string& word,
@@ -0,0 +1,110 @@
+/*
+ * FileChangeCoalescer.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_SYSTEM_FILE_CHANGE_COALESCER_HPP
+#define CORE_SYSTEM_FILE_CHANGE_COALESCER_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/system/FileChangeEvent.hpp>
+
+namespace core {
+namespace system {
+
+struct FileChangeCoalescerStats
+{
+   FileChangeCoalescerStats()
+      : rawEvents(0), deliveredEvents(0), storms(0)
+   {
+   }
+
+   // events passed to the coalescer
+   std::size_t rawEvents;
+
+   // events returned from the coalescer
+   std::size_t deliveredEvents;
+
+   // batches which exceeded the storm threshold
+   std::size_t storms;
+
+   // events which were collapsed
+   std::size_t absorbedEvents() const { return rawEvents - deliveredEvents; }
+
+   FileChangeCoalescerStats& operator+=(const FileChangeCoalescerStats& other)
+   {
+      rawEvents += other.rawEvents;
+      deliveredEvents += other.deliveredEvents;
+      storms += other.storms;
+      return *this;
+   }
+};
+
+// Batches file change events and collapses sequences of events for the
+// same path (e.g. add then modify becomes add, add then remove cancels
+// out). A batch is ready once no events have arrived for the quiet
+// period or the batch is older than the max delay. If a batch exceeds
+// the storm threshold it is held until things are quiet and then
+// delivered as a single batch (which the caller can follow with a
+// rescan, since events are more likely to be missed during a storm).
+class FileChangeCoalescer : boost::noncopyable
+{
+public:
+   FileChangeCoalescer(const boost::posix_time::time_duration& quietPeriod,
+                       const boost::posix_time::time_duration& maxDelay,
+                       std::size_t stormThreshold);
+
+   // add raw events to the current batch
+   void add(const std::vector<FileChangeEvent>& events);
+
+   // are there events in the current batch
+   bool hasPending() const { return batchEvents_ > 0; }
+
+   // is the current batch ready to be taken
+   bool ready() const;
+
+   // take the current batch (whether or not it is ready). returns true
+   // if the batch was a storm
+   bool take(std::vector<FileChangeEvent>* pEvents);
+
+   const FileChangeCoalescerStats& stats() const { return stats_; }
+
+private:
+   void append(const FileChangeEvent& event);
+   void reset();
+
+private:
+   const boost::posix_time::time_duration quietPeriod_;
+   const boost::posix_time::time_duration maxDelay_;
+   const std::size_t stormThreshold_;
+
+   // coalesced events in the order their paths were first seen (events
+   // which cancelled out have type None) and the latest index for each path
+   std::vector<FileChangeEvent> events_;
+   boost::unordered_map<std::string, std::size_t> pathIndex_;
+
+   std::size_t batchEvents_;
+   boost::posix_time::ptime batchStarted_;
+   boost::posix_time::ptime lastEvent_;
+
+   FileChangeCoalescerStats stats_;
+};
+
+} // namespace system
+} // namespace core
+
+#endif // CORE_SYSTEM_FILE_CHANGE_COALESCER_HPP
@@ -25,6 +25,7 @@
 
 #include <core/system/System.hpp>
 #include <core/system/FileChangeEvent.hpp>
+#include <core/system/FileChangeCoalescer.hpp>
 
 // cross-platform recursive file monitoring service. note that the
 // implementation specifically avoids following soft-links. only directories
@@ -93,7 +94,11 @@ struct Callbacks
    // monitor is automatically unregistered if a monitoring error occurs)
    boost::function<void(const core::Error&)> onMonitoringError;
 
-   // callback which occurs when files change
+   // callback which occurs when files change. events are batched and
+   // coalesced (so e.g. a file which is added and then removed between
+   // calls won't generate any events). when a very large number of files
+   // change at once (e.g. a git checkout) the monitored directory is also
+   // rescanned and any changes missed are delivered here as well
    boost::function<void(const std::vector<FileChangeEvent>&)> onFilesChanged;
 
    // callback which occurs when the monitor is fully unregistered. note that
@@ -126,10 +131,14 @@ void unregisterMonitor(Handle handle);
 
 
 // check for changes (will cause onRegistered, onRegistrationError,
-// onMonitoringError, onFilesChanged, and onUnregistered calls to occur
-// on the same thread that calls checkForChanges)
+// onMonitoringError, onFilesChanged, and onUnregistered
+// calls to occur on the same thread that calls checkForChanges)
 void checkForChanges();
 
+// counters for the coalescing of file change events across all monitors
+// (must be called on the same thread as checkForChanges)
+FileChangeCoalescerStats coalescingStats();
+
 
 
 // convenience functions for creating filters that are useful in
@@ -298,11 +298,19 @@ public:
             const boost::function<void(const ProcessResult&)>& onCompleted);
 
 
+   // Set a function to be called when a child has output or has exited so
+   // that poll can be called right away rather than at the next polling
+   // interval. The function is called on a background thread and only
+   // applies to children started after it is set (it is currently never
+   // called on Windows or OS X)
+   void setActivityHandler(const boost::function<void()>& onActivity);
+
    // Check whether any children are currently active
    bool hasRunningChildren();
 
    // Poll for child (output and exit) events. returns true if there
-   // are still children being supervised after the poll
+   // are still children being supervised after the poll. On linux the
+   // output of children is only read once they have had some activity
    bool poll();
 
    // Terminate all running children
@@ -13,14 +13,18 @@
 
 #include <core/json/Json.hpp>
 
+#include <algorithm>
+#include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <clocale>
 #include <sstream>
 
+#include <boost/cstdint.hpp>
 #include <boost/format.hpp>
 #include <boost/scoped_array.hpp>
 
 #include <core/Log.hpp>
-#include <core/Thread.hpp>
 
 #include "spirit/json_spirit.h"
 
@@ -40,29 +44,571 @@ json::Value toJsonString(const std::string& val)
    return json::Value(val);
 }
 
+namespace {
+
+// Recursive descent json parser. This replaces json_spirit's reader, which
+// (being built on boost spirit) had to be protected by a global mutex and
+// built values through a stack of semantic actions. The parser keeps all
+// of its state on the stack so any number of threads can parse at once,
+// and it parses each value in place within its parent object or array
+// rather than building it separately and copying it in.
+class Parser
+{
+public:
+   Parser(const char* pBegin, const char* pEnd)
+      : pPos_(pBegin), pEnd_(pEnd), depth_(0)
+   {
+   }
+
+   bool parse(Value* pValue)
+   {
+      skipWhitespace();
+      if (!parseValue(pValue))
+         return false;
+
+      // allow only trailing whitespace
+      skipWhitespace();
+      return pPos_ == pEnd_;
+   }
+
+private:
+   // guard against overflowing the stack on deeply nested input
+   static const int kMaxDepth = 512;
+
+   bool atEnd() const { return pPos_ == pEnd_; }
+
+   void skipWhitespace()
+   {
+      while (pPos_ != pEnd_)
+      {
+         switch (*pPos_)
+         {
+            case ' ': case '\t': case '\n': case '\r': case '\f': case '\v':
+               ++pPos_;
+               break;
+            default:
+               return;
+         }
+      }
+   }
+
+   bool consume(char ch)
+   {
+      skipWhitespace();
+      if (atEnd() || *pPos_ != ch)
+         return false;
+      ++pPos_;
+      return true;
+   }
+
+   bool consumeLiteral(const char* literal)
+   {
+      std::size_t length = std::strlen(literal);
+      if (static_cast<std::size_t>(pEnd_ - pPos_) < length ||
+          std::strncmp(pPos_, literal, length) != 0)
+      {
+         return false;
+      }
+      pPos_ += length;
+      return true;
+   }
+
+   bool parseValue(Value* pValue)
+   {
+      if (atEnd())
+         return false;
+
+      switch (*pPos_)
+      {
+         case '{':
+            return parseObject(pValue);
+         case '[':
+            return parseArray(pValue);
+         case '"':
+         {
+            *pValue = std::string();
+            return parseString(&(pValue->get_str()));
+         }
+         case 't':
+         {
+            *pValue = true;
+            return consumeLiteral("true");
+         }
+         case 'f':
+         {
+            *pValue = false;
+            return consumeLiteral("false");
+         }
+         case 'n':
+         {
+            *pValue = Value();
+            return consumeLiteral("null");
+         }
+         default:
+            return parseNumber(pValue);
+      }
+   }
+
+   bool parseObject(Value* pValue)
+   {
+      if (++depth_ > kMaxDepth)
+         return false;
+
+      ++pPos_; // {
+      *pValue = Object();
+      Object& object = pValue->get_obj();
+
+      if (!consume('}'))
+      {
+         std::string name;
+         do
+         {
+            skipWhitespace();
+            if (atEnd() || *pPos_ != '"')
+               return false;
+            name.clear();
+            if (!parseString(&name))
+               return false;
+
+            if (!consume(':'))
+               return false;
+
+            // a repeated name replaces the earlier value
+            skipWhitespace();
+            if (!parseValue(&object[name]))
+               return false;
+         }
+         while (consume(','));
+
+         if (!consume('}'))
+            return false;
+      }
+
+      --depth_;
+      return true;
+   }
+
+   bool parseArray(Value* pValue)
+   {
+      if (++depth_ > kMaxDepth)
+         return false;
+
+      ++pPos_; // [
+      *pValue = Array();
+      Array& array = pValue->get_array();
+
+      if (!consume(']'))
+      {
+         do
+         {
+            skipWhitespace();
+            array.push_back(Value());
+            if (!parseValue(&array.back()))
+               return false;
+         }
+         while (consume(','));
+
+         if (!consume(']'))
+            return false;
+      }
+
+      --depth_;
+      return true;
+   }
+
+   bool parseHexDigits(int count, unsigned int* pValue)
+   {
+      if (pEnd_ - pPos_ < count)
+         return false;
+
+      unsigned int value = 0;
+      for (int i = 0; i < count; i++)
+      {
+         char ch = *pPos_++;
+         value <<= 4;
+         if (ch >= '0' && ch <= '9')
+            value |= ch - '0';
+         else if (ch >= 'a' && ch <= 'f')
+            value |= ch - 'a' + 10;
+         else if (ch >= 'A' && ch <= 'F')
+            value |= ch - 'A' + 10;
+         else
+            return false;
+      }
+      *pValue = value;
+      return true;
+   }
+
+   static void appendUtf8(unsigned int codePoint, std::string* pOutput)
+   {
+      if (codePoint < 0x80)
+      {
+         pOutput->push_back(static_cast<char>(codePoint));
+      }
+      else if (codePoint < 0x800)
+      {
+         pOutput->push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+         pOutput->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+      else if (codePoint < 0x10000)
+      {
+         pOutput->push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+         pOutput->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+         pOutput->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+      else
+      {
+         pOutput->push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+         pOutput->push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+         pOutput->push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+         pOutput->push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+   }
+
+   bool parseUnicodeEscape(std::string* pOutput)
+   {
+      unsigned int codePoint;
+      if (!parseHexDigits(4, &codePoint))
+         return false;
+
+      // combine surrogate pairs (an unpaired surrogate is passed through)
+      if (codePoint >= 0xD800 && codePoint <= 0xDBFF &&
+          pEnd_ - pPos_ >= 6 && pPos_[0] == '\\' && pPos_[1] == 'u')
+      {
+         const char* pSaved = pPos_;
+         pPos_ += 2;
+         unsigned int lowSurrogate;
+         if (parseHexDigits(4, &lowSurrogate) &&
+             lowSurrogate >= 0xDC00 && lowSurrogate <= 0xDFFF)
+         {
+            codePoint = 0x10000 + ((codePoint - 0xD800) << 10) +
+                        (lowSurrogate - 0xDC00);
+         }
+         else
+         {
+            pPos_ = pSaved;
+         }
+      }
+
+      appendUtf8(codePoint, pOutput);
+      return true;
+   }
+
+   bool parseString(std::string* pOutput)
+   {
+      ++pPos_; // opening quote
+
+      while (!atEnd())
+      {
+         // copy everything up to the next quote or escape in one go
+         const char* pRunStart = pPos_;
+         while (pPos_ != pEnd_ && *pPos_ != '"' && *pPos_ != '\\')
+            ++pPos_;
+         pOutput->append(pRunStart, pPos_);
+
+         if (atEnd())
+            return false;
+
+         if (*pPos_++ == '"')
+            return true;
+
+         // escape
+         if (atEnd())
+            return false;
+         char ch = *pPos_++;
+         switch (ch)
+         {
+            case '"':  pOutput->push_back('"'); break;
+            case '\\': pOutput->push_back('\\'); break;
+            case '/':  pOutput->push_back('/'); break;
+            case 'b':  pOutput->push_back('\b'); break;
+            case 'f':  pOutput->push_back('\f'); break;
+            case 'n':  pOutput->push_back('\n'); break;
+            case 'r':  pOutput->push_back('\r'); break;
+            case 't':  pOutput->push_back('\t'); break;
+            case 'u':
+               if (!parseUnicodeEscape(pOutput))
+                  return false;
+               break;
+            default:
+               return false;
+         }
+      }
+
+      // unterminated string
+      return false;
+   }
+
+   static bool isDigit(char ch)
+   {
+      return ch >= '0' && ch <= '9';
+   }
+
+   bool parseNumber(Value* pValue)
+   {
+      const char* pStart = pPos_;
+
+      bool negative = false;
+      if (*pPos_ == '-' || *pPos_ == '+')
+         negative = (*pPos_++ == '-');
+
+      // accumulate the integer part as we scan it
+      const boost::uint64_t kMaxUInt64 = ~static_cast<boost::uint64_t>(0);
+      boost::uint64_t magnitude = 0;
+      bool overflow = false;
+      const char* pDigits = pPos_;
+      while (pPos_ != pEnd_ && isDigit(*pPos_))
+      {
+         unsigned int digit = *pPos_++ - '0';
+         if (magnitude > (kMaxUInt64 - digit) / 10)
+            overflow = true;
+         else
+            magnitude = (magnitude * 10) + digit;
+      }
+      bool hasIntegerDigits = pPos_ != pDigits;
+
+      bool isReal = false;
+      if (pPos_ != pEnd_ && *pPos_ == '.')
+      {
+         isReal = true;
+         ++pPos_;
+         const char* pFraction = pPos_;
+         while (pPos_ != pEnd_ && isDigit(*pPos_))
+            ++pPos_;
+         if (!hasIntegerDigits && pPos_ == pFraction)
+            return false;
+      }
+      else if (!hasIntegerDigits)
+      {
+         return false;
+      }
+
+      if (pPos_ != pEnd_ && (*pPos_ == 'e' || *pPos_ == 'E'))
+      {
+         isReal = true;
+         ++pPos_;
+         if (pPos_ != pEnd_ && (*pPos_ == '-' || *pPos_ == '+'))
+            ++pPos_;
+         const char* pExponent = pPos_;
+         while (pPos_ != pEnd_ && isDigit(*pPos_))
+            ++pPos_;
+         if (pPos_ == pExponent)
+            return false;
+      }
+
+      if (!isReal && !overflow)
+      {
+         const boost::uint64_t kMaxInt64 = kMaxUInt64 >> 1;
+         if (!negative && magnitude <= kMaxInt64)
+         {
+            *pValue = static_cast<boost::int64_t>(magnitude);
+            return true;
+         }
+         else if (!negative)
+         {
+            *pValue = magnitude;
+            return true;
+         }
+         else if (magnitude <= kMaxInt64 + 1)
+         {
+            *pValue = static_cast<boost::int64_t>(0 - magnitude);
+            return true;
+         }
+      }
+
+      // reals (and integers too large for 64 bits) go through strtod
+      return parseReal(pStart, pPos_, pValue);
+   }
+
+   static bool parseReal(const char* pBegin, const char* pEnd, Value* pValue)
+   {
+      // copy to a terminated buffer (using the locale's decimal point
+      // since that is what strtod expects)
+      std::string number(pBegin, pEnd);
+      char decimalPoint = *(std::localeconv()->decimal_point);
+      if (decimalPoint != '.')
+      {
+         std::string::size_type pos = number.find('.');
+         if (pos != std::string::npos)
+            number[pos] = decimalPoint;
+      }
+
+      char* pParseEnd = NULL;
+      double value = std::strtod(number.c_str(), &pParseEnd);
+      if (pParseEnd != number.c_str() + number.length())
+         return false;
+
+      *pValue = value;
+      return true;
+   }
+
+private:
+   const char* pPos_;
+   const char* const pEnd_;
+   int depth_;
+};
+
+// Writes compact json directly into a string (json_spirit's writer builds
+// an escaped copy of every string and formats each token through the
+// stream). Output is identical to json_spirit::write.
+class Writer
+{
+public:
+   explicit Writer(std::string* pOutput)
+      : pOutput_(pOutput)
+   {
+   }
+
+   void write(const Value& value)
+   {
+      switch (value.type())
+      {
+         case json_spirit::obj_type:
+            writeObject(value.get_obj());
+            break;
+         case json_spirit::array_type:
+            writeArray(value.get_array());
+            break;
+         case json_spirit::str_type:
+            writeString(value.get_str());
+            break;
+         case json_spirit::bool_type:
+            pOutput_->append(value.get_bool() ? "true" : "false");
+            break;
+         case json_spirit::int_type:
+            if (value.is_uint64())
+               writeUInt64(value.get_uint64(), false);
+            else
+               writeInt64(value.get_int64());
+            break;
+         case json_spirit::real_type:
+            writeReal(value.get_real());
+            break;
+         case json_spirit::null_type:
+         default:
+            pOutput_->append("null");
+            break;
+      }
+   }
+
+private:
+   void writeObject(const Object& object)
+   {
+      pOutput_->push_back('{');
+      for (Object::const_iterator it = object.begin(); it != object.end(); ++it)
+      {
+         if (it != object.begin())
+            pOutput_->push_back(',');
+         writeString(it->first);
+         pOutput_->push_back(':');
+         write(it->second);
+      }
+      pOutput_->push_back('}');
+   }
+
+   void writeArray(const Array& array)
+   {
+      pOutput_->push_back('[');
+      for (Array::const_iterator it = array.begin(); it != array.end(); ++it)
+      {
+         if (it != array.begin())
+            pOutput_->push_back(',');
+         write(*it);
+      }
+      pOutput_->push_back(']');
+   }
+
+   void writeString(const std::string& value)
+   {
+      pOutput_->push_back('"');
+
+      // copy runs of characters which don't need escaping in one go
+      const char* pRunStart = value.data();
+      const char* pEnd = pRunStart + value.length();
+      for (const char* pChar = pRunStart; pChar != pEnd; ++pChar)
+      {
+         const char* escaped;
+         switch (*pChar)
+         {
+            case '"':  escaped = "\\\""; break;
+            case '\\': escaped = "\\\\"; break;
+            case '\b': escaped = "\\b"; break;
+            case '\f': escaped = "\\f"; break;
+            case '\n': escaped = "\\n"; break;
+            case '\r': escaped = "\\r"; break;
+            case '\t': escaped = "\\t"; break;
+            default:   continue;
+         }
+         pOutput_->append(pRunStart, pChar);
+         pOutput_->append(escaped);
+         pRunStart = pChar + 1;
+      }
+      pOutput_->append(pRunStart, pEnd);
+
+      pOutput_->push_back('"');
+   }
+
+   void writeUInt64(boost::uint64_t value, bool negative)
+   {
+      char buffer[24];
+      char* pEnd = buffer + sizeof(buffer);
+      char* pStart = pEnd;
+      do
+      {
+         *--pStart = static_cast<char>('0' + (value % 10));
+         value /= 10;
+      }
+      while (value != 0);
+
+      if (negative)
+         *--pStart = '-';
+
+      pOutput_->append(pStart, pEnd);
+   }
+
+   void writeInt64(boost::int64_t value)
+   {
+      if (value < 0)
+         writeUInt64(0 - static_cast<boost::uint64_t>(value), true);
+      else
+         writeUInt64(static_cast<boost::uint64_t>(value), false);
+   }
+
+   void writeReal(double value)
+   {
+      // equivalent to streaming with showpoint and setprecision(16)
+      char buffer[64];
+      int length = ::snprintf(buffer, sizeof(buffer), "%#.16g", value);
+      if (length <= 0 || length >= static_cast<int>(sizeof(buffer)))
+         return;
+
+      // always use '.' regardless of the locale
+      char decimalPoint = *(std::localeconv()->decimal_point);
+      if (decimalPoint != '.')
+         std::replace(buffer, buffer + length, decimalPoint, '.');
+
+      pOutput_->append(buffer, length);
+   }
+
+private:
+   std::string* pOutput_;
+};
+
+} // anonymous namespace
+
 bool parse(const std::string& input, Value* pValue)
 {
-   // two threads simultaneously using the json parser has been observed
-   // to crash the process. protect it globally with a mutex. note this was
-   // probably a result of not defining BOOST_SPIRIT_THREADSAFE (which we
-   // have subsequently defined) however since there isn't much documentation 
-   // on the behavior of boost spirit w/ threads and the specific behavior
-   // of this constant we leave in mutex just to be sure   
-      
-   static boost::mutex s_spiritMutex ;
-   LOCK_MUTEX(s_spiritMutex)
-   {
-      return json_spirit::read(input, *pValue);
-   }
-   END_LOCK_MUTEX
-   
-   // mutex related error
-   return false;
+   const char* pBegin = input.data();
+   Parser parser(pBegin, pBegin + input.length());
+   return parser.parse(pValue);
 }
 
 void write(const Value& value, std::ostream& os)
 {
-   json_spirit::write(value, os);
+   std::string output;
+   Writer writer(&output);
+   writer.write(value);
+   os.write(output.data(), output.length());
 }
 
 void writeFormatted(const Value& value, std::ostream& os)
@@ -43,11 +43,11 @@ Error parseJsonRpcRequest(const std::string& input, JsonRpcRequest* pRequest)
 
       // extract the fields
       json::Object& requestObject = var.get_obj();
-      for (json::Object::const_iterator it = 
+      for (json::Object::iterator it = 
             requestObject.begin(); it != requestObject.end(); ++it)
       {
-         std::string fieldName = it->first ;
-         json::Value fieldValue = it->second ;
+         const std::string& fieldName = it->first ;
+         json::Value& fieldValue = it->second ;
 
          if ( fieldName == "method" )
          {
@@ -61,14 +61,15 @@ Error parseJsonRpcRequest(const std::string& input, JsonRpcRequest* pRequest)
             if (fieldValue.type() != json::ArrayType)
                return Error(errc::ParamTypeMismatch, ERROR_LOCATION) ;
 
-            pRequest->params = fieldValue.get_array();
+            // swap rather than copy (params can hold large documents)
+            pRequest->params.swap(fieldValue.get_array());
          }
          else if ( fieldName == "kwparams" )
          {
             if (fieldValue.type() != json::ObjectType)
                return Error(errc::ParamTypeMismatch, ERROR_LOCATION) ;
 
-            pRequest->kwparams = fieldValue.get_obj();
+            pRequest->kwparams.swap(fieldValue.get_obj());
          }
          else if (fieldName == "sourceWnd")
          {
@@ -164,20 +165,57 @@ void JsonRpcResponse::runAfterResponse()
       afterResponse_();
 }
    
+void JsonRpcResponse::setRawResult(const std::string& result)
+{
+   response_.erase(kRpcResult);
+   rawResult_ = result;
+}
+
 json::Object JsonRpcResponse::getRawResponse()
 {
+   parseRawResult();
    return response_;
 }
    
 void JsonRpcResponse::write(std::ostream& os) const
 {
-   json::write(response_, os);
+   if (rawResult_.empty())
+   {
+      json::write(response_, os);
+      return;
+   }
+
+   // write the raw result followed by the other fields
+   os << "{\"" << kRpcResult << "\":" << rawResult_;
+   for (json::Object::const_iterator it = response_.begin();
+        it != response_.end();
+        ++it)
+   {
+      os << ",";
+      json::write(json::Value(it->first), os);
+      os << ":";
+      json::write(it->second, os);
+   }
+   os << "}";
+}
+
+void JsonRpcResponse::parseRawResult()
+{
+   if (rawResult_.empty())
+      return;
+
+   json::Value result;
+   if (!json::parse(rawResult_, &result))
+      LOG_ERROR_MESSAGE("Invalid json-rpc result: " + rawResult_.substr(0, 100));
+   response_[kRpcResult] = result;
+   rawResult_.clear();
 }
    
 void JsonRpcResponse::setError(const Error& error, const json::Value& clientInfo)
 {
    // remove result
    response_.erase(kRpcResult);
+   rawResult_.clear();
    response_.erase(kRpcAsyncHandle);
 
    const boost::system::error_code& ec = error.code();
@@ -219,6 +257,7 @@ void JsonRpcResponse::setError(const boost::system::error_code& ec)
 {
    // remove result
    response_.erase(kRpcResult);
+   rawResult_.clear();
    response_.erase(kRpcAsyncHandle);
 
    // error from error code
@@ -235,6 +274,7 @@ void JsonRpcResponse::setError(const boost::system::error_code& ec)
 void JsonRpcResponse::setAsyncHandle(const std::string& handle)
 {
    response_.erase(kRpcResult);
+   rawResult_.clear();
    response_.erase(kRpcError);
 
    setField(kRpcAsyncHandle, handle);
@@ -0,0 +1,233 @@
+/*
+ * JsonTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/json/Json.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/format.hpp>
+#include <boost/thread.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/json/JsonRpc.hpp>
+
+namespace core {
+namespace json {
+
+namespace {
+
+const char * const kClientId = "33e600bb-c1b1-46bf-b562-ab5cba070b0e";
+
+std::string toJson(const Value& value)
+{
+   std::ostringstream ostr;
+   write(value, ostr);
+   return ostr.str();
+}
+
+// lines of R code with quotes, backslashes, tabs, and non-ascii characters
+// (so the string escapes are exercised)
+std::string sourceCode(std::size_t bytes)
+{
+   std::string code;
+   for (int i = 0; code.size() < bytes; i++)
+   {
+      code += boost::str(boost::format(
+         "f%1% <- function(x, y = \"caf\xC3\xA9\")\n"
+         "{\n"
+         "\tpaste(x, y, sep = \"\\\\\") # %1%\n"
+         "}\n") % i);
+   }
+   return code;
+}
+
+std::string rpcRequest(const std::string& method, const Array& params)
+{
+   Object request;
+   request["method"] = method;
+   request["params"] = params;
+   request["clientId"] = kClientId;
+   request["version"] = 1351798283.0;
+   return toJson(request);
+}
+
+std::string consoleInputRequest()
+{
+   Array params;
+   params.push_back("x <- rnorm(100)");
+   return rpcRequest("console_input", params);
+}
+
+std::string saveDocumentRequest(std::size_t bytes)
+{
+   Array params;
+   params.push_back("A1B2C3D4");
+   params.push_back("~/analysis/model.R");
+   params.push_back("r_source");
+   params.push_back("UTF-8");
+   params.push_back(Array());
+   params.push_back(sourceCode(bytes));
+   return rpcRequest("save_document", params);
+}
+
+std::string clientStateRequest()
+{
+   Object state;
+   for (int i = 0; i < 400; i++)
+   {
+      Object scope;
+      scope["visible"] = (i % 2) == 0;
+      scope["width"] = 100 + i;
+      scope["height"] = 0.5 + i;
+      scope["panes"] = Array(3, Value("Source"));
+      state[boost::str(boost::format("pane-%1%") % i)] = scope;
+   }
+
+   Array params;
+   params.push_back(state);
+   return rpcRequest("set_client_state", params);
+}
+
+// a list of workspace objects, which is typical of a large rpc result
+Value workspaceResult(int objects)
+{
+   Array result;
+   for (int i = 0; i < objects; i++)
+   {
+      Object object;
+      object["name"] = boost::str(boost::format("var%1%") % i);
+      object["type"] = "numeric";
+      object["len"] = i;
+      object["value"] = boost::str(boost::format("num [1:%1%]") % i);
+      result.push_back(object);
+   }
+   return result;
+}
+
+void parseRepeatedly(const std::string& payload, int iterations, int* pFailed)
+{
+   for (int i = 0; i < iterations; i++)
+   {
+      JsonRpcRequest request;
+      if (parseJsonRpcRequest(payload, &request))
+         (*pFailed)++;
+   }
+}
+
+// parse the payload the given number of times on each of the threads
+// and return the aggregate throughput
+double megabytesPerSecond(const std::string& payload,
+                          int iterations,
+                          int threads)
+{
+   using namespace boost::posix_time;
+
+   std::vector<int> failed(threads, 0);
+   ptime start = microsec_clock::universal_time();
+   boost::thread_group threadGroup;
+   for (int i = 0; i < threads; i++)
+   {
+      threadGroup.create_thread(boost::bind(parseRepeatedly,
+                                            boost::cref(payload),
+                                            iterations,
+                                            &(failed[i])));
+   }
+   threadGroup.join_all();
+   time_duration elapsed = microsec_clock::universal_time() - start;
+
+   int totalFailed = 0;
+   for (int i = 0; i < threads; i++)
+      totalFailed += failed[i];
+   if (totalFailed > 0)
+      std::cerr << totalFailed << " requests failed to parse" << std::endl;
+   BOOST_ASSERT(totalFailed == 0);
+
+   double bytes = static_cast<double>(payload.size()) * iterations * threads;
+   double seconds = std::max<boost::int64_t>(elapsed.total_microseconds(), 1) /
+                    1000000.0;
+   return (bytes / (1024 * 1024)) / seconds;
+}
+
+// writing what we parsed gives back the same text
+void verifyRoundTrip(const std::string& payload)
+{
+   Value value;
+   bool roundTrips = parse(payload, &value) && toJson(value) == payload;
+   if (!roundTrips)
+      std::cerr << "Json didn't round trip: " << payload.substr(0, 80)
+                << std::endl;
+   BOOST_ASSERT(roundTrips);
+}
+
+} // anonymous namespace
+
+// parseJsonRpcRequest throughput for representative requests (on one and
+// several threads, since parsing used to be serialized) and the time taken
+// to write a large rpc response
+void runJsonBenchmark()
+{
+   using namespace boost::posix_time;
+
+   const int kThreads = 4;
+   const std::size_t kTargetBytes = 32 * 1024 * 1024;
+
+   std::vector<std::string> payloads;
+   payloads.push_back(consoleInputRequest());
+   payloads.push_back(saveDocumentRequest(4 * 1024));
+   payloads.push_back(clientStateRequest());
+   payloads.push_back(saveDocumentRequest(120 * 1024));
+
+   for (std::size_t i = 0; i < payloads.size(); i++)
+   {
+      const std::string& payload = payloads[i];
+      verifyRoundTrip(payload);
+
+      int iterations = static_cast<int>(kTargetBytes / payload.size()) + 1;
+      double single = megabytesPerSecond(payload, iterations, 1);
+      double multiple = megabytesPerSecond(payload,
+                                           iterations / kThreads + 1,
+                                           kThreads);
+
+      std::cout << "Json parse (" << payload.size() << " bytes): "
+                << single << " MB/s, " << kThreads << " threads "
+                << multiple << " MB/s" << std::endl;
+   }
+
+   const int kWrites = 100;
+   JsonRpcResponse response;
+   response.setResult(workspaceResult(2000));
+   std::size_t bytes = 0;
+   ptime start = microsec_clock::universal_time();
+   for (int i = 0; i < kWrites; i++)
+   {
+      std::ostringstream ostr;
+      response.write(ostr);
+      bytes = ostr.str().size();
+   }
+   time_duration elapsed = microsec_clock::universal_time() - start;
+
+   std::cout << "Json write (" << bytes << " bytes): "
+             << (elapsed.total_microseconds() / 1000.0) / kWrites << " ms"
+             << std::endl;
+}
+
+} // namespace json
+} // namespace core
@@ -24,38 +24,50 @@ namespace r_util {
 
 namespace {
 
-std::wstring removeQuoteDelims(const std::wstring& input)
+std::string removeQuoteDelims(const RUtf8Token& token)
 {
    // since we know this was parsed as a quoted string we can just remove
-   // the first and last characters
-   if (input.size() >= 2)
-      return std::wstring(input, 1, input.size() - 2);
+   // the first and last characters (quotes are always single bytes)
+   if (token.length() >= 2)
+      return std::string(token.begin() + 1, token.end() - 1);
    else
-      return std::wstring();
+      return std::string();
 }
 
-std::string contentAsUtf8(const RToken& token)
+std::string contentAsUtf8(const RUtf8Token& token)
 {
    if (token.type() == RToken::STRING)
-      return string_utils::wideToUtf8(removeQuoteDelims(token.content()));
+      return removeQuoteDelims(token);
    else
-      return string_utils::wideToUtf8(token.content());
+      return token.content();
 }
 
-bool isTokenType(RTokens::const_iterator begin,
-                 RTokens::const_iterator end,
+// number of characters in a range of UTF-8 encoded text
+std::size_t charCount(const char* begin, const char* end)
+{
+   std::size_t count = 0;
+   for ( ; begin < end; ++begin)
+   {
+      if ((static_cast<unsigned char>(*begin) & 0xC0) != 0x80)
+         count++;
+   }
+   return count;
+}
+
+bool isTokenType(RUtf8Tokens::const_iterator begin,
+                 RUtf8Tokens::const_iterator end,
                  const wchar_t type)
 {
    return begin != end && begin->type() == type;
 }
 
 bool advancePastNextToken(
-         RTokens::const_iterator* pBegin,
-         RTokens::const_iterator end,
-         const boost::function<bool(const RToken&)>& tokenCondition)
+         RUtf8Tokens::const_iterator* pBegin,
+         RUtf8Tokens::const_iterator end,
+         const boost::function<bool(const RUtf8Token&)>& tokenCondition)
 {
    // alias and advance past current token
-   RTokens::const_iterator& begin = *pBegin;
+   RUtf8Tokens::const_iterator& begin = *pBegin;
    begin++;
 
    // check for end
@@ -78,31 +90,31 @@ bool advancePastNextToken(
    }
 }
 
-bool advancePastNextToken(RTokens::const_iterator* pBegin,
-                          RTokens::const_iterator end,
+bool advancePastNextToken(RUtf8Tokens::const_iterator* pBegin,
+                          RUtf8Tokens::const_iterator end,
                           const wchar_t type)
 {
    return advancePastNextToken(pBegin,
                                end,
-                               boost::bind(&RToken::isType, _1, type));
+                               boost::bind(&RUtf8Token::isType, _1, type));
 }
 
-bool advancePastNextOperatorToken(RTokens::const_iterator* pBegin,
-                                  RTokens::const_iterator end,
-                                  const std::wstring& op)
+bool advancePastNextOperatorToken(RUtf8Tokens::const_iterator* pBegin,
+                                  RUtf8Tokens::const_iterator end,
+                                  const std::string& op)
 {
    return advancePastNextToken(pBegin,
                                end,
-                               boost::bind(&RToken::isOperator, _1, op));
+                               boost::bind(&RUtf8Token::isOperator, _1, op));
 }
 
 // statics for signature parsing comparisons
-const std::wstring kOpEquals(L"=");
-const std::wstring kSignatureSymbol(L"signature");
-const std::wstring kCSymbol(L"c");
+const std::string kOpEquals("=");
+const std::string kSignatureSymbol("signature");
+const std::string kCSymbol("c");
 
-void parseSignatureFunction(RTokens::const_iterator begin,
-                            RTokens::const_iterator end,
+void parseSignatureFunction(RUtf8Tokens::const_iterator begin,
+                            RUtf8Tokens::const_iterator end,
                             std::vector<RS4MethodParam>* pSignature)
 {
    // advance to args
@@ -137,8 +149,8 @@ void parseSignatureFunction(RTokens::const_iterator begin,
    }
 }
 
-void parseSignatureCharacterVector(RTokens::const_iterator begin,
-                                   RTokens::const_iterator end,
+void parseSignatureCharacterVector(RUtf8Tokens::const_iterator begin,
+                                   RUtf8Tokens::const_iterator end,
                                    std::vector<RS4MethodParam>* pSignature)
 {
    // advance to args
@@ -157,8 +169,8 @@ void parseSignatureCharacterVector(RTokens::const_iterator begin,
    }
 }
 
-void parseSignature(RTokens::const_iterator begin,
-                    RTokens::const_iterator end,
+void parseSignature(RUtf8Tokens::const_iterator begin,
+                    RUtf8Tokens::const_iterator end,
                     std::vector<RS4MethodParam>* pSignature)
 {
    // the signature parameter of the setMethod function can take any
@@ -194,44 +206,42 @@ RSourceIndex::RSourceIndex(const std::string& context,
                            const std::string& code)
    : context_(context)
 {
-   // convert code to wide
-   std::wstring wCode = string_utils::utf8ToWide(code, context);
-
-   // determine where the linebreaks are and initialize an iterator
-   // used for scanning them
+   // determine where the linebreaks are (byte offsets) and initialize an
+   // iterator used for scanning them
    std::vector<std::size_t> newlineLocs;
    std::size_t nextNL = 0;
-   while ( (nextNL = wCode.find(L'\n', nextNL)) != std::string::npos )
+   while ( (nextNL = code.find('\n', nextNL)) != std::string::npos )
       newlineLocs.push_back(nextNL++);
    std::vector<std::size_t>::const_iterator newlineIter = newlineLocs.begin();
    std::vector<std::size_t>::const_iterator endNewlines = newlineLocs.end();
 
-   // tokenize
-   RTokens rTokens(wCode, RTokens::StripWhitespace | RTokens::StripComments);
+   // tokenize (in place, without conversion to wide)
+   RUtf8Tokens rTokens(code,
+                       RTokens::StripWhitespace | RTokens::StripComments);
 
    // scan for function, method, and class definitions (track indent level)
    int braceLevel = 0;
-   std::wstring function(L"function");
-   std::wstring set(L"set");
-   std::wstring setGeneric(L"setGeneric");
-   std::wstring setGroupGeneric(L"setGroupGeneric");
-   std::wstring setMethod(L"setMethod");
-   std::wstring setClass(L"setClass");
-   std::wstring setClassUnion(L"setClassUnion");
-   std::wstring eqOp(L"=");
-   std::wstring assignOp(L"<-");
-   std::wstring parentAssignOp(L"<<-");
+   std::string function("function");
+   std::string set("set");
+   std::string setGeneric("setGeneric");
+   std::string setGroupGeneric("setGroupGeneric");
+   std::string setMethod("setMethod");
+   std::string setClass("setClass");
+   std::string setClassUnion("setClassUnion");
+   std::string eqOp("=");
+   std::string assignOp("<-");
+   std::string parentAssignOp("<<-");
    for (std::size_t i=0; i<rTokens.size(); i++)
    {
       // initial name, qualifer, and type are nil
       RSourceItem::Type type = RSourceItem::None;
-      std::wstring name;
+      std::string name;
       std::size_t tokenOffset = -1;
       bool isSetMethod = false;
       std::vector<RS4MethodParam> signature;
 
       // alias the token
-      const RToken& token = rTokens.at(i);
+      const RUtf8Token& token = rTokens.at(i);
 
       // see if this is a begin or end brace and update the level
       if (token.type() == RToken::LBRACE)
@@ -288,7 +298,7 @@ RSourceIndex::RSourceIndex(const std::string& context,
 
          // found a class or method definition (will find location below)
          type = setType;
-         name = removeQuoteDelims(rTokens.at(i+2).content());
+         name = removeQuoteDelims(rTokens.at(i+2));
          tokenOffset = token.offset();
 
          // if this was a setMethod then try to lookahead for the signature
@@ -309,7 +319,7 @@ RSourceIndex::RSourceIndex(const std::string& context,
             continue;
 
          // check for an assignment operator
-         const RToken& opToken = rTokens.at(i-1);
+         const RUtf8Token& opToken = rTokens.at(i-1);
          if ( opToken.type() != RToken::OPER)
             continue;
          if (!opToken.isOperator(eqOp) &&
@@ -318,7 +328,7 @@ RSourceIndex::RSourceIndex(const std::string& context,
             continue;
 
          // check for an identifier
-         const RToken& idToken = rTokens.at(i-2);
+         const RUtf8Token& idToken = rTokens.at(i-2);
          if ( idToken.type() != RToken::ID )
             continue;
 
@@ -326,7 +336,7 @@ RSourceIndex::RSourceIndex(const std::string& context,
          // comma or an open paren
          if ( i > 2 )
          {
-            const RToken& prevToken = rTokens.at(i-3);
+            const RUtf8Token& prevToken = rTokens.at(i-3);
             if (prevToken.type() == RToken::LPAREN ||
                 prevToken.type() == RToken::COMMA)
                continue;
@@ -349,17 +359,18 @@ RSourceIndex::RSourceIndex(const std::string& context,
                                      tokenOffset);
       std::size_t line = newlineIter - newlineLocs.begin() + 1;
 
-      // compute column by comparing the offset to the PREVIOUS newline
-      // (guard against no previous newline)
+      // compute column by counting the characters since the PREVIOUS
+      // newline (guard against no previous newline)
       std::size_t column;
+      const char* pCode = code.data();
       if (line > 1)
-         column = tokenOffset - *(newlineIter - 1);
+         column = charCount(pCode + *(newlineIter - 1), pCode + tokenOffset);
       else
-         column = tokenOffset;
+         column = charCount(pCode, pCode + tokenOffset);
 
       // add to index
       items_.push_back(RSourceItem(type,
-                                   string_utils::wideToUtf8(name),
+                                   name,
                                    signature,
                                    braceLevel,
                                    line,
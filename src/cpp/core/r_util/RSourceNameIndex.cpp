@@ -0,0 +1,293 @@
+/*
+ * RSourceNameIndex.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSourceNameIndex.hpp>
+
+#include <algorithm>
+
+#include <boost/foreach.hpp>
+#include <boost/regex.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <core/StringUtils.hpp>
+#include <core/RegexUtils.hpp>
+
+namespace core {
+namespace r_util {
+
+namespace {
+
+boost::uint32_t trigramAt(const std::string& str, std::size_t pos)
+{
+   return (static_cast<boost::uint32_t>(static_cast<unsigned char>(str[pos])) << 16) |
+          (static_cast<boost::uint32_t>(static_cast<unsigned char>(str[pos+1])) << 8) |
+          static_cast<boost::uint32_t>(static_cast<unsigned char>(str[pos+2]));
+}
+
+} // anonymous namespace
+
+void RSourceNameIndex::add(const boost::shared_ptr<RSourceIndex>& pIndex)
+{
+   // replace any existing index for this context
+   remove(pIndex->context());
+
+   boost::uint32_t fileId = static_cast<boost::uint32_t>(files_.size());
+   files_.push_back(pIndex);
+   fileIds_[pIndex->context()] = fileId;
+   addEntries(fileId, *pIndex);
+}
+
+void RSourceNameIndex::remove(const std::string& context)
+{
+   std::map<std::string, boost::uint32_t>::iterator it =
+                                                fileIds_.find(context);
+   if (it == fileIds_.end())
+      return;
+
+   // tombstone the file (its entries are skipped until compaction)
+   boost::shared_ptr<RSourceIndex>& pIndex = files_[it->second];
+   std::size_t count = pIndex->items().size();
+   liveItems_ -= count;
+   deadItems_ += count;
+   pIndex.reset();
+   fileIds_.erase(it);
+
+   if (deadItems_ > liveItems_)
+      compact();
+}
+
+void RSourceNameIndex::clear()
+{
+   files_.clear();
+   fileIds_.clear();
+   names_.clear();
+   pendingNames_.clear();
+   trigrams_.clear();
+   liveItems_ = 0;
+   deadItems_ = 0;
+}
+
+void RSourceNameIndex::search(const std::string& term,
+                              bool prefixOnly,
+                              const std::set<std::string>& excludeContexts,
+                              std::size_t maxResults,
+                              std::vector<RSourceItem>* pItems)
+{
+   if (pItems->size() >= maxResults)
+      return;
+
+   // bring the sorted name array up to date
+   mergePending();
+
+   // resolve excluded contexts to file ids
+   std::set<boost::uint32_t> excludeIds;
+   BOOST_FOREACH(const std::string& context, excludeContexts)
+   {
+      std::map<std::string, boost::uint32_t>::const_iterator it =
+                                                   fileIds_.find(context);
+      if (it != fileIds_.end())
+         excludeIds.insert(it->second);
+   }
+
+   if (term.find('*') != std::string::npos)
+      searchWildcard(term, prefixOnly, excludeIds, maxResults, pItems);
+   else if (prefixOnly)
+      searchPrefix(string_utils::toLower(term), excludeIds, maxResults, pItems);
+   else
+      searchContains(string_utils::toLower(term), excludeIds, maxResults, pItems);
+}
+
+void RSourceNameIndex::addEntries(boost::uint32_t fileId,
+                                  const RSourceIndex& index)
+{
+   const std::vector<RSourceItem>& items = index.items();
+   for (std::size_t i = 0; i<items.size(); i++)
+   {
+      ItemRef ref(fileId, static_cast<boost::uint32_t>(i));
+      std::string name = string_utils::toLower(items[i].name());
+
+      // add the trigrams (once each per name)
+      std::set<boost::uint32_t> nameTrigrams;
+      for (std::size_t pos = 0; pos + 3 <= name.size(); pos++)
+         nameTrigrams.insert(trigramAt(name, pos));
+      BOOST_FOREACH(boost::uint32_t trigram, nameTrigrams)
+      {
+         trigrams_[trigram].push_back(ref);
+      }
+
+      pendingNames_.push_back(NameEntry(name, ref));
+   }
+
+   liveItems_ += items.size();
+}
+
+void RSourceNameIndex::mergePending()
+{
+   if (pendingNames_.empty())
+      return;
+
+   std::sort(pendingNames_.begin(), pendingNames_.end());
+   std::size_t mid = names_.size();
+   names_.insert(names_.end(), pendingNames_.begin(), pendingNames_.end());
+   std::inplace_merge(names_.begin(), names_.begin() + mid, names_.end());
+   pendingNames_.clear();
+}
+
+void RSourceNameIndex::compact()
+{
+   std::vector<boost::shared_ptr<RSourceIndex> > liveFiles;
+   BOOST_FOREACH(const boost::shared_ptr<RSourceIndex>& pIndex, files_)
+   {
+      if (pIndex)
+         liveFiles.push_back(pIndex);
+   }
+
+   clear();
+
+   BOOST_FOREACH(const boost::shared_ptr<RSourceIndex>& pIndex, liveFiles)
+   {
+      add(pIndex);
+   }
+}
+
+bool RSourceNameIndex::isLive(const ItemRef& ref,
+                              const std::set<boost::uint32_t>& excludeIds) const
+{
+   return files_[ref.fileId] && (excludeIds.find(ref.fileId) == excludeIds.end());
+}
+
+const RSourceItem& RSourceNameIndex::item(const ItemRef& ref) const
+{
+   return files_[ref.fileId]->items()[ref.itemIndex];
+}
+
+RSourceItem RSourceNameIndex::resultItem(const ItemRef& ref) const
+{
+   const boost::shared_ptr<RSourceIndex>& pIndex = files_[ref.fileId];
+   return pIndex->items()[ref.itemIndex].withContext(pIndex->context());
+}
+
+void RSourceNameIndex::searchPrefix(const std::string& term,
+                                    const std::set<boost::uint32_t>& excludeIds,
+                                    std::size_t maxResults,
+                                    std::vector<RSourceItem>* pItems)
+{
+   std::vector<NameEntry>::const_iterator it = std::lower_bound(
+                                             names_.begin(),
+                                             names_.end(),
+                                             NameEntry(term, ItemRef(0, 0)));
+   for ( ; it != names_.end(); ++it)
+   {
+      if (!boost::algorithm::starts_with(it->name, term))
+         break;
+
+      if (!isLive(it->ref, excludeIds))
+         continue;
+
+      pItems->push_back(resultItem(it->ref));
+      if (pItems->size() >= maxResults)
+         return;
+   }
+}
+
+void RSourceNameIndex::searchContains(const std::string& term,
+                                      const std::set<boost::uint32_t>& excludeIds,
+                                      std::size_t maxResults,
+                                      std::vector<RSourceItem>* pItems)
+{
+   // terms too short to have a trigram require a scan of the names
+   if (term.size() < 3)
+   {
+      BOOST_FOREACH(const NameEntry& entry, names_)
+      {
+         if (entry.name.find(term) == std::string::npos)
+            continue;
+
+         if (!isLive(entry.ref, excludeIds))
+            continue;
+
+         pItems->push_back(resultItem(entry.ref));
+         if (pItems->size() >= maxResults)
+            return;
+      }
+      return;
+   }
+
+   // find the rarest trigram in the term (if any trigram is missing
+   // from the index then nothing can match)
+   const std::vector<ItemRef>* pCandidates = NULL;
+   for (std::size_t pos = 0; pos + 3 <= term.size(); pos++)
+   {
+      Postings::const_iterator it = trigrams_.find(trigramAt(term, pos));
+      if (it == trigrams_.end())
+         return;
+
+      if (pCandidates == NULL || it->second.size() < pCandidates->size())
+         pCandidates = &(it->second);
+   }
+
+   // verify the candidates
+   BOOST_FOREACH(const ItemRef& ref, *pCandidates)
+   {
+      if (!isLive(ref, excludeIds))
+         continue;
+
+      std::string name = string_utils::toLower(item(ref).name());
+      if (name.find(term) == std::string::npos)
+         continue;
+
+      pItems->push_back(resultItem(ref));
+      if (pItems->size() >= maxResults)
+         return;
+   }
+}
+
+void RSourceNameIndex::searchWildcard(const std::string& term,
+                                      bool prefixOnly,
+                                      const std::set<boost::uint32_t>& excludeIds,
+                                      std::size_t maxResults,
+                                      std::vector<RSourceItem>* pItems)
+{
+   // names are already case-folded so match against the folded pattern
+   std::string lowerTerm = string_utils::toLower(term);
+   boost::regex pattern = regex_utils::wildcardPatternToRegex(lowerTerm);
+
+   // for prefix searches we can skip directly to the literal prefix
+   std::vector<NameEntry>::const_iterator it = names_.begin();
+   std::string prefix = lowerTerm.substr(0, lowerTerm.find('*'));
+   if (prefixOnly && !prefix.empty())
+   {
+      it = std::lower_bound(names_.begin(),
+                            names_.end(),
+                            NameEntry(prefix, ItemRef(0, 0)));
+   }
+
+   for ( ; it != names_.end(); ++it)
+   {
+      if (prefixOnly && !boost::algorithm::starts_with(it->name, prefix))
+         break;
+
+      if (!isLive(it->ref, excludeIds))
+         continue;
+
+      if (!regex_utils::textMatches(it->name, pattern, prefixOnly, true))
+         continue;
+
+      pItems->push_back(resultItem(it->ref));
+      if (pItems->size() >= maxResults)
+         return;
+   }
+}
+
+} // namespace r_util
+} // namespace core
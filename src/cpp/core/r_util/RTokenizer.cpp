@@ -30,6 +30,7 @@
 #include <boost/regex.hpp>
 
 #include <iostream>
+#include <algorithm>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -365,6 +366,359 @@ RToken RTokenizer::consumeToken(wchar_t tokenType, std::size_t length)
 }
 
 
+namespace {
+
+bool isDigit(char c)
+{
+   return c >= '0' && c <= '9';
+}
+
+bool isHexDigit(char c)
+{
+   return isDigit(c) || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+} // anonymous namespace
+
+RUtf8Token RUtf8Tokenizer::nextToken()
+{
+  if (eol())
+     return RUtf8Token() ;
+
+  char c = peek() ;
+
+  switch (c)
+  {
+  case '(': case ')':
+  case '{': case '}':
+  case ';': case ',':
+     return consumeToken(c, 1) ;
+  case '[':
+     if (peek(1) == '[')
+        return consumeToken(RToken::LDBRACKET, 2) ;
+     else
+        return consumeToken(c, 1) ;
+  case ']':
+     if (peek(1) == ']')
+        return consumeToken(RToken::RDBRACKET, 2) ;
+     else
+        return consumeToken(c, 1) ;
+  case '"':
+  case '\'':
+     return matchStringLiteral() ;
+  case '`':
+     return matchQuotedIdentifier();
+  case '#':
+     return matchComment();
+  case '%':
+     return matchUserOperator();
+  }
+
+  if (whitespaceLength(pos_) > 0)
+     return matchWhitespace();
+
+  char cNext = peek(1) ;
+
+  if (isDigit(c) || (c == '.' && isDigit(cNext)))
+  {
+     RUtf8Token numberToken = matchNumber() ;
+     if (numberToken.length() > 0)
+        return numberToken ;
+  }
+
+  // identifiers (see RTokenizer::nextToken for why this must follow
+  // the attempt to match a number)
+  std::size_t charLength;
+  wchar_t ch = peekChar(&charLength);
+  if (string_utils::isalnum(ch) || ch == L'.')
+     return matchIdentifier() ;
+
+  RUtf8Token oper = matchOperator() ;
+  if (oper)
+     return oper ;
+
+  // Error!! (consume the entire character)
+  return consumeToken(RToken::ERR, charLength) ;
+}
+
+RUtf8Token RUtf8Tokenizer::matchWhitespace()
+{
+   const char* pos = pos_;
+   std::size_t length;
+   while ((length = whitespaceLength(pos)) > 0)
+      pos += length;
+   return consumeToken(RToken::WHITESPACE, pos - pos_) ;
+}
+
+RUtf8Token RUtf8Tokenizer::matchStringLiteral()
+{
+   const char* start = pos_ ;
+   char quot = *pos_++ ;
+
+   while (!eol())
+   {
+      // advance to the next quote or escape
+      while (!eol() && *pos_ != '\\' && *pos_ != '\'' && *pos_ != '"')
+         pos_++;
+
+      if (eol())
+         break ;
+
+      char c = *pos_++ ;
+      if (c == quot)
+         break ;
+
+      if (c == '\\')
+      {
+         if (!eol())
+            pos_++ ;
+      }
+   }
+
+   return RUtf8Token(RToken::STRING,
+                     begin_,
+                     start - begin_,
+                     pos_ - start);
+}
+
+RUtf8Token RUtf8Tokenizer::matchNumber()
+{
+   const char* pos = pos_;
+
+   // 0x[0-9a-fA-F]*L?
+   if (peek() == '0' && peek(1) == 'x')
+   {
+      pos += 2;
+      while (pos < end_ && isHexDigit(*pos))
+         pos++;
+      if (pos < end_ && *pos == 'L')
+         pos++;
+      return consumeToken(RToken::NUMBER, pos - pos_);
+   }
+
+   // [0-9]*(\.[0-9]*)?([eE][+-]?[0-9]*)?[Li]?
+   while (pos < end_ && isDigit(*pos))
+      pos++;
+   if (pos < end_ && *pos == '.')
+   {
+      pos++;
+      while (pos < end_ && isDigit(*pos))
+         pos++;
+   }
+   if (pos < end_ && (*pos == 'e' || *pos == 'E'))
+   {
+      pos++;
+      if (pos < end_ && (*pos == '+' || *pos == '-'))
+         pos++;
+      while (pos < end_ && isDigit(*pos))
+         pos++;
+   }
+   if (pos < end_ && (*pos == 'L' || *pos == 'i'))
+      pos++;
+
+   return consumeToken(RToken::NUMBER, pos - pos_);
+}
+
+RUtf8Token RUtf8Tokenizer::matchIdentifier()
+{
+   const char* start = pos_ ;
+   std::size_t length;
+   peekChar(&length);
+   pos_ += length;
+   while (!eol())
+   {
+      wchar_t ch = peekChar(&length);
+      if (!string_utils::isalnum(ch) && ch != L'.' && ch != L'_')
+         break;
+      pos_ += length;
+   }
+   return RUtf8Token(RToken::ID,
+                     begin_,
+                     start - begin_,
+                     pos_ - start) ;
+}
+
+RUtf8Token RUtf8Tokenizer::matchQuotedIdentifier()
+{
+   // `[^`]*`
+   const char* close = std::find(pos_ + 1, end_, '`');
+   if (close == end_)
+      return consumeToken(RToken::ERR, 1);
+   else
+      return consumeToken(RToken::ID, close - pos_ + 1);
+}
+
+RUtf8Token RUtf8Tokenizer::matchComment()
+{
+   // comments extend up to (but not including) the end of the line
+   const char* pos = pos_;
+   while (pos < end_)
+   {
+      unsigned char c = static_cast<unsigned char>(*pos);
+      if (c == '\n' || c == '\r' || c == '\f')
+         break;
+
+      // U+0085, U+2028, and U+2029 are also line separators
+      if (c == 0xC2 && (pos + 1) < end_ &&
+          static_cast<unsigned char>(pos[1]) == 0x85)
+         break;
+      if (c == 0xE2 && (pos + 2) < end_ &&
+          static_cast<unsigned char>(pos[1]) == 0x80 &&
+          (static_cast<unsigned char>(pos[2]) == 0xA8 ||
+           static_cast<unsigned char>(pos[2]) == 0xA9))
+         break;
+
+      pos++;
+   }
+   return consumeToken(RToken::COMMENT, pos - pos_);
+}
+
+RUtf8Token RUtf8Tokenizer::matchUserOperator()
+{
+   // %[^%]*%
+   const char* close = std::find(pos_ + 1, end_, '%');
+   if (close == end_)
+      return consumeToken(RToken::ERR, 1) ;
+   else
+      return consumeToken(RToken::UOPER, close - pos_ + 1) ;
+}
+
+RUtf8Token RUtf8Tokenizer::matchOperator()
+{
+   char cNext = peek(1) ;
+
+   switch (peek())
+   {
+   case '+': case '*': case '/':
+   case '^': case '&': case '|':
+   case '~': case '$': case ':':
+      // single-character operators
+      return consumeToken(RToken::OPER, 1) ;
+   case '-': // also ->
+      return consumeToken(RToken::OPER, cNext == '>' ? 2 : 1) ;
+   case '>': // also >=
+      return consumeToken(RToken::OPER, cNext == '=' ? 2 : 1) ;
+   case '<': // also <- and <=
+      return consumeToken(RToken::OPER, cNext == '=' ? 2 :
+                                       cNext == '-' ? 2 :
+                                       1) ;
+   case '=': // also ==
+      return consumeToken(RToken::OPER, cNext == '=' ? 2 : 1) ;
+   case '!': // also !=
+      return consumeToken(RToken::OPER, cNext == '=' ? 2 : 1) ;
+   default:
+      return RUtf8Token() ;
+   }
+}
+
+bool RUtf8Tokenizer::eol() const
+{
+   return pos_ >= end_;
+}
+
+char RUtf8Tokenizer::peek(std::size_t lookahead) const
+{
+   if ((pos_ + lookahead) >= end_)
+      return 0 ;
+   else
+      return *(pos_ + lookahead) ;
+}
+
+// decode the character at the current position (invalid sequences are
+// treated as a single byte character)
+wchar_t RUtf8Tokenizer::peekChar(std::size_t* pLength) const
+{
+   *pLength = 1;
+   if (eol())
+      return 0;
+
+   unsigned char c = static_cast<unsigned char>(*pos_);
+   std::size_t length;
+   wchar_t ch;
+   if (c < 0x80)
+      return c;
+   else if ((c & 0xE0) == 0xC0)
+   {
+      length = 2;
+      ch = c & 0x1F;
+   }
+   else if ((c & 0xF0) == 0xE0)
+   {
+      length = 3;
+      ch = c & 0x0F;
+   }
+   else if ((c & 0xF8) == 0xF0)
+   {
+      length = 4;
+      ch = c & 0x07;
+   }
+   else
+      return c;
+
+   if (static_cast<std::size_t>(end_ - pos_) < length)
+      return c;
+
+   for (std::size_t i = 1; i<length; i++)
+   {
+      unsigned char cont = static_cast<unsigned char>(pos_[i]);
+      if ((cont & 0xC0) != 0x80)
+         return c;
+      ch = (ch << 6) | (cont & 0x3F);
+   }
+
+   *pLength = length;
+   return ch;
+}
+
+// length in bytes of the whitespace character at pos (0 if none)
+std::size_t RUtf8Tokenizer::whitespaceLength(const char* pos) const
+{
+   if (pos >= end_)
+      return 0;
+
+   switch (*pos)
+   {
+   case ' ': case '\t': case '\r': case '\n': case '\f': case '\v':
+      return 1;
+   }
+
+   // U+00A0 (no-break space)
+   unsigned char c = static_cast<unsigned char>(*pos);
+   if (c == 0xC2 && (pos + 1) < end_ &&
+       static_cast<unsigned char>(pos[1]) == 0xA0)
+      return 2;
+
+   // U+3000 (ideographic space)
+   if (c == 0xE3 && (pos + 2) < end_ &&
+       static_cast<unsigned char>(pos[1]) == 0x80 &&
+       static_cast<unsigned char>(pos[2]) == 0x80)
+      return 3;
+
+   return 0;
+}
+
+RUtf8Token RUtf8Tokenizer::consumeToken(wchar_t tokenType, std::size_t length)
+{
+   if (length == 0)
+   {
+      LOG_WARNING_MESSAGE("Can't create zero-length token");
+      return RUtf8Token();
+   }
+   else if ((pos_ + length) > end_)
+   {
+      LOG_WARNING_MESSAGE("Premature EOF");
+      return RUtf8Token();
+   }
+
+   const char* start = pos_ ;
+   pos_ += length ;
+   return RUtf8Token(tokenType,
+                     begin_,
+                     start - begin_,
+                     length) ;
+}
+
+
 } // namespace r_util
 } // namespace core 
 
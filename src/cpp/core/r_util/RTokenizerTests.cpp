@@ -17,6 +17,9 @@
 
 #include <boost/assert.hpp>
 #include <boost/foreach.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/StringUtils.hpp>
 
 namespace core {
 namespace r_util {
@@ -42,7 +45,12 @@ public:
 
    void verify(wchar_t tokenType, const std::wstring& value)
    {
+      verifyWide(tokenType, value);
+      verifyUtf8(tokenType, value);
+   }
 
+   void verifyWide(wchar_t tokenType, const std::wstring& value)
+   {
       RTokenizer rt(prefix_ + value + suffix_) ;
       RToken t ;
       while (t = rt.nextToken())
@@ -59,6 +67,26 @@ public:
 
    }
 
+   void verifyUtf8(wchar_t tokenType, const std::wstring& value)
+   {
+      std::string prefix = string_utils::wideToUtf8(prefix_);
+      std::string utf8Value = string_utils::wideToUtf8(value);
+      std::string code = prefix + utf8Value + string_utils::wideToUtf8(suffix_);
+
+      RUtf8Tokenizer rt(code) ;
+      RUtf8Token t ;
+      while (t = rt.nextToken())
+      {
+         if (t.offset() == prefix.length())
+         {
+            BOOST_ASSERT(tokenType == t.type());
+            BOOST_ASSERT(utf8Value.length() == t.length());
+            BOOST_ASSERT(utf8Value == t.content());
+            return ;
+         }
+      }
+   }
+
    void verify(const std::deque<std::wstring>& values)
    {
       verify(defaultTokenType_, values);
@@ -82,6 +110,9 @@ void testVoid()
 {
    RTokenizer rt(L"") ;
    BOOST_ASSERT(!rt.nextToken());
+
+   RUtf8Tokenizer rtUtf8("") ;
+   BOOST_ASSERT(!rtUtf8.nextToken());
 }
 
 void testSimple()
@@ -218,9 +249,75 @@ void testWhitespace()
 }
 
 
+// synthesize R code for benchmarking
+std::string benchmarkCode(std::size_t targetBytes)
+{
+   std::string chunk =
+      "# compute a summary \u00e9t\u00e9\n"
+      "summarize <- function(x, na.rm = TRUE, ...) {\n"
+      "   if (!is.numeric(x)) stop(\"x must be numeric\")\n"
+      "   result <- c(mean = mean(x, na.rm = na.rm), sd = sd(x) * 1.5e-3)\n"
+      "   result[[\"n\"]] <- length(x) %in% 0x1FL\n"
+      "   `my var` <- result$mean >= 10L\n"
+      "   result\n"
+      "}\n"
+      "setMethod(\"show\", signature(object=\"track\"), function(object) 1)\n";
+
+   std::string code;
+   code.reserve(targetBytes + chunk.size());
+   while (code.size() < targetBytes)
+      code.append(chunk);
+   return code;
+}
+
+double megabytesPerSecond(std::size_t bytes,
+                          const boost::posix_time::time_duration& elapsed)
+{
+   double seconds = elapsed.total_microseconds() / 1000000.0;
+   if (seconds <= 0)
+      return 0;
+   return (bytes / (1024.0 * 1024.0)) / seconds;
+}
+
 } // anonymous namespace
 
 
+// compare tokenizer throughput for the wide string path (which includes
+// the conversion to wide) against the in place UTF-8 path
+void runTokenizerBenchmark()
+{
+   using namespace boost::posix_time;
+
+   const std::size_t kBytes = 8 * 1024 * 1024;
+   std::string code = benchmarkCode(kBytes);
+
+   ptime start = microsec_clock::universal_time();
+   std::size_t wideTokens = 0;
+   {
+      std::wstring wCode = string_utils::utf8ToWide(code);
+      RTokens tokens(wCode);
+      wideTokens = tokens.size();
+   }
+   time_duration wideElapsed = microsec_clock::universal_time() - start;
+
+   start = microsec_clock::universal_time();
+   std::size_t utf8Tokens = 0;
+   {
+      RUtf8Tokens tokens(code);
+      utf8Tokens = tokens.size();
+   }
+   time_duration utf8Elapsed = microsec_clock::universal_time() - start;
+
+   BOOST_ASSERT(wideTokens == utf8Tokens);
+
+   std::wcout << L"RTokenizer (wide): "
+              << megabytesPerSecond(code.size(), wideElapsed) << L" MB/s"
+              << std::endl;
+   std::wcout << L"RUtf8Tokenizer: "
+              << megabytesPerSecond(code.size(), utf8Elapsed) << L" MB/s"
+              << std::endl;
+}
+
 void runTokenizerTests()
 {
    testVoid();
@@ -14,6 +14,9 @@
 #include <core/spelling/SpellChecker.hpp>
 
 #include <boost/scoped_ptr.hpp>
+#include <boost/algorithm/string/join.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
 
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
@@ -99,6 +102,44 @@ public:
       return Success();
    }
 
+   Error checkSpelling(const std::vector<std::string>& words,
+                       std::vector<bool>* pCorrect)
+   {
+      pCorrect->clear();
+      pCorrect->reserve(words.size());
+      if (words.empty())
+         return Success();
+
+      // convert all of the words to the dictionary encoding in one pass
+      // (newlines never appear within words so can delimit them)
+      std::string joined = boost::algorithm::join(words, "\n");
+      std::string encoded;
+      Error error = iconvstrFunc_(joined,"UTF-8",encoding_,false,&encoded);
+      std::vector<std::string> encodedWords;
+      if (!error)
+         boost::algorithm::split(encodedWords, encoded, boost::is_any_of("\n"));
+
+      if (!error && encodedWords.size() == words.size())
+      {
+         for (std::size_t i = 0; i < encodedWords.size(); i++)
+            pCorrect->push_back(pHunspell_->spell(encodedWords[i].c_str()));
+      }
+      else
+      {
+         // one of the words couldn't be converted, so check them one at a
+         // time so the rest still get checked
+         for (std::size_t i = 0; i < words.size(); i++)
+         {
+            bool isCorrect;
+            if (checkSpelling(words[i], &isCorrect))
+               isCorrect = true;
+            pCorrect->push_back(isCorrect);
+         }
+      }
+
+      return Success();
+   }
+
    Error suggestionList(const std::string& word, std::vector<std::string>* pSug)
    {
       std::string encoded;
@@ -0,0 +1,241 @@
+/*
+ * HunspellSpellCheckerTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/spelling/SpellChecker.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/StringUtils.hpp>
+
+#include <core/collection/LruCache.hpp>
+
+namespace core {
+namespace spelling {
+
+namespace {
+
+// a 50k word document drawn from a vocabulary of a few thousand words with
+// a zipf distribution (as natural language is), 5% of them misspelled
+const int kDocumentWords = 50000;
+const int kVocabularyStride = 9;
+const int kMisspelledPercent = 5;
+
+// same capacity as the session's cache
+const std::size_t kCacheSize = 50000;
+
+typedef core::collection::LruCache<std::string,bool> SpellingCache;
+
+void verifySuccess(const Error& error)
+{
+   if (error)
+      std::cerr << error.summary() << std::endl;
+   BOOST_ASSERT(!error);
+}
+
+// every kVocabularyStride'th ascii word in the dictionary (without affix
+// flags). the first line of a .dic file is the word count
+std::vector<std::string> readVocabulary(const FilePath& dicPath)
+{
+   std::vector<std::string> vocabulary;
+   std::ifstream ifs(dicPath.absolutePath().c_str());
+   std::string line;
+   std::getline(ifs, line);
+   for (int i = 0; std::getline(ifs, line); i++)
+   {
+      if (i % kVocabularyStride != 0)
+         continue;
+
+      std::string word = line.substr(0, line.find('/'));
+      bool ascii = !word.empty();
+      BOOST_FOREACH(char ch, word)
+      {
+         if (static_cast<unsigned char>(ch) > 0x7F)
+            ascii = false;
+      }
+      if (ascii)
+         vocabulary.push_back(word);
+   }
+   return vocabulary;
+}
+
+std::vector<std::string> buildDocument(
+                              const std::vector<std::string>& vocabulary)
+{
+   // cumulative zipf weights (rank r has weight 1/r)
+   std::vector<double> cumulative;
+   double total = 0;
+   for (std::size_t i = 0; i < vocabulary.size(); i++)
+   {
+      total += 1.0 / (i + 1);
+      cumulative.push_back(total);
+   }
+
+   std::vector<std::string> document;
+   document.reserve(kDocumentWords);
+   unsigned int seed = 1;
+   for (int i = 0; i < kDocumentWords; i++)
+   {
+      seed = (seed * 1103515245) + 12345;
+      double sample = total * ((seed >> 8) % 1000000) / 1000000.0;
+      std::size_t rank = std::lower_bound(cumulative.begin(),
+                                          cumulative.end(),
+                                          sample) - cumulative.begin();
+      std::string word = vocabulary[std::min(rank, vocabulary.size() - 1)];
+
+      seed = (seed * 1103515245) + 12345;
+      if ((seed >> 8) % 100 < static_cast<unsigned int>(kMisspelledPercent))
+         word.insert(1, "qx");
+
+      document.push_back(word);
+   }
+   return document;
+}
+
+// one check per word (what the client did before the batch rpc)
+int countMisspelledPerWord(SpellChecker* pSpellChecker,
+                           const std::vector<std::string>& document)
+{
+   int misspelled = 0;
+   BOOST_FOREACH(const std::string& word, document)
+   {
+      bool isCorrect = true;
+      verifySuccess(pSpellChecker->checkSpelling(word, &isCorrect));
+      if (!isCorrect)
+         misspelled++;
+   }
+   return misspelled;
+}
+
+// what the check_spelling_batch rpc does: distinct words are resolved from
+// the cache where possible and the rest are checked in one call
+int countMisspelledBatch(SpellChecker* pSpellChecker,
+                         const std::vector<std::string>& document,
+                         SpellingCache* pCache)
+{
+   boost::unordered_map<std::string,bool> results;
+   std::vector<std::string> uncheckedWords;
+   BOOST_FOREACH(const std::string& word, document)
+   {
+      if (results.find(word) != results.end())
+         continue;
+
+      bool isCorrect;
+      if (pCache->get(word, &isCorrect))
+      {
+         results[word] = isCorrect;
+      }
+      else
+      {
+         results[word] = true;
+         uncheckedWords.push_back(word);
+      }
+   }
+
+   std::vector<bool> correct;
+   verifySuccess(pSpellChecker->checkSpelling(uncheckedWords, &correct));
+   for (std::size_t i = 0; i < uncheckedWords.size() && i < correct.size(); i++)
+   {
+      results[uncheckedWords[i]] = correct[i];
+      pCache->put(uncheckedWords[i], correct[i]);
+   }
+
+   int misspelled = 0;
+   BOOST_FOREACH(const std::string& word, document)
+   {
+      if (!results[word])
+         misspelled++;
+   }
+   return misspelled;
+}
+
+void verifyMisspelled(int expected, int actual, const std::string& name)
+{
+   if (expected != actual)
+   {
+      std::cerr << name << ": " << actual << " misspelled (expected "
+                << expected << ")" << std::endl;
+   }
+   BOOST_ASSERT(expected == actual);
+}
+
+} // anonymous namespace
+
+// compare checking a document word by word against checking it as a batch
+// (with a cold and then a warm cache). dictionaryPath is the directory
+// containing en_US.aff and en_US.dic
+void runSpellingBenchmark(const FilePath& dictionaryPath)
+{
+   using namespace boost::posix_time;
+
+   boost::shared_ptr<SpellChecker> pSpellChecker;
+   verifySuccess(createHunspell(dictionaryPath.childPath("en_US.aff"),
+                                dictionaryPath.childPath("en_US.dic"),
+                                &pSpellChecker,
+                                &string_utils::iconvstr));
+   if (!pSpellChecker)
+      return;
+
+   std::vector<std::string> vocabulary =
+                        readVocabulary(dictionaryPath.childPath("en_US.dic"));
+   if (vocabulary.empty())
+   {
+      std::cerr << "No words read from the dictionary" << std::endl;
+      return;
+   }
+   std::vector<std::string> document = buildDocument(vocabulary);
+
+   ptime start = microsec_clock::universal_time();
+   int perWordMisspelled = countMisspelledPerWord(pSpellChecker.get(),
+                                                  document);
+   time_duration perWordElapsed = microsec_clock::universal_time() - start;
+
+   SpellingCache cache(kCacheSize);
+   start = microsec_clock::universal_time();
+   int coldMisspelled = countMisspelledBatch(pSpellChecker.get(),
+                                             document,
+                                             &cache);
+   time_duration coldElapsed = microsec_clock::universal_time() - start;
+
+   start = microsec_clock::universal_time();
+   int warmMisspelled = countMisspelledBatch(pSpellChecker.get(),
+                                             document,
+                                             &cache);
+   time_duration warmElapsed = microsec_clock::universal_time() - start;
+
+   verifyMisspelled(perWordMisspelled, coldMisspelled, "Batch (cold)");
+   verifyMisspelled(perWordMisspelled, warmMisspelled, "Batch (warm)");
+
+   std::cout << "Spelling: " << document.size() << " words, "
+             << vocabulary.size() << " word vocabulary, "
+             << perWordMisspelled << " misspelled" << std::endl;
+   std::cout << "Spelling per word: "
+             << perWordElapsed.total_milliseconds() << " ms" << std::endl;
+   std::cout << "Spelling batch (cold cache): "
+             << coldElapsed.total_milliseconds() << " ms" << std::endl;
+   std::cout << "Spelling batch (warm cache): "
+             << warmElapsed.total_milliseconds() << " ms" << std::endl;
+}
+
+} // namespace spelling
+} // namespace core
@@ -170,13 +170,16 @@ public:
                      const ProcessOptions& options);
    virtual ~AsyncChildProcess();
 
-   // run process asynchronously
-   Error run(const ProcessCallbacks& callbacks)
+   // run process asynchronously. onActivity (which may be empty) is called
+   // on a background thread when the process has output or has exited
+   Error run(const ProcessCallbacks& callbacks,
+             const boost::function<void()>& onActivity)
    {
       Error error = ChildProcess::run();
       if (!error)
       {
          callbacks_ = callbacks;
+         watchForActivity(onActivity);
          return Success();
       }
       else
@@ -196,6 +199,10 @@ public:
 
 private:
 
+   // platform specific (a no-op where activity can't be watched, in which
+   // case poll always services the process)
+   void watchForActivity(const boost::function<void()>& onActivity);
+
    void reportError(const Error& error)
    {
       if (callbacks_.onError)
@@ -29,10 +29,20 @@
 #include <sys/wait.h>
 #include <sys/types.h>
 
+#ifndef __APPLE__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#endif
+
+#include <map>
+
 #include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/cstdint.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/Thread.hpp>
 #include <core/system/System.hpp>
 #include <core/system/ProcessArgs.hpp>
 #include <core/system/ShellUtils.hpp>
@@ -128,6 +138,247 @@ Error readPipe(int pipeFd, std::string* pOutput, bool *pEOF = NULL)
    return Success();
 }
 
+// descriptor which becomes readable when the process exits (-1 if the
+// kernel doesn't support them)
+int openPidFd(pid_t pid)
+{
+#if !defined(__APPLE__) && defined(SYS_pidfd_open)
+   // note that pidfds are always close on exec
+   return ::syscall(SYS_pidfd_open, pid, 0);
+#else
+   return -1;
+#endif
+}
+
+// Watches the output pipes of async children (and their pidfds) on a
+// background thread so that poll only needs to read from the children
+// which have something to report. Children which aren't being watched
+// (e.g. on OS X or if we couldn't create the epoll set) are always active.
+class ActivityMonitor : boost::noncopyable
+{
+public:
+   ActivityMonitor()
+      : initialized_(false), failed_(false), epollFd_(-1), nextId_(1)
+   {
+   }
+
+   // start watching the descriptors of a child. returns an id for the
+   // child or 0 if it can't be watched
+   boost::uint64_t add(const std::vector<int>& fds,
+                       const boost::function<void()>& onActivity);
+
+   // was there activity on the child since the last call
+   bool takeActivity(boost::uint64_t id);
+
+   // stop watching the descriptors of a child (must be called before
+   // they are closed)
+   void remove(boost::uint64_t id, const std::vector<int>& fds);
+
+private:
+   void initialize();
+   void removeDescriptors(const std::vector<int>& fds);
+   void watch();
+
+private:
+   struct Child
+   {
+      // active until the first poll
+      Child() : active(true) {}
+      bool active;
+      boost::function<void()> onActivity;
+   };
+
+   boost::mutex mutex_;
+   bool initialized_;
+   bool failed_;
+   int epollFd_;
+   boost::uint64_t nextId_;
+   std::map<boost::uint64_t,Child> children_;
+};
+
+ActivityMonitor& activityMonitor()
+{
+   // never deleted so that the watcher thread can't outlive it during exit
+   static ActivityMonitor* pMonitor = new ActivityMonitor();
+   return *pMonitor;
+}
+
+boost::uint64_t ActivityMonitor::add(const std::vector<int>& fds,
+                                     const boost::function<void()>& onActivity)
+{
+#ifndef __APPLE__
+   LOCK_MUTEX(mutex_)
+   {
+      if (!initialized_)
+      {
+         initialize();
+         initialized_ = true;
+      }
+
+      if (epollFd_ == -1)
+         return 0;
+
+      boost::uint64_t id = nextId_++;
+      BOOST_FOREACH(int fd, fds)
+      {
+         // edge triggered so we hear about each new write (or the exit)
+         // once rather than until poll gets around to reading it
+         struct epoll_event event;
+         event.events = EPOLLIN | EPOLLET;
+         event.data.u64 = id;
+         if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) == -1)
+         {
+            LOG_ERROR(systemError(errno, ERROR_LOCATION));
+            removeDescriptors(fds);
+            return 0;
+         }
+      }
+
+      children_[id].onActivity = onActivity;
+      return id;
+   }
+   END_LOCK_MUTEX
+#endif
+
+   return 0;
+}
+
+bool ActivityMonitor::takeActivity(boost::uint64_t id)
+{
+   if (id == 0)
+      return true;
+
+   LOCK_MUTEX(mutex_)
+   {
+      std::map<boost::uint64_t,Child>::iterator it = children_.find(id);
+      if (failed_ || it == children_.end())
+         return true;
+
+      bool active = it->second.active;
+      it->second.active = false;
+      return active;
+   }
+   END_LOCK_MUTEX
+
+   return true;
+}
+
+void ActivityMonitor::remove(boost::uint64_t id, const std::vector<int>& fds)
+{
+   if (id == 0)
+      return;
+
+   LOCK_MUTEX(mutex_)
+   {
+      removeDescriptors(fds);
+      children_.erase(id);
+   }
+   END_LOCK_MUTEX
+}
+
+void ActivityMonitor::initialize()
+{
+#ifndef __APPLE__
+   epollFd_ = ::epoll_create(1);
+   if (epollFd_ == -1)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      return;
+   }
+
+   // don't let children inherit the epoll set
+   int fdFlags = ::fcntl(epollFd_, F_GETFD);
+   if (fdFlags != -1)
+      ::fcntl(epollFd_, F_SETFD, fdFlags | FD_CLOEXEC);
+
+   boost::thread watcherThread;
+   core::thread::safeLaunchThread(boost::bind(&ActivityMonitor::watch, this),
+                                  &watcherThread);
+   if (watcherThread.joinable())
+   {
+      watcherThread.detach();
+   }
+   else
+   {
+      ::close(epollFd_);
+      epollFd_ = -1;
+   }
+#endif
+}
+
+void ActivityMonitor::removeDescriptors(const std::vector<int>& fds)
+{
+#ifndef __APPLE__
+   BOOST_FOREACH(int fd, fds)
+   {
+      // a descriptor which never made it into the set (or which was
+      // already closed) isn't an error
+      struct epoll_event event;
+      if (::epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, &event) == -1 &&
+          errno != ENOENT && errno != EBADF)
+      {
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      }
+   }
+#endif
+}
+
+void ActivityMonitor::watch()
+{
+#ifndef __APPLE__
+   const int kMaxEpollEvents = 64;
+   struct epoll_event epollEvents[kMaxEpollEvents];
+   while (true)
+   {
+      int count = ::epoll_wait(epollFd_, epollEvents, kMaxEpollEvents, -1);
+      if (count == -1)
+      {
+         if (errno == EINTR)
+            continue;
+
+         // treat every child as active from now on so that their output
+         // is still read
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+         LOCK_MUTEX(mutex_)
+         {
+            failed_ = true;
+         }
+         END_LOCK_MUTEX
+         return;
+      }
+
+      // mark children active and collect the handlers of those which
+      // weren't already (the handlers are called without the lock held)
+      std::vector<boost::function<void()> > handlers;
+      LOCK_MUTEX(mutex_)
+      {
+         for (int i = 0; i < count; i++)
+         {
+            // events may still arrive for children which were removed
+            std::map<boost::uint64_t,Child>::iterator it =
+                                       children_.find(epollEvents[i].data.u64);
+            if (it == children_.end() || it->second.active)
+               continue;
+
+            it->second.active = true;
+            if (it->second.onActivity)
+               handlers.push_back(it->second.onActivity);
+         }
+      }
+      END_LOCK_MUTEX
+
+      BOOST_FOREACH(const boost::function<void()>& handler, handlers)
+      {
+         try
+         {
+            handler();
+         }
+         CATCH_UNEXPECTED_EXCEPTION
+      }
+   }
+#endif
+}
+
 } // anonymous namespace
 
 
@@ -644,14 +895,35 @@ struct AsyncChildProcess::AsyncImpl
       : calledOnStarted_(false),
         finishedStdout_(false),
         finishedStderr_(false),
-        exited_(false)
+        exited_(false),
+        monitorId_(0),
+        pidFd_(-1)
+   {
+   }
+
+   void stopWatching()
    {
+      activityMonitor().remove(monitorId_, watchedFds_);
+      monitorId_ = 0;
+      watchedFds_.clear();
+
+      if (pidFd_ != -1)
+      {
+         ::close(pidFd_);
+         pidFd_ = -1;
+      }
    }
 
    bool calledOnStarted_;
    bool finishedStdout_;
    bool finishedStderr_;
    bool exited_;
+
+   // activity monitoring (pidFd_ is -1 if we need to check for exit
+   // on every poll)
+   boost::uint64_t monitorId_;
+   int pidFd_;
+   std::vector<int> watchedFds_;
 };
 
 AsyncChildProcess::AsyncChildProcess(const std::string& exe,
@@ -676,6 +948,28 @@ AsyncChildProcess::AsyncChildProcess(const std::string& command,
 
 AsyncChildProcess::~AsyncChildProcess()
 {
+   pAsyncImpl_->stopWatching();
+}
+
+void AsyncChildProcess::watchForActivity(
+                              const boost::function<void()>& onActivity)
+{
+   std::vector<int> fds;
+   fds.push_back(pImpl_->fdStdout);
+   if (pImpl_->fdStderr != -1)
+      fds.push_back(pImpl_->fdStderr);
+
+   int pidFd = openPidFd(pImpl_->pid);
+   if (pidFd != -1)
+      fds.push_back(pidFd);
+
+   pAsyncImpl_->monitorId_ = activityMonitor().add(fds, onActivity);
+   pAsyncImpl_->watchedFds_ = fds;
+   pAsyncImpl_->pidFd_ = pidFd;
+
+   // without the monitor the pidfd is of no use
+   if (pAsyncImpl_->monitorId_ == 0)
+      pAsyncImpl_->stopWatching();
 }
 
 Error AsyncChildProcess::terminate()
@@ -724,6 +1018,29 @@ void AsyncChildProcess::poll()
       }
    }
 
+   // Check for exited. Note that this method specifies WNOHANG
+   // so we don't block forever waiting for a process the exit. We may
+   // not be able to reap the child due to an error (typically ECHILD,
+   // which occurs if the child was reaped by a global handler) in which
+   // case we'll allow the exit sequence to proceed and simply pass -1 as
+   // the exit status. We check before reading so that we get all of the
+   // output of a child which has exited. If we have a pidfd for the child
+   // then it's only worth checking when there has been activity.
+   bool active = activityMonitor().takeActivity(pAsyncImpl_->monitorId_);
+   int status;
+   pid_t result = 0;
+   int waitErrno = 0;
+   if (active || pAsyncImpl_->pidFd_ == -1)
+   {
+      result = posixCall<pid_t>(
+               boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
+      waitErrno = errno;
+   }
+
+   // nothing more to do until there is output or an exit
+   if (!active && result == 0)
+      return;
+
    // check stdout and fire event if we got output
    if (!pAsyncImpl_->finishedStdout_)
    {
@@ -765,21 +1082,11 @@ void AsyncChildProcess::poll()
       }
    }
 
-
-   // Check for exited. Note that this method specifies WNOHANG
-   // so we don't block forever waiting for a process the exit. We may
-   // not be able to reap the child due to an error (typically ECHILD,
-   // which occurs if the child was reaped by a global handler) in which
-   // case we'll allow the exit sequence to proceed and simply pass -1 as
-   // the exit status.
-   int status;
-   pid_t result = posixCall<pid_t>(
-            boost::bind(::waitpid, pImpl_->pid, &status, WNOHANG));
-
    // either a normal exit or an error while waiting
    if (result != 0)
    {
-      // close all of our pipes
+      // stop watching and close all of our pipes
+      pAsyncImpl_->stopWatching();
       pImpl_->closeAll(ERROR_LOCATION);
 
       // fire exit event
@@ -802,8 +1109,8 @@ void AsyncChildProcess::poll()
       // if this is an error that isn't ECHILD then log it (we never
       // expect this to occur as the only documented error codes are
       // EINTR and ECHILD, and EINTR is handled internally by posixCall)
-      if (result == -1 && errno != ECHILD)
-         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      if (result == -1 && waitErrno != ECHILD)
+         LOG_ERROR(systemError(waitErrno, ERROR_LOCATION));
    }
 }
 
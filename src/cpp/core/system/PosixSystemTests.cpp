@@ -0,0 +1,178 @@
+/*
+ * PosixSystemTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/system/System.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+
+namespace core {
+namespace system {
+
+namespace {
+
+// number of descriptors (beyond stdin/out/err) open in the parent, which
+// is typical of a session with a few connections, pipes and files open
+const int kExtraDescriptors = 40;
+
+std::vector<int> openExtraDescriptors()
+{
+   std::vector<int> fds;
+   for (int i = 0; i < kExtraDescriptors; i++)
+   {
+      int fd = ::open("/dev/null", O_RDONLY);
+      BOOST_ASSERT(fd >= 0);
+      fds.push_back(fd);
+   }
+   return fds;
+}
+
+void closeDescriptors(const std::vector<int>& fds)
+{
+   for (std::size_t i = 0; i < fds.size(); i++)
+      ::close(fds[i]);
+}
+
+// closes every descriptor up to the limit (what we did before only
+// closing the descriptors which are open). used as a baseline
+Error closeToLimit()
+{
+   struct rlimit rl;
+   if (::getrlimit(RLIMIT_NOFILE, &rl) < 0)
+      return systemError(errno, ERROR_LOCATION);
+   if (rl.rlim_max == RLIM_INFINITY)
+      rl.rlim_max = 1024;
+
+   for (int i = STDERR_FILENO+1; i < (int)rl.rlim_max; i++)
+   {
+      if (::close(i) < 0 && errno != EBADF)
+         return systemError(errno, ERROR_LOCATION);
+   }
+
+   return Success();
+}
+
+// fork, close descriptors as a child process does, then either exec
+// /bin/true or (if exec is false) exit with the number of descriptors
+// beyond stdin/out/err which are still open. returns the exit status
+int spawn(const boost::function<Error()>& closeFunction, bool exec)
+{
+   pid_t pid = ::fork();
+   BOOST_ASSERT(pid >= 0);
+   if (pid < 0)
+      return -1;
+
+   if (pid == 0)
+   {
+      if (closeFunction())
+         ::_exit(EXIT_FAILURE);
+
+      if (exec)
+      {
+         ::execl("/bin/true", "true", (char*)NULL);
+         ::_exit(EXIT_FAILURE);
+      }
+
+      int openCount = 0;
+      for (int fd = STDERR_FILENO+1; fd < 1024; fd++)
+      {
+         if (::fcntl(fd, F_GETFD) != -1)
+            openCount++;
+      }
+      ::_exit(openCount);
+   }
+
+   int status = 0;
+   while (::waitpid(pid, &status, 0) < 0 && errno == EINTR)
+   {
+   }
+   BOOST_ASSERT(WIFEXITED(status));
+   return WEXITSTATUS(status);
+}
+
+void verifyNoOpenDescriptors(const boost::function<Error()>& closeFunction,
+                             const std::string& name)
+{
+   int openCount = spawn(closeFunction, false);
+   if (openCount != 0)
+      std::cerr << name << ": " << openCount << " left open" << std::endl;
+   BOOST_ASSERT(openCount == 0);
+}
+
+double millisecondsPerSpawn(const boost::function<Error()>& closeFunction,
+                            int spawns)
+{
+   using namespace boost::posix_time;
+
+   int failures = 0;
+   ptime start = microsec_clock::universal_time();
+   for (int i = 0; i < spawns; i++)
+   {
+      if (spawn(closeFunction, true) != EXIT_SUCCESS)
+         failures++;
+   }
+   time_duration elapsed = microsec_clock::universal_time() - start;
+
+   if (failures > 0)
+      std::cerr << failures << " of " << spawns << " spawns failed" << std::endl;
+   BOOST_ASSERT(failures == 0);
+
+   return (elapsed.total_microseconds() / 1000.0) / spawns;
+}
+
+} // anonymous namespace
+
+void runSystemTests()
+{
+   std::vector<int> fds = openExtraDescriptors();
+   verifyNoOpenDescriptors(closeNonStdFileDescriptors,
+                           "closeNonStdFileDescriptors");
+   verifyNoOpenDescriptors(closeToLimit, "closeToLimit");
+   closeDescriptors(fds);
+}
+
+// compare the time taken to fork + close descriptors + exec. note that
+// the baseline is proportional to RLIMIT_NOFILE so run this with a large
+// hard limit (e.g. ulimit -Hn 1048576) to see the difference in containers
+void runSpawnBenchmark()
+{
+   const int kSpawns = 200;
+
+   std::vector<int> fds = openExtraDescriptors();
+
+   double baseline = millisecondsPerSpawn(closeToLimit, kSpawns);
+   double current = millisecondsPerSpawn(closeNonStdFileDescriptors,
+                                         kSpawns);
+
+   closeDescriptors(fds);
+
+   std::cout << "Spawn (close to limit): " << baseline << " ms" << std::endl;
+   std::cout << "Spawn (close open): " << current << " ms" << std::endl;
+}
+
+} // namespace system
+} // namespace core
@@ -63,6 +63,7 @@ struct ProcessSupervisor::Impl
    Impl() : isPolling(false) {}
    bool isPolling;
    std::vector<boost::shared_ptr<AsyncChildProcess> > children;
+   boost::function<void()> onActivity;
 };
 
 ProcessSupervisor::ProcessSupervisor()
@@ -78,10 +79,11 @@ namespace {
 
 Error runChild(boost::shared_ptr<AsyncChildProcess> pChild,
                std::vector<boost::shared_ptr<AsyncChildProcess> >* pChildren,
-               const ProcessCallbacks& callbacks)
+               const ProcessCallbacks& callbacks,
+               const boost::function<void()>& onActivity)
 {
    // run the child
-   Error error = pChild->run(callbacks);
+   Error error = pChild->run(callbacks, onActivity);
    if (error)
       return error;
 
@@ -106,7 +108,10 @@ Error ProcessSupervisor::runProgram(const std::string& executable,
                                                        options));
 
    // run the child
-   return runChild(pChild, &(pImpl_->children), callbacks);
+   return runChild(pChild,
+                   &(pImpl_->children),
+                   callbacks,
+                   pImpl_->onActivity);
 }
 
 Error ProcessSupervisor::runCommand(const std::string& command,
@@ -118,7 +123,10 @@ Error ProcessSupervisor::runCommand(const std::string& command,
                                  new AsyncChildProcess(command, options));
 
    // run the child
-   return runChild(pChild, &(pImpl_->children), callbacks);
+   return runChild(pChild,
+                   &(pImpl_->children),
+                   callbacks,
+                   pImpl_->onActivity);
 }
 
 namespace {
@@ -255,6 +263,12 @@ Error ProcessSupervisor::runCommand(
 
 
 
+void ProcessSupervisor::setActivityHandler(
+                              const boost::function<void()>& onActivity)
+{
+   pImpl_->onActivity = onActivity;
+}
+
 bool ProcessSupervisor::hasRunningChildren()
 {
    return !pImpl_->children.empty();
@@ -596,6 +596,12 @@ Error AsyncChildProcess::terminate()
    return ChildProcess::terminate();
 }
 
+void AsyncChildProcess::watchForActivity(
+                              const boost::function<void()>& onActivity)
+{
+   // not supported (poll reads available bytes from every child)
+}
+
 
 void AsyncChildProcess::poll()
 {
@@ -0,0 +1,173 @@
+/*
+ * FileChangeCoalescer.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/system/FileChangeCoalescer.hpp>
+
+#include <boost/foreach.hpp>
+
+namespace core {
+namespace system {
+
+namespace {
+
+boost::posix_time::ptime now()
+{
+   return boost::posix_time::microsec_clock::universal_time();
+}
+
+// combine an event with the pending event for the same path. returns
+// false if the two events can't be expressed as a single event
+bool combine(const FileChangeEvent& pending,
+             const FileChangeEvent& event,
+             FileChangeEvent* pCombined)
+{
+   const FileInfo& fileInfo = event.fileInfo();
+   switch(pending.type())
+   {
+   case FileChangeEvent::FileAdded:
+      if (event.type() == FileChangeEvent::FileRemoved)
+         *pCombined = FileChangeEvent(FileChangeEvent::None, fileInfo);
+      else
+         *pCombined = FileChangeEvent(FileChangeEvent::FileAdded, fileInfo);
+      return true;
+
+   case FileChangeEvent::FileModified:
+      if (event.type() == FileChangeEvent::FileRemoved)
+         *pCombined = event;
+      else
+         *pCombined = FileChangeEvent(FileChangeEvent::FileModified, fileInfo);
+      return true;
+
+   case FileChangeEvent::FileRemoved:
+      // a file which was replaced is a modification (unless it changed
+      // between being a file and a directory)
+      if (event.type() == FileChangeEvent::FileRemoved)
+      {
+         *pCombined = event;
+         return true;
+      }
+      else if (pending.fileInfo().isDirectory() == fileInfo.isDirectory())
+      {
+         *pCombined = FileChangeEvent(FileChangeEvent::FileModified, fileInfo);
+         return true;
+      }
+      else
+      {
+         return false;
+      }
+
+   case FileChangeEvent::None:
+   default:
+      *pCombined = event;
+      return true;
+   }
+}
+
+} // anonymous namespace
+
+FileChangeCoalescer::FileChangeCoalescer(
+                     const boost::posix_time::time_duration& quietPeriod,
+                     const boost::posix_time::time_duration& maxDelay,
+                     std::size_t stormThreshold)
+   : quietPeriod_(quietPeriod),
+     maxDelay_(maxDelay),
+     stormThreshold_(stormThreshold),
+     batchEvents_(0)
+{
+}
+
+void FileChangeCoalescer::add(const std::vector<FileChangeEvent>& events)
+{
+   if (events.empty())
+      return;
+
+   lastEvent_ = now();
+   if (batchEvents_ == 0)
+      batchStarted_ = lastEvent_;
+
+   batchEvents_ += events.size();
+   stats_.rawEvents += events.size();
+
+   BOOST_FOREACH(const FileChangeEvent& event, events)
+   {
+      append(event);
+   }
+}
+
+bool FileChangeCoalescer::ready() const
+{
+   if (!hasPending())
+      return false;
+
+   boost::posix_time::ptime time = now();
+   if (time - lastEvent_ >= quietPeriod_)
+      return true;
+
+   // storms are held until they are over so they are delivered as a
+   // single batch
+   return batchEvents_ < stormThreshold_ && (time - batchStarted_ >= maxDelay_);
+}
+
+bool FileChangeCoalescer::take(std::vector<FileChangeEvent>* pEvents)
+{
+   bool storm = batchEvents_ >= stormThreshold_;
+   if (storm)
+      stats_.storms++;
+
+   BOOST_FOREACH(const FileChangeEvent& event, events_)
+   {
+      if (event.type() != FileChangeEvent::None)
+      {
+         pEvents->push_back(event);
+         stats_.deliveredEvents++;
+      }
+   }
+
+   reset();
+   return storm;
+}
+
+void FileChangeCoalescer::append(const FileChangeEvent& event)
+{
+   const std::string& path = event.fileInfo().absolutePath();
+   boost::unordered_map<std::string, std::size_t>::iterator it =
+                                                      pathIndex_.find(path);
+   if (it != pathIndex_.end())
+   {
+      FileChangeEvent combined(FileChangeEvent::None, event.fileInfo());
+      if (combine(events_[it->second], event, &combined))
+      {
+         events_[it->second] = combined;
+         return;
+      }
+
+      // couldn't combine so this becomes the latest event for the path
+      it->second = events_.size();
+   }
+   else
+   {
+      pathIndex_[path] = events_.size();
+   }
+
+   events_.push_back(event);
+}
+
+void FileChangeCoalescer::reset()
+{
+   events_.clear();
+   pathIndex_.clear();
+   batchEvents_ = 0;
+}
+
+} // namespace system
+} // namespace core
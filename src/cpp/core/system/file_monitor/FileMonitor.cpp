@@ -15,6 +15,7 @@
 #include <core/system/FileMonitor.hpp>
 
 #include <list>
+#include <map>
 
 #include <boost/bind.hpp>
 #include <boost/foreach.hpp>
@@ -98,6 +99,22 @@ bool sizeAndLastWriteTimeAreEqual(const FileInfo& a, const FileInfo& b)
    return a.size() == b.size() && a.lastWriteTime() == b.lastWriteTime();
 }
 
+// insert a child at its sorted position (children are kept in path order)
+tree<FileInfo>::sibling_iterator insertChild(tree<FileInfo>::iterator parentIt,
+                                             const FileInfo& fileInfo,
+                                             tree<FileInfo>* pTree)
+{
+   for (tree<FileInfo>::sibling_iterator it = pTree->begin(parentIt);
+        it != pTree->end(parentIt);
+        ++it)
+   {
+      if (fileInfoPathLessThan(fileInfo, *it))
+         return pTree->insert(it, fileInfo);
+   }
+
+   return pTree->append_child(parentIt, fileInfo);
+}
+
 } // anonymous namespace
 
 
@@ -130,6 +147,40 @@ boost::function<bool(const FileInfo&)> excludeHiddenFilter()
 // helpers for platform-specific implementations
 namespace impl {
 
+void FileTreeIndex::rebuild(tree<FileInfo>* pTree)
+{
+   nodes_.clear();
+   for (tree<FileInfo>::iterator it = pTree->begin(); it != pTree->end(); ++it)
+      nodes_[it->absolutePath()] = it;
+}
+
+void FileTreeIndex::addSubtree(tree<FileInfo>::iterator it)
+{
+   tree<FileInfo>::iterator end = it;
+   end.skip_children();
+   ++end;
+   for ( ; it != end; ++it)
+      nodes_[it->absolutePath()] = it;
+}
+
+void FileTreeIndex::removeSubtree(tree<FileInfo>::iterator it)
+{
+   tree<FileInfo>::iterator end = it;
+   end.skip_children();
+   ++end;
+   for ( ; it != end; ++it)
+      nodes_.erase(it->absolutePath());
+}
+
+tree<FileInfo>::iterator FileTreeIndex::find(const std::string& path) const
+{
+   Nodes::const_iterator it = nodes_.find(path);
+   if (it != nodes_.end())
+      return it->second;
+   else
+      return tree<FileInfo>::iterator();
+}
+
 Error processFileAdded(
               tree<FileInfo>::iterator parentIt,
               const FileChangeEvent& fileChange,
@@ -137,16 +188,16 @@ Error processFileAdded(
               const boost::function<bool(const FileInfo&)>& filter,
               const boost::function<Error(const FileInfo&)>& onBeforeScanDir,
               tree<FileInfo>* pTree,
+              FileTreeIndex* pIndex,
               std::vector<FileChangeEvent>* pFileChanges)
 {
    // see if this node already exists. if it does then check it for changes
    // (if there are no changes then ignore). we do this because some editors
    // (for example gedit) actually save files in such a way that FileAdded
    // is generated (because they overwrite the old file with a move)
-   tree<FileInfo>::sibling_iterator it = impl::findFile(pTree->begin(parentIt),
-                                                        pTree->end(parentIt),
-                                                        fileChange.fileInfo());
-   if (it != pTree->end(parentIt))
+   tree<FileInfo>::iterator it = pIndex->find(
+                                          fileChange.fileInfo().absolutePath());
+   if (pTree->is_valid(it))
    {
       if (fileChange.fileInfo() != *it)
       {
@@ -174,9 +225,11 @@ Error processFileAdded(
 
       // merge in the sub-tree
       tree<FileInfo>::sibling_iterator addedIter =
-         pTree->append_child(parentIt, fileChange.fileInfo());
-      pTree->insert_subtree_after(addedIter, subTree.begin());
+         insertChild(parentIt, fileChange.fileInfo(), pTree);
+      tree<FileInfo>::iterator subtreeIter =
+         pTree->insert_subtree_after(addedIter, subTree.begin());
       pTree->erase(addedIter);
+      pIndex->addSubtree(subtreeIter);
 
       // generate events
       std::for_each(subTree.begin(),
@@ -188,35 +241,28 @@ Error processFileAdded(
    }
    else
    {
-      pTree->append_child(parentIt, fileChange.fileInfo());
+      pIndex->addSubtree(insertChild(parentIt, fileChange.fileInfo(), pTree));
       pFileChanges->push_back(fileChange);
    }
 
-   // sort the container after insert
-   pTree->sort(pTree->begin(parentIt),
-               pTree->end(parentIt),
-               fileInfoPathLessThan,
-               false);
-
    return Success();
 }
 
 void processFileModified(tree<FileInfo>::iterator parentIt,
                          const FileChangeEvent& fileChange,
                          tree<FileInfo>* pTree,
+                         FileTreeIndex* pIndex,
                          std::vector<FileChangeEvent>* pFileChanges)
 {
-   // search for a child with this path
-   tree<FileInfo>::sibling_iterator modIt = impl::findFile(
-                                                     pTree->begin(parentIt),
-                                                     pTree->end(parentIt),
-                                                     fileChange.fileInfo());
+   // search for a node with this path
+   tree<FileInfo>::iterator modIt = pIndex->find(
+                                          fileChange.fileInfo().absolutePath());
 
    // only generate actions if the data is actually new (win32 file monitoring
    // can generate redundant modified events for save operations as well as
    // when directories are copied and pasted, in which case an add is followed
    // by a modified)
-   if ((modIt != pTree->end(parentIt)) &&
+   if (pTree->is_valid(modIt) &&
        !sizeAndLastWriteTimeAreEqual(fileChange.fileInfo(), *modIt))
    {
       pTree->replace(modIt, fileChange.fileInfo());
@@ -230,15 +276,15 @@ void processFileRemoved(tree<FileInfo>::iterator parentIt,
                         const FileChangeEvent& fileChange,
                         bool recursive,
                         tree<FileInfo>* pTree,
+                        FileTreeIndex* pIndex,
                         std::vector<FileChangeEvent>* pFileChanges)
 {
-   // search for a child with this path
-   tree<FileInfo>::sibling_iterator remIt = findFile(pTree->begin(parentIt),
-                                                     pTree->end(parentIt),
-                                                     fileChange.fileInfo());
+   // search for a node with this path
+   tree<FileInfo>::iterator remIt = pIndex->find(
+                                          fileChange.fileInfo().absolutePath());
 
    // only generate actions if the item was found in the tree
-   if (remIt != pTree->end(parentIt))
+   if (pTree->is_valid(remIt))
    {
       // if this is folder then we need to generate recursive
       // remove events, otherwise can just add single event
@@ -262,6 +308,7 @@ void processFileRemoved(tree<FileInfo>::iterator parentIt,
       }
 
       // remove it from the tree
+      pIndex->removeSubtree(remIt);
       pTree->erase(remIt);
    }
 }
@@ -272,16 +319,15 @@ Error discoverAndProcessFileChanges(
    const boost::function<bool(const FileInfo&)>& filter,
    const boost::function<Error(const FileInfo&)>& onBeforeScanDir,
    tree<FileInfo>* pTree,
+   FileTreeIndex* pIndex,
    const  boost::function<void(const std::vector<FileChangeEvent>&)>&
                                                                onFilesChanged)
 {
    // find this path in our fileTree
-   tree<FileInfo>::iterator it = std::find(pTree->begin(),
-                                           pTree->end(),
-                                           fileInfo);
+   tree<FileInfo>::iterator it = pIndex->find(fileInfo.absolutePath());
 
    // if we don't find it then it may have been excluded by a filter, just bail
-   if (it == pTree->end())
+   if (!pTree->is_valid(it))
       return Success();
 
    // scan this directory into a new tree which we can compare to the old tree
@@ -311,8 +357,11 @@ Error discoverAndProcessFileChanges(
       onFilesChanged(fileChanges);
 
       // wholesale replace subtree
-      pTree->insert_subtree_after(it, subdirTree.begin());
+      pIndex->removeSubtree(it);
+      tree<FileInfo>::iterator subtreeIt =
+                  pTree->insert_subtree_after(it, subdirTree.begin());
       pTree->erase(it);
+      pIndex->addSubtree(subtreeIt);
    }
    else
    {
@@ -337,6 +386,7 @@ Error discoverAndProcessFileChanges(
                                            recursive,
                                            filter,
                                            pTree,
+                                           pIndex,
                                            &fileChanges);
             if (error)
                LOG_ERROR(error);
@@ -344,7 +394,11 @@ Error discoverAndProcessFileChanges(
          }
          case FileChangeEvent::FileModified:
          {
-            processFileModified(it, fileChange, pTree, &fileChanges);
+            processFileModified(it,
+                                fileChange,
+                                pTree,
+                                pIndex,
+                                &fileChanges);
             break;
          }
          case FileChangeEvent::FileRemoved:
@@ -353,6 +407,7 @@ Error discoverAndProcessFileChanges(
                                fileChange,
                                recursive,
                                pTree,
+                               pIndex,
                                &fileChanges);
             break;
          }
@@ -387,8 +442,8 @@ std::list<void*> activeEventContexts()
 // these are implemented per-platform
 namespace detail {
 
-// run the monitor, calling back checkForInput periodically to see if there are
-// new registrations or unregistrations
+// run the monitor, calling back checkForInput periodically (or after being
+// woken) to see if there are new registrations or unregistrations
 void run(const boost::function<void()>& checkForInput);
 
 // register a new file monitor
@@ -400,10 +455,19 @@ Handle registerMonitor(const core::FilePath& filePath,
 // unregister a file monitor
 void unregisterMonitor(Handle handle);
 
+// rescan the monitored directory, comparing the result to the existing
+// tree and firing onFilesChanged for any differences
+void rescanMonitor(Handle handle);
+
 // stop the monitor. allows for optinal global cleanup and/or waiting
 // for termination state on the monitor thread
 void stop();
 
+// wake the monitor thread (called after registration commands are enqued
+// and when the monitor is stopped so that implementations which block
+// waiting for file system events can respond immediately)
+void wakeup();
+
 } // namespace detail
 
 
@@ -412,7 +476,7 @@ namespace {
 class RegistrationCommand
 {
 public:
-   enum Type { None, Register, Unregister };
+   enum Type { None, Register, Unregister, Rescan };
 
 public:
    RegistrationCommand()
@@ -432,8 +496,8 @@ public:
    {
    }
 
-   explicit RegistrationCommand(Handle handle)
-      : type_(Unregister), handle_(handle)
+   explicit RegistrationCommand(Handle handle, Type type = Unregister)
+      : type_(type), handle_(handle)
    {
    }
 
@@ -462,7 +526,7 @@ private:
    boost::function<bool(const FileInfo&)> filter_;
    Callbacks callbacks_;
 
-   // unregister command data
+   // unregister and rescan command data
    Handle handle_;
 };
 
@@ -486,11 +550,18 @@ void checkForInput()
 {
    // wait for up to 250ms for new input (we can't block indefinitely because this
    // code runs within the context of the monitoring thread which also needs to free
-   // up so that filesystem change notifications can be received)
+   // up so that filesystem change notifications can be received). note that
+   // implementations which are woken when input arrives only call this when
+   // there is input so won't actually wait
    RegistrationCommand command;
-   while (registrationCommandQueue().deque(
-                              &command,
-                              boost::posix_time::milliseconds(250)))
+   if (!registrationCommandQueue().deque(&command,
+                                         boost::posix_time::milliseconds(250)))
+   {
+      return;
+   }
+
+   // process all available input
+   do
    {
       switch(command.type())
       {
@@ -521,10 +592,23 @@ void checkForInput()
          break;
       }
 
+      case RegistrationCommand::Rescan:
+      {
+         // the monitor may have been unregistered since the rescan was
+         // requested so make sure it is still active
+         std::list<Handle>::iterator it = std::find(s_pActiveHandles->begin(),
+                                                    s_pActiveHandles->end(),
+                                                    command.handle());
+         if (it != s_pActiveHandles->end())
+            detail::rescanMonitor(*it);
+         break;
+      }
+
       case RegistrationCommand::None:
          break;
       }
    }
+   while (registrationCommandQueue().deque(&command));
 }
 
 void fileMonitorThreadMain()
@@ -567,17 +651,6 @@ void fileMonitorThreadMain()
    CATCH_UNEXPECTED_EXCEPTION
 }
 
-void enqueOnRegistered(const Callbacks& callbacks,
-                       Handle handle,
-                       const tree<FileInfo>& fileTree)
-{
-   if (callbacks.onRegistered)
-   {
-      callbackQueue().enque(boost::bind(callbacks.onRegistered,
-                                        handle,
-                                        fileTree));
-   }
-}
 
 void enqueOnRegistrationError(const Callbacks& callbacks, const Error& error)
 {
@@ -595,23 +668,113 @@ void enqueOnMonitoringError(const Callbacks& callbacks, const Error& error)
    }
 }
 
-void enqueOnFilesChanged(const Callbacks& callbacks,
-                         const std::vector<FileChangeEvent>& fileChanges)
+// file change events are coalesced on the thread which calls checkForChanges
+// (quiet period and max delay bound the latency added by batching)
+const boost::posix_time::time_duration kCoalesceQuietPeriod =
+                                       boost::posix_time::milliseconds(50);
+const boost::posix_time::time_duration kCoalesceMaxDelay =
+                                       boost::posix_time::milliseconds(500);
+const std::size_t kCoalesceStormThreshold = 2000;
+
+typedef std::map<boost::shared_ptr<FileChangeCoalescer>, Callbacks> Coalescers;
+Coalescers s_coalescers;
+FileChangeCoalescerStats s_retiredCoalescerStats;
+
+// handles of registered monitors (so storms can request a rescan)
+typedef std::map<boost::shared_ptr<FileChangeCoalescer>, Handle>
+                                                         CoalescerHandles;
+CoalescerHandles s_coalescerHandles;
+
+void deliverFileChanges(boost::shared_ptr<FileChangeCoalescer> pCoalescer,
+                        const Callbacks& callbacks)
 {
-   if (callbacks.onFilesChanged)
+   std::vector<FileChangeEvent> fileChanges;
+   bool storm = pCoalescer->take(&fileChanges);
+   if (!fileChanges.empty())
+      callbacks.onFilesChanged(fileChanges);
+
+   // changes are easily missed during a storm (e.g. files created in a new
+   // directory before it is watched) so rescan and diff against the tree.
+   // any differences arrive as ordinary file change events
+   CoalescerHandles::const_iterator it = s_coalescerHandles.find(pCoalescer);
+   if (storm && it != s_coalescerHandles.end())
    {
-      callbackQueue().enque(boost::bind(callbacks.onFilesChanged, fileChanges));
+      registrationCommandQueue().enque(
+               RegistrationCommand(it->second, RegistrationCommand::Rescan));
+      detail::wakeup();
    }
 }
 
-void enqueOnUnregistered(const Callbacks& callbacks, Handle handle)
+void coalescerRegistered(boost::shared_ptr<FileChangeCoalescer> pCoalescer,
+                         const Callbacks& callbacks,
+                         Handle handle,
+                         const tree<FileInfo>& fileTree)
+{
+   s_coalescerHandles[pCoalescer] = handle;
+
+   if (callbacks.onRegistered)
+      callbacks.onRegistered(handle, fileTree);
+}
+
+void enqueOnRegistered(const Callbacks& callbacks,
+                       boost::shared_ptr<FileChangeCoalescer> pCoalescer,
+                       Handle handle,
+                       const tree<FileInfo>& fileTree)
+{
+   callbackQueue().enque(boost::bind(coalescerRegistered,
+                                     pCoalescer,
+                                     callbacks,
+                                     handle,
+                                     fileTree));
+}
+
+void addFileChanges(boost::shared_ptr<FileChangeCoalescer> pCoalescer,
+                    const Callbacks& callbacks,
+                    const std::vector<FileChangeEvent>& fileChanges)
 {
+   pCoalescer->add(fileChanges);
+   s_coalescers.insert(std::make_pair(pCoalescer, callbacks));
+}
+
+void retireCoalescer(boost::shared_ptr<FileChangeCoalescer> pCoalescer,
+                     const Callbacks& callbacks,
+                     Handle handle)
+{
+   // deliver any pending changes ahead of the unregistration
+   if (pCoalescer->hasPending())
+      deliverFileChanges(pCoalescer, callbacks);
+
+   s_retiredCoalescerStats += pCoalescer->stats();
+   s_coalescers.erase(pCoalescer);
+   s_coalescerHandles.erase(pCoalescer);
+
    if (callbacks.onUnregistered)
+      callbacks.onUnregistered(handle);
+}
+
+void enqueOnFilesChanged(const Callbacks& callbacks,
+                         boost::shared_ptr<FileChangeCoalescer> pCoalescer,
+                         const std::vector<FileChangeEvent>& fileChanges)
+{
+   if (callbacks.onFilesChanged)
    {
-      callbackQueue().enque(boost::bind(callbacks.onUnregistered, handle));
+      callbackQueue().enque(boost::bind(addFileChanges,
+                                        pCoalescer,
+                                        callbacks,
+                                        fileChanges));
    }
 }
 
+void enqueOnUnregistered(const Callbacks& callbacks,
+                         boost::shared_ptr<FileChangeCoalescer> pCoalescer,
+                         Handle handle)
+{
+   callbackQueue().enque(boost::bind(retireCoalescer,
+                                     pCoalescer,
+                                     callbacks,
+                                     handle));
+}
+
 boost::thread s_fileMonitorThread;
 
 } // anonymous namespace
@@ -628,6 +791,7 @@ void stop()
    if (s_fileMonitorThread.joinable())
    {
       s_fileMonitorThread.interrupt();
+      detail::wakeup();
 
       // wait for for the thread to stop
       if (!s_fileMonitorThread.timed_join(boost::posix_time::seconds(3)))
@@ -644,28 +808,46 @@ void registerMonitor(const FilePath& filePath,
                      const boost::function<bool(const FileInfo&)>& filter,
                      const Callbacks& callbacks)
 {
+   // coalescer for file change events
+   boost::shared_ptr<FileChangeCoalescer> pCoalescer(
+                        new FileChangeCoalescer(kCoalesceQuietPeriod,
+                                                kCoalesceMaxDelay,
+                                                kCoalesceStormThreshold));
+
    // bind a new version of the callbacks that puts them on the callback queue
    Callbacks qCallbacks;
-   qCallbacks.onRegistered = boost::bind(enqueOnRegistered, callbacks, _1, _2);
+   qCallbacks.onRegistered = boost::bind(enqueOnRegistered,
+                                         callbacks,
+                                         pCoalescer,
+                                         _1,
+                                         _2);
    qCallbacks.onRegistrationError = boost::bind(enqueOnRegistrationError,
                                                 callbacks,
                                                 _1);
    qCallbacks.onMonitoringError = boost::bind(enqueOnMonitoringError,
                                               callbacks,
                                               _1);
-   qCallbacks.onFilesChanged = boost::bind(enqueOnFilesChanged, callbacks, _1);
-   qCallbacks.onUnregistered = boost::bind(enqueOnUnregistered, callbacks, _1);
+   qCallbacks.onFilesChanged = boost::bind(enqueOnFilesChanged,
+                                           callbacks,
+                                           pCoalescer,
+                                           _1);
+   qCallbacks.onUnregistered = boost::bind(enqueOnUnregistered,
+                                           callbacks,
+                                           pCoalescer,
+                                           _1);
 
    // enque the registration
    registrationCommandQueue().enque(RegistrationCommand(filePath,
                                                         recursive,
                                                         filter,
                                                         qCallbacks));
+   detail::wakeup();
 }
 
 void unregisterMonitor(Handle handle)
 {
    registrationCommandQueue().enque(RegistrationCommand(handle));
+   detail::wakeup();
 }
 
 void checkForChanges()
@@ -673,6 +855,29 @@ void checkForChanges()
    boost::function<void()> callback;
    while (callbackQueue().deque(&callback))
       callback();
+
+   // deliver coalesced file changes which are ready (copy the ready
+   // coalescers first since the callbacks could register or unregister)
+   std::vector<Coalescers::value_type> ready;
+   BOOST_FOREACH(const Coalescers::value_type& coalescer, s_coalescers)
+   {
+      if (coalescer.first->ready())
+         ready.push_back(coalescer);
+   }
+   BOOST_FOREACH(const Coalescers::value_type& coalescer, ready)
+   {
+      deliverFileChanges(coalescer.first, coalescer.second);
+   }
+}
+
+FileChangeCoalescerStats coalescingStats()
+{
+   FileChangeCoalescerStats stats = s_retiredCoalescerStats;
+   BOOST_FOREACH(const Coalescers::value_type& coalescer, s_coalescers)
+   {
+      stats += coalescer.first->stats();
+   }
+   return stats;
 }
 
 } // namespace file_monitor
@@ -19,6 +19,8 @@
 #include <list>
 
 #include <boost/bind.hpp>
+#include <boost/utility.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <core/FilePath.hpp>
 #include <core/collection/Tree.hpp>
@@ -32,6 +34,35 @@ namespace system {
 namespace file_monitor {
 namespace impl {
 
+// Path-keyed index of the nodes within a monitored file tree. Change
+// events are located in the tree using the index rather than a linear
+// search so the cost of processing an event doesn't depend on the
+// number of files being monitored. Note that tree iterators remain valid
+// as other nodes are inserted and erased so the index only needs to be
+// updated for the nodes which are actually added or removed.
+class FileTreeIndex : boost::noncopyable
+{
+public:
+   // index all of the nodes in the tree
+   void rebuild(tree<FileInfo>* pTree);
+
+   // index the node and all of its descendents
+   void addSubtree(tree<FileInfo>::iterator it);
+
+   // remove the node and all of its descendents from the index
+   void removeSubtree(tree<FileInfo>::iterator it);
+
+   // find the node with the specified path (returns an iterator for
+   // which tree::is_valid returns false if there is no such node)
+   tree<FileInfo>::iterator find(const std::string& path) const;
+
+   void clear() { nodes_.clear(); }
+
+private:
+   typedef boost::unordered_map<std::string, tree<FileInfo>::iterator> Nodes;
+   Nodes nodes_;
+};
+
 Error processFileAdded(
                tree<FileInfo>::iterator parentIt,
                const FileChangeEvent& fileChange,
@@ -39,6 +70,7 @@ Error processFileAdded(
                const boost::function<bool(const FileInfo&)>& filter,
                const boost::function<Error(const FileInfo&)>& onBeforeScanDir,
                tree<FileInfo>* pTree,
+               FileTreeIndex* pIndex,
                std::vector<FileChangeEvent>* pFileChanges);
 
 inline Error processFileAdded(
@@ -47,6 +79,7 @@ inline Error processFileAdded(
                bool recursive,
                const boost::function<bool(const FileInfo&)>& filter,
                tree<FileInfo>* pTree,
+               FileTreeIndex* pIndex,
                std::vector<FileChangeEvent>* pFileChanges)
 {
    return processFileAdded(parentIt,
@@ -55,18 +88,21 @@ inline Error processFileAdded(
                            filter,
                            boost::function<Error(const FileInfo&)>(),
                            pTree,
+                           pIndex,
                            pFileChanges);
 }
 
 void processFileModified(tree<FileInfo>::iterator parentIt,
                          const FileChangeEvent& fileChange,
                          tree<FileInfo>* pTree,
+                         FileTreeIndex* pIndex,
                          std::vector<FileChangeEvent>* pFileChanges);
 
 void processFileRemoved(tree<FileInfo>::iterator parentIt,
                         const FileChangeEvent& fileChange,
                         bool recursive,
                         tree<FileInfo>* pTree,
+                        FileTreeIndex* pIndex,
                         std::vector<FileChangeEvent>* pFileChanges);
 
 Error discoverAndProcessFileChanges(
@@ -75,6 +111,7 @@ Error discoverAndProcessFileChanges(
    const boost::function<bool(const FileInfo&)>& filter,
    const boost::function<Error(const FileInfo&)>& onBeforeScanDir,
    tree<FileInfo>* pTree,
+   FileTreeIndex* pIndex,
    const boost::function<void(const std::vector<FileChangeEvent>&)>&
                                                             onFilesChanged);
 
@@ -83,6 +120,7 @@ inline Error discoverAndProcessFileChanges(
    bool recursive,
    const boost::function<bool(const FileInfo&)>& filter,
    tree<FileInfo>* pTree,
+   FileTreeIndex* pIndex,
    const boost::function<void(const std::vector<FileChangeEvent>&)>&
                                                             onFilesChanged)
 {
@@ -92,23 +130,10 @@ inline Error discoverAndProcessFileChanges(
                                  filter,
                                  boost::function<Error(const FileInfo&)>(),
                                  pTree,
+                                 pIndex,
                                  onFilesChanged);
 }
 
-template <typename Iterator>
-Iterator findFile(Iterator begin, Iterator end, const std::string& path)
-{
-   return std::find_if(begin, end, boost::bind(fileInfoHasPath,
-                                               _1,
-                                               path));
-}
-
-template <typename Iterator>
-Iterator findFile(Iterator begin, Iterator end, const FileInfo& fileInfo)
-{
-   return findFile(begin, end, fileInfo.absolutePath());
-}
-
 std::list<void*> activeEventContexts();
 
 
@@ -0,0 +1,247 @@
+/*
+ * FileMonitorTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/system/FileMonitor.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/assert.hpp>
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/FileInfo.hpp>
+
+#include "FileMonitorImpl.hpp"
+
+namespace core {
+namespace system {
+namespace file_monitor {
+
+namespace {
+
+// a project of 2000 directories x 100 files and a burst of changes such
+// as a git checkout across branches produces. the tree is synthetic (the
+// paths don't exist) so only the cost of reconciling events is measured
+const int kDirs = 2000;
+const int kFilesPerDir = 100;
+const int kEvents = 100000;
+const std::string kRoot = "/file-monitor-benchmark";
+
+std::string dirPath(int dir)
+{
+   return boost::str(boost::format("%1%/dir%2$04d") % kRoot % dir);
+}
+
+std::string filePath(int dir, const std::string& name)
+{
+   return dirPath(dir) + "/" + name;
+}
+
+void buildTree(tree<FileInfo>* pTree)
+{
+   tree<FileInfo>::iterator rootIt = pTree->set_head(FileInfo(kRoot, true));
+   for (int dir = 0; dir < kDirs; dir++)
+   {
+      tree<FileInfo>::iterator dirIt =
+                  pTree->append_child(rootIt, FileInfo(dirPath(dir), true));
+      for (int file = 0; file < kFilesPerDir; file++)
+      {
+         std::string name = boost::str(boost::format("file%1$04d") % file);
+         pTree->append_child(dirIt,
+                             FileInfo(filePath(dir, name), false, 100, 0));
+      }
+   }
+}
+
+// deterministic mix of modifications, removes, and adds spread across
+// the whole tree
+std::vector<FileChangeEvent> buildEvents()
+{
+   std::vector<FileChangeEvent> events;
+   events.reserve(kEvents);
+
+   unsigned int seed = 1;
+   for (int i = 0; i < kEvents; i++)
+   {
+      seed = (seed * 1103515245) + 12345;
+      int dir = (seed >> 8) % kDirs;
+      int file = (seed >> 4) % kFilesPerDir;
+      std::string name = boost::str(boost::format("file%1$04d") % file);
+
+      switch (i % 4)
+      {
+      case 0:
+      case 1:
+         events.push_back(FileChangeEvent(
+               FileChangeEvent::FileModified,
+               FileInfo(filePath(dir, name), false, 100 + i, i)));
+         break;
+      case 2:
+         events.push_back(FileChangeEvent(
+               FileChangeEvent::FileRemoved,
+               FileInfo(filePath(dir, name), false)));
+         break;
+      case 3:
+         name = boost::str(boost::format("new%1$06d") % i);
+         events.push_back(FileChangeEvent(
+               FileChangeEvent::FileAdded,
+               FileInfo(filePath(dir, name), false, 100, i)));
+         break;
+      }
+   }
+
+   return events;
+}
+
+std::string parentPath(const FileChangeEvent& event)
+{
+   const std::string& path = event.fileInfo().absolutePath();
+   return path.substr(0, path.find_last_of('/'));
+}
+
+// apply an event the same way the platform monitors do
+void replayEvent(const FileChangeEvent& event,
+                 tree<FileInfo>* pTree,
+                 impl::FileTreeIndex* pIndex,
+                 std::vector<FileChangeEvent>* pFileChanges)
+{
+   tree<FileInfo>::iterator parentIt = pIndex->find(parentPath(event));
+   if (!pTree->is_valid(parentIt))
+      return;
+
+   switch (event.type())
+   {
+   case FileChangeEvent::FileAdded:
+   {
+      boost::function<bool(const FileInfo&)> noFilter;
+      Error error = impl::processFileAdded(parentIt,
+                                           event,
+                                           true,
+                                           noFilter,
+                                           pTree,
+                                           pIndex,
+                                           pFileChanges);
+      if (error)
+         std::cerr << error.summary() << std::endl;
+      break;
+   }
+   case FileChangeEvent::FileModified:
+      impl::processFileModified(parentIt, event, pTree, pIndex, pFileChanges);
+      break;
+   case FileChangeEvent::FileRemoved:
+      impl::processFileRemoved(parentIt,
+                               event,
+                               true,
+                               pTree,
+                               pIndex,
+                               pFileChanges);
+      break;
+   case FileChangeEvent::None:
+   default:
+      break;
+   }
+}
+
+// every node can be found at its own position and children are still
+// in path order
+bool indexMatchesTree(tree<FileInfo>* pTree, impl::FileTreeIndex* pIndex)
+{
+   for (tree<FileInfo>::iterator it = pTree->begin(); it != pTree->end(); ++it)
+   {
+      if (pIndex->find(it->absolutePath()) != it)
+         return false;
+
+      tree<FileInfo>::sibling_iterator next = pTree->next_sibling(it);
+      if (pTree->is_valid(next) && !fileInfoPathLessThan(*it, *next))
+         return false;
+   }
+
+   return true;
+}
+
+double microsecondsPerEvent(const boost::posix_time::time_duration& elapsed,
+                            std::size_t events)
+{
+   return static_cast<double>(elapsed.total_microseconds()) / events;
+}
+
+} // anonymous namespace
+
+// replay a burst of events against a large tree (and compare to locating
+// each event's directory by linear search, which is what we used to do)
+void runFileMonitorBenchmark()
+{
+   using namespace boost::posix_time;
+
+   tree<FileInfo> fileTree;
+   buildTree(&fileTree);
+   impl::FileTreeIndex fileTreeIndex;
+   fileTreeIndex.rebuild(&fileTree);
+   std::size_t nodes = fileTree.size();
+
+   std::vector<FileChangeEvent> events = buildEvents();
+
+   // linear search for the parent (sampled, it is far too slow to do all)
+   const std::size_t kLinearSamples = 500;
+   std::size_t missing = 0;
+   ptime start = microsec_clock::universal_time();
+   for (std::size_t i = 0; i < kLinearSamples; i++)
+   {
+      tree<FileInfo>::iterator it = std::find_if(
+                                      fileTree.begin(),
+                                      fileTree.end(),
+                                      boost::bind(fileInfoHasPath,
+                                                  _1,
+                                                  parentPath(events[i])));
+      if (it == fileTree.end())
+         missing++;
+   }
+   time_duration linearElapsed = microsec_clock::universal_time() - start;
+   if (missing > 0)
+      std::cerr << missing << " directories not found" << std::endl;
+
+   // indexed replay of all of the events
+   std::vector<FileChangeEvent> fileChanges;
+   start = microsec_clock::universal_time();
+   BOOST_FOREACH(const FileChangeEvent& event, events)
+   {
+      replayEvent(event, &fileTree, &fileTreeIndex, &fileChanges);
+   }
+   time_duration indexedElapsed = microsec_clock::universal_time() - start;
+
+   bool consistent = indexMatchesTree(&fileTree, &fileTreeIndex);
+   if (!consistent)
+      std::cerr << "File tree index doesn't match the tree" << std::endl;
+   BOOST_ASSERT(consistent);
+
+   std::cout << "File monitor replay: " << events.size() << " events, "
+             << nodes << " nodes, " << fileChanges.size() << " changes"
+             << std::endl;
+   std::cout << "File monitor linear lookup: "
+             << microsecondsPerEvent(linearElapsed, kLinearSamples)
+             << " us/event" << std::endl;
+   std::cout << "File monitor indexed replay: "
+             << indexedElapsed.total_milliseconds() << " ms ("
+             << microsecondsPerEvent(indexedElapsed, events.size())
+             << " us/event)" << std::endl;
+}
+
+} // namespace file_monitor
+} // namespace system
+} // namespace core
@@ -16,14 +16,19 @@
 #include <stdio.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/inotify.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 #include <set>
 
 #include <boost/utility.hpp>
 #include <boost/foreach.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/thread/once.hpp>
+#include <boost/thread/thread.hpp>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -46,6 +51,87 @@ namespace file_monitor {
 
 namespace {
 
+// epoll set containing the inotify descriptors of all active contexts
+// along with an eventfd used to wake the monitor thread when there is
+// registration input (either is -1 if it couldn't be created, in which
+// case we fall back to polling)
+int s_epollFd = -1;
+int s_wakeupFd = -1;
+boost::once_flag s_epollOnce = BOOST_ONCE_INIT;
+
+Error setNonBlockingAndCloseOnExec(int fd)
+{
+   int flags = ::fcntl(fd, F_GETFL);
+   if (flags == -1)
+      return systemError(errno, ERROR_LOCATION);
+   if (::fcntl(fd, F_SETFL, flags | O_NONBLOCK) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   int fdFlags = ::fcntl(fd, F_GETFD);
+   if (fdFlags == -1)
+      return systemError(errno, ERROR_LOCATION);
+   if (::fcntl(fd, F_SETFD, fdFlags | FD_CLOEXEC) == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   return Success();
+}
+
+Error addToEpoll(int fd, void* pData)
+{
+   struct epoll_event event;
+   event.events = EPOLLIN;
+   event.data.ptr = pData;
+   if (::epoll_ctl(s_epollFd, EPOLL_CTL_ADD, fd, &event) == -1)
+      return systemError(errno, ERROR_LOCATION);
+   else
+      return Success();
+}
+
+void closeEpoll()
+{
+   if (s_wakeupFd != -1)
+      ::close(s_wakeupFd);
+   if (s_epollFd != -1)
+      ::close(s_epollFd);
+   s_wakeupFd = -1;
+   s_epollFd = -1;
+}
+
+void initializeEpoll()
+{
+   s_epollFd = ::epoll_create(1);
+   if (s_epollFd == -1)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      return;
+   }
+
+   s_wakeupFd = ::eventfd(0, 0);
+   if (s_wakeupFd == -1)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      closeEpoll();
+      return;
+   }
+
+   Error error = setNonBlockingAndCloseOnExec(s_epollFd);
+   if (!error)
+      error = setNonBlockingAndCloseOnExec(s_wakeupFd);
+   if (!error)
+      error = addToEpoll(s_wakeupFd, NULL);
+   if (error)
+   {
+      LOG_ERROR(error);
+      closeEpoll();
+   }
+}
+
+bool haveEpoll()
+{
+   boost::call_once(initializeEpoll, s_epollOnce);
+   return s_epollFd != -1;
+}
+
 struct Watch
 {
    Watch()
@@ -173,12 +259,30 @@ public:
    bool recursive;
    boost::function<bool(const FileInfo&)> filter;
    tree<FileInfo> fileTree;
+   impl::FileTreeIndex fileTreeIndex;
    Callbacks callbacks;
 };
 
+void removeFromEpoll(FileEventContext* pContext)
+{
+   // ENOENT is expected if the descriptor was never added or has
+   // already been removed
+   struct epoll_event event;
+   if (haveEpoll() &&
+       ::epoll_ctl(s_epollFd, EPOLL_CTL_DEL, pContext->fd, &event) == -1 &&
+       errno != ENOENT)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   }
+}
+
 void terminateWithMonitoringError(FileEventContext* pContext,
                                   const Error& error)
 {
+   // stop listening for events (the context may remain readable until
+   // the unregistration is processed)
+   removeFromEpoll(pContext);
+
    pContext->callbacks.onMonitoringError(error);
 
    // unregister this monitor (this is done via postback from the
@@ -275,6 +379,9 @@ void closeContext(FileEventContext* pContext)
    // close the file descriptor
    if (pContext->fd >= 0)
    {
+      // remove it from the epoll set
+      removeFromEpoll(pContext);
+
       // close the descriptor
       safePosixCall<int>(boost::bind(::close, pContext->fd), ERROR_LOCATION);
 
@@ -310,14 +417,12 @@ Error processEvent(FileEventContext* pContext,
          return Success();
 
       // get an iterator to the parent dir
-      tree<FileInfo>::iterator parentIt = impl::findFile(
-                                                   pContext->fileTree.begin(),
-                                                   pContext->fileTree.end(),
-                                                   watch.path);
+      tree<FileInfo>::iterator parentIt =
+                              pContext->fileTreeIndex.find(watch.path);
 
       // if we can't find a parent then return (this directory may have
       // been excluded from scanning due to a filter)
-      if (parentIt == pContext->fileTree.end())
+      if (!pContext->fileTree.is_valid(parentIt))
          return Success();
 
       // get file info
@@ -353,6 +458,7 @@ Error processEvent(FileEventContext* pContext,
                                      event,
                                      pContext->recursive,
                                      &pContext->fileTree,
+                                     &pContext->fileTreeIndex,
                                      &removeEvents);
 
             // for each directory remove event remove any watches we have for it
@@ -386,6 +492,7 @@ Error processEvent(FileEventContext* pContext,
                                                  pContext->filter,
                                                  addWatchFunction(pContext),
                                                  &pContext->fileTree,
+                                                 &pContext->fileTreeIndex,
                                                  pFileChanges);
             // log the error if it wasn't no such file/dir (this can happen
             // in the normal course of business if a file is deleted between
@@ -403,6 +510,7 @@ Error processEvent(FileEventContext* pContext,
             impl::processFileModified(parentIt,
                                       event,
                                       &pContext->fileTree,
+                                      &pContext->fileTreeIndex,
                                       pFileChanges);
             break;
          }
@@ -417,6 +525,102 @@ Error processEvent(FileEventContext* pContext,
 }
 
 
+void processContextEvents(FileEventContext* pContext)
+{
+   // create event buffer (enough to hold 5000 events)
+   const int kEventSize = sizeof(struct inotify_event);
+   const int kFilenameSizeEstimate = 20;
+   const int kEventBufferLength = 5000 * (kEventSize+kFilenameSizeEstimate);
+   char eventBuffer[kEventBufferLength];
+
+   // bail if we don't have callbacks (we wouldn't if a callback snuck
+   // through to us even after we failed to fully initialize the
+   // file monitor  (e.g. if there was an error during file listing)
+   if (!pContext->callbacks.onFilesChanged)
+      return;
+
+   // check for context root directory deleted
+   if (!pContext->rootPath.exists())
+   {
+      Error error = fileNotFoundError(pContext->rootPath.absolutePath(),
+                                      ERROR_LOCATION);
+      terminateWithMonitoringError(pContext, error);
+      return;
+   }
+
+   // loop reading from this context's fd until EAGAIN or EWOULDBLOCK
+   std::vector<FileChangeEvent> fileChanges;
+   while (true)
+   {
+      // read
+      int len = posixCall<int>(boost::bind(::read,
+                                           pContext->fd,
+                                           eventBuffer,
+                                           kEventBufferLength));
+      if (len < 0)
+      {
+         // don't terminate for errors indicating no events available
+         if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+
+         // otherwise terminate this watch (notify user and break
+         // out of the read loop for this context)
+         terminateWithMonitoringError(pContext,
+                                      systemError(errno, ERROR_LOCATION));
+         break;
+      }
+
+      // iterate through the events
+      int i = 0;
+      while (i < len)
+      {
+         // get the event
+         typedef struct inotify_event* EventPtr;
+         EventPtr pEvent = (EventPtr)&eventBuffer[i];
+
+         // buffer overflow is handled specially -- basically
+         // we start over because we missed events
+         if (pEvent->mask & IN_Q_OVERFLOW)
+         {
+            // remove all watches
+            removeAllWatches(pContext);
+
+            // generate events based on scanning
+            Error error =impl::discoverAndProcessFileChanges(
+                  FileInfo(pContext->rootPath),
+                  pContext->recursive,
+                  pContext->filter,
+                  addWatchFunction(pContext, true),
+                  &pContext->fileTree,
+                  &pContext->fileTreeIndex,
+                  pContext->callbacks.onFilesChanged);
+            if (error)
+               terminateWithMonitoringError(pContext, error);
+
+            // always break here -- we've generated events based on
+            // a fresh scan so any other events in the queue would
+            // be duplicates
+            break;
+         }
+
+         // process the event
+         Error error = processEvent(pContext, pEvent, &fileChanges);
+         if (error)
+         {
+            terminateWithMonitoringError(pContext, error);
+            break;
+         }
+
+         // advance to next event
+         i += kEventSize + pEvent->len;
+      }
+   }
+
+   // fire any events we got
+   if (!fileChanges.empty())
+      pContext->callbacks.onFilesChanged(fileChanges);
+}
+
 Handle registrationFailure(int errorNumber,
                            FileEventContext* pContext,
                            const Callbacks& callbacks,
@@ -489,6 +693,21 @@ Handle registerMonitor(const core::FilePath& filePath,
        return Handle();
    }
 
+   // index the tree so events can be located within it
+   pContext->fileTreeIndex.rebuild(&pContext->fileTree);
+
+   // add the descriptor to the epoll set
+   if (haveEpoll())
+   {
+      error = addToEpoll(pContext->fd, pContext);
+      if (error)
+      {
+         closeContext(pContext);
+         callbacks.onRegistrationError(error);
+         return Handle();
+      }
+   }
+
    // now that we have finished the file listing we know we have a valid
    // file-monitor so set the callbacks
    pContext->callbacks = callbacks;
@@ -521,111 +740,81 @@ void unregisterMonitor(Handle handle)
    delete pContext;
 }
 
-void run(const boost::function<void()>& checkForInput)
+// rescan a file monitor
+void rescanMonitor(Handle handle)
 {
-   // create event buffer (enough to hold 5000 events)
-   const int kEventSize = sizeof(struct inotify_event);
-   const int kFilenameSizeEstimate = 20;
-   const int kEventBufferLength = 5000 * (kEventSize+kFilenameSizeEstimate);
-   char eventBuffer[kEventBufferLength];
+   // cast to context
+   FileEventContext* pContext = (FileEventContext*)(handle.pData);
+
+   // generate events based on scanning (adding watches for any directories
+   // we missed, existing watches are left alone)
+   Error error = impl::discoverAndProcessFileChanges(
+                                       FileInfo(pContext->rootPath),
+                                       pContext->recursive,
+                                       pContext->filter,
+                                       addWatchFunction(pContext, true),
+                                       &pContext->fileTree,
+                                       &pContext->fileTreeIndex,
+                                       pContext->callbacks.onFilesChanged);
+   if (error)
+      terminateWithMonitoringError(pContext, error);
+}
 
-   while(true)
+void run(const boost::function<void()>& checkForInput)
+{
+   // fall back to polling if we couldn't create the epoll set
+   if (!haveEpoll())
    {
-      std::list<void*> contexts = impl::activeEventContexts();
-      BOOST_FOREACH(void* ctx, contexts)
+      while (true)
       {
-         // cast to context
-         FileEventContext* pContext = (FileEventContext*)ctx;
-
-         // bail if we don't have callbacks (we wouldn't if a callback snuck
-         // through to us even after we failed to fully initialize the
-         // file monitor  (e.g. if there was an error during file listing)
-         if (!pContext->callbacks.onFilesChanged)
-            continue;
-
-         // check for context root directory deleted
-         if (!pContext->rootPath.exists())
+         std::list<void*> contexts = impl::activeEventContexts();
+         BOOST_FOREACH(void* ctx, contexts)
          {
-            Error error = fileNotFoundError(pContext->rootPath.absolutePath(),
-                                            ERROR_LOCATION);
-            terminateWithMonitoringError(pContext, error);
-            continue;
+            processContextEvents((FileEventContext*)ctx);
          }
 
-         // loop reading from this context's fd until EAGAIN or EWOULDBLOCK
-         std::vector<FileChangeEvent> fileChanges;
-         while (true)
-         {
-            // read
-            int len = posixCall<int>(boost::bind(::read,
-                                                 pContext->fd,
-                                                 eventBuffer,
-                                                 kEventBufferLength));
-            if (len < 0)
-            {
-               // don't terminate for errors indicating no events available
-               if (errno == EAGAIN || errno == EWOULDBLOCK)
-                  break;
-
-               // otherwise terminate this watch (notify user and break
-               // out of the read loop for this context)
-               terminateWithMonitoringError(pContext,
-                                            systemError(errno, ERROR_LOCATION));
-               break;
-            }
+         // check for input (register/unregister of monitors)
+         checkForInput();
+      }
+   }
 
-            // iterate through the events
-            int i = 0;
-            while (i < len)
-            {
-               // get the event
-               typedef struct inotify_event* EventPtr;
-               EventPtr pEvent = (EventPtr)&eventBuffer[i];
+   // block until there are file system events or registration input
+   const int kMaxEpollEvents = 64;
+   struct epoll_event epollEvents[kMaxEpollEvents];
+   while (true)
+   {
+      int count = ::epoll_wait(s_epollFd, epollEvents, kMaxEpollEvents, -1);
 
-               // buffer overflow is handled specially -- basically
-               // we start over because we missed events
-               if (pEvent->mask & IN_Q_OVERFLOW)
-               {
-                  // remove all watches
-                  removeAllWatches(pContext);
-
-                  // generate events based on scanning
-                  Error error =impl::discoverAndProcessFileChanges(
-                        FileInfo(pContext->rootPath),
-                        pContext->recursive,
-                        pContext->filter,
-                        addWatchFunction(pContext, true),
-                        &pContext->fileTree,
-                        pContext->callbacks.onFilesChanged);
-                  if (error)
-                     terminateWithMonitoringError(pContext, error);
-
-                  // always break here -- we've generated events based on
-                  // a fresh scan so any other events in the queue would
-                  // be duplicates
-                  break;
-               }
+      // check for stop (file_monitor::stop wakes us after interrupting)
+      boost::this_thread::interruption_point();
 
-               // process the event
-               Error error = processEvent(pContext, pEvent, &fileChanges);
-               if (error)
-               {
-                  terminateWithMonitoringError(pContext, error);
-                  break;
-               }
+      if (count == -1)
+      {
+         if (errno != EINTR)
+            LOG_ERROR(systemError(errno, ERROR_LOCATION));
+         continue;
+      }
 
-               // advance to next event
-               i += kEventSize + pEvent->len;
-            }
+      bool haveInput = false;
+      for (int i = 0; i < count; i++)
+      {
+         if (epollEvents[i].data.ptr == NULL)
+         {
+            // reset the wakeup counter
+            eventfd_t value;
+            ::eventfd_read(s_wakeupFd, &value);
+            haveInput = true;
+         }
+         else
+         {
+            processContextEvents((FileEventContext*)epollEvents[i].data.ptr);
          }
-
-         // fire any events we got
-         if (!fileChanges.empty())
-            pContext->callbacks.onFilesChanged(fileChanges);
       }
 
-      // check for input (register/unregister of monitors)
-      checkForInput();
+      // process input (register/unregister of monitors) -- contexts are
+      // only deleted here so the pointers above are always valid
+      if (haveInput)
+         checkForInput();
    }
 }
 
@@ -634,6 +823,15 @@ void stop()
    // nothing to do here
 }
 
+void wakeup()
+{
+   if (haveEpoll())
+   {
+      if (::eventfd_write(s_wakeupFd, 1) == -1)
+         LOG_ERROR(systemError(errno, ERROR_LOCATION));
+   }
+}
+
 } // namespace detail
 } // namespace file_monitor
 } // namespace system
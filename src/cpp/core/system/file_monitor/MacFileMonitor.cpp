@@ -50,6 +50,7 @@ public:
    bool recursive;
    boost::function<bool(const FileInfo&)> filter;
    tree<FileInfo> fileTree;
+   impl::FileTreeIndex fileTreeIndex;
    Callbacks callbacks;
 };
 
@@ -112,6 +113,7 @@ void fileEventCallback(ConstFSEventStreamRef streamRef,
                                              recursive,
                                              pContext->filter,
                                              &(pContext->fileTree),
+                                             &(pContext->fileTreeIndex),
                                              pContext->callbacks.onFilesChanged);
          if (error &&
             (error.code() != boost::system::errc::no_such_file_or_directory))
@@ -258,6 +260,9 @@ Handle registerMonitor(const FilePath& filePath,
        return Handle();
    }
 
+   // index the tree so events can be located within it
+   pContext->fileTreeIndex.rebuild(&pContext->fileTree);
+
    // now that we have finished the file listing we know we have a valid
    // file-monitor so set the callbacks
    pContext->callbacks = callbacks;
@@ -290,6 +295,24 @@ void unregisterMonitor(Handle handle)
    delete pContext;
 }
 
+// rescan a file monitor
+void rescanMonitor(Handle handle)
+{
+   // cast to context
+   FileEventContext* pContext = (FileEventContext*)(handle.pData);
+
+   // full scan to detect changes and refresh the tree
+   Error error = impl::discoverAndProcessFileChanges(
+                                       FileInfo(pContext->rootPath),
+                                       pContext->recursive,
+                                       pContext->filter,
+                                       &(pContext->fileTree),
+                                       &(pContext->fileTreeIndex),
+                                       pContext->callbacks.onFilesChanged);
+   if (error)
+      LOG_ERROR(error);
+}
+
 void run(const boost::function<void()>& checkForInput)
 {
    // ensure we have a run loop for this thread (not sure if this is
@@ -324,6 +347,11 @@ void stop()
    // is already outside of the run loop logic (above).
 }
 
+void wakeup()
+{
+   // nothing to do here (the run loop polls for input)
+}
+
 } // namespace detail
 } // namespace file_monitor
 } // namespace system
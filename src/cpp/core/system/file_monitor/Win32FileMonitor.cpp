@@ -70,6 +70,7 @@ public:
 
    // our own snapshot of the file tree
    tree<FileInfo> fileTree;
+   impl::FileTreeIndex fileTreeIndex;
 
    // timer for attempting restarts on a delayed basis (and counter
    // to enforce a maximum number of retries)
@@ -148,6 +149,7 @@ void processFileChange(DWORD action,
                        bool recursive,
                        const boost::function<bool(const FileInfo&)>& filter,
                        tree<FileInfo>* pTree,
+                       impl::FileTreeIndex* pIndex,
                        std::vector<FileChangeEvent>* pFileChanges)
 {
    // ignore all directory modified actions (we rely instead on the
@@ -166,13 +168,12 @@ void processFileChange(DWORD action,
 
    // get an iterator to this file's parent
    FileInfo parentFileInfo = FileInfo(filePath.parent());
-   tree<FileInfo>::iterator parentIt = impl::findFile(pTree->begin(),
-                                                      pTree->end(),
-                                                      parentFileInfo);
+   tree<FileInfo>::iterator parentIt = pIndex->find(
+                                             parentFileInfo.absolutePath());
 
    // if we can't find a parent then return (this directory may have
    // been excluded from scanning due to a filter)
-   if (parentIt == pTree->end())
+   if (!pTree->is_valid(parentIt))
       return;
 
    // get the file info
@@ -193,6 +194,7 @@ void processFileChange(DWORD action,
                                               recursive,
                                               filter,
                                               pTree,
+                                              pIndex,
                                               pFileChanges);
          if (error)
             LOG_ERROR(error);
@@ -206,13 +208,18 @@ void processFileChange(DWORD action,
                                   event,
                                   recursive,
                                   pTree,
+                                  pIndex,
                                   pFileChanges);
          break;
       }
       case FILE_ACTION_MODIFIED:
       {
          FileChangeEvent event(FileChangeEvent::FileModified, fileInfo);
-         impl::processFileModified(parentIt, event, pTree, pFileChanges);
+         impl::processFileModified(parentIt,
+                                   event,
+                                   pTree,
+                                   pIndex,
+                                   pFileChanges);
          break;
       }
    }
@@ -263,6 +270,7 @@ void processFileChanges(FileEventContext* pContext,
                            pContext->recursive,
                            pContext->filter,
                            &(pContext->fileTree),
+                           &(pContext->fileTreeIndex),
                            &fileChanges);
       }
 
@@ -331,6 +339,7 @@ void restartMonitoring(FileEventContext* pContext)
                                        pContext->recursive,
                                        pContext->filter,
                                        &(pContext->fileTree),
+                                       &(pContext->fileTreeIndex),
                                        pContext->callbacks.onFilesChanged);
    if (error)
       terminateWithMonitoringError(pContext, error);
@@ -565,6 +574,9 @@ Handle registerMonitor(const core::FilePath& filePath,
        return Handle();
    }
 
+   // index the tree so events can be located within it
+   pContext->fileTreeIndex.rebuild(&pContext->fileTree);
+
    // now that we have finished the file listing we know we have a valid
    // file-monitor so set the callbacks
    pContext->filter = filter;
@@ -585,6 +597,24 @@ void unregisterMonitor(Handle handle)
    cleanupContext((FileEventContext*)(handle.pData));
 }
 
+// rescan a file monitor
+void rescanMonitor(Handle handle)
+{
+   // cast to context
+   FileEventContext* pContext = (FileEventContext*)(handle.pData);
+
+   // full recursive scan to detect changes and refresh the tree
+   Error error = impl::discoverAndProcessFileChanges(
+                                       *(pContext->fileTree.begin()),
+                                       pContext->recursive,
+                                       pContext->filter,
+                                       &(pContext->fileTree),
+                                       &(pContext->fileTreeIndex),
+                                       pContext->callbacks.onFilesChanged);
+   if (error)
+      terminateWithMonitoringError(pContext, error);
+}
+
 void run(const boost::function<void()>& checkForInput)
 {
    // initialize active requests to zero
@@ -611,6 +641,11 @@ void stop()
    }
 }
 
+void wakeup()
+{
+   // nothing to do here (the run loop polls for input)
+}
+
 } // namespace detail
 } // namespace file_monitor
 } // namespace system
@@ -35,7 +35,9 @@
 5) R data frame (class="data.frame") are returned as arrays of json objects
    JsArray<Object>. Note that when creating a data frame to be marshalled
    back to javascript that check.rows = TRUE & stringsAsFactors = FALSE
-   should be specified.
+   should be specified. Data frames wrapped in .rs.columnar are instead
+   returned as a single object with an array of values for each column
+   (much more compact for large frames).
  
 4) R old style lists (LISTSXP) are not currently supported.
 
@@ -44,7 +46,10 @@
  
 */
 
+#include <cstdio>
+#include <map>
 #include <iostream>
+#include <sstream>
 
 #define R_INTERNAL_FUNCTIONS
 #include <r/RJson.hpp>
@@ -316,6 +321,303 @@ Error jsonObjectArrayFromDataFrame(SEXP listSEXP, core::json::Value* pValue)
    return Success();
 }
 
+// helpers for writing json directly (without intermediate json::Values).
+// these follow the same conversion rules as the functions above
+
+void writeJsonString(const char* value, std::string* pOutput)
+{
+   pOutput->push_back('"');
+   for (const char* pChar = value; *pChar != '\0'; ++pChar)
+   {
+      char ch = *pChar;
+      switch(ch)
+      {
+         case '"':  pOutput->append("\\\""); break;
+         case '\\': pOutput->append("\\\\"); break;
+         case '\b': pOutput->append("\\b"); break;
+         case '\f': pOutput->append("\\f"); break;
+         case '\n': pOutput->append("\\n"); break;
+         case '\r': pOutput->append("\\r"); break;
+         case '\t': pOutput->append("\\t"); break;
+         default:
+         {
+            if (static_cast<unsigned char>(ch) < 0x20)
+            {
+               char buffer[8];
+               ::snprintf(buffer, sizeof(buffer), "\\u%04x", ch);
+               pOutput->append(buffer);
+            }
+            else
+            {
+               pOutput->push_back(ch);
+            }
+            break;
+         }
+      }
+   }
+   pOutput->push_back('"');
+}
+
+void writeJsonInteger(int value, std::string* pOutput)
+{
+   char buffer[16];
+   char* pEnd = buffer + sizeof(buffer);
+   char* pStart = pEnd;
+   unsigned int magnitude = value < 0 ? -static_cast<unsigned int>(value)
+                                      : static_cast<unsigned int>(value);
+   do
+   {
+      *--pStart = static_cast<char>('0' + (magnitude % 10));
+      magnitude /= 10;
+   }
+   while (magnitude != 0);
+
+   if (value < 0)
+      *--pStart = '-';
+
+   pOutput->append(pStart, pEnd);
+}
+
+void writeJsonReal(double value, std::string* pOutput)
+{
+   // json has no representation for NaN or infinite values
+   if (!R_FINITE(value))
+   {
+      pOutput->append("null");
+      return;
+   }
+
+   char buffer[32];
+   int length = ::snprintf(buffer, sizeof(buffer), "%.16g", value);
+   pOutput->append(buffer, length);
+}
+
+// can the vector be written directly?
+bool isWritableVector(SEXP vectorSEXP)
+{
+   switch(TYPEOF(vectorSEXP))
+   {
+      case STRSXP:
+      case INTSXP:
+      case REALSXP:
+      case LGLSXP:
+         return true;
+      default:
+         return false;
+   }
+}
+
+void writeJsonVectorElement(SEXP vectorSEXP, int i, std::string* pOutput)
+{
+   switch(TYPEOF(vectorSEXP))
+   {
+      case STRSXP:
+      {
+         SEXP stringSEXP = STRING_ELT(vectorSEXP, i);
+         if (stringSEXP != NA_STRING)
+            writeJsonString(Rf_translateCharUTF8(stringSEXP), pOutput);
+         else
+            pOutput->append("null");
+         break;
+      }
+      case INTSXP:
+      {
+         int value = INTEGER(vectorSEXP)[i];
+         if (value != NA_INTEGER)
+            writeJsonInteger(value, pOutput);
+         else
+            pOutput->append("null");
+         break;
+      }
+      case REALSXP:
+      {
+         writeJsonReal(REAL(vectorSEXP)[i], pOutput);
+         break;
+      }
+      case LGLSXP:
+      {
+         int value = LOGICAL(vectorSEXP)[i];
+         if (value != NA_LOGICAL)
+            pOutput->append(value == TRUE ? "true" : "false");
+         else
+            pOutput->append("null");
+         break;
+      }
+   }
+}
+
+// write an array of the vector's values, looping within each type so we
+// don't switch on the type of every element
+void writeJsonVectorArray(SEXP vectorSEXP, std::string* pOutput)
+{
+   int length = Rf_length(vectorSEXP);
+   pOutput->push_back('[');
+   switch(TYPEOF(vectorSEXP))
+   {
+      case INTSXP:
+      {
+         const int* pValues = INTEGER(vectorSEXP);
+         for (int i = 0; i < length; i++)
+         {
+            if (i > 0)
+               pOutput->push_back(',');
+            if (pValues[i] != NA_INTEGER)
+               writeJsonInteger(pValues[i], pOutput);
+            else
+               pOutput->append("null");
+         }
+         break;
+      }
+      case REALSXP:
+      {
+         const double* pValues = REAL(vectorSEXP);
+         for (int i = 0; i < length; i++)
+         {
+            if (i > 0)
+               pOutput->push_back(',');
+            writeJsonReal(pValues[i], pOutput);
+         }
+         break;
+      }
+      default:
+      {
+         for (int i = 0; i < length; i++)
+         {
+            if (i > 0)
+               pOutput->push_back(',');
+            writeJsonVectorElement(vectorSEXP, i, pOutput);
+         }
+         break;
+      }
+   }
+   pOutput->push_back(']');
+}
+
+// json objects are written with their fields ordered by name and (for
+// duplicate names) using the last element with the name, matching the
+// behavior of the json::Object map used by the functions above
+typedef std::map<std::string,int> FieldIndexes;
+
+Error getFieldIndexes(SEXP listSEXP, FieldIndexes* pIndexes)
+{
+   std::vector<std::string> fieldNames ;
+   Error error = sexp::getNames(listSEXP, &fieldNames);
+   if (error)
+      return error;
+
+   for (std::size_t i = 0; i < fieldNames.size(); i++)
+      (*pIndexes)[fieldNames[i]] = static_cast<int>(i);
+
+   return Success();
+}
+
+void writeJsonFieldName(const std::string& name, std::string* pOutput)
+{
+   writeJsonString(name.c_str(), pOutput);
+   pOutput->push_back(':');
+}
+
+bool isWritableDataFrame(SEXP dataFrameSEXP)
+{
+   int columns = Rf_length(dataFrameSEXP);
+   for (int i = 0; i < columns; i++)
+   {
+      if (!isWritableVector(VECTOR_ELT(dataFrameSEXP, i)))
+         return false;
+   }
+   return true;
+}
+
+//
+// NOTE: this function assumes that isNamedList and isWritableDataFrame
+// have been called and returned true for this list
+//
+Error writeJsonObjectArrayFromDataFrame(SEXP dataFrameSEXP,
+                                        std::string* pOutput)
+{
+   FieldIndexes fieldIndexes;
+   Error error = getFieldIndexes(dataFrameSEXP, &fieldIndexes);
+   if (error)
+      return error;
+
+   // pre-compute the quoted field names
+   std::vector<std::pair<std::string,SEXP> > fields;
+   for (FieldIndexes::const_iterator it = fieldIndexes.begin();
+        it != fieldIndexes.end();
+        ++it)
+   {
+      std::string fieldName;
+      writeJsonFieldName(it->first, &fieldName);
+      fields.push_back(std::make_pair(fieldName,
+                                      VECTOR_ELT(dataFrameSEXP, it->second)));
+   }
+
+   int rows = fields.empty() ? 0 : Rf_length(fields[0].second);
+   pOutput->push_back('[');
+   for (int row = 0; row < rows; row++)
+   {
+      if (row > 0)
+         pOutput->push_back(',');
+      pOutput->push_back('{');
+      for (std::size_t f = 0; f < fields.size(); f++)
+      {
+         if (f > 0)
+            pOutput->push_back(',');
+         pOutput->append(fields[f].first);
+         writeJsonVectorElement(fields[f].second, row, pOutput);
+      }
+      pOutput->push_back('}');
+   }
+   pOutput->push_back(']');
+
+   return Success();
+}
+
+//
+// NOTE: this function assumes that isNamedList has been called and
+// returned true for this list
+//
+Error writeJsonObjectFromList(SEXP listSEXP, std::string* pOutput)
+{
+   FieldIndexes fieldIndexes;
+   Error error = getFieldIndexes(listSEXP, &fieldIndexes);
+   if (error)
+      return error;
+
+   pOutput->push_back('{');
+   for (FieldIndexes::const_iterator it = fieldIndexes.begin();
+        it != fieldIndexes.end();
+        ++it)
+   {
+      if (it != fieldIndexes.begin())
+         pOutput->push_back(',');
+      writeJsonFieldName(it->first, pOutput);
+      error = writeJsonFromObject(VECTOR_ELT(listSEXP, it->second), pOutput);
+      if (error)
+         return error;
+   }
+   pOutput->push_back('}');
+
+   return Success();
+}
+
+Error writeJsonArrayFromList(SEXP listSEXP, std::string* pOutput)
+{
+   pOutput->push_back('[');
+   int listLength = Rf_length(listSEXP);
+   for (int i = 0; i < listLength; i++)
+   {
+      if (i > 0)
+         pOutput->push_back(',');
+      Error error = writeJsonFromObject(VECTOR_ELT(listSEXP, i), pOutput);
+      if (error)
+         return error;
+   }
+   pOutput->push_back(']');
+
+   return Success();
+}
+
 } // anonymous namespace
 
 Error jsonValueFromScalar(SEXP scalarSEXP, core::json::Value* pValue)
@@ -365,7 +667,8 @@ Error jsonValueFromList(SEXP listSEXP, core::json::Value* pValue)
 {
    if (isNamedList(listSEXP))
    {
-      if (Rf_inherits(listSEXP, "data.frame"))
+      if (Rf_inherits(listSEXP, "data.frame") &&
+          !Rf_inherits(listSEXP, "rs.columnar"))
           return jsonObjectArrayFromDataFrame(listSEXP, pValue);
       else
           return jsonObjectFromList(listSEXP, pValue);
@@ -410,6 +713,70 @@ Error jsonValueFromObject(SEXP objectSEXP, core::json::Value* pValue)
    }
 } 
    
+Error writeJsonFromObject(SEXP objectSEXP, std::string* pOutput)
+{
+   switch(TYPEOF(objectSEXP))
+   {
+      case NILSXP:
+      {
+         pOutput->append("null");
+         return Success();
+      }
+      case VECSXP:
+      {
+         if (isNamedList(objectSEXP))
+         {
+            if (Rf_inherits(objectSEXP, "data.frame") &&
+                !Rf_inherits(objectSEXP, "rs.columnar"))
+            {
+               if (isWritableDataFrame(objectSEXP))
+                  return writeJsonObjectArrayFromDataFrame(objectSEXP,
+                                                           pOutput);
+               break;
+            }
+            else
+            {
+               return writeJsonObjectFromList(objectSEXP, pOutput);
+            }
+         }
+         else
+         {
+            return writeJsonArrayFromList(objectSEXP, pOutput);
+         }
+      }
+      default:
+      {
+         if (isWritableVector(objectSEXP))
+         {
+            if (Rf_inherits(objectSEXP, "rs.scalar"))
+            {
+               if (Rf_length(objectSEXP) > 0)
+                  writeJsonVectorElement(objectSEXP, 0, pOutput);
+               else
+                  pOutput->append("null");
+            }
+            else
+            {
+               writeJsonVectorArray(objectSEXP, pOutput);
+            }
+            return Success();
+         }
+         break;
+      }
+   }
+
+   // other types go through json::Value
+   core::json::Value value;
+   Error error = jsonValueFromObject(objectSEXP, &value);
+   if (error)
+      return error;
+
+   std::ostringstream ostr;
+   core::json::write(value, ostr);
+   pOutput->append(ostr.str());
+   return Success();
+}
+
 } // namespace json
 } // namesapce r
 
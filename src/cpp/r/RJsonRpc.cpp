@@ -64,14 +64,15 @@ namespace {
          
 Error setJsonResult(SEXP resultSEXP, core::json::JsonRpcResponse* pResponse)
 {   
-   // get the result
-   core::json::Value resultValue ;
-   Error error = jsonValueFromObject(resultSEXP, &resultValue);
+   // write the result directly to json (avoids building an intermediate
+   // json::Value, which is expensive for large vectors and data frames)
+   std::string result;
+   Error error = writeJsonFromObject(resultSEXP, &result);
    if (error)
       return error ;
    
    // set the result and return success
-   pResponse->setResult(resultValue);
+   pResponse->setRawResult(result);
    return Success();
 }
 
@@ -0,0 +1,155 @@
+/*
+ * RJsonTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <r/RJson.hpp>
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <boost/assert.hpp>
+#include <boost/format.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/json/JsonRpc.hpp>
+
+#include <r/RExec.hpp>
+#include <r/RSexp.hpp>
+
+using namespace core ;
+
+namespace r {
+namespace json {
+
+namespace {
+
+const int kRows = 100000;
+
+void verifySuccess(const Error& error)
+{
+   if (error)
+      std::cerr << error.summary() << std::endl;
+   BOOST_ASSERT(!error);
+}
+
+// a data frame with a column of each atomic type and an NA in each. reals
+// are all exact quarters so the two paths format them identically
+std::string dataFrameCode(int rows)
+{
+   return boost::str(boost::format(
+      "local({"
+      "   n <- %1%;"
+      "   data.frame(chr = c(NA, sprintf('row%%d', seq_len(n - 1))),"
+      "              int = c(NA, seq_len(n - 1)),"
+      "              lgl = rep(c(TRUE, FALSE, NA), length.out = n),"
+      "              dbl = c((seq_len(n - 1) - 0.5) / 2, NA),"
+      "              stringsAsFactors = FALSE)"
+      "})") % rows);
+}
+
+// what .rs.columnar does
+std::string columnarCode(int rows)
+{
+   return "local({"
+          "   df <- " + dataFrameCode(rows) + ";"
+          "   class(df) <- c('rs.columnar', class(df));"
+          "   df"
+          "})";
+}
+
+// the response as it was written before writeJsonFromObject
+std::string valueResponse(SEXP objectSEXP)
+{
+   core::json::Value value;
+   verifySuccess(jsonValueFromObject(objectSEXP, &value));
+
+   core::json::JsonRpcResponse response;
+   response.setResult(value);
+   std::ostringstream ostr;
+   response.write(ostr);
+   return ostr.str();
+}
+
+std::string directResponse(SEXP objectSEXP)
+{
+   std::string result;
+   verifySuccess(writeJsonFromObject(objectSEXP, &result));
+
+   core::json::JsonRpcResponse response;
+   response.setRawResult(result);
+   std::ostringstream ostr;
+   response.write(ostr);
+   return ostr.str();
+}
+
+bool sameJson(const std::string& json1, const std::string& json2)
+{
+   core::json::Value value1, value2;
+   return core::json::parse(json1, &value1) &&
+          core::json::parse(json2, &value2) &&
+          value1 == value2;
+}
+
+} // anonymous namespace
+
+// compare writing an rpc response for a large data frame via json::Value
+// against writing it directly (as rows, and as columns). calls into R so
+// must be run on the main thread
+void runDataFrameJsonBenchmark()
+{
+   using namespace boost::posix_time;
+
+   r::sexp::Protect rProtect;
+   SEXP dataFrameSEXP, columnarSEXP;
+   Error error = r::exec::evaluateString(dataFrameCode(kRows),
+                                         &dataFrameSEXP,
+                                         &rProtect);
+   if (!error)
+      error = r::exec::evaluateString(columnarCode(kRows),
+                                      &columnarSEXP,
+                                      &rProtect);
+   verifySuccess(error);
+   if (error)
+      return;
+
+   ptime start = microsec_clock::universal_time();
+   std::string valueJson = valueResponse(dataFrameSEXP);
+   time_duration valueElapsed = microsec_clock::universal_time() - start;
+
+   start = microsec_clock::universal_time();
+   std::string directJson = directResponse(dataFrameSEXP);
+   time_duration directElapsed = microsec_clock::universal_time() - start;
+
+   start = microsec_clock::universal_time();
+   std::string columnarJson = directResponse(columnarSEXP);
+   time_duration columnarElapsed = microsec_clock::universal_time() - start;
+
+   bool same = sameJson(valueJson, directJson);
+   if (!same)
+      std::cerr << "Direct json differs from json::Value json" << std::endl;
+   BOOST_ASSERT(same);
+
+   std::cout << "Data frame json (" << kRows << " rows, json::Value): "
+             << valueElapsed.total_milliseconds() << " ms, "
+             << valueJson.size() << " bytes" << std::endl;
+   std::cout << "Data frame json (" << kRows << " rows, direct): "
+             << directElapsed.total_milliseconds() << " ms, "
+             << directJson.size() << " bytes" << std::endl;
+   std::cout << "Data frame json (" << kRows << " rows, columnar): "
+             << columnarElapsed.total_milliseconds() << " ms, "
+             << columnarJson.size() << " bytes" << std::endl;
+}
+
+} // namespace json
+} // namespace r
@@ -14,6 +14,8 @@
 #ifndef R_JSON_HPP
 #define R_JSON_HPP
 
+#include <string>
+
 #include <core/json/Json.hpp>
 
 typedef struct SEXPREC *SEXP;
@@ -33,6 +35,11 @@ core::Error jsonValueFromScalar(SEXP scalarSEXP, core::json::Value* pValue);
 core::Error jsonValueFromVector(SEXP vectorSEXP, core::json::Value* pValue);
 core::Error jsonValueFromList(SEXP listSEXP, core::json::Value* pValue);
 core::Error jsonValueFromObject(SEXP objectSEXP, core::json::Value* pValue);
+
+// append the json representation of an object to a string. atomic vectors
+// and data frames are written directly rather than via json::Value (which
+// is much faster and lighter on memory for large objects)
+core::Error writeJsonFromObject(SEXP objectSEXP, std::string* pOutput);
    
 } // namespace json
 } // namesapce r
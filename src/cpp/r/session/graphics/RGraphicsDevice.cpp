@@ -565,6 +565,15 @@ DisplaySize displaySize()
    return DisplaySize(s_width, s_height);
 }
 
+int displayDpi()
+{
+   // the device reports its resolution as inches per raster unit
+   if (s_pGEDevDesc != NULL && s_pGEDevDesc->dev->ipr[0] > 0)
+      return static_cast<int>(1.0 / s_pGEDevDesc->dev->ipr[0] + 0.5);
+   else
+      return 72;
+}
+
 void deviceConvert(double* x,
                    double* y,
                    const boost::function<double(double,pGEDevDesc)>& xConv,
@@ -582,8 +591,7 @@ void deviceConvert(double* x,
    }
 }
 
-Error saveSnapshot(const core::FilePath& snapshotFile,
-                   const core::FilePath& imageFile)
+Error saveSnapshot(const core::FilePath& snapshotFile)
 {
    // ensure we are active
    Error error = makeActive();
@@ -591,10 +599,16 @@ Error saveSnapshot(const core::FilePath& snapshotFile,
       return error ;
    
    // save snaphot file
-   error = r::exec::RFunction(".rs.saveGraphics",
-                              string_utils::utf8ToSystem(snapshotFile.absolutePath())).call();
+   return r::exec::RFunction(".rs.saveGraphics",
+                             string_utils::utf8ToSystem(snapshotFile.absolutePath())).call();
+}
+
+Error saveImage(const core::FilePath& imageFile)
+{
+   // ensure we are active
+   Error error = makeActive();
    if (error)
-      return error;
+      return error ;
 
    // resync display list before saving png if necessary. for unknown reasons
    // there are permutations of plotting code which leaves the underlying PNG
@@ -603,9 +617,9 @@ Error saveSnapshot(const core::FilePath& snapshotFile,
    if (handler::resyncDisplayListBeforeWriteToPNG())
       resyncDisplayList();
 
-   // save png file
+   // save png file (may complete in the background)
    DeviceContext* pDC = (DeviceContext*)s_pGEDevDesc->dev->deviceSpecific;
-   return handler::writeToPNG(imageFile, pDC, true);
+   return handler::beginWriteToPNG(imageFile, pDC);
 }
 
 Error restoreSnapshot(const core::FilePath& snapshotFile)
@@ -663,8 +677,12 @@ Error initialize(
    // create plot manager (provide functions & events)
    GraphicsDeviceFunctions graphicsDevice;
    graphicsDevice.displaySize = displaySize;
+   graphicsDevice.displayDpi = displayDpi;
    graphicsDevice.convert = convert;
    graphicsDevice.saveSnapshot = saveSnapshot;
+   graphicsDevice.saveImage = saveImage;
+   graphicsDevice.afterImagesSaved = handler::afterPendingPNGWrites;
+   graphicsDevice.removeImage = handler::removePNG;
    graphicsDevice.restoreSnapshot = restoreSnapshot;
    graphicsDevice.copyToActiveDevice = copyToActiveDevice;
    graphicsDevice.imageFileExtension = imageFileExtension;
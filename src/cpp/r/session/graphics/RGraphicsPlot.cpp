@@ -15,6 +15,7 @@
 
 #include <iostream>
 
+#include <boost/bind.hpp>
 #include <boost/format.hpp>
 
 #include <core/Error.hpp>
@@ -26,6 +27,8 @@
 #include <r/RExec.hpp>
 #include <r/session/RGraphics.hpp>
 
+#include "RGraphicsPlotRenderCache.hpp"
+
 using namespace core ;
 
 namespace r {
@@ -129,14 +132,35 @@ Error Plot::renderFromDisplay()
    // generate a new storage uuid
    std::string storageUuid = core::system::generateUuid();
    
-   // generate snapshot and image files
-   Error error = graphicsDevice_.saveSnapshot(snapshotFilePath(storageUuid),
-                                              imageFilePath(storageUuid));
+   // generate snapshot file
+   FilePath snapshotFile = snapshotFilePath(storageUuid);
+   Error error = graphicsDevice_.saveSnapshot(snapshotFile);
    if (error)
       return Error(errc::PlotRenderingError, error, ERROR_LOCATION);
+
+   // generate image file (using a previous rendering of the same snapshot
+   // at the same size if we have one)
+   DisplaySize displaySize = graphicsDevice_.displaySize();
+   FilePath imageFile = imageFilePath(storageUuid);
+   std::string cacheKey = plotRenderCache().keyFor(snapshotFile,
+                                                   displaySize,
+                                                   graphicsDevice_.displayDpi());
+   if (!plotRenderCache().restoreImage(cacheKey, imageFile))
+   {
+      error = graphicsDevice_.saveImage(imageFile);
+      if (error)
+         return Error(errc::PlotRenderingError, error, ERROR_LOCATION);
+
+      // the image may still be being written so cache it once it's done
+      graphicsDevice_.afterImagesSaved(
+                           boost::bind(&PlotRenderCache::addImage,
+                                       &plotRenderCache(),
+                                       cacheKey,
+                                       imageFile));
+   }
    
    // save rendered size
-   renderedSize_ = graphicsDevice_.displaySize();
+   renderedSize_ = displaySize;
    
    // save manipulator (if any)
    saveManipulator(storageUuid);
@@ -217,7 +241,8 @@ Error Plot::removeFiles()
       return Success();
    
    Error snapshotError = snapshotFilePath(storageUuid_).removeIfExists();
-   Error imageError = imageFilePath(storageUuid_).removeIfExists();
+   Error imageError = graphicsDevice_.removeImage(
+                                          imageFilePath(storageUuid_));
    Error manipulatorError = manipulatorFilePath(storageUuid_).removeIfExists();
    
    if (snapshotError)
@@ -32,6 +32,7 @@
 #include "RGraphicsDevice.hpp"
 #include "RGraphicsFileDevice.hpp"
 #include "RGraphicsPlotManipulatorManager.hpp"
+#include "RGraphicsPlotRenderCache.hpp"
 
 using namespace core;
 
@@ -94,6 +95,11 @@ Error PlotManager::initialize(const FilePath& graphicsPath,
 
    // save reference to plots state file
    plotsStateFile_ = graphicsPath_.complete("INDEX");
+
+   // initialize cache of rendered plot images
+   error = plotRenderCache().initialize(graphicsPath_.complete("cache"));
+   if (error)
+      return error;
    
    // save reference to graphics device functions
    graphicsDevice_ = graphicsDevice;
@@ -461,14 +467,15 @@ void PlotManager::render(boost::function<void(DisplayState)> outputFunction)
       }
    }
    
-   // call output function
+   // call output function once the image has been written (rendering
+   // can complete the image file in the background)
    DisplayState currentState(imageFilename(),
                              plotManipulatorJson,
                              r::session::graphics::device::getWidth(),
                              r::session::graphics::device::getHeight(),
                              activePlotIndex(), 
                              plotCount());
-   outputFunction(currentState);
+   graphicsDevice_.afterImagesSaved(boost::bind(outputFunction, currentState));
 }
    
 std::string PlotManager::imageFilename() const 
@@ -720,6 +727,7 @@ void PlotManager::onDeviceClosed()
    // clear plots
    activePlot_ = -1;
    plots_.clear();
+   plotRenderCache().clear();
    
    // trip changes flag to ensure repaint
    displayHasChanges_ = true;
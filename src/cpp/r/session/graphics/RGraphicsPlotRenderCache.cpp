@@ -0,0 +1,177 @@
+/*
+ * RGraphicsPlotRenderCache.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RGraphicsPlotRenderCache.hpp"
+
+#include <boost/format.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Hash.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
+
+using namespace core;
+
+namespace r {
+namespace session {
+namespace graphics {
+
+namespace {
+
+// enough to hold every plot in the history at a couple of sizes
+const std::size_t kMaxCachedImages = 60;
+
+} // anonymous namespace
+
+PlotRenderCache& plotRenderCache()
+{
+   static PlotRenderCache instance;
+   return instance;
+}
+
+PlotRenderCache::PlotRenderCache()
+   : images_(kMaxCachedImages)
+{
+}
+
+Error PlotRenderCache::initialize(const FilePath& cachePath)
+{
+   LOCK_MUTEX(mutex_)
+   {
+      cachePath_ = cachePath;
+      images_.clear();
+
+      // images left over from a previous session aren't indexed so
+      // remove them
+      Error error = cachePath_.removeIfExists();
+      if (error)
+         return error;
+
+      return cachePath_.ensureDirectory();
+   }
+   END_LOCK_MUTEX
+
+   return Success();
+}
+
+std::string PlotRenderCache::keyFor(const FilePath& snapshotFile,
+                                    const DisplaySize& size,
+                                    int dpi) const
+{
+   std::string snapshot;
+   Error error = readStringFromFile(snapshotFile, &snapshot);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return std::string();
+   }
+
+   // include the length of the snapshot along with its checksum to make
+   // collisions between different plots even less likely
+   boost::format fmt("%1%-%2%-%3%x%4%-%5%");
+   return boost::str(fmt % hash::crc32HexHash(snapshot) %
+                           snapshot.length() %
+                           size.width %
+                           size.height %
+                           dpi);
+}
+
+bool PlotRenderCache::restoreImage(const std::string& key,
+                                   const FilePath& imageFile)
+{
+   if (key.empty())
+      return false;
+
+   LOCK_MUTEX(mutex_)
+   {
+      FilePath cachedImageFile;
+      if (!images_.get(key, &cachedImageFile))
+         return false;
+
+      Error error = cachedImageFile.copy(imageFile);
+      if (error)
+      {
+         // the cached file has gone missing (e.g. the graphics directory
+         // was removed) so stop tracking it and render normally
+         LOG_ERROR(error);
+         images_.remove(key);
+         return false;
+      }
+
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void PlotRenderCache::addImage(const std::string& key,
+                               const FilePath& imageFile)
+{
+   // the image won't exist if the plot was removed before it was written
+   if (key.empty() || !imageFile.exists())
+      return;
+
+   LOCK_MUTEX(mutex_)
+   {
+      // the graphics directory (and hence the cache) may have been removed
+      // by a call to dev.off
+      Error error = cachePath_.ensureDirectory();
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      FilePath cachedImageFile = cachePath_.complete(key +
+                                                     imageFile.extension());
+      error = cachedImageFile.removeIfExists();
+      if (!error)
+         error = imageFile.copy(cachedImageFile);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      FilePath evictedImageFile;
+      if (images_.put(key, cachedImageFile, &evictedImageFile))
+      {
+         error = evictedImageFile.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void PlotRenderCache::clear()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      images_.clear();
+
+      if (!cachePath_.empty())
+      {
+         Error error = cachePath_.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+} // namespace graphics
+} // namespace session
+} // namespace r
@@ -0,0 +1,84 @@
+/*
+ * RGraphicsPlotRenderCache.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_GRAPHICS_PLOT_RENDER_CACHE_HPP
+#define R_SESSION_GRAPHICS_PLOT_RENDER_CACHE_HPP
+
+#include <string>
+
+#include <boost/utility.hpp>
+
+#include <core/BoostThread.hpp>
+#include <core/FilePath.hpp>
+#include <core/collection/LruCache.hpp>
+
+#include "RGraphicsTypes.hpp"
+
+namespace core {
+   class Error;
+}
+
+namespace r {
+namespace session {
+namespace graphics {
+
+// singleton
+class PlotRenderCache;
+PlotRenderCache& plotRenderCache();
+
+// Images previously rendered from plot snapshots, keyed by the contents of
+// the snapshot and the size and resolution it was rendered at. This lets
+// us redisplay a plot at a size it has already been shown at (e.g. when
+// navigating the plot history or toggling between pane sizes) without
+// replaying its display list onto the png device. Images are kept as files
+// within the cache directory and the least recently used are removed once
+// the cache is full. Images may be added from the png writer thread so
+// access is synchronized.
+class PlotRenderCache : boost::noncopyable
+{
+private:
+   friend PlotRenderCache& plotRenderCache();
+   PlotRenderCache();
+
+public:
+   virtual ~PlotRenderCache() {}
+
+public:
+   core::Error initialize(const core::FilePath& cachePath);
+
+   // cache key for a snapshot file rendered at the specified size (returns
+   // an empty string if the snapshot can't be read)
+   std::string keyFor(const core::FilePath& snapshotFile,
+                      const DisplaySize& size,
+                      int dpi) const;
+
+   // copy the cached image for the key to imageFile. returns false if
+   // there is no such image
+   bool restoreImage(const std::string& key, const core::FilePath& imageFile);
+
+   // add a copy of imageFile to the cache
+   void addImage(const std::string& key, const core::FilePath& imageFile);
+
+   void clear();
+
+private:
+   boost::mutex mutex_;
+   core::FilePath cachePath_;
+   core::collection::LruCache<std::string,core::FilePath> images_;
+};
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+
+#endif // R_SESSION_GRAPHICS_PLOT_RENDER_CACHE_HPP
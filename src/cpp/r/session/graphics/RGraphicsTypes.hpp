@@ -59,9 +59,12 @@ struct UnitConversionFunctions
 struct GraphicsDeviceFunctions
 {
    boost::function<DisplaySize()> displaySize;
+   boost::function<int()> displayDpi;
    UnitConversionFunctions convert;
-   boost::function<core::Error(const core::FilePath&,
-                               const core::FilePath&)> saveSnapshot;
+   boost::function<core::Error(const core::FilePath&)> saveSnapshot;
+   boost::function<core::Error(const core::FilePath&)> saveImage;
+   boost::function<void(const boost::function<void()>&)> afterImagesSaved;
+   boost::function<core::Error(const core::FilePath&)> removeImage;
    boost::function<core::Error(const core::FilePath&)> restoreSnapshot;
    boost::function<void()> copyToActiveDevice;
    boost::function<std::string()> imageFileExtension;
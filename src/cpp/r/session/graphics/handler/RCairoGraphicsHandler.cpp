@@ -22,7 +22,10 @@
 
 #include <math.h>
 
+#include <boost/shared_ptr.hpp>
+
 #include "RGraphicsHandler.hpp"
+#include "RGraphicsPngWriter.hpp"
 
 using namespace core ;
 
@@ -358,6 +361,43 @@ Error writeToPNG(const FilePath& targetPath,
    }
 }
 
+Error beginWriteToPNG(const FilePath& targetPath, DeviceContext* pDC)
+{
+   CairoDeviceData* pCDD = (CairoDeviceData*)pDC->pDeviceSpecific;
+
+   // copy the surface so drawing can continue while it's being encoded
+   cairo_surface_flush(pCDD->surface);
+   const unsigned char* pData = cairo_image_surface_get_data(pCDD->surface);
+   if (pData == NULL)
+   {
+      return systemError(boost::system::errc::io_error,
+                         "Cairo error saving PNG: no surface data",
+                         ERROR_LOCATION);
+   }
+
+   int width = cairo_image_surface_get_width(pCDD->surface);
+   int height = cairo_image_surface_get_height(pCDD->surface);
+   int stride = cairo_image_surface_get_stride(pCDD->surface);
+   boost::shared_ptr<png_writer::Pixels> pPixels(
+            new png_writer::Pixels(pData, pData + (stride * height)));
+
+   return png_writer::writeInBackground(pPixels,
+                                        width,
+                                        height,
+                                        stride,
+                                        targetPath);
+}
+
+void afterPendingPNGWrites(const boost::function<void()>& function)
+{
+   png_writer::afterPendingWrites(function);
+}
+
+Error removePNG(const FilePath& targetPath)
+{
+   return png_writer::remove(targetPath);
+}
+
 
 void circle(double x,
             double y,
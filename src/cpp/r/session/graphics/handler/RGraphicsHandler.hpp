@@ -14,6 +14,8 @@
 #ifndef R_GRAPHICS_HANDLER_HPP
 #define R_GRAPHICS_HANDLER_HPP
 
+#include <boost/function.hpp>
+
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 
@@ -82,6 +84,17 @@ core::Error writeToPNG(const core::FilePath& targetPath,
                        DeviceContext* pDC,
                        bool keepContextAlive);
 
+// write the contents of the interactive device to a PNG for display. the
+// handler may complete the write in the background
+core::Error beginWriteToPNG(const core::FilePath& targetPath,
+                            DeviceContext* pDC);
+
+// call the function once all PNG writes begun so far have completed
+void afterPendingPNGWrites(const boost::function<void()>& function);
+
+// remove a PNG file (including one whose write has yet to complete)
+core::Error removePNG(const core::FilePath& targetPath);
+
 void circle(double x,
             double y,
             double r,
@@ -0,0 +1,348 @@
+/*
+ * RGraphicsPngWriter.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RGraphicsPngWriter.hpp"
+
+#include <cstring>
+#include <set>
+#include <string>
+
+#include <zlib.h>
+
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/Thread.hpp>
+
+using namespace core;
+
+namespace r {
+namespace session {
+namespace graphics {
+namespace handler {
+namespace png_writer {
+
+namespace {
+
+// beyond this many queued writes we encode on the calling thread rather
+// than holding on to ever more copies of the device surface
+const std::size_t kMaxQueuedWrites = 8;
+
+// png row filter which subtracts the pixel above (cheap to compute and
+// very effective on plots, which are mostly runs of flat color)
+const unsigned char kFilterUp = 2;
+
+void appendUInt32(boost::uint32_t value, std::string* pBuffer)
+{
+   pBuffer->push_back(static_cast<char>((value >> 24) & 0xFF));
+   pBuffer->push_back(static_cast<char>((value >> 16) & 0xFF));
+   pBuffer->push_back(static_cast<char>((value >> 8) & 0xFF));
+   pBuffer->push_back(static_cast<char>(value & 0xFF));
+}
+
+void appendChunk(const char* type, const std::string& data, std::string* pPng)
+{
+   appendUInt32(static_cast<boost::uint32_t>(data.length()), pPng);
+   std::size_t crcOffset = pPng->length();
+   pPng->append(type, 4);
+   pPng->append(data);
+
+   uLong crc = ::crc32(0L, Z_NULL, 0);
+   crc = ::crc32(crc,
+                 reinterpret_cast<const Bytef*>(pPng->data() + crcOffset),
+                 static_cast<uInt>(4 + data.length()));
+   appendUInt32(static_cast<boost::uint32_t>(crc), pPng);
+}
+
+// convert a row of premultiplied native-endian ARGB to straight RGBA
+void unpremultiplyRow(const unsigned char* pSource,
+                      int width,
+                      unsigned char* pDest)
+{
+   const boost::uint32_t* pPixels =
+                     reinterpret_cast<const boost::uint32_t*>(pSource);
+   for (int i = 0; i < width; i++)
+   {
+      boost::uint32_t pixel = pPixels[i];
+      unsigned int alpha = pixel >> 24;
+      unsigned int red = (pixel >> 16) & 0xFF;
+      unsigned int green = (pixel >> 8) & 0xFF;
+      unsigned int blue = pixel & 0xFF;
+
+      if (alpha == 0)
+      {
+         red = green = blue = 0;
+      }
+      else if (alpha != 0xFF)
+      {
+         red = (red * 0xFF + alpha / 2) / alpha;
+         green = (green * 0xFF + alpha / 2) / alpha;
+         blue = (blue * 0xFF + alpha / 2) / alpha;
+      }
+
+      *pDest++ = static_cast<unsigned char>(red);
+      *pDest++ = static_cast<unsigned char>(green);
+      *pDest++ = static_cast<unsigned char>(blue);
+      *pDest++ = static_cast<unsigned char>(alpha);
+   }
+}
+
+Error zlibError(int result, const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::io_error,
+                      std::string("zlib error compressing PNG: ") +
+                      boost::lexical_cast<std::string>(result),
+                      location);
+}
+
+Error deflateInto(z_stream* pStream, int flush, std::string* pOutput)
+{
+   unsigned char buffer[64 * 1024];
+   int result;
+   do
+   {
+      pStream->next_out = buffer;
+      pStream->avail_out = sizeof(buffer);
+      result = ::deflate(pStream, flush);
+      if (result == Z_STREAM_ERROR)
+         return zlibError(result, ERROR_LOCATION);
+      pOutput->append(reinterpret_cast<const char*>(buffer),
+                      sizeof(buffer) - pStream->avail_out);
+   }
+   while (pStream->avail_out == 0 ||
+          (flush == Z_FINISH && result != Z_STREAM_END));
+
+   return Success();
+}
+
+Error compressImageData(const unsigned char* pPixels,
+                        int width,
+                        int height,
+                        int stride,
+                        std::string* pCompressed)
+{
+   z_stream stream;
+   std::memset(&stream, 0, sizeof(stream));
+   int result = ::deflateInit(&stream, Z_BEST_SPEED);
+   if (result != Z_OK)
+      return zlibError(result, ERROR_LOCATION);
+
+   // each row is a filter type byte followed by the filtered pixels
+   std::size_t rowBytes = static_cast<std::size_t>(width) * 4;
+   std::vector<unsigned char> row(rowBytes), previousRow(rowBytes, 0);
+   std::vector<unsigned char> filteredRow(rowBytes + 1);
+   filteredRow[0] = kFilterUp;
+
+   Error error;
+   for (int y = 0; y < height && !error; y++)
+   {
+      unpremultiplyRow(pPixels + static_cast<std::size_t>(y) * stride,
+                       width,
+                       &row[0]);
+      for (std::size_t i = 0; i < rowBytes; i++)
+         filteredRow[i + 1] = row[i] - previousRow[i];
+      row.swap(previousRow);
+
+      stream.next_in = &filteredRow[0];
+      stream.avail_in = static_cast<uInt>(filteredRow.size());
+      error = deflateInto(&stream, Z_NO_FLUSH, pCompressed);
+   }
+
+   if (!error)
+      error = deflateInto(&stream, Z_FINISH, pCompressed);
+
+   ::deflateEnd(&stream);
+   return error;
+}
+
+// paths of queued writes and of those which were removed while queued
+boost::mutex s_mutex;
+std::set<std::string> s_pendingPaths;
+std::set<std::string> s_discardedPaths;
+
+core::thread::ThreadPool& writerThread()
+{
+   // never deleted so that the thread can't outlive it during exit
+   static core::thread::ThreadPool* pWriterThread =
+                                    new core::thread::ThreadPool(1, 100);
+   return *pWriterThread;
+}
+
+bool isDiscarded(const FilePath& targetPath)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      return s_discardedPaths.count(targetPath.absolutePath()) > 0;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+// mark a pending write as complete, moving the written temporary file (if
+// any) into place unless the target was removed in the meantime. returns
+// true if the file was moved
+bool completeWrite(const FilePath& targetPath, const FilePath& tempPath)
+{
+   bool moved = false;
+   LOCK_MUTEX(s_mutex)
+   {
+      std::string path = targetPath.absolutePath();
+
+      // move while holding the lock so that a concurrent remove either
+      // prevents the move or finds the file in place
+      if (!tempPath.empty() && !s_discardedPaths.count(path))
+      {
+         Error error = tempPath.move(targetPath);
+         if (error)
+            LOG_ERROR(error);
+         else
+            moved = true;
+      }
+
+      s_pendingPaths.erase(path);
+      s_discardedPaths.erase(path);
+   }
+   END_LOCK_MUTEX
+
+   return moved;
+}
+
+void performWrite(const boost::shared_ptr<Pixels>& pPixels,
+                  int width,
+                  int height,
+                  int stride,
+                  const FilePath& targetPath)
+{
+   // the plot may have been removed (or the device closed, removing the
+   // whole graphics directory) since the write was queued
+   if (isDiscarded(targetPath) || !targetPath.parent().exists())
+   {
+      completeWrite(targetPath, FilePath());
+      return;
+   }
+
+   FilePath tempPath = targetPath.parent().complete(targetPath.filename() +
+                                                    ".tmp");
+   Error error = write(&(pPixels->at(0)), width, height, stride, tempPath);
+   if (error)
+      LOG_ERROR(error);
+
+   if (!completeWrite(targetPath, error ? FilePath() : tempPath))
+   {
+      Error removeError = tempPath.removeIfExists();
+      if (removeError)
+         LOG_ERROR(removeError);
+   }
+}
+
+} // anonymous namespace
+
+Error write(const unsigned char* pPixels,
+            int width,
+            int height,
+            int stride,
+            const FilePath& targetPath)
+{
+   std::string compressed;
+   Error error = compressImageData(pPixels, width, height, stride, &compressed);
+   if (error)
+      return error;
+
+   // signature
+   std::string png("\x89PNG\r\n\x1A\n", 8);
+
+   // header: dimensions, 8 bits per channel, rgba, default compression,
+   // filtering and no interlacing
+   std::string header;
+   appendUInt32(width, &header);
+   appendUInt32(height, &header);
+   header.push_back(8);
+   header.push_back(6);
+   header.append(3, '\0');
+   appendChunk("IHDR", header, &png);
+
+   appendChunk("IDAT", compressed, &png);
+   appendChunk("IEND", std::string(), &png);
+
+   return writeStringToFile(targetPath, png);
+}
+
+Error writeInBackground(const boost::shared_ptr<Pixels>& pPixels,
+                        int width,
+                        int height,
+                        int stride,
+                        const FilePath& targetPath)
+{
+   if (pPixels->empty())
+      return systemError(boost::system::errc::invalid_argument,
+                         ERROR_LOCATION);
+
+   // encode on this thread if the writer has fallen behind
+   if (writerThread().pending() < kMaxQueuedWrites)
+   {
+      LOCK_MUTEX(s_mutex)
+      {
+         s_pendingPaths.insert(targetPath.absolutePath());
+      }
+      END_LOCK_MUTEX
+
+      if (writerThread().enque(boost::bind(performWrite,
+                                           pPixels,
+                                           width,
+                                           height,
+                                           stride,
+                                           targetPath)))
+      {
+         return Success();
+      }
+
+      completeWrite(targetPath, FilePath());
+   }
+
+   return write(&(pPixels->at(0)), width, height, stride, targetPath);
+}
+
+void afterPendingWrites(const boost::function<void()>& function)
+{
+   if (writerThread().pending() == 0 || !writerThread().enque(function))
+      function();
+}
+
+Error remove(const FilePath& targetPath)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      std::string path = targetPath.absolutePath();
+      if (s_pendingPaths.count(path))
+      {
+         // the writer will skip (or clean up after) the write
+         s_discardedPaths.insert(path);
+         return Success();
+      }
+   }
+   END_LOCK_MUTEX
+
+   return targetPath.removeIfExists();
+}
+
+} // namespace png_writer
+} // namespace handler
+} // namespace graphics
+} // namespace session
+} // namespace r
@@ -0,0 +1,67 @@
+/*
+ * RGraphicsPngWriter.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_GRAPHICS_PNG_WRITER_HPP
+#define R_SESSION_GRAPHICS_PNG_WRITER_HPP
+
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+
+namespace core {
+   class Error;
+   class FilePath;
+}
+
+namespace r {
+namespace session {
+namespace graphics {
+namespace handler {
+namespace png_writer {
+
+// pixels are 32-bit premultiplied ARGB in native byte order (i.e. the
+// format of a CAIRO_FORMAT_ARGB32 image surface)
+typedef std::vector<unsigned char> Pixels;
+
+// encode pixels as a PNG file (using fast rather than maximal compression)
+core::Error write(const unsigned char* pPixels,
+                  int width,
+                  int height,
+                  int stride,
+                  const core::FilePath& targetPath);
+
+// queue pixels to be encoded as a PNG file on a background thread. the
+// file is written under a temporary name and then renamed into place
+// so readers never see a partially written file. if too many writes are
+// already queued the file is written before returning instead
+core::Error writeInBackground(const boost::shared_ptr<Pixels>& pPixels,
+                              int width,
+                              int height,
+                              int stride,
+                              const core::FilePath& targetPath);
+
+// call the function once all writes queued so far have completed (called
+// immediately if there are none pending, otherwise on the writer thread)
+void afterPendingWrites(const boost::function<void()>& function);
+
+// remove a PNG file, including one which has yet to be written
+core::Error remove(const core::FilePath& targetPath);
+
+} // namespace png_writer
+} // namespace handler
+} // namespace graphics
+} // namespace session
+} // namespace r
+
+#endif // R_SESSION_GRAPHICS_PNG_WRITER_HPP
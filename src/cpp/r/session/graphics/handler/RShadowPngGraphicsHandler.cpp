@@ -304,6 +304,23 @@ Error writeToPNG(const FilePath& targetPath,
    return error;
 }
 
+// the png device writes files as it's closed so there is nothing left to
+// do in the background
+Error beginWriteToPNG(const FilePath& targetPath, DeviceContext* pDC)
+{
+   return writeToPNG(targetPath, pDC, true);
+}
+
+void afterPendingPNGWrites(const boost::function<void()>& function)
+{
+   function();
+}
+
+Error removePNG(const FilePath& targetPath)
+{
+   return targetPath.removeIfExists();
+}
+
 
 void circle(double x,
             double y,
@@ -67,10 +67,18 @@ bool mainPageFilter(const core::http::Request& request,
 
 http::UriHandlerFunction blockingFileHandler()
 {
-   Options& options = server::options();
-   return gwt::fileHandlerFunction(options.wwwLocalPath(),
-                                   "/",
-                                   mainPageFilter);
+   // the handler keeps an in-memory cache of the www files so we create
+   // it (and preload the cache) only once
+   static http::UriHandlerFunction fileHandler;
+   if (!fileHandler)
+   {
+      Options& options = server::options();
+      fileHandler = gwt::fileHandlerFunction(options.wwwLocalPath(),
+                                             "/",
+                                             mainPageFilter,
+                                             true);
+   }
+   return fileHandler;
 }
 
 //
@@ -34,6 +34,7 @@
 #include <server/auth/ServerValidateUser.hpp>
 
 #include "ServerREnvironment.hpp"
+#include "ServerSessionProxy.hpp"
 
 
 using namespace core;
@@ -90,7 +91,7 @@ Error SessionManager::launchSession(const std::string& username)
    else
    {
       // add it to our active pids
-      addActivePid(pid);
+      addActivePid(pid, username);
 
       // return success
       return Success();
@@ -156,7 +157,11 @@ void SessionManager::notifySIGCHLD()
          if (exited)
          {
             // all done with this pid
-            removeActivePid(pid);
+            std::string username = removeActivePid(pid);
+
+            // idle proxy connections to the session are no longer usable
+            if (!username.empty())
+               session_proxy::evictSessionConnections(username);
          }
          else
          {
@@ -175,32 +180,46 @@ void SessionManager::notifySIGCHLD()
    }
 }
 
-void SessionManager::addActivePid(PidType pid)
+void SessionManager::addActivePid(PidType pid, const std::string& username)
 {
    LOCK_MUTEX(pidsMutex_)
    {
-      activePids_.push_back(pid);
+      activePids_[pid] = username;
    }
    END_LOCK_MUTEX
 }
 
-void SessionManager::removeActivePid(PidType pid)
+std::string SessionManager::removeActivePid(PidType pid)
 {
    LOCK_MUTEX(pidsMutex_)
    {
-      activePids_.erase(std::remove(activePids_.begin(),
-                                    activePids_.end(),
-                                    pid),
-                        activePids_.end());
+      std::string username;
+      PidMap::iterator it = activePids_.find(pid);
+      if (it != activePids_.end())
+      {
+         username = it->second;
+         activePids_.erase(it);
+      }
+      return username;
    }
    END_LOCK_MUTEX
+
+   // keep compiler happy
+   return std::string();
 }
 
 std::vector<PidType> SessionManager::activePids()
 {
    LOCK_MUTEX(pidsMutex_)
    {
-      return activePids_;
+      std::vector<PidType> pids;
+      for (PidMap::const_iterator it = activePids_.begin();
+           it != activePids_.end();
+           ++it)
+      {
+         pids.push_back(it->first);
+      }
+      return pids;
    }
    END_LOCK_MUTEX
 
@@ -54,8 +54,8 @@ public:
    void notifySIGCHLD();
 
 private:
-   void addActivePid(PidType pid);
-   void removeActivePid(PidType pid);
+   void addActivePid(PidType pid, const std::string& username);
+   std::string removeActivePid(PidType pid);
    std::vector<PidType> activePids();
 
 private:
@@ -64,9 +64,10 @@ private:
    typedef std::map<std::string,boost::posix_time::ptime> LaunchMap;
    LaunchMap pendingLaunches_;
 
-   // pids we have launched
+   // pids we have launched (and the users they were launched for)
    boost::mutex pidsMutex_;
-   std::vector<PidType> activePids_;
+   typedef std::map<PidType,std::string> PidMap;
+   PidMap activePids_;
 };
 
 // Lower-level global functions for launching sessions. These are used
@@ -35,6 +35,7 @@
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/LocalStreamAsyncClient.hpp>
+#include <core/http/LocalStreamConnectionPool.hpp>
 #include <core/http/Util.hpp>
 #include <core/system/System.hpp>
 #include <core/system/PosixUser.hpp>
@@ -60,6 +61,13 @@ namespace session_proxy {
    
 namespace {
 
+// pool of keep-alive connections to session local streams
+boost::shared_ptr<http::LocalStreamConnectionPool> s_ptrConnectionPool;
+
+// limits for idle connections kept for each session
+const std::size_t kMaxIdleConnectionsPerSession = 8;
+const int kIdleConnectionTimeoutSeconds = 30;
+
 void launchSessionRecovery(const std::string& username)
 {
    Error error = sessionManager().launchSession(username);
@@ -192,9 +200,12 @@ void proxyRequest(
    // calculate stream path
    FilePath streamPath = session::local_streams::streamPath(username);
 
-   // create async client
+   // create async client (reusing an idle connection to the session
+   // if we have one)
    boost::shared_ptr<http::LocalStreamAsyncClient> pClient(
-    new http::LocalStreamAsyncClient(ptrConnection->ioService(), streamPath));
+    new http::LocalStreamAsyncClient(ptrConnection->ioService(),
+                                     streamPath,
+                                     s_ptrConnectionPool));
 
    // setup retry context
    if (!connectionRetryProfile.empty())
@@ -243,9 +254,22 @@ bool validateUser(boost::shared_ptr<http::AsyncConnection> ptrConnection,
 
 Error initialize()
 { 
+   s_ptrConnectionPool.reset(new http::LocalStreamConnectionPool(
+                  kMaxIdleConnectionsPerSession,
+                  boost::posix_time::seconds(kIdleConnectionTimeoutSeconds)));
+
    return session::local_streams::createStreamsDir();
 }
 
+void evictSessionConnections(const std::string& username)
+{
+   if (s_ptrConnectionPool)
+   {
+      s_ptrConnectionPool->evict(
+                  session::local_streams::streamPath(username));
+   }
+}
+
 Error runVerifyInstallationSession()
 {
    // get current user
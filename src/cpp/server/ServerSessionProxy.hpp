@@ -27,6 +27,10 @@ namespace session_proxy {
 
 core::Error initialize();
 
+// close idle proxy connections to the user's session (called when the
+// session process exits)
+void evictSessionConnections(const std::string& username);
+
 core::Error runVerifyInstallationSession();
    
 void proxyContentRequest(
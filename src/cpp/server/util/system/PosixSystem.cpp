@@ -43,50 +43,6 @@ namespace system {
 
 namespace {
 
-// NOTE: this function is duplicated between here and core::system
-// Did this to prevent the "system" interface from allowing Posix
-// constructs with Win32 no-ops to creep in (since this is used on
-// Posix for forking and has no purpose on Win32)
-
-Error closeFileDescriptorsFrom(int fdStart)
-{
-   // There is no fully reliable and cross-platform way to do this
-   //
-   // Various potential mechanisms include:
-   //
-   //  - closefrom
-   //  - fcntl(0, F_MAXFD)
-   //  - sysconf(_SC_OPEN_MAX)
-   //  - getrlimit(RLIMIT_NOFILE, &rl)
-   //  - gettdtablesize
-   //  - read from /proc/self/fd, /proc/<pid>/fd, or /dev/fd
-   //
-   // Note that the above functions may return either -1 or MAX_INT, in
-   // which case substituting/truncating to an appropriate number (1024?)
-   // is still required
-
-   // get limit
-   struct rlimit rl;
-   if (::getrlimit(RLIMIT_NOFILE, &rl) < 0)
-      return systemError(errno, ERROR_LOCATION);
-   if (rl.rlim_max == RLIM_INFINITY)
-      rl.rlim_max = 1024; // default on linux
-
-   // close file descriptors
-   for (int i=fdStart; i< (int)rl.rlim_max; i++)
-   {
-      if (::close(i) < 0 && errno != EBADF)
-         return systemError(errno, ERROR_LOCATION);
-   }
-
-   return Success();
-}
-
-Error closeNonStdFileDescriptors()
-{
-   return closeFileDescriptorsFrom(STDERR_FILENO+1);
-}
-
 const int kNotFoundError = EACCES;
 
 } // anonymouys namespace
@@ -105,7 +61,7 @@ Error daemonize()
    ::setsid();
 
    // close all file descriptors
-   Error error = closeFileDescriptorsFrom(0);
+   Error error = core::system::closeAllFileDescriptors();
    if (error)
       return error;
 
@@ -394,7 +350,7 @@ Error launchChildProcess(std::string path,
       }
 
       // close all open file descriptors other than std streams
-      error = closeNonStdFileDescriptors();
+      error = core::system::closeNonStdFileDescriptors();
       if (error)
       {
          LOG_ERROR(error);
@@ -47,9 +47,10 @@ public:
    
    void setClientId(const std::string& clientId, bool clearEvents);
 
+   // thread safe
+   std::string clientId();
 
 private:
-   std::string clientId();
 
    void run();
 
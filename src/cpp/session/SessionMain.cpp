@@ -115,6 +115,7 @@
 #include "workers/SessionWebRequestWorker.hpp"
 
 #include <session/SessionHttpConnectionListener.hpp>
+#include <session/SessionRpcWorkers.hpp>
 
 #include "config.h"
 
@@ -1166,7 +1167,15 @@ Error bufferConsoleInput(const core::json::JsonRpcRequest& request,
 
 Error startHttpConnectionListener()
 {
+   rpc_workers::initialize(s_version);
    initializeHttpConnectionListener();
+
+   // wake the main thread's wait for connections when a child process has
+   // output or exits so it is handled right away rather than after the wait
+   module_context::processSupervisor().setActivityHandler(
+         boost::bind(&HttpConnectionQueue::wakeup,
+                     &(httpConnectionListener().mainConnectionQueue())));
+
    return httpConnectionListener().start();
 }
 
@@ -1807,6 +1816,19 @@ void rCleanup(bool terminatedNormally)
       // fire shutdown event to modules
       module_context::events().onShutdown(terminatedNormally);
 
+      // log how much file change coalescing saved us
+      core::system::FileChangeCoalescerStats coalescerStats =
+                           core::system::file_monitor::coalescingStats();
+      if (coalescerStats.rawEvents > 0)
+      {
+         boost::format fmt("File monitor coalescing: %1% raw events, "
+                           "%2% delivered, %3% absorbed, %4% storms");
+         LOG_DEBUG_MESSAGE(boost::str(fmt % coalescerStats.rawEvents
+                                          % coalescerStats.deliveredEvents
+                                          % coalescerStats.absorbedEvents()
+                                          % coalescerStats.storms));
+      }
+
       // cause graceful exit of clientEventService (ensures delivery
       // of any pending events prior to process termination). wait a
       // very brief interval first to allow the quit or other termination
@@ -2151,6 +2173,15 @@ Error registerRpcMethod(const std::string& name,
    return Success();
 }
 
+Error registerWorkerRpcMethod(const std::string& name,
+                              const core::json::JsonRpcFunction& function)
+{
+   // also register as a normal method so the main thread can handle it
+   // when the workers are saturated
+   rpc_workers::registerMethod(name, function);
+   return registerRpcMethod(name, function);
+}
+
 namespace {
 
 bool continueChildProcess(core::system::ProcessOperations&)
@@ -775,17 +775,33 @@ void enqueFileChangedEvent(
    ClientEvent clientEvent(client_events::kFileChanged, fileChange);
    module_context::enqueClientEvent(clientEvent);
 }
+
+void enqueDecoratedFileChangedEvents(
+                     const FilePath& decorationRoot,
+                     const std::vector<core::system::FileChangeEvent>& events)
+{
+   using namespace session::modules::source_control;
+   boost::shared_ptr<FileDecorationContext> pCtx =
+                                 fileDecorationContext(decorationRoot, true);
+
+   BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
+   {
+      enqueFileChangedEvent(event, pCtx);
+   }
+}
 } // namespace
 
 void enqueFileChangedEvent(const core::system::FileChangeEvent &event)
 {
    FilePath filePath = FilePath(event.fileInfo().absolutePath());
 
+   // decorate once vcs status reflects the change
    using namespace session::modules::source_control;
-   boost::shared_ptr<FileDecorationContext> pCtx =
-                                       fileDecorationContext(filePath);
-
-   enqueFileChangedEvent(event, pCtx);
+   whenStatusAvailable(
+         std::vector<FilePath>(1, filePath),
+         boost::bind(enqueDecoratedFileChangedEvents,
+                     filePath,
+                     std::vector<core::system::FileChangeEvent>(1, event)));
 }
 
 void enqueFileChangedEvents(const core::FilePath& vcsStatusRoot,
@@ -798,25 +814,23 @@ void enqueFileChangedEvents(const core::FilePath& vcsStatusRoot,
 
    // try to find the common parent of the events
    FilePath commonParentPath = FilePath(events.front().fileInfo().absolutePath()).parent();
+   std::vector<FilePath> changedPaths;
    BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
    {
+      FilePath changedPath(event.fileInfo().absolutePath());
+      changedPaths.push_back(changedPath);
+
       // if not within the common parent then revert to the vcs status root
-      if (!FilePath(event.fileInfo().absolutePath()).isWithin(commonParentPath))
-      {
+      if (!changedPath.isWithin(commonParentPath))
          commonParentPath = vcsStatusRoot;
-         break;
-      }
    }
 
+   // fire client events once vcs status reflects the changes
    using namespace session::modules::source_control;
-   boost::shared_ptr<FileDecorationContext> pCtx =
-                                  fileDecorationContext(commonParentPath);
-
-   // fire client events as necessary
-   BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
-   {
-      enqueFileChangedEvent(event, pCtx);
-   }
+   whenStatusAvailable(changedPaths,
+                       boost::bind(enqueDecoratedFileChangedEvents,
+                                   commonParentPath,
+                                   events));
 }
 
 
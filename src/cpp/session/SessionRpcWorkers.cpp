@@ -0,0 +1,240 @@
+/*
+ * SessionRpcWorkers.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <session/SessionRpcWorkers.hpp>
+
+#include <map>
+
+#include <boost/bind.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+#include <core/http/Request.hpp>
+
+#include <session/SessionConstants.hpp>
+#include <session/SessionHttpConnectionListener.hpp>
+
+#include "SessionClientEventQueue.hpp"
+#include "SessionClientEventService.hpp"
+
+#include "http/SessionHttpLog.hpp"
+
+using namespace core;
+using namespace boost::posix_time;
+
+namespace session {
+namespace rpc_workers {
+
+namespace {
+
+// more than one worker so a slow method doesn't hold up the others. once
+// kMaxPendingConnections are queued further connections go to the main
+// thread as usual
+const std::size_t kWorkerThreads = 2;
+const std::size_t kMaxPendingConnections = 64;
+
+struct MethodMetrics
+{
+   MethodMetrics()
+      : calls(0), totalQueueDelay(0, 0, 0), maxQueueDelay(0, 0, 0),
+        totalExecution(0, 0, 0)
+   {
+   }
+
+   int calls;
+   time_duration totalQueueDelay;
+   time_duration maxQueueDelay;
+   time_duration totalExecution;
+};
+
+boost::mutex s_mutex;
+json::JsonRpcMethods s_methods;
+std::map<std::string,MethodMetrics> s_metrics;
+double s_version = 0;
+
+core::thread::ThreadPool& workerPool()
+{
+   // never deleted so that the threads can't outlive it during exit
+   static core::thread::ThreadPool* pWorkerPool =
+         new core::thread::ThreadPool(kWorkerThreads, kMaxPendingConnections);
+   return *pWorkerPool;
+}
+
+bool lookupMethod(const std::string& uri,
+                  std::string* pMethod,
+                  json::JsonRpcFunction* pFunction)
+{
+   const std::string kRpcPrefix("/rpc/");
+   if (!boost::algorithm::starts_with(uri, kRpcPrefix))
+      return false;
+
+   std::string method = uri.substr(kRpcPrefix.length());
+
+   LOCK_MUTEX(s_mutex)
+   {
+      json::JsonRpcMethods::const_iterator it = s_methods.find(method);
+      if (it == s_methods.end())
+         return false;
+
+      *pMethod = method;
+      *pFunction = it->second;
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+// we only execute requests which the main thread would accept (it takes
+// care of sending the appropriate error for the others)
+bool isValidRequest(const json::JsonRpcRequest& request)
+{
+   if (request.clientId != clientEventService().clientId())
+      return false;
+
+   if (request.version > 0 && s_version > request.version)
+      return false;
+
+   return true;
+}
+
+void recordMetrics(const std::string& method,
+                   const time_duration& queueDelay,
+                   const time_duration& execution)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      MethodMetrics& metrics = s_metrics[method];
+      metrics.calls++;
+      metrics.totalQueueDelay += queueDelay;
+      if (queueDelay > metrics.maxQueueDelay)
+         metrics.maxQueueDelay = queueDelay;
+      metrics.totalExecution += execution;
+   }
+   END_LOCK_MUTEX
+}
+
+void executeConnection(boost::shared_ptr<HttpConnection> ptrConnection,
+                       const std::string& method,
+                       const json::JsonRpcFunction& function,
+                       const ptime& queuedTime)
+{
+   try
+   {
+      ptime startTime = microsec_clock::universal_time();
+
+      json::JsonRpcRequest request;
+      Error error = json::parseJsonRpcRequest(ptrConnection->request().body(),
+                                              &request);
+      if (error || !isValidRequest(request))
+      {
+         httpConnectionListener().mainConnectionQueue().enqueConnection(
+                                                               ptrConnection);
+         return;
+      }
+
+      httpLog().addEntry(HttpLog::ConnectionDequeued,
+                         ptrConnection->requestId());
+
+      // workers never detect changes (that requires the main thread)
+      request.isBackgroundConnection = true;
+      json::JsonRpcResponse response;
+      response.setSuppressDetectChanges(true);
+
+      error = function(request, &response);
+      if (error)
+      {
+         ptrConnection->sendJsonRpcError(error);
+      }
+      else
+      {
+         // are there (or will there likely be) events pending?
+         if (!clientEventQueue().eventAddedSince(startTime) &&
+             !response.hasAfterResponse())
+         {
+            response.setField(kEventsPending, "false");
+         }
+
+         ptrConnection->sendJsonRpcResponse(response);
+
+         if (response.hasAfterResponse())
+            response.runAfterResponse();
+      }
+
+      recordMetrics(method,
+                    startTime - queuedTime,
+                    microsec_clock::universal_time() - startTime);
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // anonymous namespace
+
+void registerMethod(const std::string& name,
+                    const json::JsonRpcFunction& function)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      s_methods[name] = function;
+   }
+   END_LOCK_MUTEX
+}
+
+void initialize(double version)
+{
+   s_version = version;
+}
+
+bool enqueConnection(boost::shared_ptr<HttpConnection> ptrConnection)
+{
+   std::string method;
+   json::JsonRpcFunction function;
+   if (!lookupMethod(ptrConnection->request().uri(), &method, &function))
+      return false;
+
+   return workerPool().enque(boost::bind(executeConnection,
+                                         ptrConnection,
+                                         method,
+                                         function,
+                                         microsec_clock::universal_time()));
+}
+
+void metricsAsJson(json::Array* pMetricsArray)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      for (std::map<std::string,MethodMetrics>::const_iterator it =
+              s_metrics.begin(); it != s_metrics.end(); ++it)
+      {
+         const MethodMetrics& metrics = it->second;
+         json::Object metricsJson;
+         metricsJson["method"] = it->first;
+         metricsJson["calls"] = metrics.calls;
+         metricsJson["total_queue_ms"] = static_cast<double>(
+                              metrics.totalQueueDelay.total_microseconds()) / 1000;
+         metricsJson["max_queue_ms"] = static_cast<double>(
+                              metrics.maxQueueDelay.total_microseconds()) / 1000;
+         metricsJson["total_execution_ms"] = static_cast<double>(
+                              metrics.totalExecution.total_microseconds()) / 1000;
+         pMetricsArray->push_back(metricsJson);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+} // namespace rpc_workers
+} // namespace session
@@ -13,8 +13,10 @@
 
 #include <session/SessionSourceDatabase.hpp>
 
+#include <map>
 #include <string>
 #include <vector>
+#include <sstream>
 #include <algorithm>
 
 #include <boost/bind.hpp>
@@ -27,6 +29,7 @@
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 #include <core/Hash.hpp>
+#include <core/KeyValueStore.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/DateTime.hpp>
 
@@ -58,93 +61,129 @@ namespace source_database {
 
 namespace {
 
-struct PropertiesDatabase
-{
-   FilePath path;
-   FilePath indexFile;
-   std::map<std::string,std::string> index;
-};
+// durable document properties are kept in a single key value store (keyed
+// by path) within the scoped scratch path
+KeyValueStore s_propertiesStore;
+FilePath s_propertiesStorePath;
 
-Error getPropertiesDatabase(PropertiesDatabase* pDatabase)
+// older versions kept an INDEX of escaped path => properties file within
+// the properties directory; import these into the store then remove them
+// (entries which can't be imported are left in the INDEX)
+Error migrateLegacyProperties(const FilePath& propertiesDir)
 {
-   pDatabase->path = module_context::scopedScratchPath().complete("sdb/prop");
-   Error error = pDatabase->path.ensureDirectory();
+   FilePath indexFile = propertiesDir.complete("INDEX");
+   if (!indexFile.exists())
+      return Success();
+
+   std::map<std::string,std::string> index;
+   Error error = readStringMapFromFile(indexFile, &index);
    if (error)
       return error;
 
-   pDatabase->indexFile = pDatabase->path.complete("INDEX");
+   std::vector<FilePath> importedFiles;
+   std::map<std::string,std::string> remainingIndex;
+   typedef std::map<std::string,std::string>::value_type IndexEntry;
+   BOOST_FOREACH(const IndexEntry& entry, index)
+   {
+      FilePath propertiesFile = propertiesDir.complete(entry.second);
 
-   if (pDatabase->indexFile.exists())
-      return readStringMapFromFile(pDatabase->indexFile, &(pDatabase->index));
-   else
-      return Success();
-}
+      std::string contents;
+      error = readStringFromFile(propertiesFile, &contents);
+      if (error)
+      {
+         LOG_ERROR(error);
+         remainingIndex.insert(entry);
+         continue;
+      }
 
-Error putProperties(const std::string& path, const json::Object& properties)
-{
-   // url escape path (so we can use key=value persistence)
-   std::string escapedPath = http::util::urlEncode(path);
+      json::Value value;
+      if (!json::parse(contents, &value) ||
+          !json::isType<json::Object>(value))
+      {
+         LOG_WARNING_MESSAGE("Unable to parse document properties file " +
+                             propertiesFile.absolutePath());
+         remainingIndex.insert(entry);
+         continue;
+      }
+
+      std::ostringstream ostr;
+      json::write(value, ostr);
+      error = s_propertiesStore.set(http::util::urlDecode(entry.first),
+                                    ostr.str());
+      if (error)
+         return error;
+
+      importedFiles.push_back(propertiesFile);
+   }
 
-   // get properties database
-   PropertiesDatabase propertiesDB;
-   Error error = getPropertiesDatabase(&propertiesDB);
+   // make sure the imported properties are on disk before removing the
+   // files they came from
+   error = s_propertiesStore.sync();
    if (error)
       return error;
 
-   // use existing properties file if it exists, otherwise create new
-   bool updateIndex = false;
-   std::string propertiesFile = propertiesDB.index[escapedPath];
-   if (propertiesFile.empty())
+   BOOST_FOREACH(const FilePath& importedFile, importedFiles)
    {
-      FilePath propFile = module_context::uniqueFilePath(propertiesDB.path);
-      propertiesFile = propFile.filename();
-      propertiesDB.index[escapedPath] = propertiesFile;
-      updateIndex = true;
+      error = importedFile.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
    }
 
-   // write the file
-   std::ostringstream ostr ;
-   json::writeFormatted(properties, ostr);
-   FilePath propertiesFilePath = propertiesDB.path.complete(propertiesFile);
-   error = writeStringToFile(propertiesFilePath, ostr.str());
+   if (remainingIndex.empty())
+      return indexFile.remove();
+   else
+      return writeStringMapToFile(indexFile, remainingIndex);
+}
+
+Error getPropertiesStore(KeyValueStore** ppStore)
+{
+   // (re-)open the store if the scratch path has changed
+   FilePath propertiesDir =
+               module_context::scopedScratchPath().complete("sdb/prop");
+   FilePath storePath = propertiesDir.complete("properties.db");
+   if (s_propertiesStorePath != storePath)
+   {
+      Error error = s_propertiesStore.initialize(storePath);
+      if (error)
+         return error;
+      s_propertiesStorePath = storePath;
+
+      error = migrateLegacyProperties(propertiesDir);
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   *ppStore = &s_propertiesStore;
+   return Success();
+}
+
+Error putProperties(const std::string& path, const json::Object& properties)
+{
+   KeyValueStore* pStore;
+   Error error = getPropertiesStore(&pStore);
    if (error)
       return error;
 
-   // update the index if necessary
-   if (updateIndex)
-      return writeStringMapToFile(propertiesDB.indexFile, propertiesDB.index);
-   else
-      return Success();
+   std::ostringstream ostr;
+   json::write(properties, ostr);
+   return pStore->set(path, ostr.str());
 }
 
 Error getProperties(const std::string& path, json::Object* pProperties)
 {
-   // url escape path (so we can use key=value persistence)
-   std::string escapedPath = http::util::urlEncode(path);
-
-   // get properties database
-   PropertiesDatabase propertiesDB;
-   Error error = getPropertiesDatabase(&propertiesDB);
+   KeyValueStore* pStore;
+   Error error = getPropertiesStore(&pStore);
    if (error)
       return error;
 
-   // check for properties file
-   std::string propertiesFile = propertiesDB.index[escapedPath];
-   if (propertiesFile.empty())
+   // return empty object if there are no properties
+   std::string contents = pStore->get(path);
+   if (contents.empty())
    {
-      // return empty object if there is none
       *pProperties = json::Object();
       return Success();
    }
 
-   // read the properties file
-   std::string contents ;
-   FilePath propertiesFilePath = propertiesDB.path.complete(propertiesFile);
-   error = readStringFromFile(propertiesFilePath, &contents,
-                              options().sourceLineEnding());
-   if (error)
-      return error;
-
    // parse the json
    json::Value value;
    if ( !json::parse(contents, &value) )
@@ -364,16 +403,25 @@ void SourceDocument::writeToJson(json::Object* pDocJson) const
    jsonDoc["encoding"] = encoding_;
 }
 
+namespace {
+
+Error writeDocumentJson(const FilePath& filePath, const json::Object& jsonDoc)
+{
+   std::ostringstream ostr ;
+   json::writeFormatted(jsonDoc, ostr);
+   return writeStringToFile(filePath, ostr.str());
+}
+
+} // anonymous namespace
+
 Error SourceDocument::writeToFile(const FilePath& filePath) const
 {
    // get json representation
    json::Object jsonDoc ;
    writeToJson(&jsonDoc);
-   std::ostringstream ostr ;
-   json::writeFormatted(jsonDoc, ostr);
 
    // write to file
-   return writeStringToFile(filePath, ostr.str());
+   return writeDocumentJson(filePath, jsonDoc);
 }
 
 void SourceDocument::editProperty(const json::Object::value_type& property)
@@ -394,46 +442,263 @@ bool sortByCreated(const boost::shared_ptr<SourceDocument>& pDoc1,
    return pDoc1->created() < pDoc2->created();
 }
 
+// Documents are kept in memory (as their json representation) once they
+// have been read or written. Diffs to a document are appended to a journal
+// (<id>.journal) rather than rewriting the whole document. The journal is
+// replayed when the document is read from disk, and is compacted back into
+// the document during idle time once it becomes large. Each compaction
+// starts a new journal epoch (recorded in the document and in each journal
+// entry) so that a journal left behind by a crash during compaction is
+// never replayed onto the compacted document.
+
 namespace {
 
+const char * const kJournalExtension = ".journal";
+const char * const kJournalEpoch = "journal_epoch";
+
+// compact journals once they are larger than this or the document itself
+// (whichever is larger) so replay is never more expensive than a rewrite
+const std::size_t kMinCompactJournalSize = 64 * 1024;
+
+struct LiveDocument
+{
+   LiveDocument() : journalSize(0) {}
+
+   json::Object jsonDoc;
+   std::size_t journalSize;
+   std::string journalEpoch;
+};
+
 FilePath s_sourceDBPath;
 
-} // anonymous namespace
+std::map<std::string,LiveDocument> s_liveDocuments;
 
-FilePath path()
+FilePath documentPath(const std::string& id)
 {
-   return s_sourceDBPath;
+   return s_sourceDBPath.complete(id);
 }
-   
-Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
+
+FilePath journalPath(const std::string& id)
+{
+   return s_sourceDBPath.complete(id + kJournalExtension);
+}
+
+std::size_t contentsSize(const json::Object& jsonDoc)
+{
+   json::Object::const_iterator it = jsonDoc.find("contents");
+   if (it != jsonDoc.end() && json::isType<std::string>(it->second))
+      return it->second.get_str().size();
+   else
+      return 0;
+}
+
+bool needsCompaction(const LiveDocument& liveDoc)
 {
-   FilePath filePath = source_database::path().complete(id);
-   if (filePath.exists())
+   return liveDoc.journalSize > std::max(kMinCompactJournalSize,
+                                         contentsSize(liveDoc.jsonDoc));
+}
+
+// apply the journal's diffs to the document. entries from other epochs
+// (written before the document was last compacted) are skipped. each entry
+// also records the hash it was based on so we stop at the first entry which
+// doesn't follow on from the document (e.g. one which was only partially
+// written)
+void replayJournal(const std::string& id,
+                   const std::string& epoch,
+                   json::Object* pJsonDoc)
+{
+   FilePath filePath = journalPath(id);
+   if (!filePath.exists())
+      return;
+
+   std::string journal;
+   Error error = readStringFromFile(filePath, &journal);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   json::Object& jsonDoc = *pJsonDoc;
+   std::istringstream istr(journal);
+   std::string line;
+   while (std::getline(istr, line))
    {
-      // read the contents of the file
-      std::string contents ;
-      Error error = readStringFromFile(filePath, &contents,
-                                       options().sourceLineEnding());
-      if (error)
-         return error;
-   
-      // parse the json
       json::Value value;
-      if ( !json::parse(contents, &value) )
+      if (!json::parse(line, &value) || !json::isType<json::Object>(value))
+         break;
+      json::Object entry = value.get_obj();
+
+      json::Object::const_iterator epochIt = entry.find(kJournalEpoch);
+      std::string entryEpoch;
+      if (epochIt != entry.end() && json::isType<std::string>(epochIt->second))
+         entryEpoch = epochIt->second.get_str();
+      if (entryEpoch != epoch)
+         continue;
+
+      std::string base, replacement;
+      int offset, length;
+      error = json::readObject(entry,
+                               "base", &base,
+                               "offset", &offset,
+                               "length", &length,
+                               "replacement", &replacement);
+      if (error)
+         break;
+
+      if (!json::isType<std::string>(jsonDoc["hash"]) ||
+          jsonDoc["hash"].get_str() != base)
+         break;
+
+      std::string contents = jsonDoc["contents"].get_str();
+      if (offset < 0 || length < 0 ||
+          static_cast<std::size_t>(offset + length) > contents.size())
+         break;
+      contents.replace(offset, length, replacement);
+
+      // the remaining fields are the document's updated properties
+      entry.erase(kJournalEpoch);
+      entry.erase("base");
+      entry.erase("offset");
+      entry.erase("length");
+      entry.erase("replacement");
+      for (json::Object::const_iterator it = entry.begin();
+           it != entry.end();
+           ++it)
       {
-         return systemError(boost::system::errc::invalid_argument,
-                            ERROR_LOCATION);
+         jsonDoc[it->first] = it->second;
       }
-      
-      // initialize doc from json
-      json::Object jsonDoc = value.get_obj();
-      return pDoc->readFromJson(&jsonDoc);
+      jsonDoc["contents"] = contents;
    }
-   else
+}
+
+// is contents the result of replacing [offset, offset+length) of
+// previousContents with replacement?
+bool isDiffOf(const std::string& previousContents,
+              std::size_t offset,
+              std::size_t length,
+              const std::string& replacement,
+              const std::string& contents)
+{
+   if (offset + length > previousContents.size())
+      return false;
+
+   std::size_t suffixLength = previousContents.size() - offset - length;
+   if (contents.size() != offset + replacement.size() + suffixLength)
+      return false;
+
+   return contents.compare(0, offset, previousContents, 0, offset) == 0 &&
+          contents.compare(offset, replacement.size(), replacement) == 0 &&
+          contents.compare(offset + replacement.size(),
+                           suffixLength,
+                           previousContents,
+                           offset + length,
+                           suffixLength) == 0;
+}
+
+Error readLiveDocument(const std::string& id, LiveDocument** ppLiveDoc)
+{
+   std::map<std::string,LiveDocument>::iterator it = s_liveDocuments.find(id);
+   if (it != s_liveDocuments.end())
+   {
+      *ppLiveDoc = &(it->second);
+      return Success();
+   }
+
+   FilePath filePath = documentPath(id);
+   if (!filePath.exists())
    {
       return systemError(boost::system::errc::no_such_file_or_directory,
                          ERROR_LOCATION);
    }
+
+   // read the contents of the file
+   std::string contents ;
+   Error error = readStringFromFile(filePath, &contents,
+                                    options().sourceLineEnding());
+   if (error)
+      return error;
+
+   // parse the json
+   json::Value value;
+   if ( !json::parse(contents, &value) || !json::isType<json::Object>(value))
+   {
+      return systemError(boost::system::errc::invalid_argument,
+                         ERROR_LOCATION);
+   }
+
+   // bring it up to date with the journal
+   LiveDocument liveDoc;
+   liveDoc.jsonDoc = value.get_obj();
+   json::Object::iterator epochIt = liveDoc.jsonDoc.find(kJournalEpoch);
+   if (epochIt != liveDoc.jsonDoc.end())
+   {
+      if (json::isType<std::string>(epochIt->second))
+         liveDoc.journalEpoch = epochIt->second.get_str();
+      liveDoc.jsonDoc.erase(epochIt);
+   }
+   replayJournal(id, liveDoc.journalEpoch, &liveDoc.jsonDoc);
+   FilePath journalFilePath = journalPath(id);
+   if (journalFilePath.exists())
+      liveDoc.journalSize = journalFilePath.size();
+
+   LiveDocument& cachedDoc = s_liveDocuments[id];
+   cachedDoc = liveDoc;
+   *ppLiveDoc = &cachedDoc;
+   return Success();
+}
+
+// write the document and start a new journal epoch. if we don't get as
+// far as removing the old journal its entries are ignored from then on
+Error compactDocument(const std::string& id, LiveDocument* pLiveDoc)
+{
+   std::string epoch = core::system::generateUuid(false);
+   json::Object& jsonDoc = pLiveDoc->jsonDoc;
+   jsonDoc[kJournalEpoch] = epoch;
+   Error error = writeDocumentJson(documentPath(id), jsonDoc);
+   jsonDoc.erase(kJournalEpoch);
+   if (error)
+      return error;
+
+   pLiveDoc->journalEpoch = epoch;
+   pLiveDoc->journalSize = 0;
+   return journalPath(id).removeIfExists();
+}
+
+bool compactJournals()
+{
+   for (std::map<std::string,LiveDocument>::iterator
+         it = s_liveDocuments.begin(); it != s_liveDocuments.end(); ++it)
+   {
+      if (needsCompaction(it->second))
+      {
+         Error error = compactDocument(it->first, &(it->second));
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   // keep running
+   return true;
+}
+
+} // anonymous namespace
+
+FilePath path()
+{
+   return s_sourceDBPath;
+}
+   
+Error get(const std::string& id, boost::shared_ptr<SourceDocument> pDoc)
+{
+   LiveDocument* pLiveDoc;
+   Error error = readLiveDocument(id, &pLiveDoc);
+   if (error)
+      return error;
+
+   // initialize doc from json (copy since reading can modify it)
+   json::Object jsonDoc = pLiveDoc->jsonDoc;
+   return pDoc->readFromJson(&jsonDoc);
 }
 
 Error getDurableProperties(const std::string& path, json::Object* pProperties)
@@ -449,6 +714,8 @@ bool isSourceDocument(const FilePath& filePath)
       return false;
    else if (filePath.filename() == "lock_file")
       return false;
+   else if (filePath.extensionLowerCase() == kJournalExtension)
+      return false;
    else
       return true;
 }
@@ -479,11 +746,16 @@ Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs)
    
 Error put(boost::shared_ptr<SourceDocument> pDoc)
 {   
-   // write to file
-   FilePath filePath = source_database::path().complete(pDoc->id());
-   Error error = pDoc->writeToFile(filePath);
+   // write to file (this supersedes any journal)
+   LiveDocument liveDoc;
+   pDoc->writeToJson(&liveDoc.jsonDoc);
+   Error error = compactDocument(pDoc->id(), &liveDoc);
    if (error)
+   {
+      s_liveDocuments.erase(pDoc->id());
       return error ;
+   }
+   s_liveDocuments[pDoc->id()] = liveDoc;
 
    // write properties to durable storage (if there is a path)
    if (!pDoc->path().empty())
@@ -496,13 +768,86 @@ Error put(boost::shared_ptr<SourceDocument> pDoc)
    return Success();
 }
    
+Error putDiff(boost::shared_ptr<SourceDocument> pDoc,
+              std::size_t offset,
+              std::size_t length,
+              const std::string& replacement)
+{
+   // get the document as it currently is in the database
+   LiveDocument* pLiveDoc;
+   Error error = readLiveDocument(pDoc->id(), &pLiveDoc);
+   if (error)
+      return put(pDoc);
+
+   // confirm that the diff takes us from the database's version of the
+   // document to this one (if not then fall back to writing it all)
+   json::Object& currentJson = pLiveDoc->jsonDoc;
+   if (!isDiffOf(currentJson["contents"].get_str(),
+                 offset,
+                 length,
+                 replacement,
+                 pDoc->contents()))
+   {
+      return put(pDoc);
+   }
+
+   // the journal entry is the diff plus the document's other fields
+   json::Object jsonDoc;
+   pDoc->writeToJson(&jsonDoc);
+   json::Object entry;
+   for (json::Object::const_iterator it = jsonDoc.begin();
+        it != jsonDoc.end();
+        ++it)
+   {
+      if (it->first != "contents")
+         entry.insert(*it);
+   }
+   entry[kJournalEpoch] = pLiveDoc->journalEpoch;
+   entry["base"] = currentJson["hash"];
+   entry["offset"] = static_cast<int>(offset);
+   entry["length"] = static_cast<int>(length);
+   entry["replacement"] = replacement;
+
+   std::ostringstream ostr;
+   json::write(entry, ostr);
+   ostr << std::endl;
+   std::string line = ostr.str();
+
+   error = appendToFile(journalPath(pDoc->id()), line);
+   if (error)
+      return put(pDoc);
+
+   bool pathChanged = !(currentJson["path"] == jsonDoc["path"]);
+   pLiveDoc->jsonDoc.swap(jsonDoc);
+   pLiveDoc->journalSize += line.size();
+
+   // write properties to durable storage (if the document has a new path;
+   // diffs don't otherwise change properties)
+   if (pathChanged && !pDoc->path().empty())
+   {
+      error = putProperties(pDoc->path(), pDoc->properties());
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   return Success();
+}
+   
 Error remove(const std::string& id)
 {
-   return source_database::path().complete(id).removeIfExists();
+   s_liveDocuments.erase(id);
+
+   Error error = journalPath(id).removeIfExists();
+   if (error)
+      LOG_ERROR(error);
+
+   return documentPath(id).removeIfExists();
 }
    
 Error removeAll()
 {
+   s_liveDocuments.clear();
+
    std::vector<FilePath> files ;
    Error error = source_database::path().children(&files);
    if (error)
@@ -522,9 +867,16 @@ namespace {
 
 void onShutdown(bool)
 {
+   // (detaching writes out all of the documents so there is no need to
+   // compact their journals first)
    Error error = supervisor::detachFromSourceDatabase();
    if (error)
       LOG_ERROR(error);
+
+   // make sure property changes are on disk
+   error = s_propertiesStore.sync();
+   if (error)
+      LOG_ERROR(error);
 }
 
 } // anonymous namespace
@@ -534,6 +886,10 @@ Error initialize()
    // signup for the shutdown event
    module_context::events().onShutdown.connect(onShutdown);
 
+   // compact journals during idle time
+   module_context::schedulePeriodicWork(boost::posix_time::seconds(5),
+                                        compactJournals);
+
    // provision a source database directory
    return supervisor::attachToSourceDatabase(&s_sourceDBPath);
 }
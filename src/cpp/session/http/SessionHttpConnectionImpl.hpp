@@ -18,6 +18,8 @@
 #include <boost/array.hpp>
 
 #include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/asio/io_service.hpp>
 #include <boost/asio/write.hpp>
 #include <boost/asio/placeholders.hpp>
@@ -54,7 +56,21 @@ public:
 public:
    HttpConnectionImpl(boost::asio::io_service& ioService,
                       const Handler& handler)
-      : socket_(ioService), handler_(handler)
+      : ptrSocket_(new typename ProtocolType::socket(ioService)),
+        handler_(handler),
+        keepAlive_(false),
+        socketReleased_(false)
+   {
+   }
+
+   // construct a connection for the next request on an existing socket
+   HttpConnectionImpl(
+            const boost::shared_ptr<typename ProtocolType::socket>& ptrSocket,
+            const Handler& handler)
+      : ptrSocket_(ptrSocket),
+        handler_(handler),
+        keepAlive_(false),
+        socketReleased_(false)
    {
    }
 
@@ -80,12 +96,29 @@ public:
       // set log entry type depending upon what happens (default to success)
       HttpLog::EntryType logEntryType = HttpLog::ConnectionResponded;
 
+      // we can only keep the connection open if the client can find the
+      // end of the response using its Content-Length
+      bool keepAlive = keepAlive_ && response.containsHeader("Content-Length");
+
       try
       {
          // write the response
-         boost::asio::write(socket_,
-                            response.toBuffers(
-                                  core::http::Header::connectionClose()));
+         core::http::Header connectionHeader = keepAlive ?
+                           core::http::Header("Connection", "keep-alive") :
+                           core::http::Header::connectionClose();
+         boost::asio::write(*ptrSocket_, response.toBuffers(connectionHeader));
+
+#ifndef _WIN32
+         // write the body directly from its file (failures are handled
+         // the same way as failures writing the rest of the response)
+         if (response.streamFile())
+         {
+            core::Error error = response.streamFile()->writeAll(
+                                                   ptrSocket_->native(), 0);
+            if (error)
+               throw boost::system::system_error(error.code());
+         }
+#endif
       }
       catch(const boost::system::system_error& e)
       {
@@ -106,14 +139,17 @@ public:
       }
       CATCH_UNEXPECTED_EXCEPTION
 
-      // always log and close connection
+      // always log and then either close the connection or read the
+      // next request from it
       try
       {
          // log it
          httpLog().addEntry(logEntryType, requestId_);
 
-         // close
-         close();
+         if (keepAlive && logEntryType == HttpLog::ConnectionResponded)
+            readNextRequest();
+         else
+            close();
       }
       CATCH_UNEXPECTED_EXCEPTION
    }
@@ -152,8 +188,12 @@ public:
    // need to be closed in other circumstances
    virtual void close()
    {
+      // the socket now belongs to the connection for the next request
+      if (socketReleased_)
+         return;
+
       // always close connection
-      core::Error error = core::http::closeSocket(socket_);
+      core::Error error = core::http::closeSocket(*ptrSocket_);
       if (error)
          LOG_ERROR(error);
    }
@@ -169,7 +209,7 @@ public:
    }
 
    // get the socket
-   typename ProtocolType::socket& socket() { return socket_; }
+   typename ProtocolType::socket& socket() { return *ptrSocket_; }
 
 
 private:
@@ -183,7 +223,7 @@ private:
       // (unless the handler chooses to retain a copy of it e.g. to perform
       // processing in a background thread)
 
-      socket_.async_read_some(
+      ptrSocket_->async_read_some(
          boost::asio::buffer(buffer_),
          boost::bind(
                &HttpConnectionImpl<ProtocolType>::handleRead,
@@ -200,10 +240,14 @@ private:
          if (!e)
          {
             // parse next chunk
+            const char* begin = buffer_.data();
+            const char* end = begin + bytesTransferred;
+            const char* consumed = begin;
             core::http::RequestParser::status status = requestParser_.parse(
                                         request_,
-                                        buffer_.data(),
-                                        buffer_.data() + bytesTransferred);
+                                        begin,
+                                        end,
+                                        &consumed);
 
             // error - return bad request
             if (status == core::http::RequestParser::error)
@@ -228,6 +272,11 @@ private:
                // establish request id
                requestId_ = rstudioRequestIdFromRequest(request_);
 
+               // determine whether the client wants the connection kept
+               // open (we don't support pipelining so any input after
+               // the request means we close the connection)
+               keepAlive_ = (consumed == end) && requestWantsKeepAlive();
+
                // log it
                httpLog().addEntry(HttpLog::ConnectionReceived, requestId_);
 
@@ -257,13 +306,39 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
 
+   bool requestWantsKeepAlive() const
+   {
+      if (request_.containsHeader("Transfer-Encoding"))
+         return false;
+
+      std::string connection = request_.headerValue("Connection");
+      if (request_.isHttp10())
+         return boost::algorithm::iequals(connection, "keep-alive");
+      else
+         return request_.httpVersionMajor() == 1 &&
+                !boost::algorithm::iequals(connection, "close");
+   }
+
+   void readNextRequest()
+   {
+      // the next request is read by a new connection object which shares
+      // our socket (handlers may still be referencing this connection's
+      // request on other threads)
+      boost::shared_ptr<HttpConnectionImpl<ProtocolType> > ptrNextConnection(
+            new HttpConnectionImpl<ProtocolType>(ptrSocket_, handler_));
+      socketReleased_ = true;
+      ptrNextConnection->startReading();
+   }
+
 private:
-   typename ProtocolType::socket socket_;
+   boost::shared_ptr<typename ProtocolType::socket> ptrSocket_;
    boost::array<char, 8192> buffer_ ;
    core::http::RequestParser requestParser_ ;
    core::http::Request request_;
    std::string requestId_;
    Handler handler_;
+   bool keepAlive_;
+   bool socketReleased_;
 };
 
 } // namespace session
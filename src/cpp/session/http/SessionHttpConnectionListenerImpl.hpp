@@ -36,6 +36,7 @@
 #include <session/SessionHttpConnection.hpp>
 #include <session/SessionHttpConnectionQueue.hpp>
 #include <session/SessionHttpConnectionListener.hpp>
+#include <session/SessionRpcWorkers.hpp>
 
 #include "SessionHttpLog.hpp"
 #include "SessionHttpConnectionImpl.hpp"
@@ -273,6 +274,15 @@ private:
       if (checkForHttpLog(ptrHttpConnection))
          return;
 
+      // or for the rpc worker metrics
+      if (checkForRpcWorkerMetrics(ptrHttpConnection))
+         return;
+
+      // methods which don't use R are executed directly by worker threads
+      // (so they don't have to wait for the main thread)
+      if (rpc_workers::enqueConnection(ptrHttpConnection))
+         return;
+
       // place the connection on the correct queue
       if (isGetEvents(ptrHttpConnection))
          eventsConnectionQueue_.enqueConnection(ptrHttpConnection);
@@ -354,6 +364,26 @@ private:
       }
    }
 
+   static bool checkForRpcWorkerMetrics(
+                        boost::shared_ptr<HttpConnection> ptrConnection)
+   {
+      if (isMethod(ptrConnection, "rpc_worker_metrics"))
+      {
+         core::json::Array metricsJson;
+         rpc_workers::metricsAsJson(&metricsJson);
+         core::json::JsonRpcResponse response;
+         response.setResult(metricsJson);
+         response.setField(kEventsPending, "false");
+         ptrConnection->sendJsonRpcResponse(response);
+
+         return true;
+      }
+      else
+      {
+         return false;
+      }
+   }
+
 private:
 
    // acceptor service (includes io service)
@@ -106,6 +106,17 @@ std::string HttpConnectionQueue::peekNextConnectionUri()
    return std::string();
 }
 
+void HttpConnectionQueue::wakeup()
+{
+   LOCK_MUTEX(*pMutex_)
+   {
+      wakeupRequested_ = true;
+   }
+   END_LOCK_MUTEX
+
+   pWaitCondition_->notify_all();
+}
+
 bool HttpConnectionQueue::waitForConnection(
                      const boost::posix_time::time_duration& waitDuration)
 {
@@ -113,8 +124,13 @@ bool HttpConnectionQueue::waitForConnection(
    try
    {
       unique_lock<mutex> lock(*pMutex_);
-      system_time timeoutTime = get_system_time() + waitDuration;
-      return pWaitCondition_->timed_wait(lock, timeoutTime);
+
+      // don't wait at all if we were woken in between waits
+      bool woken = wakeupRequested_ ||
+                   pWaitCondition_->timed_wait(lock,
+                                               get_system_time() + waitDuration);
+      wakeupRequested_ = false;
+      return woken;
    }
    catch(const thread_resource_error& e)
    {
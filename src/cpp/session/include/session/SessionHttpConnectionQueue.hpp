@@ -35,7 +35,8 @@ class HttpConnectionQueue : boost::noncopyable
 public:
    HttpConnectionQueue()
       : pMutex_(new boost::mutex()),
-        pWaitCondition_(new boost::condition())
+        pWaitCondition_(new boost::condition()),
+        wakeupRequested_(false)
    {
    }
 
@@ -48,6 +49,10 @@ public:
 
    std::string peekNextConnectionUri();
 
+   // end the current (or next) wait for a connection early, e.g. so that
+   // the main thread can service output from a child process right away
+   void wakeup();
+
 private:
    boost::shared_ptr<HttpConnection> doDequeConnection();
    bool waitForConnection(const boost::posix_time::time_duration& waitDuration);
@@ -63,6 +68,7 @@ private:
 
    // instance data
    std::queue<boost::shared_ptr<HttpConnection> > queue_;
+   bool wakeupRequested_;
 };
 
 } // namespace session
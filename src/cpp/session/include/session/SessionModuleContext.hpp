@@ -116,6 +116,13 @@ core::Error registerAsyncRpcMethod(
 core::Error registerRpcMethod(const std::string& name,
                               const core::json::JsonRpcFunction& function);
 
+// register an rpc method which never uses R (or anything else which isn't
+// threadsafe). these are executed on worker threads so they can be
+// serviced while R is busy. note that change detection isn't performed
+// after they are called
+core::Error registerWorkerRpcMethod(const std::string& name,
+                                    const core::json::JsonRpcFunction& function);
+
 
 core::Error executeAsync(const core::json::JsonRpcFunction& function,
                          const core::json::JsonRpcRequest& request,
@@ -0,0 +1,55 @@
+/*
+ * SessionRpcWorkers.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_RPC_WORKERS_HPP
+#define SESSION_RPC_WORKERS_HPP
+
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
+#include <core/json/JsonRpc.hpp>
+
+#include <session/SessionHttpConnection.hpp>
+
+// Executes json-rpc methods which don't use R on worker threads, taking
+// their connections directly from the connection listener. This lets them
+// be serviced while R is busy rather than waiting for the main thread to
+// get to them (which during a computation only happens in between polled
+// event handler slices)
+
+namespace session {
+namespace rpc_workers {
+
+// register a method for execution on a worker thread. the method must not
+// use R or any other state which is owned by the main thread (the method
+// is also registered as a normal rpc method by module_context and is run
+// on the main thread if the workers are saturated)
+void registerMethod(const std::string& name,
+                    const core::json::JsonRpcFunction& function);
+
+// client version which requests must be compatible with
+void initialize(double version);
+
+// called on the connection listener thread. if the connection is for a
+// worker method then queue it for execution and return true
+bool enqueConnection(boost::shared_ptr<HttpConnection> ptrConnection);
+
+// call counts and timings for each method (queue delay is the time from
+// the listener receiving the connection to a worker starting on it)
+void metricsAsJson(core::json::Array* pMetricsArray);
+
+} // namespace rpc_workers
+} // namespace session
+
+#endif // SESSION_RPC_WORKERS_HPP
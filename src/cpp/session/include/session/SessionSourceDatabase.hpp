@@ -127,6 +127,13 @@ core::Error getDurableProperties(const std::string& path,
                                  core::json::Object* pProperties);
 core::Error list(std::vector<boost::shared_ptr<SourceDocument> >* pDocs);
 core::Error put(boost::shared_ptr<SourceDocument> pDoc);
+
+// put a document whose contents differ from the stored version by the
+// replacement of [offset, offset+length) (in bytes) with replacement
+core::Error putDiff(boost::shared_ptr<SourceDocument> pDoc,
+                    std::size_t offset,
+                    std::size_t length,
+                    const std::string& replacement);
 core::Error remove(const std::string& id);
 core::Error removeAll();
 
@@ -16,21 +16,27 @@
 #include <iostream>
 #include <vector>
 #include <set>
+#include <map>
 
 #include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/foreach.hpp>
 #include <boost/format.hpp>
 #include <boost/regex.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
 #include <core/FilePath.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
 
 #include <core/r_util/RSourceIndex.hpp>
+#include <core/r_util/RSourceNameIndex.hpp>
 
 #include <core/system/FileChangeEvent.hpp>
 #include <core/system/FileMonitor.hpp>
@@ -39,6 +45,7 @@
 
 #include <r/RExec.hpp>
 
+#include <session/SessionOptions.hpp>
 #include <session/SessionUserSettings.hpp>
 #include <session/SessionModuleContext.hpp>
 
@@ -93,11 +100,156 @@ bool enforceMaxResults(std::size_t maxResults,
 }
 
 
+// The project source index is persisted to the project scratch path as a
+// flat binary file (native byte order, length-prefixed strings) which is
+// read back via a memory mapping. Each entry records the size and last
+// write time of the file it was indexed from so that when the file
+// monitor delivers the initial tree we only need to re-index the files
+// which have changed since the snapshot was written.
+const char * const kSnapshotMagic = "RSIX";
+const boost::uint32_t kSnapshotVersion = 1;
+
+class SnapshotWriter
+{
+public:
+   explicit SnapshotWriter(std::ostream& os)
+      : os_(os)
+   {
+   }
+
+   template <typename T>
+   void write(T value)
+   {
+      os_.write(reinterpret_cast<const char*>(&value), sizeof(T));
+   }
+
+   void writeString(const std::string& value)
+   {
+      write(static_cast<boost::uint32_t>(value.size()));
+      os_.write(value.data(), value.size());
+   }
+
+private:
+   std::ostream& os_;
+};
+
+class SnapshotReader
+{
+public:
+   SnapshotReader(const char* begin, const char* end)
+      : pos_(begin), end_(end)
+   {
+   }
+
+   template <typename T>
+   bool read(T* pValue)
+   {
+      if (static_cast<std::size_t>(end_ - pos_) < sizeof(T))
+         return false;
+      ::memcpy(pValue, pos_, sizeof(T));
+      pos_ += sizeof(T);
+      return true;
+   }
+
+   bool readString(std::string* pValue)
+   {
+      boost::uint32_t length;
+      if (!read(&length) || static_cast<std::size_t>(end_ - pos_) < length)
+         return false;
+      pValue->assign(pos_, length);
+      pos_ += length;
+      return true;
+   }
+
+private:
+   const char* pos_;
+   const char* end_;
+};
+
+Error corruptSnapshotError(const FilePath& snapshotPath)
+{
+   Error error = systemError(boost::system::errc::illegal_byte_sequence,
+                             ERROR_LOCATION);
+   error.addProperty("snapshot", snapshotPath);
+   return error;
+}
+
+// request to index a file on the indexing thread pool
+struct IndexRequest
+{
+   FileInfo fileInfo;
+   std::string context;
+   std::string encoding;
+   boost::uint64_t sequence;
+};
+
+// result of indexing a file (delivered back to the main thread)
+struct IndexResult
+{
+   FileInfo fileInfo;
+   boost::uint64_t sequence;
+   boost::shared_ptr<r_util::RSourceIndex> pIndex;
+   Error error;
+};
+
+// equivalent of module_context::readAndDecodeFile which is safe to call
+// off the main thread (it uses core iconv rather than R's)
+Error readAndDecodeFile(const FilePath& filePath,
+                        const std::string& encoding,
+                        std::string* pContents)
+{
+   std::string encodedContents;
+   Error error = readStringFromFile(filePath,
+                                    &encodedContents,
+                                    session::options().sourceLineEnding());
+   if (error)
+      return error;
+
+   error = string_utils::iconvstr(encodedContents,
+                                  encoding,
+                                  "UTF-8",
+                                  true,
+                                  pContents);
+   if (error)
+      return error;
+
+   stripBOM(pContents);
+
+   return string_utils::utf8Clean(pContents->begin(), pContents->end(), '?');
+}
+
+// read, decode, and index a file. runs on the indexing thread pool so
+// must not call into R.
+void indexFile(const IndexRequest& request,
+               core::thread::ThreadsafeQueue<IndexResult>* pResults)
+{
+   IndexResult result;
+   result.fileInfo = request.fileInfo;
+   result.sequence = request.sequence;
+
+   FilePath filePath(request.fileInfo.absolutePath());
+   std::string code;
+   result.error = readAndDecodeFile(filePath, request.encoding, &code);
+   if (result.error)
+      result.error.addProperty("src-file", filePath.absolutePath());
+   else
+      result.pIndex.reset(new r_util::RSourceIndex(request.context, code));
+
+   pResults->enque(result);
+}
+
+// limit on files queued for or being indexed by the thread pool (keeps
+// memory bounded when very large numbers of files are enqued at once)
+const std::size_t kMaxPendingIndexRequests = 64;
+
 class SourceFileIndex : boost::noncopyable
 {
 public:
    SourceFileIndex()
-      : indexing_(false)
+      : indexing_(false),
+        nextSequence_(0),
+        indexingPool_(0, kMaxPendingIndexRequests),
+        indexResults_(true)
    {
    }
 
@@ -116,24 +268,23 @@ public:
       {
          if (isRSourceFile(*begin))
          {
+            // files which are unchanged since the snapshot was written
+            // don't need to be re-indexed
+            if (restoreFromSnapshot(*begin))
+               continue;
+
             FileChangeEvent addEvent(FileChangeEvent::FileAdded, *begin);
             indexingQueue_.push(addEvent);
          }
       }
 
-      // schedule indexing if necessary. perform up to 200ms of work
-      // immediately and then continue in periodic 20ms chunks until
-      // we are completed.
-      if (!indexingQueue_.empty() && !indexing_)
-      {
-         indexing_ = true;
+      // snapshot entries not found in the tree are for files which
+      // were removed while we weren't running
+      snapshot_.clear();
 
-         module_context::scheduleIncrementalWork(
-                           boost::posix_time::milliseconds(200),
-                           boost::posix_time::milliseconds(20),
-                           boost::bind(&SourceFileIndex::dequeAndIndex, this),
-                           false /* allow indexing even when non-idle */);
-      }
+      // schedule indexing if necessary
+      if (!indexingQueue_.empty())
+         scheduleIndexing();
    }
 
    void enqueFileChange(const core::system::FileChangeEvent& event)
@@ -145,19 +296,8 @@ public:
       // add to the queue
       indexingQueue_.push(event);
 
-      // schedule indexing if necessary. don't index anything immediately
-      // (this is to defend against large numbers of files being enqued
-      // at once and typing up the main thread). rather, schedule indexing
-      // to occur during idle time in 20ms chunks
-      if (!indexing_)
-      {
-         indexing_ = true;
-
-         module_context::scheduleIncrementalWork(
-                           boost::posix_time::milliseconds(20),
-                           boost::bind(&SourceFileIndex::dequeAndIndex, this),
-                           false /* allow indexing even when non-idle */);
-      }
+      // schedule indexing if necessary
+      scheduleIndexing();
    }
 
    bool findGlobalFunction(const std::string& functionName,
@@ -198,28 +338,8 @@ public:
                      const std::set<std::string>& excludeContexts,
                      std::vector<r_util::RSourceItem>* pItems)
    {
-      BOOST_FOREACH(const Entry& entry, entries_)
-      {
-         // bail if this is an exluded context
-         if (excludeContexts.find(entry.pIndex->context()) !=
-             excludeContexts.end())
-         {
-            continue;
-         }
-
-         // scan the next index
-         entry.pIndex->search(term,
-                              prefixOnly,
-                              false,
-                              std::back_inserter(*pItems));
-
-         // return if we are past maxResults
-         if (pItems->size() >= maxResults)
-         {
-            pItems->resize(maxResults);
-            return;
-         }
-      }
+      // use the global name index rather than scanning every entry
+      nameIndex_.search(term, prefixOnly, excludeContexts, maxResults, pItems);
    }
 
    void searchFiles(const std::string& term,
@@ -275,9 +395,186 @@ public:
 
    void clear()
    {
+      // in flight results will be discarded when they arrive since they
+      // will no longer have an entry in requestSequences_
       indexing_ = false;
       indexingQueue_ = std::queue<core::system::FileChangeEvent>();
+      requestSequences_.clear();
+      IndexResult result;
+      while (indexResults_.deque(&result))
+      {
+      }
       entries_.clear();
+      nameIndex_.clear();
+      snapshot_.clear();
+   }
+
+   void stopIndexing()
+   {
+      indexingPool_.stop();
+   }
+
+   Error readSnapshot(const FilePath& snapshotPath)
+   {
+      snapshot_.clear();
+
+      if (!snapshotPath.exists())
+         return Success();
+
+      try
+      {
+         boost::iostreams::mapped_file_source file(
+                                    snapshotPath.absolutePathNative());
+         SnapshotReader reader(file.data(), file.data() + file.size());
+
+         // verify header
+         char magic[4];
+         boost::uint32_t version, count;
+         if (!reader.read(&magic) ||
+             ::memcmp(magic, kSnapshotMagic, sizeof(magic)) != 0 ||
+             !reader.read(&version) ||
+             !reader.read(&count))
+         {
+            return corruptSnapshotError(snapshotPath);
+         }
+
+         // silently ignore snapshots written by other versions
+         if (version != kSnapshotVersion)
+            return Success();
+
+         for (boost::uint32_t i = 0; i<count; i++)
+         {
+            std::string path;
+            boost::uint64_t size;
+            boost::int64_t lastWriteTime;
+            boost::uint32_t itemCount;
+            if (!reader.readString(&path) ||
+                !reader.read(&size) ||
+                !reader.read(&lastWriteTime) ||
+                !reader.read(&itemCount))
+            {
+               snapshot_.clear();
+               return corruptSnapshotError(snapshotPath);
+            }
+
+            std::vector<r_util::RSourceItem> items;
+            items.reserve(itemCount);
+            for (boost::uint32_t j = 0; j<itemCount; j++)
+            {
+               boost::int32_t type, braceLevel, line, column;
+               std::string name;
+               boost::uint32_t paramCount;
+               if (!reader.read(&type) ||
+                   !reader.readString(&name) ||
+                   !reader.read(&braceLevel) ||
+                   !reader.read(&line) ||
+                   !reader.read(&column) ||
+                   !reader.read(&paramCount))
+               {
+                  snapshot_.clear();
+                  return corruptSnapshotError(snapshotPath);
+               }
+
+               std::vector<r_util::RS4MethodParam> signature;
+               for (boost::uint32_t k = 0; k<paramCount; k++)
+               {
+                  std::string paramName, paramType;
+                  if (!reader.readString(&paramName) ||
+                      !reader.readString(&paramType))
+                  {
+                     snapshot_.clear();
+                     return corruptSnapshotError(snapshotPath);
+                  }
+                  signature.push_back(r_util::RS4MethodParam(paramName,
+                                                             paramType));
+               }
+
+               items.push_back(r_util::RSourceItem(type,
+                                                   name,
+                                                   signature,
+                                                   braceLevel,
+                                                   line,
+                                                   column));
+            }
+
+            // the context is computed at restore time (rather than
+            // persisted) since the aliased path depends on the home dir
+            FileInfo fileInfo(path,
+                              false,
+                              size,
+                              static_cast<std::time_t>(lastWriteTime));
+            boost::shared_ptr<r_util::RSourceIndex> pIndex(
+                     new r_util::RSourceIndex(std::string(), items));
+            snapshot_.insert(std::make_pair(path, Entry(fileInfo, pIndex)));
+         }
+      }
+      catch(const std::exception& e)
+      {
+         snapshot_.clear();
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("what", e.what());
+         error.addProperty("snapshot", snapshotPath);
+         return error;
+      }
+
+      return Success();
+   }
+
+   Error writeSnapshot(const FilePath& snapshotPath) const
+   {
+      // write to a temporary file then move it into place so that a crash
+      // mid-write never leaves a truncated snapshot behind
+      FilePath tempPath(snapshotPath.absolutePath() + ".tmp");
+      {
+         boost::shared_ptr<std::ostream> pStream;
+         Error error = tempPath.open_w(&pStream);
+         if (error)
+            return error;
+
+         SnapshotWriter writer(*pStream);
+         pStream->write(kSnapshotMagic, 4);
+         writer.write(kSnapshotVersion);
+         writer.write(static_cast<boost::uint32_t>(entries_.size()));
+         BOOST_FOREACH(const Entry& entry, entries_)
+         {
+            writer.writeString(entry.fileInfo.absolutePath());
+            writer.write(static_cast<boost::uint64_t>(entry.fileInfo.size()));
+            writer.write(static_cast<boost::int64_t>(
+                                       entry.fileInfo.lastWriteTime()));
+
+            const std::vector<r_util::RSourceItem>& items =
+                                                   entry.pIndex->items();
+            writer.write(static_cast<boost::uint32_t>(items.size()));
+            BOOST_FOREACH(const r_util::RSourceItem& item, items)
+            {
+               writer.write(static_cast<boost::int32_t>(item.type()));
+               writer.writeString(item.name());
+               writer.write(static_cast<boost::int32_t>(item.braceLevel()));
+               writer.write(static_cast<boost::int32_t>(item.line()));
+               writer.write(static_cast<boost::int32_t>(item.column()));
+               writer.write(static_cast<boost::uint32_t>(
+                                                item.signature().size()));
+               BOOST_FOREACH(const r_util::RS4MethodParam& param,
+                             item.signature())
+               {
+                  writer.writeString(param.name());
+                  writer.writeString(param.type());
+               }
+            }
+         }
+
+         pStream->flush();
+         if (pStream->fail())
+         {
+            Error error = systemError(boost::system::errc::io_error,
+                                      ERROR_LOCATION);
+            error.addProperty("snapshot", tempPath);
+            return error;
+         }
+      }
+
+      return tempPath.move(snapshotPath);
    }
 
 private:
@@ -303,29 +600,60 @@ private:
 
 private:
 
-   bool dequeAndIndex()
+   void scheduleIndexing()
+   {
+      // reading, decoding, and tokenizing happen on the indexing thread
+      // pool -- the main thread only dispatches requests and swaps the
+      // completed indexes into place. start dispatching immediately and
+      // then check for results every 20ms until we are completed
+      if (!indexing_)
+      {
+         indexing_ = true;
+
+         dispatchAndApply();
+
+         module_context::schedulePeriodicWork(
+                           boost::posix_time::milliseconds(20),
+                           boost::bind(&SourceFileIndex::dispatchAndApply, this),
+                           false /* allow indexing even when non-idle */);
+      }
+   }
+
+   bool dispatchAndApply()
    {
       using namespace core::system;
 
-      if (!indexingQueue_.empty())
-      {
-         // remove the event from the queue
-         FileChangeEvent event = indexingQueue_.front();
-         indexingQueue_.pop();
+      // bail if we were cleared
+      if (!indexing_)
+         return false;
+
+      // apply completed results
+      IndexResult result;
+      while (indexResults_.deque(&result))
+         applyIndexResult(result);
 
-         // process the change
+      // dispatch queued events until the thread pool is at capacity
+      while (!indexingQueue_.empty())
+      {
+         const FileChangeEvent& event = indexingQueue_.front();
          const FileInfo& fileInfo = event.fileInfo();
          switch(event.type())
          {
             case FileChangeEvent::FileAdded:
             case FileChangeEvent::FileModified:
             {
-               updateIndexEntry(fileInfo);
+               if (!dispatchIndexRequest(fileInfo))
+               {
+                  indexing_ = true;
+                  return indexing_;
+               }
                break;
             }
 
             case FileChangeEvent::FileRemoved:
             {
+               // supersede any index request which is in flight
+               requestSequences_.erase(fileInfo.absolutePath());
                removeIndexEntry(fileInfo);
                break;
             }
@@ -333,34 +661,56 @@ private:
             case FileChangeEvent::None:
                break;
          }
+
+         indexingQueue_.pop();
       }
 
       // return status
-      indexing_ = !indexingQueue_.empty();
+      indexing_ = !requestSequences_.empty();
       return indexing_;
    }
 
-   void updateIndexEntry(const FileInfo& fileInfo)
+   bool dispatchIndexRequest(const FileInfo& fileInfo)
    {
-      // read the file
-      FilePath filePath(fileInfo.absolutePath());
-      std::string code;
-      Error error = module_context::readAndDecodeFile(
-                              filePath,
-                              projects::projectContext().defaultEncoding(),
-                              true,
-                              &code);
-      if (error)
+      IndexRequest request;
+      request.fileInfo = fileInfo;
+      request.context = module_context::createAliasedPath(fileInfo);
+      request.encoding = projects::projectContext().defaultEncoding();
+      request.sequence = ++nextSequence_;
+
+      if (!indexingPool_.enque(boost::bind(indexFile,
+                                           request,
+                                           &indexResults_)))
       {
-         error.addProperty("src-file", filePath.absolutePath());
-         LOG_ERROR(error);
-         return;
+         return false;
       }
 
-      // index the source
-      std::string context = module_context::createAliasedPath(filePath);
-      boost::shared_ptr<r_util::RSourceIndex> pIndex(
-                new r_util::RSourceIndex(context, code));
+      // record the latest request for this path (supersedes any earlier
+      // request which is still in flight)
+      requestSequences_[fileInfo.absolutePath()] = request.sequence;
+      return true;
+   }
+
+   void applyIndexResult(const IndexResult& result)
+   {
+      // discard results which have been superseded
+      std::map<std::string,boost::uint64_t>::iterator it =
+                  requestSequences_.find(result.fileInfo.absolutePath());
+      if (it == requestSequences_.end() || it->second != result.sequence)
+         return;
+      requestSequences_.erase(it);
+
+      if (result.error)
+         LOG_ERROR(result.error);
+      else
+         updateIndexEntry(result.fileInfo, result.pIndex);
+   }
+
+   void updateIndexEntry(const FileInfo& fileInfo,
+                         boost::shared_ptr<r_util::RSourceIndex> pIndex)
+   {
+      // update the name index
+      nameIndex_.add(pIndex);
 
       // attempt to add the entry
       Entry entry(fileInfo, pIndex);
@@ -389,6 +739,35 @@ private:
       }
    }
 
+   bool restoreFromSnapshot(const FileInfo& fileInfo)
+   {
+      std::map<std::string,Entry>::iterator it =
+                                 snapshot_.find(fileInfo.absolutePath());
+      if (it == snapshot_.end())
+         return false;
+
+      // only use the snapshot if the file is unchanged
+      const FileInfo& snapshotInfo = it->second.fileInfo;
+      if (snapshotInfo.size() != fileInfo.size() ||
+          snapshotInfo.lastWriteTime() != fileInfo.lastWriteTime())
+      {
+         snapshot_.erase(it);
+         return false;
+      }
+
+      // rebuild the index with the correct context
+      FilePath filePath(fileInfo.absolutePath());
+      std::string context = module_context::createAliasedPath(filePath);
+      boost::shared_ptr<r_util::RSourceIndex> pIndex(
+             new r_util::RSourceIndex(context, it->second.pIndex->items()));
+      snapshot_.erase(it);
+
+      // leaves are delivered in path order so hint at the end
+      nameIndex_.add(pIndex);
+      entries_.insert(entries_.end(), Entry(fileInfo, pIndex));
+      return true;
+   }
+
    void removeIndexEntry(const FileInfo& fileInfo)
    {
       // create a fake entry with a null source index to pass to find
@@ -397,7 +776,10 @@ private:
       // do the find (will use Entry::operator< for equivilance test)
       std::set<Entry>::iterator it = entries_.find(entry);
       if (it != entries_.end())
+      {
+         nameIndex_.remove(it->pIndex->context());
          entries_.erase(it);
+      }
    }
 
    static bool isRSourceFile(const FileInfo& fileInfo)
@@ -411,9 +793,23 @@ private:
    // index entries
    std::set<Entry> entries_;
 
+   // global name index over all entries (used for searchSource)
+   r_util::RSourceNameIndex nameIndex_;
+
    // indexing queue
    bool indexing_;
    std::queue<core::system::FileChangeEvent> indexingQueue_;
+
+   // indexing thread pool, its results, and the sequence number of the
+   // latest request dispatched for each path which is in flight
+   boost::uint64_t nextSequence_;
+   core::thread::ThreadPool indexingPool_;
+   core::thread::ThreadsafeQueue<IndexResult> indexResults_;
+   std::map<std::string,boost::uint64_t> requestSequences_;
+
+   // entries restored from the on-disk snapshot (keyed by path) which
+   // are waiting to be validated against the initial file monitor tree
+   std::map<std::string,Entry> snapshot_;
 };
 
 // global source file index
@@ -1334,6 +1730,27 @@ Error findFunctionInSearchPath(const json::JsonRpcRequest& request,
    return Success();
 }
 
+FilePath projectIndexSnapshotPath()
+{
+   return projects::projectContext().scratchPath().childPath("source_index");
+}
+
+void onShutdown(bool terminatedNormally)
+{
+   // stop indexing threads
+   s_projectIndex.stopIndexing();
+
+   // persist the project index so the next session can skip re-indexing
+   // files which haven't changed
+   if (projects::projectContext().hasProject() &&
+       projects::projectContext().hasFileMonitor())
+   {
+      Error error = s_projectIndex.writeSnapshot(projectIndexSnapshotPath());
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
 void onFileMonitorEnabled(const tree<core::FileInfo>& files)
 {
    s_projectIndex.enqueFiles(files.begin_leaf(), files.end_leaf());
@@ -1367,6 +1784,16 @@ Error initialize()
    projects::projectContext().subscribeToFileMonitor("R source file indexing",
                                                      cb);
 
+   // read the persisted project index (entries are validated against the
+   // file monitor's initial tree within onFileMonitorEnabled)
+   if (projects::projectContext().hasProject())
+   {
+      Error error = s_projectIndex.readSnapshot(projectIndexSnapshotPath());
+      if (error)
+         LOG_ERROR(error);
+   }
+   module_context::events().onShutdown.connect(onShutdown);
+
    using boost::bind;
    using namespace module_context;
    ExecBlock initBlock ;
@@ -654,7 +654,16 @@ void setAttachmentResponse(const http::Request& request,
                         "attachment; filename*=UTF-8''"
                         + http::util::urlEncode(filename, false));
    pResponse->setHeader("Content-Type", "application/octet-stream");
-   pResponse->setBody(attachmentPath);
+
+   // stream the file rather than reading it into memory (exports can be
+   // large archives)
+   Error error = pResponse->setStreamFile(attachmentPath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      pResponse->setError(http::status::InternalServerError,
+                          error.code().message());
+   }
 }
    
 void handleMultipleFileExportRequest(const http::Request& request, 
@@ -830,7 +839,7 @@ Error initialize()
    using boost::bind;
    ExecBlock initBlock ;
    initBlock.addFunctions()
-      (bind(registerRpcMethod, "stat", stat))
+      (bind(registerWorkerRpcMethod, "stat", stat))
       (bind(registerRpcMethod, "list_files", listFiles))
       (bind(registerRpcMethod, "create_folder", createFolder))
       (bind(registerRpcMethod, "delete_files", deleteFiles))
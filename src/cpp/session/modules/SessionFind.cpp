@@ -13,15 +13,31 @@
 
 #include "SessionFind.hpp"
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <string.h>
+
+#include <set>
+#include <map>
+#include <deque>
+#include <algorithm>
+
 #include <boost/algorithm/string.hpp>
 #include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/regex.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 
 #include <core/Exec.hpp>
+#include <core/FileInfo.hpp>
 #include <core/StringUtils.hpp>
-#include <core/system/Environment.hpp>
-#include <core/system/Process.hpp>
-#include <core/system/ShellUtils.hpp>
+#include <core/RegexUtils.hpp>
+#include <core/Thread.hpp>
+#include <core/system/System.hpp>
+#include <core/system/FileScanner.hpp>
+#include <core/system/FileChangeEvent.hpp>
 
 #include <session/SessionModuleContext.hpp>
 #include <session/projects/SessionProjects.hpp>
@@ -29,92 +45,608 @@
 using namespace core;
 
 namespace session {
-namespace modules {   
+namespace modules {
 namespace find {
 
 namespace {
 
-   class GrepOperation : public boost::enable_shared_from_this<GrepOperation>
+// default limit on the number of matches returned by a find (can be
+// overridden by passing maxResults to begin_find)
+const int kDefaultMaxResults = 1000;
+
+// interval at which matches are delivered to the client
+const int kDeliverResultsIntervalMs = 50;
+
+// pool used for all find operations
+core::thread::ThreadPool s_findPool(0, 256);
+
+// files known to the project file monitor (we use these rather than
+// walking the directory when searching within the project)
+std::set<std::string> s_monitoredFiles;
+
+// ascii case folding (sufficient for the literal prefilter since any
+// match of the full pattern must also contain the folded literal)
+void foldCase(const char* begin, const char* end, char* pDest)
+{
+   for ( ; begin != end; ++begin, ++pDest)
+   {
+      char c = *begin;
+      *pDest = (c >= 'A' && c <= 'Z') ? (c + ('a' - 'A')) : c;
+   }
+}
+
+// locate a literal within a buffer (memchr for the first byte is
+// vectorized by the c library so this is a fast prefilter)
+const char* findLiteral(const char* begin,
+                        const char* end,
+                        const std::string& literal)
+{
+   std::size_t length = literal.length();
+   const char first = literal[0];
+   while (static_cast<std::size_t>(end - begin) >= length)
+   {
+      const char* pos = static_cast<const char*>(
+                             ::memchr(begin, first, (end - begin) - length + 1));
+      if (pos == NULL)
+         return end;
+
+      if (::memcmp(pos, literal.data(), length) == 0)
+         return pos;
+
+      begin = pos + 1;
+   }
+   return end;
+}
+
+// is the character at pos quantified (by *, \+, \? or \{)
+bool isQuantified(const std::string& pattern, std::size_t pos)
+{
+   std::size_t next = pos + 1;
+   if (next >= pattern.length())
+      return false;
+   else if (pattern[next] == '*')
+      return true;
+   else
+      return pattern[next] == '\\' && next + 1 < pattern.length() &&
+             boost::algorithm::is_any_of("+?{")(pattern[next + 1]);
+}
+
+// determine the longest literal which any match of the regex must contain
+// (returns an empty string if there is none we can reliably determine).
+// patterns use grep's basic syntax (along with the GNU \+, \? and \|
+// extensions) so e.g. "(" is a literal and "\(" starts a group
+std::string requiredLiteral(const std::string& pattern)
+{
+   // alternation means no single literal is required (grep also treats
+   // each line of the pattern as an alternative)
+   if (pattern.find("\\|") != std::string::npos ||
+       pattern.find('\n') != std::string::npos)
+   {
+      return std::string();
+   }
+
+   std::string best, run;
+   int depth = 0;
+   for (std::size_t i = 0; i < pattern.length(); i++)
    {
-   public:
-      static boost::shared_ptr<GrepOperation> create(const FilePath& tempFile)
+      char c = pattern[i];
+      bool escaped = false;
+      if (c == '\\' && i + 1 < pattern.length())
       {
-         return boost::shared_ptr<GrepOperation>(new GrepOperation(tempFile));
+         c = pattern[++i];
+         escaped = true;
       }
 
-   private:
-      GrepOperation(const FilePath& tempFile)
-         : stopped_(false), tempFile_(tempFile)
+      if ((!escaped && c == '*') ||
+          (escaped && (c == '+' || c == '?' || c == '{')))
       {
-         handle_ = core::system::generateUuid(false);
+         // the previous character is quantified so can't be required
+         if (!run.empty())
+            run.erase(run.length() - 1);
+         if (depth == 0 && run.length() > best.length())
+            best = run;
+         run.clear();
+         if (c == '{')
+         {
+            std::size_t close = pattern.find("\\}", i);
+            i = (close == std::string::npos) ? pattern.length() : close + 1;
+         }
+      }
+      else if (escaped)
+      {
+         // groups, backreferences, word boundaries and escaped literals
+         // all end the run
+         if (c == '(')
+            depth++;
+         else if (c == ')')
+            depth--;
+         run.clear();
+      }
+      else if (c == '[')
+      {
+         // skip the bracket expression (within which backslash is a
+         // literal rather than an escape)
+         run.clear();
+         std::size_t j = i + 1;
+         if (j < pattern.length() && pattern[j] == '^')
+            j++;
+         if (j < pattern.length() && pattern[j] == ']')
+            j++;
+         while (j < pattern.length() && pattern[j] != ']')
+            j++;
+         i = j;
       }
+      else if (c == '.' || c == '^' || c == '$')
+      {
+         run.clear();
+      }
+      else if (depth == 0)
+      {
+         // literals within groups may be optional so only consider
+         // literals which are at the top level (note that unescaped
+         // parens, braces, +, ? and | are all literals)
+         run.push_back(c);
+         if (run.length() > best.length() && !isQuantified(pattern, i))
+            best = run;
+      }
+   }
+
+   return best;
+}
 
-   public:
-      std::string handle() const
+struct FindMatch
+{
+   FindMatch(const std::string& file, int line, const std::string& lineValue)
+      : file(file), line(line), lineValue(lineValue)
+   {
+   }
+
+   std::string file;
+   int line;
+   std::string lineValue;
+};
+
+class FindPattern
+{
+public:
+   FindPattern(const std::string& searchString, bool asRegex, bool ignoreCase)
+      : asRegex_(asRegex), ignoreCase_(ignoreCase)
+   {
+      // regexes have the same (basic) syntax as they did when we used
+      // grep to search, including the GNU extensions
+      boost::regex::flag_type flags = asRegex_ ? boost::regex::grep |
+                                                 boost::regex::bk_plus_qm |
+                                                 boost::regex::bk_vbar
+                                               : boost::regex::literal;
+      if (ignoreCase_)
+         flags |= boost::regex::icase;
+
+      if (asRegex_)
       {
-         return handle_;
+         regex_ = boost::regex(searchString, flags);
+         literal_ = requiredLiteral(searchString);
+      }
+      else
+      {
+         literal_ = searchString;
       }
 
-      core::system::ProcessCallbacks createProcessCallbacks()
+      // we only fold ascii for the prefilter so for case insensitive
+      // searches on other characters we need to rely on the regex
+      if (ignoreCase_ && !isAscii(literal_))
       {
-         core::system::ProcessCallbacks callbacks;
-         callbacks.onContinue = boost::bind(&GrepOperation::onContinue,
-                                            shared_from_this(),
-                                            _1);
-         callbacks.onStdout = boost::bind(&GrepOperation::onStdout,
-                                          shared_from_this(),
-                                          _1, _2);
-         callbacks.onStderr = boost::bind(&GrepOperation::onStderr,
-                                          shared_from_this(),
-                                          _1, _2);
-         callbacks.onExit = boost::bind(&GrepOperation::onExit,
-                                        shared_from_this(),
-                                        _1);
-         return callbacks;
+         if (!asRegex_)
+         {
+            regex_ = boost::regex(searchString, flags);
+            asRegex_ = true;
+         }
+         literal_.clear();
       }
 
-      void stop()
+      if (ignoreCase_ && !literal_.empty())
+         foldCase(literal_.data(),
+                  literal_.data() + literal_.length(),
+                  &literal_[0]);
+   }
+
+   // COPYING: via compiler (regex is safe for concurrent matching)
+
+   bool empty() const
+   {
+      return literal_.empty() && regex_.empty();
+   }
+
+   // search the buffer line by line, calling onMatch for each matching
+   // line (onMatch returns false to stop the search)
+   void search(const char* begin,
+               const char* end,
+               const boost::function<bool(int, const char*, const char*)>&
+                                                               onMatch) const
+   {
+      if (empty())
+         return;
+
+      // no literal means we need to test each line against the regex
+      if (literal_.empty())
+      {
+         int lineNumber = 1;
+         const char* lineStart = begin;
+         while (lineStart < end)
+         {
+            const char* lineEnd = std::find(lineStart, end, '\n');
+            if (boost::regex_search(lineStart, lineEnd, regex_))
+            {
+               if (!onMatch(lineNumber, lineStart, lineEnd))
+                  return;
+            }
+            lineStart = lineEnd + 1;
+            lineNumber++;
+         }
+         return;
+      }
+
+      // search a case folded copy of the buffer if necessary
+      std::string folded;
+      const char* text = begin;
+      if (ignoreCase_)
+      {
+         folded.resize(end - begin);
+         foldCase(begin, end, &folded[0]);
+         text = folded.data();
+      }
+      const char* textEnd = text + (end - begin);
+
+      // use the literal to find candidate lines
+      int lineNumber = 1;
+      const char* counted = text;
+      const char* pos = text;
+      while (pos < textEnd)
+      {
+         const char* hit = findLiteral(pos, textEnd, literal_);
+         if (hit == textEnd)
+            return;
+
+         // find the bounds of the line containing the hit
+         const char* lineStart = hit;
+         while (lineStart > pos && *(lineStart - 1) != '\n')
+            lineStart--;
+         const char* lineEnd = std::find(hit, textEnd, '\n');
+
+         // update the line number
+         lineNumber += std::count(counted, lineStart, '\n');
+         counted = lineStart;
+
+         // check for a match (against the original text)
+         const char* origStart = begin + (lineStart - text);
+         const char* origEnd = begin + (lineEnd - text);
+         if (!asRegex_ || boost::regex_search(origStart, origEnd, regex_))
+         {
+            if (!onMatch(lineNumber, origStart, origEnd))
+               return;
+         }
+
+         pos = lineEnd + 1;
+      }
+   }
+
+private:
+   static bool isAscii(const std::string& str)
+   {
+      for (std::string::const_iterator it = str.begin(); it != str.end(); ++it)
+      {
+         if (static_cast<unsigned char>(*it) > 0x7F)
+            return false;
+      }
+      return true;
+   }
+
+private:
+   bool asRegex_;
+   bool ignoreCase_;
+   boost::regex regex_;
+   std::string literal_;
+};
+
+class FindOperation : public boost::enable_shared_from_this<FindOperation>
+{
+public:
+   static boost::shared_ptr<FindOperation> create(const FilePath& directory,
+                                                  const FindPattern& pattern,
+                                                  const std::string& filePattern,
+                                                  std::size_t maxResults)
+   {
+      return boost::shared_ptr<FindOperation>(
+            new FindOperation(directory, pattern, filePattern, maxResults));
+   }
+
+private:
+   FindOperation(const FilePath& directory,
+                 const FindPattern& pattern,
+                 const std::string& filePattern,
+                 std::size_t maxResults)
+      : directory_(directory),
+        pattern_(pattern),
+        maxResults_(maxResults),
+        stopped_(false),
+        activeTasks_(0),
+        resultCount_(0)
+   {
+      handle_ = core::system::generateUuid(false);
+      if (!filePattern.empty())
+         filePattern_ = regex_utils::wildcardPatternToRegex(filePattern);
+   }
+
+public:
+   std::string handle() const
+   {
+      return handle_;
+   }
+
+   // start the find. if the list of files to search is already known
+   // it is passed in, otherwise the directory is scanned
+   Error start(const std::vector<std::string>* pKnownFiles)
+   {
+      if (pKnownFiles != NULL)
+      {
+         std::for_each(pKnownFiles->begin(),
+                       pKnownFiles->end(),
+                       boost::bind(&FindOperation::addFile, this, _1));
+         if (enqueSearchTasks() == 0)
+         {
+            return systemError(boost::system::errc::resource_unavailable_try_again,
+                               ERROR_LOCATION);
+         }
+      }
+      else
+      {
+         activeTasks_++;
+         if (!s_findPool.enque(boost::bind(&FindOperation::scanDirectory,
+                                           shared_from_this())))
+         {
+            activeTasks_--;
+            return systemError(boost::system::errc::resource_unavailable_try_again,
+                               ERROR_LOCATION);
+         }
+      }
+
+      // deliver results to the client periodically
+      module_context::schedulePeriodicWork(
+            boost::posix_time::milliseconds(kDeliverResultsIntervalMs),
+            boost::bind(&FindOperation::deliverResults, shared_from_this()),
+            false);
+
+      return Success();
+   }
+
+   void stop()
+   {
+      LOCK_MUTEX(mutex_)
       {
          stopped_ = true;
+         files_.clear();
       }
+      END_LOCK_MUTEX
+   }
 
-   private:
-      bool onContinue(const core::system::ProcessOperations& ops) const
+private:
+   bool isStopped()
+   {
+      LOCK_MUTEX(mutex_)
       {
-         return !stopped_;
+         return stopped_;
       }
+      END_LOCK_MUTEX
+
+      // keep compiler happy
+      return true;
+   }
 
-      void onStdout(const core::system::ProcessOperations& ops, const std::string& data)
+   void addFile(const std::string& path)
+   {
+      // apply the file pattern
+      if (!filePattern_.empty())
       {
-         json::Array files;
-         json::Array lineNums;
-         json::Array contents;
+         std::string filename = FilePath(path).filename();
+         if (!regex_utils::textMatches(filename, filePattern_, false, true))
+            return;
+      }
+
+      files_.push_back(path);
+   }
+
+   bool nextFile(std::string* pPath)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (stopped_ || files_.empty())
+            return false;
+
+         *pPath = files_.front();
+         files_.pop_front();
+         return true;
+      }
+      END_LOCK_MUTEX
+
+      // keep compiler happy
+      return false;
+   }
+
+   // runs on the main thread or (for scanned directories) on the pool
+   // thread which completed the scan. returns the number of tasks queued
+   std::size_t enqueSearchTasks()
+   {
+      std::size_t files = 0;
+      LOCK_MUTEX(mutex_)
+      {
+         files = files_.size();
+      }
+      END_LOCK_MUTEX
+
+      std::size_t tasks = std::min(files,
+                                   static_cast<std::size_t>(
+                                      boost::thread::hardware_concurrency()));
+      tasks = std::max(tasks, static_cast<std::size_t>(1));
 
-         stdOutBuf_.append(data);
-         size_t nextLineStart = 0;
-         size_t pos = -1;
-         while (std::string::npos != (pos = stdOutBuf_.find('\n', pos + 1)))
+      std::size_t queued = 0;
+      for ( ; queued < tasks; queued++)
+      {
+         incrementActiveTasks();
+         if (!s_findPool.enque(boost::bind(&FindOperation::searchFiles,
+                                           shared_from_this())))
          {
-            std::string line = stdOutBuf_.substr(nextLineStart, pos - nextLineStart);
-            nextLineStart = pos + 1;
+            decrementActiveTasks();
+            break;
+         }
+      }
+      return queued;
+   }
 
-            boost::smatch match;
-            if (boost::regex_match(line, match, boost::regex("^([^:]+):(\\d+):(.*)")))
-            {
-               std::string file = match[1];
-               int lineNum = safe_convert::stringTo<int>(std::string(match[2]), -1);
-               std::string lineContents = match[3];
-               boost::algorithm::trim(lineContents);
-
-               files.push_back(file);
-               lineNums.push_back(lineNum);
-               contents.push_back(lineContents);
-            }
+   void scanDirectory()
+   {
+      core::system::FileScannerOptions options;
+      options.recursive = true;
+      options.filter = module_context::fileListingFilter;
+      tree<FileInfo> files;
+      Error error = core::system::scanFiles(FileInfo(directory_, true),
+                                            options,
+                                            &files);
+      if (error)
+         LOG_ERROR(error);
+
+      // add the files (symlinks aren't followed, consistent with grep -r)
+      LOCK_MUTEX(mutex_)
+      {
+         for (tree<FileInfo>::leaf_iterator it = files.begin_leaf();
+              files.is_valid(it) && it != files.end_leaf();
+              ++it)
+         {
+            if (!it->isDirectory() && !it->isSymlink())
+               addFile(it->absolutePath());
          }
+      }
+      END_LOCK_MUTEX
+
+      // search the files (this thread participates so the search makes
+      // progress even if the pool is at capacity)
+      if (!isStopped())
+         enqueSearchTasks();
+      searchFiles();
+   }
+
+   void searchFiles()
+   {
+      std::string path;
+      while (nextFile(&path))
+         searchFile(path);
+
+      decrementActiveTasks();
+   }
+
+   void searchFile(const std::string& path)
+   {
+      // only search regular files
+      struct stat st;
+      if (::stat(path.c_str(), &st) == -1 || !S_ISREG(st.st_mode))
+         return;
+
+      // nothing to search in empty files (and they can't be mapped)
+      if (st.st_size == 0)
+         return;
+
+      // compute the path relative to the search directory
+      std::string relativePath = FilePath(path).relativePath(directory_);
+      if (relativePath.empty())
+         relativePath = path;
+
+      std::vector<FindMatch> matches;
+      try
+      {
+         boost::iostreams::mapped_file_source file(path);
+         const char* begin = file.data();
+         const char* end = begin + file.size();
+
+         // skip binary files (consistent with grep --binary-files=without-match)
+         if (::memchr(begin, 0, file.size()) != NULL)
+            return;
+
+         pattern_.search(begin, end, boost::bind(&FindOperation::onMatch,
+                                                 this,
+                                                 boost::cref(relativePath),
+                                                 &matches,
+                                                 _1, _2, _3));
+      }
+      catch(const std::exception& e)
+      {
+         // files can be removed or become unreadable while we search
+         return;
+      }
+
+      addMatches(matches);
+   }
+
+   bool onMatch(const std::string& file,
+                std::vector<FindMatch>* pMatches,
+                int line,
+                const char* lineBegin,
+                const char* lineEnd)
+   {
+      std::string lineValue(lineBegin, lineEnd);
+      boost::algorithm::trim(lineValue);
+      pMatches->push_back(FindMatch(file, line, lineValue));
+
+      // stop searching the file once it alone would exceed the limit
+      return pMatches->size() < maxResults_;
+   }
+
+   void addMatches(const std::vector<FindMatch>& matches)
+   {
+      if (matches.empty())
+         return;
+
+      LOCK_MUTEX(mutex_)
+      {
+         if (stopped_)
+            return;
+
+         std::size_t count = std::min(matches.size(),
+                                      maxResults_ - resultCount_);
+         pending_.insert(pending_.end(),
+                         matches.begin(),
+                         matches.begin() + count);
+         resultCount_ += count;
+
+         // stop once we reach the limit
+         if (resultCount_ >= maxResults_)
+         {
+            stopped_ = true;
+            files_.clear();
+         }
+      }
+      END_LOCK_MUTEX
+   }
+
+   // runs periodically on the main thread
+   bool deliverResults()
+   {
+      std::vector<FindMatch> matches;
+      bool completed = false;
+      LOCK_MUTEX(mutex_)
+      {
+         matches.swap(pending_);
+         completed = (activeTasks_ == 0);
+      }
+      END_LOCK_MUTEX
 
-         if (nextLineStart)
+      if (!matches.empty())
+      {
+         json::Array files;
+         json::Array lineNums;
+         json::Array contents;
+         BOOST_FOREACH(const FindMatch& match, matches)
          {
-            stdOutBuf_.erase(0, nextLineStart);
+            files.push_back(match.file);
+            lineNums.push_back(match.line);
+            contents.push_back(match.lineValue);
          }
 
          json::Object result;
@@ -129,22 +661,107 @@ namespace {
                ClientEvent(client_events::kFindResult, result));
       }
 
-      void onStderr(const core::system::ProcessOperations& ops, const std::string& data)
+      if (completed)
+         onCompleted();
+
+      return !completed;
+   }
+
+   void onCompleted();
+
+   void incrementActiveTasks()
+   {
+      LOCK_MUTEX(mutex_)
       {
-         LOG_ERROR_MESSAGE("grep: " + data);
+         activeTasks_++;
       }
+      END_LOCK_MUTEX
+   }
 
-      void onExit(int exitCode)
+   void decrementActiveTasks()
+   {
+      LOCK_MUTEX(mutex_)
       {
-         if (!tempFile_.empty())
-            tempFile_.removeIfExists();
+         activeTasks_--;
       }
+      END_LOCK_MUTEX
+   }
+
+private:
+   std::string handle_;
+   const FilePath directory_;
+   const FindPattern pattern_;
+   boost::regex filePattern_;
+   const std::size_t maxResults_;
+
+   boost::mutex mutex_;
+   bool stopped_;
+   std::deque<std::string> files_;
+   std::size_t activeTasks_;
+   std::size_t resultCount_;
+   std::vector<FindMatch> pending_;
+};
+
+// active find operations
+typedef std::map<std::string, boost::shared_ptr<FindOperation> > FindOperations;
+FindOperations s_findOperations;
+
+void FindOperation::onCompleted()
+{
+   s_findOperations.erase(handle());
+}
+
+void onFileMonitorEnabled(const tree<core::FileInfo>& files)
+{
+   s_monitoredFiles.clear();
+   for (tree<FileInfo>::leaf_iterator it = files.begin_leaf();
+        files.is_valid(it) && it != files.end_leaf();
+        ++it)
+   {
+      if (!it->isDirectory() && !it->isSymlink())
+         s_monitoredFiles.insert(s_monitoredFiles.end(), it->absolutePath());
+   }
+}
+
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   using namespace core::system;
+   BOOST_FOREACH(const FileChangeEvent& event, events)
+   {
+      const FileInfo& fileInfo = event.fileInfo();
+      if (fileInfo.isDirectory())
+         continue;
+
+      if (event.type() == FileChangeEvent::FileAdded)
+         s_monitoredFiles.insert(fileInfo.absolutePath());
+      else if (event.type() == FileChangeEvent::FileRemoved)
+         s_monitoredFiles.erase(fileInfo.absolutePath());
+   }
+}
 
-      bool stopped_;
-      FilePath tempFile_;
-      std::string stdOutBuf_;
-      std::string handle_;
-   };
+void onFileMonitorDisabled()
+{
+   s_monitoredFiles.clear();
+}
+
+// get the monitored files within a directory (returns false if the
+// directory isn't monitored)
+bool monitoredFiles(const FilePath& directory, std::vector<std::string>* pFiles)
+{
+   if (!projects::projectContext().isMonitoringDirectory(directory))
+      return false;
+
+   std::string prefix = directory.absolutePath() + "/";
+   for (std::set<std::string>::const_iterator it =
+                                       s_monitoredFiles.lower_bound(prefix);
+        it != s_monitoredFiles.end() && boost::algorithm::starts_with(*it, prefix);
+        ++it)
+   {
+      pFiles->push_back(*it);
+   }
+
+   return true;
+}
 
 } // namespace
 
@@ -165,50 +782,50 @@ core::Error beginFind(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   core::system::ProcessOptions options;
-   options.workingDir = module_context::resolveAliasedPath(directory);
+   // optional result limit
+   int maxResults = kDefaultMaxResults;
+   if (request.params.size() > 5)
+   {
+      error = json::readParam(request.params, 5, &maxResults);
+      if (error)
+         return error;
+   }
+   if (maxResults <= 0)
+      maxResults = kDefaultMaxResults;
 
    // TODO: Encode the pattern using the project encoding
 
-   // Put the grep pattern in a file
-   FilePath tempFile = module_context::tempFile("rs_grep", "txt");
-   boost::shared_ptr<std::ostream> pStream;
-   error = tempFile.open_w(&pStream);
-   if (error)
-      return error;
-   *pStream << searchString << std::endl;
-   pStream.reset(); // release file handle
-
-   boost::shared_ptr<GrepOperation> ptrGrepOp = GrepOperation::create(tempFile);
-   core::system::ProcessCallbacks callbacks =
-                                       ptrGrepOp->createProcessCallbacks();
-
-   shell_utils::ShellCommand cmd("grep");
-   cmd << "-rHn" << "--binary-files=without-match" << "--devices=skip";
+   FilePath directoryPath = module_context::resolveAliasedPath(directory);
 
-   if (ignoreCase)
-      cmd << "-i";
-
-   // Use -f to pass pattern via file, so we don't have to worry about
-   // escaping double quotes, etc.
-   cmd << "-f";
-   cmd << tempFile;
-   if (!asRegex)
-      cmd << "-F";
+   // compile the pattern
+   boost::shared_ptr<FindOperation> ptrFindOp;
+   try
+   {
+      ptrFindOp = FindOperation::create(
+                     directoryPath,
+                     FindPattern(searchString, asRegex, ignoreCase),
+                     filePattern,
+                     static_cast<std::size_t>(maxResults));
+   }
+   catch(const boost::regex_error& e)
+   {
+      Error error = systemError(boost::system::errc::invalid_argument,
+                                ERROR_LOCATION);
+      error.addProperty("pattern", searchString);
+      error.addProperty("what", e.what());
+      return error;
+   }
 
-   cmd << "--";
-   if (filePattern.empty())
-      cmd << shell_utils::EscapeFilesOnly << "*" << shell_utils::EscapeAll;
-   else
-      cmd << filePattern;
+   // use the file monitor's list of files if it covers the directory
+   std::vector<std::string> files;
+   bool haveFiles = monitoredFiles(directoryPath, &files);
 
-   error = module_context::processSupervisor().runCommand(cmd,
-                                                          options,
-                                                          callbacks);
+   error = ptrFindOp->start(haveFiles ? &files : NULL);
    if (error)
       return error;
 
-   pResponse->setResult(ptrGrepOp->handle());
+   s_findOperations[ptrFindOp->handle()] = ptrFindOp;
+   pResponse->setResult(ptrFindOp->handle());
 
    return Success();
 }
@@ -217,14 +834,39 @@ core::Error stopFind(const json::JsonRpcRequest& request,
                      json::JsonRpcResponse* pResponse)
 {
    std::string handle;
+   Error error = json::readParams(request.params, &handle);
+   if (error)
+      return error;
+
+   FindOperations::iterator it = s_findOperations.find(handle);
+   if (it != s_findOperations.end())
+      it->second->stop();
 
    return Success();
 }
 
+void onShutdown(bool terminatedNormally)
+{
+   BOOST_FOREACH(const FindOperations::value_type& op, s_findOperations)
+   {
+      op.second->stop();
+   }
+   s_findPool.stop();
+}
+
 core::Error initialize()
 {
    using namespace session::module_context;
 
+   // track the files known to the project file monitor
+   session::projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onFileMonitorEnabled;
+   cb.onFilesChanged = onFilesChanged;
+   cb.onMonitoringDisabled = onFileMonitorDisabled;
+   projects::projectContext().subscribeToFileMonitor("Find in files", cb);
+
+   events().onShutdown.connect(onShutdown);
+
    // install handlers
    using boost::bind;
    ExecBlock initBlock ;
@@ -14,6 +14,8 @@
 
 #include <signal.h>
 
+#include <deque>
+
 #ifdef _WIN32
 #include <windows.h>
 #include <shlobj.h>
@@ -345,6 +347,79 @@ protected:
       return output;
    }
 
+   void parseStatus(const std::string& output,
+                    std::vector<FileWithStatus>* pFiles)
+   {
+      std::vector<std::string> lines = split(output);
+
+      for (std::vector<std::string>::iterator it = lines.begin();
+           it != lines.end();
+           it++)
+      {
+         std::string line = *it;
+         if (line.length() < 4)
+            continue;
+         FileWithStatus file;
+
+         file.status = line.substr(0, 2);
+
+         std::string filePath = line.substr(3);
+         if (filePath.length() > 1 && filePath[filePath.length() - 1] == '/')
+            filePath = filePath.substr(0, filePath.size() - 1);
+         file.path = root_.childPath(string_utils::systemToUtf8(filePath));
+
+         pFiles->push_back(file);
+      }
+   }
+
+   void onStatusAsyncCompleted(
+      const boost::function<void(const core::Error&,
+                                 const std::vector<FileWithStatus>&)>& onCompleted,
+      const core::system::ProcessResult& result)
+   {
+      std::vector<FileWithStatus> files;
+      if (result.exitStatus != EXIT_SUCCESS)
+      {
+         onCompleted(systemError(boost::system::errc::state_not_recoverable,
+                                 result.stdErr,
+                                 ERROR_LOCATION),
+                     files);
+         return;
+      }
+
+      parseStatus(result.stdOut, &files);
+      onCompleted(Success(), files);
+   }
+
+
+   ShellArgs statusPathsArgs(const std::vector<FilePath>& paths)
+   {
+      ShellArgs args;
+      args << "status" << "--porcelain" << "--";
+      if (paths.empty())
+         args << root_;
+      else
+         appendPathArgs(paths, &args);
+      return args;
+   }
+
+   core::system::ProcessOptions statusPathsOptions()
+   {
+      core::system::ProcessOptions options = procOptions();
+      options.workingDir = root_;
+#ifdef _WIN32
+      options.detachProcess = true;
+#endif
+
+      // don't refresh the index on behalf of the status cache (newer
+      // versions of git would otherwise write it, which would both make
+      // it look like the index had changed and contend for its lock with
+      // any command the user is running)
+      core::system::setenv(options.environment.get_ptr(),
+                           "GIT_OPTIONAL_LOCKS",
+                           "0");
+      return options;
+   }
 
    void appendPathArgs(const std::vector<FilePath>& filePaths,
                        ShellArgs* pArgs)
@@ -395,40 +470,77 @@ public:
    {
       using namespace boost;
 
-      std::vector<FileWithStatus> files;
-
-      std::vector<std::string> lines;
       std::string output;
       Error error = runGit(ShellArgs() << "status" << "--porcelain" << "--" << dir,
                            &output);
       if (error)
          return error;
-      lines = split(output);
 
-      for (std::vector<std::string>::iterator it = lines.begin();
-           it != lines.end();
-           it++)
-      {
-         std::string line = *it;
-         if (line.length() < 4)
-            continue;
-         FileWithStatus file;
+      std::vector<FileWithStatus> files;
+      parseStatus(output, &files);
 
-         file.status = line.substr(0, 2);
+      *pStatusResult = StatusResult(files);
 
-         std::string filePath = line.substr(3);
-         if (filePath.length() > 1 && filePath[filePath.length() - 1] == '/')
-            filePath = filePath.substr(0, filePath.size() - 1);
-         file.path = root_.childPath(string_utils::systemToUtf8(filePath));
+      return Success();
+   }
 
-         files.push_back(file);
-      }
+   // run status for the paths (or the entire working copy if there are
+   // none) without refreshing the index
+   core::Error statusPaths(const std::vector<FilePath>& paths,
+                           std::vector<FileWithStatus>* pFiles)
+   {
+      core::system::ProcessResult result;
+#ifdef _WIN32
+      Error error = runProgram(gitBin(),
+                               statusPathsArgs(paths).args(),
+                               "",
+                               statusPathsOptions(),
+                               &result);
+#else
+      Error error = runCommand(git() << statusPathsArgs(paths).args(),
+                               "",
+                               statusPathsOptions(),
+                               &result);
+#endif
+      if (error)
+         return error;
 
-      *pStatusResult = StatusResult(files);
+      if (result.exitStatus != EXIT_SUCCESS)
+      {
+         return systemError(boost::system::errc::state_not_recoverable,
+                            result.stdErr,
+                            ERROR_LOCATION);
+      }
 
+      parseStatus(result.stdOut, pFiles);
       return Success();
    }
 
+   // as above but without waiting for status to complete. onCompleted is
+   // called from the main thread when the process supervisor is next polled
+   core::Error statusAsync(
+      const std::vector<FilePath>& paths,
+      const boost::function<void(const core::Error&,
+                                 const std::vector<FileWithStatus>&)>& onCompleted)
+   {
+      boost::function<void(const core::system::ProcessResult&)> onExit =
+            boost::bind(&Git::onStatusAsyncCompleted, this, onCompleted, _1);
+
+#ifdef _WIN32
+      return module_context::processSupervisor().runProgram(
+                                                   gitBin(),
+                                                   statusPathsArgs(paths).args(),
+                                                   "",
+                                                   statusPathsOptions(),
+                                                   onExit);
+#else
+      return module_context::processSupervisor().runCommand(
+                                       git() << statusPathsArgs(paths).args(),
+                                       statusPathsOptions(),
+                                       onExit);
+#endif
+   }
+
    core::Error add(const std::vector<FilePath>& filePaths)
    {
       return runGit(ShellArgs() << "add" << "--" << filePaths);
@@ -1214,27 +1326,501 @@ FilePath detectGitDir(const FilePath& workingDir)
                       string_utils::systemToUtf8(result.stdOut)));
 }
 
+// Status of the entire working copy, cached so that file listings, file
+// change notifications and the vcs pane don't each need to run git. The
+// cache is filled in the background once the project's file monitor starts
+// and is then kept up to date by running status (again in the background)
+// for just the paths which are reported as changed. File change events are
+// held until the refresh which covers them completes and are then decorated
+// from the cache. Everything happens on the main thread (the process
+// supervisor calls us back when it is polled). For other requests status
+// is computed synchronously, as it was before there was a cache, whenever
+// the cached status can't be trusted: before it has been filled, after a
+// vcs operation, or once the index has been written by something other
+// than the session (e.g. git commands run in a terminal)
+class StatusCache : boost::noncopyable
+{
+public:
+   StatusCache()
+      : enabled_(false), valid_(false), refreshing_(false),
+        fullRefreshPending_(false), generation_(0), refreshes_(0),
+        indexWriteTime_(0), indexSize_(0),
+        pendingIndexWriteTime_(0), pendingIndexSize_(0)
+   {
+   }
+
+   // only enabled while the file monitor covers the entire working copy
+   bool enabled() const { return enabled_; }
+
+   void enable()
+   {
+      clear();
+      enabled_ = true;
+      refreshAll();
+   }
+
+   void disable()
+   {
+      // decorate any held events with what we have
+      releaseWaiters(refreshes_ + 1);
+      clear();
+      enabled_ = false;
+   }
+
+   // the next request for status will run it synchronously
+   void invalidate()
+   {
+      valid_ = false;
+      generation_++;
+      pendingPaths_.clear();
+   }
+
+   // run a full status in the background
+   void refreshAll()
+   {
+      if (!enabled_)
+         return;
+
+      fullRefreshPending_ = true;
+      pendingPaths_.clear();
+      refreshNext();
+   }
+
+   // queue a background status for the paths. it's started by
+   // refreshPending so that paths reported together (e.g. by both the
+   // project and files pane monitors) are refreshed together
+   void refreshPaths(const std::vector<FilePath>& paths)
+   {
+      // nothing to bring up to date if the next request will run a full
+      // status anyway (a full refresh which is yet to start will pick up
+      // these paths too)
+      if (!enabled_ || (!valid_ && !refreshing_) || fullRefreshPending_)
+         return;
+
+      BOOST_FOREACH(const FilePath& path, paths)
+      {
+         pendingPaths_[path.absolutePath()] = path;
+      }
+
+      // run a single full status rather than status for a very long list
+      // of paths (e.g. after switching branches)
+      if (pendingPaths_.size() > kMaxRefreshPaths)
+         refreshAll();
+   }
+
+   void refreshPending()
+   {
+      if (enabled_)
+         refreshNext();
+   }
+
+   // call onRefreshed once the cache reflects changes to the paths (i.e.
+   // after the next refresh to start has completed)
+   void whenRefreshed(const std::vector<FilePath>& paths,
+                      const boost::function<void()>& onRefreshed)
+   {
+      Waiter waiter;
+      waiter.refresh = refreshes_ + 1;
+      waiter.onRefreshed = onRefreshed;
+      waiters_.push_back(waiter);
+
+      std::vector<FilePath> workingCopyPaths;
+      BOOST_FOREACH(const FilePath& path, paths)
+      {
+         // the ignore rules changed so any path could have a new status
+         if (path.filename() == ".gitignore")
+         {
+            refreshAll();
+            return;
+         }
+
+         if (path.isWithin(s_git_.root()))
+            workingCopyPaths.push_back(path);
+      }
+
+      if (!valid_ && !refreshing_)
+         refreshAll();
+      else
+         refreshPaths(workingCopyPaths);
+   }
+
+   core::Error status(boost::shared_ptr<const StatusResult>* ppStatusResult)
+   {
+      if (!valid_ || indexChanged())
+      {
+         // drop the results of any refresh which is underway (it may have
+         // started before whatever made the cache stale)
+         invalidate();
+         fullRefreshPending_ = false;
+
+         recordIndex(&indexWriteTime_, &indexSize_);
+
+         std::vector<FileWithStatus> files;
+         Error error = s_git_.statusPaths(std::vector<FilePath>(), &files);
+         if (error)
+            return error;
+
+         replace(files);
+         valid_ = true;
+      }
+
+      if (!pStatusResult_)
+         pStatusResult_.reset(new StatusResult(files()));
+
+      *ppStatusResult = pStatusResult_;
+      return Success();
+   }
+
+   // status as of the last refresh (never runs git)
+   boost::shared_ptr<const StatusResult> cachedStatus()
+   {
+      if (!pStatusResult_)
+         pStatusResult_.reset(new StatusResult(files()));
+      return pStatusResult_;
+   }
+
+private:
+   typedef std::map<std::string,FileWithStatus> Files;
+
+   struct Waiter
+   {
+      int refresh;
+      boost::function<void()> onRefreshed;
+   };
+
+   void clear()
+   {
+      invalidate();
+      fullRefreshPending_ = false;
+      files_.clear();
+      pStatusResult_.reset();
+   }
+
+   FilePath indexPath() const
+   {
+      return s_git_.root().childPath(".git/index");
+   }
+
+   void recordIndex(std::time_t* pWriteTime, uintmax_t* pSize) const
+   {
+      FilePath index = indexPath();
+      *pWriteTime = index.lastWriteTime();
+      *pSize = index.exists() ? index.size() : 0;
+   }
+
+   bool indexChanged() const
+   {
+      std::time_t writeTime;
+      uintmax_t size;
+      recordIndex(&writeTime, &size);
+      return writeTime != indexWriteTime_ || size != indexSize_;
+   }
+
+   void refreshNext()
+   {
+      if (refreshing_)
+         return;
+
+      std::vector<FilePath> paths;
+      if (fullRefreshPending_)
+      {
+         fullRefreshPending_ = false;
+         recordIndex(&pendingIndexWriteTime_, &pendingIndexSize_);
+      }
+      else if (valid_ && !pendingPaths_.empty())
+      {
+         for (std::map<std::string,FilePath>::const_iterator it =
+                 pendingPaths_.begin(); it != pendingPaths_.end(); ++it)
+         {
+            paths.push_back(it->second);
+         }
+         pendingPaths_.clear();
+      }
+      else
+      {
+         // nothing more is coming so don't hold events any longer
+         releaseWaiters(refreshes_ + 1);
+         return;
+      }
+
+      int refresh = ++refreshes_;
+      Error error = s_git_.statusAsync(paths,
+                                       boost::bind(&StatusCache::onRefreshed,
+                                                   this,
+                                                   generation_,
+                                                   refresh,
+                                                   paths,
+                                                   _1,
+                                                   _2));
+      if (error)
+      {
+         LOG_ERROR(error);
+         invalidate();
+         releaseWaiters(refresh);
+         return;
+      }
+
+      refreshing_ = true;
+   }
+
+   // waiters are in the order of the refresh they're waiting for
+   void releaseWaiters(int refresh)
+   {
+      while (!waiters_.empty() && waiters_.front().refresh <= refresh)
+      {
+         Waiter waiter = waiters_.front();
+         waiters_.pop_front();
+         waiter.onRefreshed();
+      }
+   }
+
+   void onRefreshed(int generation,
+                    int refresh,
+                    const std::vector<FilePath>& paths,
+                    const core::Error& error,
+                    const std::vector<FileWithStatus>& files)
+   {
+      refreshing_ = false;
+
+      if (generation == generation_)
+      {
+         if (error)
+         {
+            LOG_ERROR(error);
+            invalidate();
+         }
+         else if (paths.empty())
+         {
+            bool wasValid = valid_;
+            bool changed = replace(files);
+            valid_ = true;
+            indexWriteTime_ = pendingIndexWriteTime_;
+            indexSize_ = pendingIndexSize_;
+
+            // the client already has status if the cache was valid
+            if (wasValid && changed)
+               enqueStatusChangedEvent();
+         }
+         else if (update(paths, files))
+         {
+            enqueStatusChangedEvent();
+         }
+      }
+
+      // (if the results were dropped the events are decorated with what
+      // we have, the client refreshes status after a vcs operation anyway)
+      releaseWaiters(refresh);
+
+      refreshNext();
+   }
+
+   // replace the entire working copy status, returning true if it changed
+   bool replace(const std::vector<FileWithStatus>& files)
+   {
+      Files previousFiles;
+      previousFiles.swap(files_);
+      pStatusResult_.reset();
+
+      BOOST_FOREACH(const FileWithStatus& file, files)
+      {
+         files_[file.path.absolutePath()] = file;
+      }
+
+      return !sameStatus(previousFiles, files_);
+   }
+
+   // replace the status of the paths (and of anything within them) with
+   // the results of running status for just those paths, returning true
+   // if any status changed
+   bool update(const std::vector<FilePath>& paths,
+               const std::vector<FileWithStatus>& files)
+   {
+      Files previousFiles;
+      BOOST_FOREACH(const FilePath& path, paths)
+      {
+         std::string key = path.absolutePath();
+         Files::iterator it = files_.find(key);
+         if (it != files_.end())
+         {
+            previousFiles.insert(*it);
+            files_.erase(it);
+         }
+
+         // contents of a directory (note that these don't follow the
+         // directory itself in the map as e.g. "dir-2" sorts before "dir/")
+         std::string prefix = key + "/";
+         it = files_.lower_bound(prefix);
+         while (it != files_.end() &&
+                boost::algorithm::starts_with(it->first, prefix))
+         {
+            previousFiles.insert(*it);
+            files_.erase(it++);
+         }
+      }
+
+      // add in order so that untracked directories precede their contents
+      Files updatedFiles;
+      BOOST_FOREACH(const FileWithStatus& file, files)
+      {
+         updatedFiles[file.path.absolutePath()] = file;
+      }
+
+      for (Files::iterator it = updatedFiles.begin(); it != updatedFiles.end(); )
+      {
+         // status for a path within an untracked directory is reported for
+         // the path itself, but a full status only reports the directory
+         if (isWithinUntrackedDirectory(it->second.path))
+         {
+            updatedFiles.erase(it++);
+         }
+         else
+         {
+            files_.insert(*it);
+            ++it;
+         }
+      }
+
+      pStatusResult_.reset();
+
+      return !sameStatus(previousFiles, updatedFiles);
+   }
+
+   bool isWithinUntrackedDirectory(const FilePath& path) const
+   {
+      FilePath root = s_git_.root();
+      FilePath parent = path.parent();
+      while (parent != root && parent != parent.parent())
+      {
+         Files::const_iterator it = files_.find(parent.absolutePath());
+         if (it != files_.end() && it->second.status.status() == "??")
+            return true;
+
+         parent = parent.parent();
+      }
+      return false;
+   }
+
+   static bool sameStatus(const Files& files1, const Files& files2)
+   {
+      if (files1.size() != files2.size())
+         return false;
+
+      for (Files::const_iterator it1 = files1.begin(), it2 = files2.begin();
+           it1 != files1.end();
+           ++it1, ++it2)
+      {
+         if (it1->first != it2->first ||
+             it1->second.status.status() != it2->second.status.status())
+         {
+            return false;
+         }
+      }
+      return true;
+   }
+
+   std::vector<FileWithStatus> files() const
+   {
+      std::vector<FileWithStatus> files;
+      files.reserve(files_.size());
+      for (Files::const_iterator it = files_.begin(); it != files_.end(); ++it)
+         files.push_back(it->second);
+      return files;
+   }
+
+private:
+   static const std::size_t kMaxRefreshPaths = 100;
+
+   bool enabled_;
+   bool valid_;
+   bool refreshing_;
+   bool fullRefreshPending_;
+   int generation_;
+   int refreshes_;
+   std::time_t indexWriteTime_;
+   uintmax_t indexSize_;
+   std::time_t pendingIndexWriteTime_;
+   uintmax_t pendingIndexSize_;
+   Files files_;
+   std::map<std::string,FilePath> pendingPaths_;
+   std::deque<Waiter> waiters_;
+   boost::shared_ptr<const StatusResult> pStatusResult_;
+};
+
+StatusCache s_statusCache;
+
+void onFileMonitorEnabled(const tree<core::FileInfo>&)
+{
+   // we can only keep the cache up to date if every change to the working
+   // copy is reported to us (i.e. the git root is within the project)
+   FilePath projectDir = projects::projectContext().directory();
+   if (isGitEnabled() && s_git_.root().isWithin(projectDir))
+      s_statusCache.enable();
+}
+
+void onBackgroundProcessing(bool)
+{
+   s_statusCache.refreshPending();
+}
+
+void onFileMonitorDisabled()
+{
+   s_statusCache.disable();
+}
+
 } // anonymous namespace
 
-GitFileDecorationContext::GitFileDecorationContext(const FilePath& rootDir)
+void whenStatusAvailable(const std::vector<FilePath>& changedPaths,
+                         const boost::function<void()>& onAvailable)
+{
+   if (s_statusCache.enabled())
+      s_statusCache.whenRefreshed(changedPaths, onAvailable);
+   else
+      onAvailable();
+}
+
+GitFileDecorationContext::GitFileDecorationContext(const FilePath& rootDir,
+                                                   bool fileChanges)
    : fullRefreshRequired_(false)
 {
    // get source control status (merely log errors doing this)
-   Error error = git::status(rootDir, &vcsStatus_);
+   Error error;
+   if (s_statusCache.enabled())
+   {
+      if (fileChanges)
+         pVcsStatus_ = s_statusCache.cachedStatus();
+      else
+         error = s_statusCache.status(&pVcsStatus_);
+   }
+   else
+   {
+      boost::shared_ptr<StatusResult> pVcsStatus(new StatusResult());
+      error = git::status(rootDir, pVcsStatus.get());
+      pVcsStatus_ = pVcsStatus;
+   }
    if (error)
+   {
       LOG_ERROR(error);
+      pVcsStatus_.reset(new StatusResult());
+   }
 }
 
 GitFileDecorationContext::~GitFileDecorationContext()
 {
+   // the cache is kept current by the file monitor so there's no need to
+   // invalidate it (which would make the next request run a full status)
    if (fullRefreshRequired_)
-      enqueueRefreshEvent();
+   {
+      if (s_statusCache.enabled())
+         enqueStatusChangedEvent();
+      else
+         enqueueRefreshEvent();
+   }
 }
 
 void GitFileDecorationContext::decorateFile(const FilePath &filePath,
                                             json::Object *pFileObject)
 {
-   VCSStatus status = vcsStatus_.getStatus(filePath);
+   VCSStatus status = pVcsStatus_->getStatus(filePath);
 
    if (status.status().empty() && !fullRefreshRequired_)
    {
@@ -1249,7 +1835,7 @@ void GitFileDecorationContext::decorateFile(const FilePath &filePath,
             break;
 
          parent = parent.parent();
-         if (vcsStatus_.getStatus(parent).status() == "??")
+         if (pVcsStatus_->getStatus(parent).status() == "??")
          {
             fullRefreshRequired_ = true;
             break;
@@ -1274,6 +1860,18 @@ core::Error status(const FilePath& dir, StatusResult* pStatusResult)
 
 Error fileStatus(const FilePath& filePath, VCSStatus* pStatus)
 {
+   if (s_statusCache.enabled())
+   {
+      boost::shared_ptr<const StatusResult> pStatusResult;
+      Error error = s_statusCache.status(&pStatusResult);
+      if (error)
+         return error;
+
+      *pStatus = pStatusResult->getStatus(filePath);
+
+      return Success();
+   }
+
    StatusResult statusResult;
    Error error = git::status(filePath.parent(), &statusResult);
    if (error)
@@ -1420,12 +2018,24 @@ Error vcsCheckout(const json::JsonRpcRequest& request,
 Error vcsFullStatus(const json::JsonRpcRequest&,
                     json::JsonRpcResponse* pResponse)
 {
-   StatusResult statusResult;
-   Error error = s_git_.status(s_git_.root(), &statusResult);
-   if (error)
-      return error;
+   std::vector<FileWithStatus> files;
+   if (s_statusCache.enabled())
+   {
+      boost::shared_ptr<const StatusResult> pStatusResult;
+      Error error = s_statusCache.status(&pStatusResult);
+      if (error)
+         return error;
+      files = pStatusResult->files();
+   }
+   else
+   {
+      StatusResult statusResult;
+      Error error = s_git_.status(s_git_.root(), &statusResult);
+      if (error)
+         return error;
+      files = statusResult.files();
+   }
 
-   std::vector<FileWithStatus> files = statusResult.files();
    json::Array result;
    for (std::vector<FileWithStatus>::const_iterator it = files.begin();
         it != files.end();
@@ -1434,7 +2044,7 @@ Error vcsFullStatus(const json::JsonRpcRequest&,
       VCSStatus status = it->status;
       FilePath path = it->path;
       json::Object obj;
-      error = statusToJson(path, status, &obj);
+      Error error = statusToJson(path, status, &obj);
       if (error)
          return error;
       result.push_back(obj);
@@ -2630,6 +3240,20 @@ core::Error initialize()
    // add settings changed handler
    userSettings().onChanged.connect(onUserSettingsChanged);
 
+   // cache status while the project's files are monitored (changes are
+   // picked up from the file changed events, see whenStatusAvailable). no
+   // feature name as status is just computed on demand without it
+   projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onFileMonitorEnabled;
+   cb.onMonitoringDisabled = onFileMonitorDisabled;
+   projects::projectContext().subscribeToFileMonitor(std::string(), cb);
+   module_context::events().onBackgroundProcessing.connect(
+                                                   onBackgroundProcessing);
+
+   // vcs operations may change the status of any file
+   onRefreshRequested().connect(boost::bind(&StatusCache::invalidate,
+                                            &s_statusCache));
+
    // install rpc methods
    using boost::bind;
    using namespace module_context;
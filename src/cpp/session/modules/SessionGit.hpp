@@ -15,6 +15,10 @@
 #define SESSION_GIT_HPP
 
 #include <map>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
@@ -37,13 +41,16 @@ extern const char * const kVcsId;
 class GitFileDecorationContext : public source_control::FileDecorationContext
 {
 public:
-   GitFileDecorationContext(const core::FilePath& rootDir);
+   // file change events are decorated from cached status as it is (they
+   // are held until it reflects the changes, see whenStatusAvailable)
+   GitFileDecorationContext(const core::FilePath& rootDir,
+                            bool fileChanges = false);
    virtual ~GitFileDecorationContext();
    virtual void decorateFile(const core::FilePath &filePath,
                              core::json::Object *pFileObject);
 
 private:
-   source_control::StatusResult vcsStatus_;
+   boost::shared_ptr<const source_control::StatusResult> pVcsStatus_;
    bool fullRefreshRequired_;
 };
 
@@ -64,6 +71,8 @@ core::Error status(const core::FilePath& dir,
                    source_control::StatusResult* pStatusResult);
 core::Error fileStatus(const core::FilePath& filePath,
                        source_control::VCSStatus* pStatus);
+void whenStatusAvailable(const std::vector<core::FilePath>& changedPaths,
+                         const boost::function<void()>& onAvailable);
 core::Error statusToJson(const core::FilePath& path,
                          const source_control::VCSStatus& status,
                          core::json::Object* pObject);
@@ -13,6 +13,7 @@
 
 #include "SessionHistory.hpp"
 
+#include <cstdlib>
 #include <iostream>
 #include <sstream>
 #include <vector>
@@ -20,6 +21,9 @@
 
 #include <boost/utility.hpp>
 #include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/function.hpp>
 #include <boost/tokenizer.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -84,6 +88,8 @@ class HistoryEntryReader
 {
 public:
    HistoryEntryReader() : nextIndex_(0) {}
+
+   void reset() { nextIndex_ = 0; }
    
    ReadCollectionAction operator()(const std::string& line, 
                                    HistoryEntry* pEntry)
@@ -92,15 +98,17 @@ public:
       if (line.find(':') == std::string::npos)
          return ReadCollectionIgnoreLine;
 
-      pEntry->index = nextIndex_++; 
-      std::istringstream istr(line);
-      istr >> pEntry->timestamp ;
-      istr.ignore(1, ':');
-      std::getline(istr, pEntry->command);
-      
+      // parse the timestamp (the command follows the separator after it)
+      const char* pLine = line.c_str();
+      char* pEnd;
+      double timestamp = std::strtod(pLine, &pEnd);
+
       // if we had a read failure log it and return ignore state
-      if (!istr.fail())
+      if (pEnd != pLine && *pEnd != '\0')
       {
+         pEntry->index = nextIndex_++;
+         pEntry->timestamp = timestamp;
+         pEntry->command = line.substr(pEnd - pLine + 1);
          return ReadCollectionAddLine;
       }
       else
@@ -115,22 +123,58 @@ private:
 };
    
    
+// commands are indexed by their tokens: runs of identifier characters
+// (bytes of multibyte characters are included so they don't split words)
+inline bool isTokenChar(char ch)
+{
+   return (ch >= 'a' && ch <= 'z') ||
+          (ch >= 'A' && ch <= 'Z') ||
+          (ch >= '0' && ch <= '9') ||
+          ch == '_' || ch == '.' ||
+          static_cast<unsigned char>(ch) >= 0x80;
+}
+
+void tokenize(const std::string& text, std::vector<std::string>* pTokens)
+{
+   std::size_t i = 0;
+   while (i < text.length())
+   {
+      if (!isTokenChar(text[i]))
+      {
+         i++;
+         continue;
+      }
+
+      std::size_t tokenStart = i;
+      while (i < text.length() && isTokenChar(text[i]))
+         i++;
+      pTokens->push_back(text.substr(tokenStart, i - tokenStart));
+   }
+}
+
+// tokens shorter than this match too many entries to be worth looking up
+// (matches for them are found when candidates are verified)
+const std::size_t kMinSearchTokenLength = 2;
+
+// precedes each token in the token text (can't appear within a token)
+const char* const kTokenSeparator = "\n";
+
+// tokens found in more than 1/kMaxMatchingFraction of entries aren't used
+// to narrow the search either
+const std::size_t kMaxMatchingFraction = 16;
+
 class History : boost::noncopyable
 {
 private:
-   History() : entryCacheLastWriteTime_(-1) {}
+   History() : readOffset_(0) {}
    friend History& historyArchive();
    
 public:
    
    Error add(const std::string& command)
    {
-      // reset the cache (since this write will invalidate the current one,
-      // no sense in keeping our cache around in memory)
-      entries_.clear();
-      entryCacheLastWriteTime_ = -1;
-
-      // write the entry to the file
+      // write the entry to the file (it will be read back along with any
+      // entries written by other sessions the next time entries are read)
       std::ostringstream ostrEntry ;
       double currentTime = core::date_time::millisecondsSinceEpoch();
       writeEntry(currentTime, command, &ostrEntry);
@@ -140,37 +184,47 @@ public:
 
    const std::vector<HistoryEntry>& entries() const
    {
-      // calculate path to history db
-      FilePath historyDBPath = historyDatabaseFilePath();
+      readNewEntries();
+      return entries_;
+   }
 
-      // if the file doesn't exist then clear the collection
-      if (!historyDBPath.exists())
+   // get the indexes (ascending) of entries with tokens starting with each
+   // of the prefix tokens and containing each of the substring tokens.
+   // returns false if none of the tokens could be used to narrow the
+   // search (in which case all entries are candidates)
+   bool candidateEntries(const std::vector<std::string>& prefixTokens,
+                         const std::vector<std::string>& substringTokens,
+                         std::vector<int>* pIndexes) const
+   {
+      readNewEntries();
+
+      // all tokens are preceded by a separator in the token text, so
+      // prefixes can be found by searching for the separator plus prefix
+      std::vector<std::string> patterns;
+      BOOST_FOREACH(const std::string& token, prefixTokens)
+      {
+         if (token.length() >= kMinSearchTokenLength)
+            patterns.push_back(kTokenSeparator + token);
+      }
+      BOOST_FOREACH(const std::string& token, substringTokens)
       {
-         entries_.clear();
+         if (token.length() >= kMinSearchTokenLength)
+            patterns.push_back(token);
       }
 
-      // otherwise check for divergent lastWriteTime and read the file
-      // if our internal list isn't up to date
-      else if (historyDBPath.lastWriteTime() != entryCacheLastWriteTime_)
+      bool haveCandidates = false;
+      pIndexes->clear();
+      BOOST_FOREACH(const std::string& pattern, patterns)
       {
-         entries_.clear();
-         Error error = readCollectionFromFile<std::vector<HistoryEntry> >(
-                                                      historyDBPath,
-                                                      &entries_,
-                                                      HistoryEntryReader());
-         if (error)
+         std::vector<int> matches;
+         if (findMatches(pattern, &matches) &&
+             !narrowCandidates(&matches, &haveCandidates, pIndexes))
          {
-            LOG_ERROR(error);
+            return true;
          }
-         else
-         {
-            entryCacheLastWriteTime_ = historyDBPath.lastWriteTime();
-         }
-
       }
-      
-      // return entries
-      return entries_;
+
+      return haveCandidates;
    }
 
    static void migrateRhistoryIfNecessary()
@@ -216,11 +270,188 @@ private:
    {
       return module_context::userScratchPath().complete("history_database");
    }
+
+   void clear() const
+   {
+      entries_.clear();
+      tokenIndex_.clear();
+      tokenText_.clear();
+      tokenOffsets_.clear();
+      tokenEntries_.clear();
+      entryReader_.reset();
+      readOffset_ = 0;
+   }
+
+   // parse and index entries appended to the file since it was last read
+   void readNewEntries() const
+   {
+      FilePath historyDBPath = historyDatabaseFilePath();
+      if (!historyDBPath.exists())
+      {
+         clear();
+         return;
+      }
+
+      // start over if the file has been truncated
+      boost::uintmax_t size = historyDBPath.size();
+      if (size < readOffset_)
+         clear();
+      if (size == readOffset_)
+         return;
+
+      std::string contents;
+      Error error = readFromOffset(historyDBPath, readOffset_, &contents);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      // add complete lines (a partial line at the end is left until the
+      // rest of it has been written)
+      std::size_t lineStart = 0, lineEnd;
+      while ((lineEnd = contents.find('\n', lineStart)) != std::string::npos)
+      {
+         std::string line = contents.substr(lineStart, lineEnd - lineStart);
+         boost::algorithm::trim(line);
+         if (!line.empty())
+         {
+            HistoryEntry entry;
+            if (entryReader_(line, &entry) == ReadCollectionAddLine)
+               addEntry(entry);
+         }
+         lineStart = lineEnd + 1;
+      }
+      readOffset_ += lineStart;
+   }
+
+   // find the entries with tokens containing the pattern. returns false
+   // if there are so many matches that a scan of the most recent entries
+   // would find results sooner than the index
+   bool findMatches(const std::string& pattern,
+                    std::vector<int>* pMatches) const
+   {
+      std::size_t maxMatches = entries_.size() / kMaxMatchingFraction;
+      std::size_t pos = 0;
+      while ((pos = tokenText_.find(pattern, pos)) != std::string::npos)
+      {
+         // locate the token containing the match
+         std::vector<std::size_t>::const_iterator it =
+               std::upper_bound(tokenOffsets_.begin(), tokenOffsets_.end(), pos);
+         std::size_t token = (it - tokenOffsets_.begin()) - 1;
+
+         const std::vector<int>& entries = tokenEntries_[token];
+         if (pMatches->size() + entries.size() > maxMatches)
+            return false;
+         pMatches->insert(pMatches->end(), entries.begin(), entries.end());
+
+         // continue from the next token
+         if (it == tokenOffsets_.end())
+            break;
+         pos = *it;
+      }
+
+      return true;
+   }
+
+   // intersect the candidates with the (unsorted) matches for another
+   // token. returns false if there are no candidates left
+   static bool narrowCandidates(std::vector<int>* pMatches,
+                                bool* pHaveCandidates,
+                                std::vector<int>* pCandidates)
+   {
+      std::sort(pMatches->begin(), pMatches->end());
+      pMatches->erase(std::unique(pMatches->begin(), pMatches->end()),
+                      pMatches->end());
+
+      if (*pHaveCandidates)
+      {
+         std::vector<int> intersection;
+         std::set_intersection(pCandidates->begin(), pCandidates->end(),
+                               pMatches->begin(), pMatches->end(),
+                               std::back_inserter(intersection));
+         pCandidates->swap(intersection);
+      }
+      else
+      {
+         pCandidates->swap(*pMatches);
+         *pHaveCandidates = true;
+      }
+
+      return !pCandidates->empty();
+   }
+
+   void addEntry(const HistoryEntry& entry) const
+   {
+      entries_.push_back(entry);
+
+      std::vector<std::string> tokens;
+      tokenize(entry.command, &tokens);
+      BOOST_FOREACH(const std::string& token, tokens)
+      {
+         // add new tokens to the token text
+         std::pair<TokenIndex::iterator,bool> result = tokenIndex_.insert(
+                        std::make_pair(token, tokenEntries_.size()));
+         if (result.second)
+         {
+            tokenOffsets_.push_back(tokenText_.length());
+            tokenText_.append(kTokenSeparator);
+            tokenText_.append(token);
+            tokenEntries_.push_back(std::vector<int>());
+         }
+
+         // record the entry (once) against the token
+         std::vector<int>& entries = tokenEntries_[result.first->second];
+         if (entries.empty() || entries.back() != entry.index)
+            entries.push_back(entry.index);
+      }
+   }
+
+   static Error readFromOffset(const FilePath& filePath,
+                               boost::uintmax_t offset,
+                               std::string* pContents)
+   {
+      boost::shared_ptr<std::istream> pIfs;
+      Error error = filePath.open_r(&pIfs);
+      if (error)
+         return error;
+
+      try
+      {
+         pIfs->exceptions(std::istream::failbit | std::istream::badbit);
+         pIfs->seekg(offset);
+         std::ostringstream ostr;
+         ostr << pIfs->rdbuf();
+         *pContents = ostr.str();
+         return Success();
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("what", e.what());
+         error.addProperty("path", filePath.absolutePath());
+         return error;
+      }
+   }
    
    
 private:
-   mutable std::time_t entryCacheLastWriteTime_;
+   // token => token number
+   typedef boost::unordered_map<std::string,std::size_t> TokenIndex;
+
+   mutable boost::uintmax_t readOffset_;
+   mutable HistoryEntryReader entryReader_;
    mutable std::vector<HistoryEntry> entries_;
+
+   // distinct tokens, each preceded by a separator (so they can be searched
+   // for substrings and prefixes in one pass), along with the offset of
+   // each within the text and the indexes (ascending) of entries containing
+   // each of them
+   mutable TokenIndex tokenIndex_;
+   mutable std::string tokenText_;
+   mutable std::vector<std::size_t> tokenOffsets_;
+   mutable std::vector<std::vector<int> > tokenEntries_;
 };
    
 History& historyArchive()
@@ -273,6 +504,50 @@ bool matches(const HistoryEntry& entry,
    return true;
 }
 
+bool startsWith(const HistoryEntry& entry, const std::string& prefix)
+{
+   return boost::algorithm::starts_with(entry.command, prefix);
+}
+
+// find the most recent entries (up to maxEntries) which satisfy the match
+// function, examining only those the token index says could contain all
+// of the passed tokens
+void findMatchingEntries(
+               const std::vector<std::string>& prefixTokens,
+               const std::vector<std::string>& substringTokens,
+               const boost::function<bool(const HistoryEntry&)>& matchFunction,
+               int maxEntries,
+               std::vector<HistoryEntry>* pMatchingEntries)
+{
+   const std::vector<HistoryEntry>& allEntries = historyArchive().entries();
+   std::size_t limit = std::max(maxEntries, 0);
+
+   std::vector<int> candidates;
+   if (historyArchive().candidateEntries(prefixTokens,
+                                         substringTokens,
+                                         &candidates))
+   {
+      for (std::vector<int>::const_reverse_iterator it = candidates.rbegin();
+           it != candidates.rend() && pMatchingEntries->size() < limit;
+           ++it)
+      {
+         const HistoryEntry& entry = allEntries[*it];
+         if (matchFunction(entry))
+            pMatchingEntries->push_back(entry);
+      }
+   }
+   else
+   {
+      for (std::vector<HistoryEntry>::const_reverse_iterator
+               it = allEntries.rbegin();
+           it != allEntries.rend() && pMatchingEntries->size() < limit;
+           ++it)
+      {
+         if (matchFunction(*it))
+            pMatchingEntries->push_back(*it);
+      }
+   }
+}
 
 void historyRangeAsJson(int startIndex,
                         int endIndex,
@@ -426,26 +701,32 @@ Error searchHistoryArchive(const json::JsonRpcRequest& request,
    boost::tokenizer<boost::char_separator<char> > tok(query, sep);
    std::copy(tok.begin(), tok.end(), std::back_inserter(searchTerms));
    
-   // examine the items in the history for matches
-   const std::vector<HistoryEntry>& allEntries =  historyArchive().entries();
-   std::vector<HistoryEntry> matchingEntries;
-   for (std::vector<HistoryEntry>::const_reverse_iterator 
-            it = allEntries.rbegin();
-            it != allEntries.rend();
-            ++it)
+   // narrow the search to entries containing the tokens of the terms. a
+   // term can match part way through a token, so if it starts with a token
+   // its first token can be anywhere within a token of the command (the
+   // rest of its tokens will be at the start of tokens of the command)
+   std::vector<std::string> prefixTokens, substringTokens;
+   BOOST_FOREACH(const std::string& term, searchTerms)
    {
-      // check limit
-      if (matchingEntries.size() >= static_cast<std::size_t>(maxEntries))
-         break;
-
-      // look for match
-      if (matches(*it, searchTerms))
-      {
-         // add entry
-         matchingEntries.push_back(*it);
-      }
+      std::vector<std::string> termTokens;
+      tokenize(term, &termTokens);
+      if (termTokens.empty())
+         continue;
+
+      std::vector<std::string>::iterator it = termTokens.begin();
+      if (isTokenChar(term[0]))
+         substringTokens.push_back(*it++);
+      prefixTokens.insert(prefixTokens.end(), it, termTokens.end());
    }
 
+   // examine the candidate items in the history for matches
+   std::vector<HistoryEntry> matchingEntries;
+   findMatchingEntries(prefixTokens,
+                       substringTokens,
+                       boost::bind(matches, _1, boost::cref(searchTerms)),
+                       maxEntries,
+                       &matchingEntries);
+
    // return json
    json::Object entriesJson;
    historyEntriesAsJson(matchingEntries, &entriesJson);
@@ -466,22 +747,19 @@ Error searchHistoryArchiveByPrefix(const json::JsonRpcRequest& request,
    // trim the prefix
    boost::algorithm::trim(prefix);
    
-   // examine the items in the history for matches
-   const std::vector<HistoryEntry>& allEntries = historyArchive().entries();
+   // narrow the search to entries containing the tokens of the prefix
+   // (all but the last of which must be complete tokens of the command;
+   // using them as prefixes here just makes for a looser filter)
+   std::vector<std::string> prefixTokens;
+   tokenize(prefix, &prefixTokens);
+
+   // examine the candidate items in the history for matches
    std::vector<HistoryEntry> matchingEntries;
-   for (std::vector<HistoryEntry>::const_reverse_iterator 
-        it = allEntries.rbegin();
-        it != allEntries.rend();
-        ++it)
-   {
-      // check limit
-      if (matchingEntries.size() >= static_cast<std::size_t>(maxEntries))
-         break;
-      
-      // look for match
-      if (boost::algorithm::starts_with(it->command, prefix))
-         matchingEntries.push_back(*it);
-   }
+   findMatchingEntries(prefixTokens,
+                       std::vector<std::string>(),
+                       boost::bind(startsWith, _1, boost::cref(prefix)),
+                       maxEntries,
+                       &matchingEntries);
    
    // return json
    json::Object entriesJson;
@@ -377,12 +377,9 @@ void setImageFileResponse(const FilePath& imageFilePath,
    // set content type
    pResponse->setContentType(imageFilePath.mimeContentType());
    
-   // attempt gzip
-   if (request.acceptsEncoding(http::kGzipEncoding))
-      pResponse->setContentEncoding(http::kGzipEncoding);
-   
-   // set file
-   Error error = pResponse->setBody(imageFilePath);
+   // stream the file (png images are already compressed so there is
+   // nothing to gain from gzipping them)
+   Error error = pResponse->setStreamFile(imageFilePath);
    if (error)
    {
       LOG_ERROR(error);
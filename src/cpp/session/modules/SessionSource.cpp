@@ -135,6 +135,25 @@ Error sourceDatabasePutWithUpdatedContents(
 
    return Success();
 }
+
+// variation of sourceDatabasePutWithUpdatedContents for documents whose
+// contents differ from the stored version by a single replacement
+Error sourceDatabasePutDiffWithUpdatedContents(
+                              boost::shared_ptr<SourceDocument> pDoc,
+                              std::size_t offset,
+                              std::size_t length,
+                              const std::string& replacement)
+{
+   // write the diff to the database
+   Error error = source_database::putDiff(pDoc, offset, length, replacement);
+   if (error)
+      return error ;
+
+   // update index
+   rSourceIndexes().update(pDoc);
+
+   return Success();
+}
    
 Error newDocument(const json::JsonRpcRequest& request,
                   json::JsonRpcResponse* pResponse)
@@ -417,6 +436,8 @@ Error saveDocumentDiff(const json::JsonRpcRequest& request,
       if (error)
          return Success(); // UTF8 decoding failed. Abort differential save.
 
+      std::size_t byteOffset = rangeBegin - contents.begin();
+      std::size_t byteLength = rangeEnd - rangeBegin;
       contents.erase(rangeBegin, rangeEnd);
       contents.insert(rangeBegin, replacement.begin(), replacement.end());
       
@@ -424,8 +445,11 @@ Error saveDocumentDiff(const json::JsonRpcRequest& request,
       if (error)
          return error;
       
-      // write to the source_database
-      error = sourceDatabasePutWithUpdatedContents(pDoc);
+      // write the diff to the source_database
+      error = sourceDatabasePutDiffWithUpdatedContents(pDoc,
+                                                       byteOffset,
+                                                       byteLength,
+                                                       replacement);
       if (error)
          return error;
 
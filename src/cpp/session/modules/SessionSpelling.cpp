@@ -14,15 +14,20 @@
 #include "SessionSpelling.hpp"
 
 #include <boost/shared_ptr.hpp>
+#include <boost/foreach.hpp>
+#include <boost/unordered_map.hpp>
 
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
+#include <core/StringUtils.hpp>
+#include <core/Thread.hpp>
+
+#include <core/collection/LruCache.hpp>
 
 #include <core/spelling/SpellChecker.hpp>
 
 #include <r/RSexp.hpp>
 #include <r/RRoutines.hpp>
-#include <r/RUtil.hpp>
 
 #include <session/SessionModuleContext.hpp>
 
@@ -37,13 +42,46 @@ namespace {
 // spell checking engine
 boost::shared_ptr<core::spelling::SpellChecker> s_pSpellChecker;
 
+// the rpc methods run on worker threads while the R functions run on the
+// main thread, so access to the engine and cache is synchronized
+boost::mutex s_spellingMutex;
+
+// results of prior checks against the current dictionary (cleared whenever
+// words or dictionaries are added or removed)
+const std::size_t kSpellingCacheSize = 50000;
+core::collection::LruCache<std::string,bool> s_spellingCache(
+                                                      kSpellingCacheSize);
+
+Error checkSpellingCached(const std::string& word, bool* pCorrect)
+{
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      if (s_spellingCache.get(word, pCorrect))
+         return Success();
+
+      Error error = s_pSpellChecker->checkSpelling(word, pCorrect);
+      if (error)
+         return error;
+
+      s_spellingCache.put(word, *pCorrect);
+   }
+   END_LOCK_MUTEX
+
+   return Success();
+}
+
 // R function for testing & debugging
 SEXP rs_checkSpelling(SEXP wordSEXP)
 {
-   bool isCorrect;
    std::string word = r::sexp::asString(wordSEXP);
 
-   Error error = s_pSpellChecker->checkSpelling(word,&isCorrect);
+   bool isCorrect = true;
+   Error error;
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      error = s_pSpellChecker->checkSpelling(word,&isCorrect);
+   }
+   END_LOCK_MUTEX
 
    // We'll return true here so as not to tie up the front end.
    if (error)
@@ -61,7 +99,12 @@ SEXP rs_suggestionList(SEXP wordSEXP)
    std::string word = r::sexp::asString(wordSEXP);
    std::vector<std::string> sugs;
 
-   Error error = s_pSpellChecker->suggestionList(word,&sugs);
+   Error error;
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      error = s_pSpellChecker->suggestionList(word,&sugs);
+   }
+   END_LOCK_MUTEX
    if (error)
       LOG_ERROR(error);
 
@@ -74,7 +117,12 @@ SEXP rs_analyzeWord(SEXP wordSEXP)
    std::string word = r::sexp::asString(wordSEXP);
    std::vector<std::string> res;
 
-   Error error = s_pSpellChecker->analyzeWord(word,&res);
+   Error error;
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      error = s_pSpellChecker->analyzeWord(word,&res);
+   }
+   END_LOCK_MUTEX
    if (error)
       LOG_ERROR(error);
 
@@ -87,7 +135,12 @@ SEXP rs_stemWord(SEXP wordSEXP)
    std::string word = r::sexp::asString(wordSEXP);
    std::vector<std::string> res;
 
-   Error error = s_pSpellChecker->stemWord(word,&res);
+   Error error;
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      error = s_pSpellChecker->stemWord(word,&res);
+   }
+   END_LOCK_MUTEX
    if (error)
       LOG_ERROR(error);
 
@@ -98,9 +151,15 @@ SEXP rs_stemWord(SEXP wordSEXP)
 SEXP rs_addWord(SEXP wordSEXP)
 {
    std::string word = r::sexp::asString(wordSEXP);
-   bool added;
+   bool added = false;
 
-   Error error = s_pSpellChecker->addWord(word,&added);
+   Error error;
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      error = s_pSpellChecker->addWord(word,&added);
+      s_spellingCache.clear();
+   }
+   END_LOCK_MUTEX
    if (error)
       LOG_ERROR(error);
 
@@ -111,9 +170,15 @@ SEXP rs_addWord(SEXP wordSEXP)
 SEXP rs_removeWord(SEXP wordSEXP)
 {
    std::string word = r::sexp::asString(wordSEXP);
-   bool removed;
+   bool removed = false;
 
-   Error error = s_pSpellChecker->removeWord(word,&removed);
+   Error error;
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      error = s_pSpellChecker->removeWord(word,&removed);
+      s_spellingCache.clear();
+   }
+   END_LOCK_MUTEX
    if (error)
       LOG_ERROR(error);
 
@@ -125,9 +190,15 @@ SEXP rs_addDictionary(SEXP dicSEXP, SEXP keySEXP)
 {
    FilePath dicPath = FilePath(r::sexp::asString(dicSEXP));
    std::string key = r::sexp::asString(keySEXP);
-   bool added;
+   bool added = false;
 
-   Error error = s_pSpellChecker->addDictionary(dicPath,key,&added);
+   Error error;
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      error = s_pSpellChecker->addDictionary(dicPath,key,&added);
+      s_spellingCache.clear();
+   }
+   END_LOCK_MUTEX
    if (error)
       LOG_ERROR(error);
 
@@ -144,7 +215,7 @@ Error checkSpelling(const json::JsonRpcRequest& request,
       return error;
 
    bool isCorrect;
-   error = s_pSpellChecker->checkSpelling(word,&isCorrect);
+   error = checkSpellingCached(word,&isCorrect);
    if (error)
       return error;
 
@@ -153,6 +224,69 @@ Error checkSpelling(const json::JsonRpcRequest& request,
    return Success();
 }
 
+// check an array of words, returning the indexes of those which are
+// misspelled
+Error checkSpellingBatch(const json::JsonRpcRequest& request,
+                         json::JsonRpcResponse* pResponse)
+{
+   json::Array wordsJson;
+   Error error = json::readParams(request.params, &wordsJson);
+   if (error)
+      return error;
+
+   BOOST_FOREACH(const json::Value& wordJson, wordsJson)
+   {
+      if (!json::isType<std::string>(wordJson))
+         return Error(json::errc::ParamTypeMismatch, ERROR_LOCATION);
+   }
+
+   // resolve each distinct word from the cache where possible and collect
+   // the rest for a single call to the spell checker
+   boost::unordered_map<std::string,bool> results;
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      std::vector<std::string> uncheckedWords;
+      BOOST_FOREACH(const json::Value& wordJson, wordsJson)
+      {
+         const std::string& word = wordJson.get_str();
+         if (results.find(word) != results.end())
+            continue;
+
+         bool isCorrect;
+         if (s_spellingCache.get(word, &isCorrect))
+         {
+            results[word] = isCorrect;
+         }
+         else
+         {
+            results[word] = true;
+            uncheckedWords.push_back(word);
+         }
+      }
+
+      std::vector<bool> correct;
+      error = s_pSpellChecker->checkSpelling(uncheckedWords, &correct);
+      if (error)
+         return error;
+      for (std::size_t i = 0; i < uncheckedWords.size(); i++)
+      {
+         results[uncheckedWords[i]] = correct[i];
+         s_spellingCache.put(uncheckedWords[i], correct[i]);
+      }
+   }
+   END_LOCK_MUTEX
+
+   json::Array misspelledJson;
+   for (std::size_t i = 0; i < wordsJson.size(); i++)
+   {
+      if (!results[wordsJson[i].get_str()])
+         misspelledJson.push_back(static_cast<int>(i));
+   }
+   pResponse->setResult(misspelledJson);
+
+   return Success();
+}
+
 Error suggestionList(const json::JsonRpcRequest& request,
                      json::JsonRpcResponse* pResponse)
 {
@@ -162,7 +296,11 @@ Error suggestionList(const json::JsonRpcRequest& request,
       return error;
 
    std::vector<std::string> sugs;
-   error = s_pSpellChecker->suggestionList(word,&sugs);
+   LOCK_MUTEX(s_spellingMutex)
+   {
+      error = s_pSpellChecker->suggestionList(word,&sugs);
+   }
+   END_LOCK_MUTEX
    if (error)
       return error;
 
@@ -220,14 +358,15 @@ Error initialize()
    methodDef.numArgs = 2;
    r::routines::addCallMethod(methodDef);
 
-   // initialize the spell checker
+   // initialize the spell checker. it's used from the rpc worker threads
+   // so must convert encodings with core iconv rather than R's
    using namespace core::spelling;
    session::Options& options = session::options();
    FilePath enUSPath = options.hunspellDictionariesPath().childPath("en_US");
    Error error = createHunspell(enUSPath.childPath("en_US.aff"),
                                 enUSPath.childPath("en_US.dic"),
                                 &s_pSpellChecker,
-                                &r::util::iconvstr);
+                                &core::string_utils::iconvstr);
    if (error)
       return error;
 
@@ -236,8 +375,9 @@ Error initialize()
    using namespace module_context;
    ExecBlock initBlock ;
    initBlock.addFunctions()
-      (bind(registerRpcMethod, "check_spelling", checkSpelling))
-      (bind(registerRpcMethod, "suggestion_list", suggestionList));
+      (bind(registerWorkerRpcMethod, "check_spelling", checkSpelling))
+      (bind(registerWorkerRpcMethod, "check_spelling_batch", checkSpellingBatch))
+      (bind(registerWorkerRpcMethod, "suggestion_list", suggestionList));
    return initBlock.execute();
 }
 
@@ -132,12 +132,13 @@ class NullFileDecorationContext : public FileDecorationContext
 } // anonymous namespace
 
 boost::shared_ptr<FileDecorationContext> fileDecorationContext(
-                                            const core::FilePath& rootDir)
+                                                const core::FilePath& rootDir,
+                                                bool fileChanges)
 {
    if (git::isGitEnabled())
    {
       return boost::shared_ptr<FileDecorationContext>(
-                           new git::GitFileDecorationContext(rootDir));
+                     new git::GitFileDecorationContext(rootDir, fileChanges));
    }
    else if (svn::isSvnEnabled())
    {
@@ -151,6 +152,15 @@ boost::shared_ptr<FileDecorationContext> fileDecorationContext(
    }
 }
 
+void whenStatusAvailable(const std::vector<core::FilePath>& changedPaths,
+                         const boost::function<void()>& onAvailable)
+{
+   if (git::isGitEnabled())
+      git::whenStatusAvailable(changedPaths, onAvailable);
+   else
+      onAvailable();
+}
+
 VCS activeVCS()
 {
    return git::isGitEnabled() ? VCSGit : VCSNone;
@@ -14,6 +14,7 @@
 #ifndef SESSION_VCS_HPP
 #define SESSION_VCS_HPP
 
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <core/json/Json.hpp>
@@ -37,8 +38,16 @@ enum VCS
    VCSSubversion
 };
 
+// context for decorating files within rootDir. file change events should
+// be decorated (with fileChanges set) from within whenStatusAvailable
 boost::shared_ptr<FileDecorationContext> fileDecorationContext(
-                                            const core::FilePath& rootDir);
+                                       const core::FilePath& rootDir,
+                                       bool fileChanges = false);
+
+// call onAvailable once status reflects changes to changedPaths (for git
+// this can be after a background status has run)
+void whenStatusAvailable(const std::vector<core::FilePath>& changedPaths,
+                         const boost::function<void()>& onAvailable);
 
 VCS activeVCS();
 std::string activeVCSName();
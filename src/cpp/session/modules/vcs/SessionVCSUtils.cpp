@@ -27,6 +27,18 @@ namespace session {
 namespace modules {
 namespace vcs_utils {
 
+namespace {
+
+void enqueVcsRefreshClientEvent(int delay)
+{
+   json::Object data;
+   data["delay"] = delay;
+   module_context::enqueClientEvent(ClientEvent(client_events::kVcsRefresh,
+                                                data));
+}
+
+} // anonymous namespace
+
 void enqueRefreshEventWithDelay(int delay)
 {
    // Sometimes on commit, the subsequent request contains outdated
@@ -34,10 +46,9 @@ void enqueRefreshEventWithDelay(int delay)
    // right now what is causing this. Add a delay for commits to make
    // sure the correct state is shown.
 
-   json::Object data;
-   data["delay"] = delay;
-   module_context::enqueClientEvent(ClientEvent(client_events::kVcsRefresh,
-                                                data));
+   onRefreshRequested()();
+
+   enqueVcsRefreshClientEvent(delay);
 }
 
 void enqueueRefreshEvent()
@@ -45,6 +56,17 @@ void enqueueRefreshEvent()
    enqueRefreshEventWithDelay(0);
 }
 
+boost::signal<void()>& onRefreshRequested()
+{
+   static boost::signal<void()> instance;
+   return instance;
+}
+
+void enqueStatusChangedEvent()
+{
+   enqueVcsRefreshClientEvent(0);
+}
+
 core::json::Object processResultToJson(
       const core::system::ProcessResult& result)
 {
@@ -15,6 +15,7 @@
 #define SESSION_VCS_UTILS_HPP
 
 #include <boost/noncopyable.hpp>
+#include <boost/signals.hpp>
 
 #include <core/json/Json.hpp>
 #include <core/system/Process.hpp>
@@ -26,6 +27,15 @@ namespace vcs_utils {
 void enqueRefreshEventWithDelay(int delay);
 void enqueueRefreshEvent();
 
+// fired when one of the above refresh events is enqueued (i.e. when a vcs
+// operation may have changed the status of the working copy) so that any
+// cached status can be discarded
+boost::signal<void()>& onRefreshRequested();
+
+// let the client know that the status of the working copy has changed
+// (e.g. because a file was edited) without discarding cached status
+void enqueStatusChangedEvent();
+
 core::json::Object processResultToJson(
       const core::system::ProcessResult& result);
 
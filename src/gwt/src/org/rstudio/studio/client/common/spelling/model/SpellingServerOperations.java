@@ -14,6 +14,7 @@ package org.rstudio.studio.client.common.spelling.model;
 
 import org.rstudio.studio.client.server.ServerRequestCallback;
 
+import com.google.gwt.core.client.JsArrayInteger;
 import com.google.gwt.core.client.JsArrayString;
 
 public interface SpellingServerOperations
@@ -21,6 +22,10 @@ public interface SpellingServerOperations
    void checkSpelling(String word, 
                       ServerRequestCallback<Boolean> requestCallback);
    
+   // returns the indexes of the misspelled words
+   void checkSpelling(JsArrayString words,
+                      ServerRequestCallback<JsArrayInteger> requestCallback);
+   
    void suggestionList(String word,
                        ServerRequestCallback<JsArrayString> requestCallback);
 }
@@ -2431,6 +2431,15 @@ public class RemoteServer implements Server
       sendRequest(RPC_SCOPE, CHECK_SPELLING, params, requestCallback);
    }
    
+   public void checkSpelling(
+                     JsArrayString words,
+                     ServerRequestCallback<JsArrayInteger> requestCallback)
+   {
+      JSONArray params = new JSONArray();
+      params.set(0, new JSONArray(words));
+      sendRequest(RPC_SCOPE, CHECK_SPELLING_BATCH, params, requestCallback);
+   }
+   
    public void suggestionList(
                      String word,
                      ServerRequestCallback<JsArrayString> requestCallback)
@@ -2668,6 +2677,7 @@ public class RemoteServer implements Server
    private static final String COMPILE_PDF_CLOSED = "compile_pdf_closed";
    
    private static final String CHECK_SPELLING = "check_spelling";
+   private static final String CHECK_SPELLING_BATCH = "check_spelling_batch";
    private static final String SUGGESTION_LIST = "suggestion_list";
 
    private static final String BEGIN_FIND = "begin_find";